@@ -0,0 +1,209 @@
+/*
+
+====================================================
+
+Bump allocation and arena-backed containers.
+
+Nothing allocated from a bump_arena is ever freed on its own. The whole arena is released at once
+when it is destroyed, so only trivially destructible types may live in it.
+
+====================================================
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace liutil {
+    struct bump_arena {
+        explicit bump_arena(const size_t block_size = 64 * 1024)
+            : block_size(block_size) {}
+
+        bump_arena(const bump_arena&) = delete;
+        bump_arena& operator=(const bump_arena&) = delete;
+
+        ~bump_arena() {
+            release();
+        }
+
+        void* allocate(const size_t size, const size_t align = alignof(std::max_align_t)) {
+            size_t offset = (head + align - 1) & ~(align - 1);
+
+            if (block_list.empty() || offset + size > capacity) {
+                const size_t new_capacity = size + align > block_size ? size + align : block_size;
+
+                block_list.push_back(static_cast<char*>(std::malloc(new_capacity)));
+                if (!block_list.back())
+                    throw std::bad_alloc();
+
+                capacity = new_capacity;
+                head = 0;
+                offset = ((reinterpret_cast<uintptr_t>(block_list.back()) + align - 1) & ~(align - 1)) - reinterpret_cast<uintptr_t>(block_list.back());
+            }
+
+            head = offset + size;
+            used += size;
+
+            return block_list.back() + offset;
+        }
+
+        template <typename T, typename... ARGS>
+        inline T* make(ARGS&&... args) {
+            static_assert(std::is_trivially_destructible_v<T>, "Arena objects are never destroyed.");
+            return new (allocate(sizeof(T), alignof(T))) T(std::forward<ARGS>(args)...);
+        }
+
+        // Zero-filled.
+        template <typename T>
+        inline T* make_array(const size_t count) {
+            static_assert(std::is_trivially_destructible_v<T>, "Arena objects are never destroyed.");
+
+            void* memory = allocate(sizeof(T) * count, alignof(T));
+            std::memset(memory, 0, sizeof(T) * count);
+
+            return static_cast<T*>(memory);
+        }
+
+        void release() {
+            for (char* block : block_list)
+                std::free(block);
+
+            block_list.clear();
+            capacity = 0;
+            head = 0;
+            used = 0;
+        }
+
+        inline size_t bytes_used() const { return used; }
+
+    private:
+        const size_t block_size;
+
+        std::vector<char*> block_list;
+        size_t capacity = 0;
+        size_t head = 0;
+        size_t used = 0;
+    };
+
+    // Open-addressing hash map from 32-bit ids (interned names, type ids...) to a trivially copyable value.
+    // Linear probing with fibonacci hashing. Storage comes from a bump_arena and is dropped with it.
+    template <typename V>
+    struct flat_map {
+        static constexpr uint32_t EMPTY_KEY = UINT32_MAX;
+
+        struct slot {
+            uint32_t key;
+            V value;
+        };
+
+        flat_map() = default;
+
+        explicit flat_map(bump_arena& arena, const uint32_t initial_capacity = 8) {
+            init(arena, initial_capacity);
+        }
+
+        void init(bump_arena& arena, const uint32_t initial_capacity = 8) {
+            this->arena = &arena;
+
+            uint32_t capacity = 8;
+            while (capacity < initial_capacity)
+                capacity <<= 1;
+
+            allocate_slots(capacity);
+        }
+
+        inline V* find(const uint32_t key) {
+            return const_cast<V*>(static_cast<const flat_map*>(this)->find(key));
+        }
+
+        inline const V* find(const uint32_t key) const {
+            if (capacity == 0)
+                return nullptr;
+
+            for (uint32_t i = index_of(key);; i = (i + 1) & (capacity - 1)) {
+                const slot& at = slot_list[i];
+
+                if (at.key == key)
+                    return &at.value;
+                if (at.key == EMPTY_KEY)
+                    return nullptr;
+            }
+        }
+
+        // Returns false and leaves the old value in place if the key already exists.
+        bool insert(const uint32_t key, const V& value) {
+            if ((count + 1) * 4 > capacity * 3)
+                grow();
+
+            for (uint32_t i = index_of(key);; i = (i + 1) & (capacity - 1)) {
+                slot& at = slot_list[i];
+
+                if (at.key == key)
+                    return false;
+
+                if (at.key == EMPTY_KEY) {
+                    at.key = key;
+                    at.value = value;
+                    count++;
+                    return true;
+                }
+            }
+        }
+
+        inline uint32_t size() const { return count; }
+
+        template <typename FUNC>
+        void for_each(const FUNC& func) const {
+            for (uint32_t i = 0; i < capacity; i++) {
+                if (slot_list[i].key != EMPTY_KEY)
+                    func(slot_list[i].key, slot_list[i].value);
+            }
+        }
+
+    private:
+        inline uint32_t index_of(const uint32_t key) const {
+            return static_cast<uint32_t>((static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull) >> (64 - shift));
+        }
+
+        void allocate_slots(const uint32_t new_capacity) {
+            slot_list = static_cast<slot*>(arena->allocate(sizeof(slot) * new_capacity, alignof(slot)));
+            capacity = new_capacity;
+            shift = 0;
+
+            while ((1u << shift) < capacity)
+                shift++;
+
+            for (uint32_t i = 0; i < capacity; i++)
+                slot_list[i].key = EMPTY_KEY;
+        }
+
+        // The old slots stay in the arena until it is released.
+        void grow() {
+            slot* old_list = slot_list;
+            const uint32_t old_capacity = capacity;
+
+            allocate_slots(capacity == 0 ? 8 : capacity * 2);
+            count = 0;
+
+            for (uint32_t i = 0; i < old_capacity; i++) {
+                if (old_list[i].key != EMPTY_KEY)
+                    insert(old_list[i].key, old_list[i].value);
+            }
+        }
+
+        bump_arena* arena = nullptr;
+
+        slot* slot_list = nullptr;
+        uint32_t capacity = 0;
+        uint32_t count = 0;
+        uint32_t shift = 0;
+    };
+}
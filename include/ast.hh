@@ -96,6 +96,8 @@ namespace core {
         };
 
         struct expr_type : node {
+            // An RVALUE ('&&') parameter is only checked to bind a temporary or a local at its last read.
+            // Nothing is moved by it: copies, temporaries and returned values are not elided in any backend.
             enum class e_reference_type : uint8_t {
                 NONE,
                 LVALUE,
@@ -114,10 +116,12 @@ namespace core {
             e_reference_type reference_type;
         };
 
-        // Get identifier contents by observing its selection in the source code.
+        // Get identifier contents by observing its selection in the source code, or through the interned name.
         struct expr_identifier : node {
-            expr_identifier(const core::lisel& selection)
-                : node(selection, node_type::EXPR_IDENTIFIER) {}
+            expr_identifier(const core::token& token)
+                : node(token.selection, node_type::EXPR_IDENTIFIER), name(token.name_id) {}
+
+            core::t_name_id name;
         };
 
         struct expr_literal : node {
@@ -182,6 +186,14 @@ namespace core {
             t_node_id return_type;
         };
 
+        // |parameter_list|: return_type body. Only ever the value of a local declaration.
+        struct expr_closure : node {
+            expr_closure(const core::lisel& selection, t_node_id function)
+                : node(selection, node_type::EXPR_CLOSURE), function(function) {}
+
+            t_node_id function; // expr_function without template parameters
+        };
+
         struct expr_call : node {
             expr_call(const core::lisel& selection, t_node_id callee, t_node_list&& template_argument_list, t_node_list&& argument_list)
                 : node(selection, node_type::EXPR_CALL), callee(callee), template_argument_list(std::move(template_argument_list)), argument_list(std::move(argument_list)) {}
@@ -382,6 +394,7 @@ namespace core {
                 expr_ternary,
                 expr_parameter,
                 expr_function,
+                expr_closure,
                 expr_call,
 
                 stmt_none,
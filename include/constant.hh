@@ -0,0 +1,82 @@
+/*
+
+====================================================
+
+Compile-time constant evaluation.
+
+Folds trees of literals, unary, binary and ternary expressions, plus names of const declarations,
+into a single value of a primitive type. Every step is carried out at the width of that type and
+overflow is an error, so 'dec x: u8 = 200 + 100' is rejected instead of wrapping.
+
+An expression without a declared type takes its natural type: integer literals are i32 unless they
+need more, floating literals are f64 and comparisons are bool.
+
+====================================================
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "core.hh"
+#include "ast.hh"
+#include "type.hh"
+
+namespace core {
+    namespace semantic {
+        struct symbol;
+        struct symbol_table;
+
+        struct constant {
+            type_kind kind; // Integer, floating point or bool primitive
+
+            union {
+                int64_t i;  // i8 to i64
+                uint64_t u; // u8 to u64
+                double f;   // f32 values are stored already rounded
+                bool b;
+            };
+        };
+
+        // Only the bytes that belong to kind take part.
+        inline uint64_t query_fingerprint(const constant& value) {
+            const uint64_t bits = value.kind == type_kind::BOOL ? static_cast<uint64_t>(value.b) : value.u;
+            return (bits ^ (static_cast<uint64_t>(value.kind) << 56)) * 0x9E3779B97F4A7C15ull;
+        }
+
+        constexpr bool is_signed_integer(const type_kind kind) { return kind >= type_kind::I8 && kind <= type_kind::I64; }
+        constexpr bool is_unsigned_integer(const type_kind kind) { return kind >= type_kind::U8 && kind <= type_kind::U64; }
+        constexpr bool is_integer(const type_kind kind) { return is_signed_integer(kind) || is_unsigned_integer(kind); }
+        constexpr bool is_floating(const type_kind kind) { return kind == type_kind::F32 || kind == type_kind::F64; }
+        constexpr bool is_foldable(const type_kind kind) { return is_integer(kind) || is_floating(kind) || kind == type_kind::BOOL; }
+
+        struct constant_context {
+            constant_context(const liprocess& process, const ast::ast_arena& ast, const symbol_table& table, std::vector<lilog>& log_sink)
+                : process(process), ast(ast), table(table), log_sink(log_sink) {}
+
+            const liprocess& process;
+            const ast::ast_arena& ast;
+            const symbol_table& table;
+
+            std::vector<lilog>& log_sink;
+
+            // Value of a const declaration that an identifier resolved to. nullptr if it has none.
+            std::function<const constant*(const symbol*)> lookup;
+
+            bool success = true;
+        };
+
+        // The type an expression folds to when nothing else is asked for. INVALID if it can not be folded.
+        type_kind natural_kind(constant_context& context, const ast::t_node_id id);
+
+        // Folds id as kind. Returns false if id is not a compile-time constant of that kind.
+        // Only constants that overflow, divide by zero or do not fit are reported as errors.
+        bool fold(constant_context& context, const ast::t_node_id id, const type_kind kind, constant& result);
+
+        std::string pretty_debug(const constant& value);
+    }
+}
@@ -14,13 +14,18 @@ Holds the declarations for all of the stages of the compiler.
 
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <deque>
+#include <unordered_map>
+#include <shared_mutex>
 #include <any>
 #include <algorithm>
 #include <iostream>
 #include <fstream>
 
 #include "licanapi.hh"
+#include "pool.hh"
 
 namespace core {
     using t_file_id = int16_t;
@@ -28,9 +33,15 @@ namespace core {
     // Honestly just for some reading clarification. I don't want to use size_t where ever I go.
     using t_pos = size_t;
 
+    // Interned identifier. Two equal names always share the same id for the lifetime of a process.
+    using t_name_id = uint32_t;
+
     constexpr t_file_id MAX_FILES = UINT16_MAX;
     constexpr t_pos MAX_POS = UINT32_MAX;
 
+    // Reserved for "no name". Interning an empty string also returns this.
+    constexpr t_name_id NONE_NAME = 0;
+
     struct liprocess;
 
     // Displays information AS IS. Do not pivot to display to the user. All pivoting is handled implicitly.
@@ -83,6 +94,24 @@ namespace core {
         std::string pretty_debug(const liprocess& process) const;
     };
 
+    // Process-wide string interner. Safe to read and write from multiple threads.
+    struct liname_table {
+        liname_table();
+
+        t_name_id intern(const std::string_view name);
+
+        // Returns a reference that stays valid for the lifetime of the table.
+        const std::string& get(const t_name_id id) const;
+
+        size_t size() const;
+
+    private:
+        mutable std::shared_mutex mutex;
+
+        std::deque<std::string> name_list;
+        std::unordered_map<std::string_view, t_name_id> id_map; // Views point into name_list.
+    };
+
     struct liprocess {
         struct lifile {
             lifile(const std::string& path, const std::string& source_code)
@@ -93,9 +122,19 @@ namespace core {
 
             std::vector<t_pos> line_marker_list; // Used to get the current line and column.
 
+            // Files brought in through 'use' items, in order of appearance.
+            std::vector<t_file_id> use_list;
+
             // Data dump - avoids additional header dependencies. Decast as needed
             std::any dump_token_list;                   // std::vector<token>
             std::any dump_ast_arena;                     // ast::ast_arena
+            std::any dump_interface;                     // std::shared_ptr<frontend::module_interface> - set when the file was never parsed
+            std::any dump_symbol_table;                  // std::shared_ptr<semantic::symbol_table>
+            std::any dump_ir_module;                     // std::shared_ptr<backend::ir_module>
+
+            inline bool is_interface_only() const {
+                return dump_interface.has_value() && !dump_ast_arena.has_value();
+            }
 
             // 0-indexed
             t_pos get_line_of_position(const t_pos position) const;
@@ -105,15 +144,30 @@ namespace core {
         };
 
         liprocess(const licanapi::liconfig_init& config_init)
-            : config(config_init) {}
+            : config(config_init), pool(config.thread_count) {}
 
         const licanapi::liconfig config;
         
         std::vector<lilog> log_list;
-        std::vector<lifile> file_list;
+        std::deque<lifile> file_list; // Deque so lifile references survive new files being added mid-stage.
+
+        liname_table name_table;
+
+        liutil::worker_pool pool;
+
+        std::any dump_builtin_table;                     // std::shared_ptr<semantic::symbol_table> - primitives and intrinsics
+        std::any dump_type_table;                        // std::shared_ptr<semantic::type_table>
+        std::any dump_instance_cache;                    // std::shared_ptr<semantic::instance_cache>
+        std::any dump_query_engine;                      // std::shared_ptr<semantic::query_engine>
+        std::any dump_path_trie;                         // std::shared_ptr<semantic::path_trie>
+        std::any dump_vm_program;                        // std::shared_ptr<backend::vm_program>
+        std::any dump_pass_statistics;                   // std::shared_ptr<std::vector<backend::pass_statistics>>
 
         bool add_file(const std::string& path);
 
+        // Returns -1 if the file has not been added.
+        t_file_id find_file(const std::string& path) const;
+
         inline void add_log(const lilog::log_level level, const lisel& selection, const std::string& message) {
             log_list.emplace_back(level, selection, message);
         }
@@ -127,10 +181,27 @@ namespace core {
         bool init(liprocess& process);
         bool lex(liprocess& process, const t_file_id file_id);
         bool parse(liprocess& process, const t_file_id file_id);
+
+        // Loads every file brought in by a 'use' item, either from source or from a precompiled interface.
+        bool resolve_uses(liprocess& process, const t_file_id file_id);
+
         bool semantic_analyze(liprocess& process, const t_file_id file_id);
     }
 
     namespace backend {
-        
+        // Lowers the checked functions of every parsed file to SSA IR.
+        bool lower(liprocess& process, const t_file_id file_id);
+
+        // Runs the IR passes -O asks for over every lowered function.
+        bool optimize(liprocess& process, const t_file_id file_id);
+
+        // With -w, optimizes the program as a whole across its modules (link.hh).
+        bool link(liprocess& process, const t_file_id file_id);
+
+        // Compiles every lowered function to bytecode for the VM.
+        bool compile_bytecode(liprocess& process, const t_file_id file_id);
+
+        // Writes a C unit per parsed file into the output path and, if asked, builds them natively.
+        bool generate(liprocess& process, const t_file_id file_id);
     }
 }
\ No newline at end of file
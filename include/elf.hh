@@ -0,0 +1,92 @@
+/*
+
+====================================================
+
+ELF64 relocatable objects.
+
+An object is built up in memory as the bytes of its sections, a list of symbols and a list of
+relocations, then written in one pass: every section is copied once into a buffer sized up front,
+followed by the symbol, string and relocation tables and the section headers. What comes out links
+with the system linker like the output of any C compiler.
+
+Only what x86-64 code needs is there: .text, .data, .bss and .rodata, symbols defined in them or
+left undefined for the linker, and RELA relocations. Symbols are kept in the order they were added;
+locals are moved in front of globals when written, like the format requires.
+
+====================================================
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace core {
+    namespace backend {
+        enum class elf_section : uint8_t {
+            TEXT,
+            DATA,
+            BSS,    // No bytes, only a size
+            RODATA,
+            COUNT,
+            UNDEFINED = COUNT, // Symbols the linker has to find elsewhere
+        };
+
+        // x86-64 relocation types used by the native backend.
+        constexpr uint32_t R_X86_64_64 = 1;
+        constexpr uint32_t R_X86_64_PC32 = 2;
+        constexpr uint32_t R_X86_64_PLT32 = 4;
+
+        struct elf_symbol {
+            std::string name;
+            elf_section section;
+            uint64_t value; // Offset into its section
+            uint64_t size;
+            bool is_global;
+            bool is_function;
+        };
+
+        struct elf_relocation {
+            elf_section section; // Where the patched bytes are
+            uint64_t offset;
+            uint32_t symbol; // Index into symbol_list, or SECTION_SYMBOL + section to point into a section
+            uint32_t type;
+            int64_t addend;
+        };
+
+        // Relocations against the start of a section rather than a named symbol.
+        constexpr uint32_t SECTION_SYMBOL = UINT32_MAX - static_cast<uint32_t>(elf_section::COUNT);
+
+        struct elf_object {
+            std::vector<uint8_t> data_list[static_cast<size_t>(elf_section::COUNT)];
+            uint64_t bss_size = 0;
+            uint64_t alignment_list[static_cast<size_t>(elf_section::COUNT)] = { 16, 8, 8, 16 };
+
+            std::vector<elf_symbol> symbol_list;
+            std::vector<elf_relocation> relocation_list;
+
+            inline std::vector<uint8_t>& data(const elf_section section) { return data_list[static_cast<size_t>(section)]; }
+
+            // Pads section to alignment and returns where the next byte goes.
+            uint64_t align(const elf_section section, const uint64_t alignment);
+
+            uint32_t add_symbol(const std::string& name, const elf_section section, const uint64_t value, const uint64_t size, const bool is_global, const bool is_function);
+
+            // The symbol named name, added as undefined the first time it is asked for.
+            uint32_t reference(const std::string& name);
+
+            inline void relocate(const elf_section section, const uint64_t offset, const uint32_t symbol, const uint32_t type, const int64_t addend) {
+                relocation_list.push_back({ section, offset, symbol, type, addend });
+            }
+
+            // The whole file.
+            std::vector<uint8_t> serialize() const;
+
+        private:
+            std::unordered_map<std::string, uint32_t> symbol_map;
+        };
+    }
+}
@@ -0,0 +1,83 @@
+/*
+
+====================================================
+
+Inlining.
+
+inline_call replaces a call with a copy of the body of its callee. The block of the call is split
+right after it, the copied entry block is jumped to in place of the call, and every return of the
+copy jumps to the rest of the block instead, its value merged by a phi when there is more than one.
+Parameters are the arguments themselves, so the copy needs no moves to get started.
+
+The inliner decides which calls that is. It walks the call graph bottom up, one strongly connected
+component at a time (Tarjan), so every callee is already as small as inlining and -O can make it by
+the time its callers look at it. Calls within a component are recursion and are never inlined.
+
+A call is inlined if the callee, less what the call itself costs, is at most the threshold of the
+level. When some of the arguments are constants the callee is first specialized to them: the
+parameters become those constants and the callee runs through -O again, and it is the size of
+what is left that counts, and what is copied. A caller stops inlining once it has grown by the
+given factor, so a chain of small functions can not blow up the one at the top.
+
+====================================================
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "ir.hh"
+#include "optimize.hh"
+
+namespace core {
+    namespace backend {
+        // Largest callee inlined, at -O1 and -O2, once the cost of the call is taken off.
+        constexpr uint32_t INLINE_THRESHOLD_O1 = 16;
+        constexpr uint32_t INLINE_THRESHOLD_O2 = 40;
+
+        // Callees up to this many times the threshold are worth specializing to constant arguments.
+        constexpr uint32_t INLINE_SPECIALIZE_FACTOR = 4;
+
+        // A caller stops inlining at its size times the factor plus the floor.
+        constexpr uint32_t INLINE_GROWTH_FACTOR = 4;
+        constexpr uint32_t INLINE_GROWTH_FLOOR = 128;
+
+        // Number of instructions in the blocks of a function, what inlining it costs in code.
+        uint32_t function_size(const ir_function& function);
+
+        // The callee is complete, returns somewhere and nothing jumps back to its entry, which is all
+        // inline_call needs of it.
+        bool can_inline(const ir_function& callee);
+
+        // call is a CALL of callee in caller, which must be another function. Predecessors are kept up
+        // to date and the caller is not compacted.
+        void inline_call(ir_function& caller, const t_value_id call, const ir_function& callee);
+
+        // Who calls whom among the given functions. Calls of anything else are left out.
+        struct call_graph {
+            explicit call_graph(const std::vector<ir_function*>& function_list);
+
+            std::vector<ir_function*> function_list;
+            std::unordered_map<const semantic::symbol*, uint32_t> index_map; // Source to function_list
+
+            // Per function, indices into function_list without repeats.
+            std::vector<std::vector<uint32_t>> callee_list;
+
+            // Strongly connected components in the order Tarjan finds them, callees before callers.
+            std::vector<std::vector<uint32_t>> component_list;
+            std::vector<uint32_t> component_of; // Per function
+
+            // Functions by level. Each level only calls into lower ones and its own components, so the
+            // functions of one level can be worked on at the same time.
+            std::vector<std::vector<uint32_t>> level_list;
+        };
+
+        // Inlines calls of the function at index into it, by the cost model of level. Returns how many.
+        // Its callees have to be done already. Specializations run through manager and count towards
+        // statistics. Predecessors are kept up to date and the caller is not compacted.
+        uint32_t inline_calls(const call_graph& graph, const uint32_t index, const uint8_t level, const pass_manager& manager, std::vector<pass_statistics>& statistics);
+    }
+}
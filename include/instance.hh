@@ -0,0 +1,83 @@
+/*
+
+====================================================
+
+Template instances.
+
+Every template (generic struct, function, method or typedec) is instantiated at most once per distinct
+list of canonical argument types, no matter how many files or function bodies ask for it. The first
+asker fills the instance in. Everyone else, on any thread, waits for that and then shares the result.
+
+Template bodies are resolved once, generically. An instance holds what differs per argument list,
+which is the substituted type.
+
+Only semantic analysis uses the cache. Lowering turns down generic callees and templated structs, so
+no backend generates code per instance, and there is no generated code for instances to share yet.
+
+====================================================
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "arena.hh"
+#include "type.hh"
+
+namespace core {
+    namespace semantic {
+        struct instance {
+            instance(const symbol* declaration, const t_type_id* argument_list, const uint16_t argument_count)
+                : declaration(declaration), argument_list(argument_list), argument_count(argument_count) {}
+
+            const symbol* declaration;
+            const t_type_id* argument_list;
+            const uint16_t argument_count;
+
+            // Signature of functions and methods, expansion of typedecs, the struct type itself for structs.
+            t_type_id type = INVALID_TYPE;
+
+            // Guards the type. Use std::call_once before reading them.
+            std::once_flag checked;
+        };
+
+        // Process-wide. Lookups from parallel workers only ever take a shared lock.
+        struct instance_cache {
+            instance_cache() = default;
+
+            instance_cache(const instance_cache&) = delete;
+            instance_cache& operator=(const instance_cache&) = delete;
+
+            // Never returns null. The reference stays valid for the lifetime of the cache.
+            instance& get(const symbol* declaration, const t_type_id* argument_list, const uint16_t argument_count);
+
+        private:
+            struct key {
+                const symbol* declaration;
+                const t_type_id* argument_list;
+                uint16_t argument_count;
+
+                bool operator==(const key& other) const;
+            };
+
+            struct key_hash {
+                size_t operator()(const key& value) const;
+            };
+
+            mutable std::shared_mutex mutex;
+
+            liutil::bump_arena arena; // argument lists
+            std::deque<instance> instance_list;
+            std::unordered_map<key, instance*, key_hash> instance_map; // Stored keys point into the arena.
+        };
+
+        // Decast of liprocess::dump_instance_cache
+        using t_instance_cache_ptr = std::shared_ptr<instance_cache>;
+    }
+}
@@ -0,0 +1,220 @@
+/*
+
+====================================================
+
+Precompiled module interfaces (.lii files).
+
+An interface is written next to the build output for every parsed file that got through semantic
+analysis without errors. When another file uses that module and the stored source hash still matches, the interface is mapped into memory and
+the module is never lexed or parsed again.
+
+Layout. Everything is little-endian and every section starts 8-byte aligned.
+    lii::header
+    lii::name_entry[name_count]         Exported names. Offsets point into the text blob.
+    lii::type_entry[type_count]         Canonical type expressions. Each distinct type is stored once.
+    lii::decl_entry[decl_count]         Exported declarations. Parents always come before children.
+    lii::member_entry[member_count]     Struct members and enum sets in declaration order (the layout).
+    uint32_t[index_count]               Shared pool for name paths, type arguments and parameters.
+    char[text_size]                     Names, use paths and template declaration source.
+
+Names inside the file are indices into the name table. They are mapped to process-wide interned ids
+once on load. Every index and offset is bounds checked then too, and an interface that fails the
+check is ignored, so its module is parsed from source.
+
+====================================================
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "core.hh"
+
+namespace core {
+    namespace frontend {
+        constexpr uint32_t INTERFACE_MAGIC = 0x3149494C; // "LII1"
+        constexpr uint32_t INTERFACE_VERSION = 3;
+
+        // Used by any index field that has nothing to point to.
+        constexpr uint32_t INTERFACE_NONE = UINT32_MAX;
+
+        constexpr const char* INTERFACE_EXTENSION = ".lii";
+
+        enum interface_flag : uint32_t {
+            // A whole program build (-w) dropped functions from the object of the module, so only
+            // whole program builds, which check for that, may link against it.
+            INTERFACE_WHOLE_PROGRAM_ONLY = 1 << 0,
+        };
+
+        namespace lii {
+            struct header {
+                uint32_t magic;
+                uint32_t version;
+
+                uint64_t source_hash;
+                uint64_t source_size;
+
+                uint32_t flags; // interface_flag
+                uint32_t pad;
+
+                uint32_t name_count;
+                uint32_t name_offset;
+                uint32_t type_count;
+                uint32_t type_offset;
+                uint32_t decl_count;
+                uint32_t decl_offset;
+                uint32_t member_count;
+                uint32_t member_offset;
+                uint32_t index_count;
+                uint32_t index_offset;
+                uint32_t text_size;
+                uint32_t text_offset;
+            };
+
+            struct name_entry {
+                uint32_t offset;
+                uint32_t length;
+            };
+
+            enum type_flag : uint8_t {
+                TYPE_CONST = 1 << 0,
+                TYPE_POINTER = 1 << 1,
+                TYPE_LVALUE = 1 << 2,
+                TYPE_RVALUE = 1 << 3,
+            };
+
+            // path_begin indexes name ids in the index pool (hash..map -> [hash, map]).
+            // argument_begin indexes type ids in the index pool.
+            struct type_entry {
+                uint32_t path_begin;
+                uint32_t path_count;
+                uint32_t argument_begin;
+                uint32_t argument_count;
+                uint8_t flags;
+                uint8_t pad[3];
+            };
+
+            enum class decl_kind : uint8_t {
+                USE,        // text holds the use path, as written
+                MODULE,
+                VARIANT,    // type is the declared value type
+                FUNCTION,   // type is the return type
+                STRUCT,
+                ENUM,
+                TYPEDEC,    // type is the aliased type
+            };
+
+            struct decl_entry {
+                decl_kind kind;
+                uint8_t pad[3];
+
+                uint32_t name;
+                uint32_t parent; // decl index of the enclosing module
+                uint32_t type;
+
+                uint32_t parameter_begin; // type ids
+                uint32_t parameter_count;
+                uint32_t template_begin; // name ids
+                uint32_t template_count;
+                uint32_t member_begin;
+                uint32_t member_count;
+
+                // Full source of templated declarations so importers can instantiate them.
+                uint32_t text_offset;
+                uint32_t text_length;
+            };
+
+            enum class member_kind : uint8_t {
+                PROPERTY,
+                METHOD,
+                OPERATOR,
+                CONSTRUCTOR,
+                DESTRUCTOR,
+                ENUM_SET,
+            };
+
+            enum member_flag : uint8_t {
+                MEMBER_PRIVATE = 1 << 0,
+                MEMBER_CONST = 1 << 1,
+                MEMBER_VALUE = 1 << 2, // Enum set with a value folded by semantic analysis
+            };
+
+            struct member_entry {
+                member_kind kind;
+                uint8_t flags;
+                uint16_t opr; // core::token_type for operators
+
+                uint32_t name;
+                uint32_t type; // property type or method return type
+                uint32_t parameter_begin;
+                uint32_t parameter_count;
+                uint32_t pad;
+
+                uint64_t value; // Bits of the enum set value, see MEMBER_VALUE
+            };
+        }
+
+        // A read-only view of a mapped .lii file.
+        struct module_interface {
+            module_interface(const module_interface&) = delete;
+            module_interface& operator=(const module_interface&) = delete;
+
+            ~module_interface();
+
+            // Returns nullptr if the file does not exist or is not a valid interface.
+            static std::shared_ptr<module_interface> open(liprocess& process, const std::string& path);
+
+            inline const lii::header& header() const { return *reinterpret_cast<const lii::header*>(data); }
+
+            inline const lii::name_entry& name_entry(const uint32_t index) const { return section<lii::name_entry>(header().name_offset)[index]; }
+            inline const lii::type_entry& type(const uint32_t index) const { return section<lii::type_entry>(header().type_offset)[index]; }
+            inline const lii::decl_entry& decl(const uint32_t index) const { return section<lii::decl_entry>(header().decl_offset)[index]; }
+            inline const lii::member_entry& member(const uint32_t index) const { return section<lii::member_entry>(header().member_offset)[index]; }
+            inline uint32_t index(const uint32_t position) const { return section<uint32_t>(header().index_offset)[position]; }
+
+            inline std::string_view text(const uint32_t offset, const uint32_t length) const {
+                return std::string_view(data + header().text_offset + offset, length);
+            }
+
+            // Interned id of a name table entry.
+            inline t_name_id name(const uint32_t index) const { return index == INTERFACE_NONE ? NONE_NAME : name_map[index]; }
+
+            bool matches_source(const std::string& source_code) const;
+
+        private:
+            module_interface() = default;
+
+            template <typename T>
+            inline const T* section(const uint32_t offset) const {
+                return reinterpret_cast<const T*>(data + offset);
+            }
+
+            bool validate() const;
+
+            const char* data = nullptr;
+            size_t size = 0;
+
+            void* map_handle = nullptr; // Windows only
+
+            std::vector<t_name_id> name_map;
+        };
+
+        // Where the interface of the given file lives inside the output path.
+        std::string interface_path(const liprocess& process, const t_file_id file_id);
+
+        // Writes the interface of a parsed file. Quietly does nothing if the output path does not exist.
+        bool emit_interface(liprocess& process, const t_file_id file_id);
+
+        // Sets INTERFACE_WHOLE_PROGRAM_ONLY on the interface of the given file, if it has one.
+        bool mark_whole_program_only(liprocess& process, const t_file_id file_id);
+
+        // Writes the interface of every parsed file that semantic analysis reported no errors in. A file
+        // with errors keeps being parsed, so its errors show up on every build.
+        void emit_interfaces(liprocess& process);
+    }
+}
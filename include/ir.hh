@@ -0,0 +1,240 @@
+/*
+
+====================================================
+
+Intermediate representation.
+
+Checked function bodies are lowered to basic blocks of instructions in SSA form. An instruction that
+produces something is that value, so value ids are plain instruction indices and dense per function.
+
+A function owns a handful of flat arrays: instructions, operands, blocks and predecessors. The
+instructions of a block are linked through their ids, so passes insert and remove in place without
+moving anything. Removed instructions stay behind as NOP until the function is compacted, which
+renumbers everything densely again in layout order.
+
+Phis list their operands as (block, value) pairs, so they stay correct however predecessors are
+reordered. Terminators keep their target blocks next to the instruction, not in the operand pool.
+
+====================================================
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "core.hh"
+
+namespace core {
+    namespace semantic {
+        struct symbol;
+        struct constant;
+    }
+
+    namespace backend {
+        using t_value_id = uint32_t;
+        using t_block_id = uint32_t;
+
+        constexpr t_value_id NO_VALUE = UINT32_MAX;
+        constexpr t_block_id NO_BLOCK = UINT32_MAX;
+
+        enum class ir_type : uint8_t {
+            VOID,
+            BOOL,
+            I8, I16, I32, I64,
+            U8, U16, U32, U64,
+            F32, F64,
+            PTR,
+        };
+
+        enum class opcode : uint8_t {
+            NOP,
+
+            PARAMETER,      // immediate: parameter index
+            CONSTANT,       // immediate: the bits. Integers sign or zero extended, floats as the bits of a double.
+            UNDEFINED,      // A variable read on a path that never wrote it
+            PHI,            // operands: (block, value) pairs
+            COPY,
+            CONVERT,        // operand converted to type
+
+            NEG,
+            NOT,            // bool only
+
+            ADD,
+            SUB,
+            MUL,
+            DIV,
+            MOD,
+            POW,
+
+            EQ,             // Comparisons produce bool and compare in the type of their operands.
+            NE,
+            LT,
+            LE,
+            GT,
+            GE,
+
+            LOAD_GLOBAL,    // symbol: module level variant
+            STORE_GLOBAL,   // symbol: module level variant. operand: the value.
+            CALL,           // symbol: callee. operands: arguments.
+
+            JUMP,           // target[0]
+            BRANCH,         // operand: condition. target[0] if true, target[1] otherwise.
+            RETURN,         // operand: the value, unless the function returns void.
+            UNREACHABLE,
+        };
+
+        constexpr bool is_terminator(const opcode op) { return op >= opcode::JUMP; }
+        constexpr bool is_comparison(const opcode op) { return op >= opcode::EQ && op <= opcode::GE; }
+        constexpr bool is_signed(const ir_type type) { return type >= ir_type::I8 && type <= ir_type::I64; }
+        constexpr bool is_unsigned(const ir_type type) { return type >= ir_type::U8 && type <= ir_type::U64; }
+        constexpr bool is_integer(const ir_type type) { return is_signed(type) || is_unsigned(type); }
+        constexpr bool is_floating(const ir_type type) { return type == ir_type::F32 || type == ir_type::F64; }
+
+        // Width in bits. Bool is 1, void and pointers are 0 and 64.
+        uint8_t bit_width(const ir_type type);
+
+        const char* type_name(const ir_type type);
+        const char* opcode_name(const opcode op);
+
+        // Immediate of a CONSTANT holding a folded value.
+        uint64_t constant_bits(const semantic::constant& value);
+
+        struct instruction {
+            opcode op;
+            ir_type type;
+            uint16_t operand_count;
+            uint32_t operand_begin; // into ir_function::operand_pool
+
+            t_block_id block;
+            t_value_id prev; // Neighbours in the block. NO_VALUE at either end.
+            t_value_id next;
+
+            uint64_t immediate;
+            t_block_id target[2];
+            const semantic::symbol* symbol;
+        };
+
+        struct ir_block {
+            t_value_id first;
+            t_value_id last; // The terminator once the block is finished
+
+            // Filled by compute_predecessors.
+            uint32_t predecessor_begin;
+            uint32_t predecessor_count;
+
+            // Unreachable and emptied. Dropped by compact.
+            bool is_removed;
+        };
+
+        struct ir_function {
+            const semantic::symbol* source = nullptr;
+            t_file_id file_id = 0;
+            std::string name;
+
+            std::vector<ir_type> parameter_type_list;
+            ir_type return_type = ir_type::VOID;
+
+            std::vector<instruction> instruction_list;
+            std::vector<uint32_t> operand_pool;
+            std::vector<ir_block> block_list;
+            std::vector<t_block_id> predecessor_pool;
+
+            // False if the body uses something the IR can not express yet. Nothing else is valid then.
+            bool complete = true;
+
+            t_block_id make_block();
+
+            // Appends to the end of block. Operands of phis are (block, value) pairs.
+            t_value_id append(const t_block_id block, const opcode op, const ir_type type, const std::vector<uint32_t>& operand_list = {}, const uint64_t immediate = 0);
+
+            // Same as append, but placed right before at.
+            t_value_id insert_before(const t_value_id at, const opcode op, const ir_type type, const std::vector<uint32_t>& operand_list = {}, const uint64_t immediate = 0);
+
+            // Unlinks the instruction and turns it into a NOP. Its id stays valid until compact.
+            void remove(const t_value_id id);
+
+            // Moves the instruction, which keeps its id, right before at. at may be in another block.
+            void move_before(const t_value_id id, const t_value_id at);
+
+            // Moves at and everything after it in its block into a new block, returned, which the old
+            // one does not reach yet. Phis of the successors come from the new block then.
+            t_block_id split_block(const t_value_id at);
+
+            // Replaces the operands. The old ones are left unused in the pool.
+            void set_operands(const t_value_id id, const std::vector<uint32_t>& operand_list);
+
+            void replace_all_uses(const t_value_id from, const t_value_id to);
+
+            inline instruction& at(const t_value_id id) { return instruction_list[id]; }
+            inline const instruction& at(const t_value_id id) const { return instruction_list[id]; }
+
+            inline uint32_t* operands(const t_value_id id) { return operand_pool.data() + instruction_list[id].operand_begin; }
+            inline const uint32_t* operands(const t_value_id id) const { return operand_pool.data() + instruction_list[id].operand_begin; }
+
+            // Number of successors of a finished block, and the i-th of them.
+            uint32_t successor_count(const t_block_id block) const;
+            t_block_id successor(const t_block_id block, const uint32_t i) const;
+
+            inline const t_block_id* predecessors(const t_block_id block) const { return predecessor_pool.data() + block_list[block].predecessor_begin; }
+
+            void compute_predecessors();
+
+            // Drops blocks that can not be reached from the entry and the phi operands coming from them.
+            // Returns true if anything was removed.
+            bool remove_unreachable_blocks();
+
+            // Renumbers blocks and values densely, in layout order, and drops NOPs and unused operands.
+            void compact();
+
+            std::string pretty_debug(const liprocess& process) const;
+        };
+
+        // Immediate dominators of every block reachable from the entry (Cooper, Harvey and Kennedy).
+        // Needs up to date predecessors.
+        struct dominator_tree {
+            explicit dominator_tree(const ir_function& function);
+
+            std::vector<t_block_id> reverse_postorder; // Reachable blocks only
+            std::vector<t_block_id> immediate_dominator; // NO_BLOCK for the entry and unreachable blocks
+
+            inline bool is_reachable(const t_block_id block) const { return order_list[block] != UINT32_MAX; }
+
+            // Constant time. Every block dominates itself.
+            bool dominates(const t_block_id a, const t_block_id b) const;
+
+            // Blocks a dominates directly.
+            inline const t_block_id* children(const t_block_id block) const { return child_pool.data() + child_begin_list[block]; }
+            inline uint32_t child_count(const t_block_id block) const { return child_begin_list[block + 1] - child_begin_list[block]; }
+
+        private:
+            std::vector<uint32_t> order_list; // Reverse postorder index, UINT32_MAX if unreachable
+
+            std::vector<t_block_id> child_pool;
+            std::vector<uint32_t> child_begin_list; // One more than there are blocks
+
+            // Entry and exit times of a walk over the tree.
+            std::vector<uint32_t> preorder_list;
+            std::vector<uint32_t> postorder_list;
+        };
+
+        struct ir_module {
+            std::vector<ir_function> function_list; // In declaration order
+
+            // Symbol of a function -> index into function_list.
+            std::unordered_map<const semantic::symbol*, uint32_t> function_map;
+
+            inline const ir_function* find(const semantic::symbol* source) const {
+                auto it = function_map.find(source);
+                return it != function_map.end() ? &function_list[it->second] : nullptr;
+            }
+        };
+
+        // Decast of liprocess::lifile::dump_ir_module
+        using t_ir_module_ptr = std::shared_ptr<ir_module>;
+    }
+}
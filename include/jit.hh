@@ -0,0 +1,84 @@
+/*
+
+====================================================
+
+Baseline JIT.
+
+Functions that get hot in the VM are translated into x86-64 machine code, one fixed template of machine
+instructions per bytecode instruction. Registers of a frame stay in memory right where the interpreter
+keeps them, so either one can take a frame over from the other at any instruction:
+
+- A loop that gets hot is entered in the middle, at the target of its back edge.
+- Machine code that meets something it does not handle, like a division by zero or an instruction it
+  has no template for, gives the frame back to the interpreter at that instruction (deoptimization).
+  The interpreter then runs it, trap included.
+
+Only x86-64 Linux has a JIT. Everywhere else every function stays in the interpreter.
+
+====================================================
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "vm.hh"
+
+#if defined(__x86_64__) && defined(__linux__)
+    #define LICAN_JIT_AVAILABLE 1
+#else
+    #define LICAN_JIT_AVAILABLE 0
+#endif
+
+namespace core {
+    namespace backend {
+        // What machine code returns. Any other value is the instruction the interpreter continues at.
+        constexpr uint32_t JIT_RETURNED = UINT32_MAX; // The result is in register 0 of the frame.
+        constexpr uint32_t JIT_TRAPPED = UINT32_MAX - 1; // Something it called trapped.
+
+        // Calls and back edges a function runs in the interpreter before it is compiled.
+        constexpr uint32_t JIT_CALL_THRESHOLD = 100;
+        constexpr uint32_t JIT_LOOP_THRESHOLD = 1000;
+
+        // State of a run, shared by the interpreter and machine code. Defined with the interpreter.
+        struct vm_machine;
+
+        // registers: the frame to run on. entry: where to start, see jit_code::run.
+        using t_jit_entry = uint32_t (*)(vm_value* registers, vm_machine* machine, const void* entry);
+
+        struct jit_code {
+            jit_code(uint8_t* memory, const size_t size) : memory(memory), size(size) {}
+            ~jit_code();
+
+            jit_code(const jit_code&) = delete;
+            jit_code& operator=(const jit_code&) = delete;
+
+            uint8_t* memory;
+            size_t size;
+
+            // Bytecode instruction -> offset of its machine code.
+            std::vector<uint32_t> offset_list;
+
+            // Runs the frame from bytecode instruction at.
+            inline uint32_t run(vm_value* registers, vm_machine* machine, const uint32_t at) const {
+                return reinterpret_cast<t_jit_entry>(memory)(registers, machine, memory + offset_list[at]);
+            }
+        };
+
+        // Machine code for function. nullptr where there is no JIT or the code could not be mapped.
+        std::shared_ptr<jit_code> jit_compile(const vm_program& program, const vm_function& function);
+
+        // Called by machine code. Defined with the interpreter.
+
+        // Runs the CALL at instruction at of caller, whose frame is registers. False if it trapped.
+        bool jit_call(vm_machine* machine, vm_value* registers, const vm_function* caller, const uint32_t at);
+
+        // CONVERT with types packed like its c.
+        uint64_t jit_convert(const uint64_t value, const uint32_t types);
+
+        uint64_t jit_power(const uint64_t base, const uint64_t exponent);
+    }
+}
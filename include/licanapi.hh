@@ -18,6 +18,7 @@ All stages of compilation are called there.
 #pragma once
 
 #include <algorithm>
+#include <any>
 #include <string>
 #include <vector>
 
@@ -33,6 +34,9 @@ namespace licanapi {
         std::string entry_point_subpath = "main.lican";
 
         std::vector <std::string> flag_list = {};
+
+        // Worker threads for the parallel stages. 0 uses every hardware thread.
+        size_t thread_count = 0;
     };
 
     // Scary internal version.
@@ -53,9 +57,34 @@ namespace licanapi {
         const bool _dump_logs = false;
         const bool _dump_chrono = false;
         const bool _show_cascading_logs = false;
+        const bool _ignore_interfaces = false;
+        const bool _dump_ir = false;
+        const bool _basic_bytecode = false;
+        const bool _profile_vm = false;
+        const bool _interpret_only = false;
+        const bool _native_build = false;
+        const bool _direct_objects = false;
+        const bool _verify_allocation = false;
+        const bool _whole_program = false;
+        const bool _dump_queries = false;
+
+        // 0 to 2, from -O0, -O1 or -O2.
+        const uint8_t optimization_level = 0;
+
+        const size_t thread_count = 0;
+    };
+
+    // What a long-lived host (the interactive prompt, a daemon, an editor) keeps from one build to the next.
+    // Only facts about files that did not change are reused, so any build may be handed any session.
+    struct lisession {
+        std::any query_engine;
     };
 
-    bool build_project(const liconfig_init& config);
+    bool build_project(const liconfig_init& config, lisession* session = nullptr);
+
+    // Builds the project, then runs function_name from the entry point in the VM.
+    // Every argument is read as the type of its parameter.
+    bool run_project(const liconfig_init& config, const std::string& function_name, const std::vector<std::string>& argument_list, lisession* session = nullptr);
 
     bool build_code(const std::string& code, const std::vector<std::string>& flag_list = {});
 }
\ No newline at end of file
@@ -0,0 +1,112 @@
+/*
+
+====================================================
+
+Whole program optimization (-w).
+
+Modules are compiled on their own, and a module that is only loaded through its interface has no IR
+in the build that uses it. With -w every lowered module also writes its optimized IR next to its
+interface (.lir files), and the build reads back the IR of every module it only has the interface
+of, so the whole program is in view at once. Over all of it:
+  - loads of consts an interface-only module exports are folded to their value,
+  - small functions that call nothing are inlined into their callers in other modules,
+  - functions nothing in the program can reach are dropped.
+
+Functions that changed are run through the -O pipeline again. IR read back is only ever looked at;
+its module keeps the object it was built into. Everything the entry point declares is reachable, and
+so is everything an interface-only module calls. A module without readable IR hides what it calls,
+so nothing is dropped then. A module that loses functions has its interface marked as whole program
+only, since its object no longer has everything the interface promises, and its IR is written again
+with the lost functions marked as dropped. Plain builds compile such a module again. Whole program
+builds load it as long as its IR is fresh: dropped functions can still be inlined, and a call of one
+that is left over is reported. Whole program builds parse every module without fresh IR, so nothing
+they load hides its IR.
+
+Layout. Everything is little-endian and written as it is laid out in memory, padding included.
+    lir::header
+    string[symbol_count]                Link names of every symbol the IR refers to
+    lir::constant[constant_count]       Exported consts and their folded bits
+    function[function_count]            In declaration order
+
+A string is a uint32_t length followed by its bytes. A function is its symbol index, its name, a
+byte of lir::function_flag, its return type, a uint32_t count and its parameter types, and
+then every array of ir_function preceded by its uint32_t length: lir::instruction, operands and
+lir::block. Predecessors are recomputed on load.
+
+====================================================
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "core.hh"
+
+namespace core {
+    namespace backend {
+        constexpr uint32_t LINK_IR_MAGIC = 0x3152494C; // "LIR1"
+        constexpr uint32_t LINK_IR_VERSION = 4;
+
+        constexpr const char* LINK_IR_EXTENSION = ".lir";
+
+        // Used by any index field that has nothing to point to.
+        constexpr uint32_t LINK_IR_NONE = UINT32_MAX;
+
+        namespace lir {
+            struct header {
+                uint32_t magic;
+                uint32_t version;
+
+                uint64_t source_hash;
+                uint64_t source_size;
+
+                uint32_t symbol_count;
+                uint32_t constant_count;
+                uint32_t function_count;
+                uint32_t pad;
+            };
+
+            enum function_flag : uint8_t {
+                FUNCTION_COMPLETE = 1 << 0,
+                FUNCTION_DROPPED = 1 << 1, // Not in the object of its module anymore, see above
+            };
+
+            struct constant {
+                uint64_t bits;
+                uint32_t symbol;
+                uint32_t pad;
+            };
+
+            struct instruction {
+                uint64_t immediate;
+                uint32_t operand_begin;
+
+                uint32_t block;
+                uint32_t prev;
+                uint32_t next;
+
+                uint32_t target[2];
+                uint32_t symbol; // LINK_IR_NONE if there is none
+
+                uint16_t operand_count;
+                uint8_t op;
+                uint8_t type;
+            };
+
+            struct block {
+                uint32_t first;
+                uint32_t last;
+                uint8_t is_removed;
+                uint8_t pad[3];
+            };
+        }
+
+        // Where the IR of the given file lives inside the output path.
+        std::string link_ir_path(const liprocess& process, const t_file_id file_id);
+
+        // True if the IR in the output path was written from the current source of the given file.
+        bool has_link_ir(const liprocess& process, const t_file_id file_id);
+    }
+}
@@ -0,0 +1,63 @@
+/*
+
+====================================================
+
+Loops of the IR.
+
+Lican has one loop, while, and lowering turns it into a header that tests the condition, a body
+that jumps back to it and an exit. The else of a while runs only if the condition fails the first
+time, so a while with an else tests it once more on the way in: the true edge of that test enters
+the body, the false edge goes to the else, and the else falls through to the exit. The header then
+only runs after an iteration, and its false edge goes straight to the exit. break jumps to the exit
+directly, continue jumps back to the header.
+
+Loops are found the way every compiler finds them: an edge whose target dominates its source is a
+back edge, and the natural loop of a header is the header plus every block that reaches one of its
+back edges without going through it. Loops with the same header are one loop, so each continue is
+one more latch. With an else, the body dominates the test in the header, so the body is the header
+of the natural loop and the test is its latch. The else is never in the loop: it is reached from
+the test on the way in, which is where the loop is entered from.
+
+====================================================
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "ir.hh"
+
+namespace core {
+    namespace backend {
+        constexpr uint32_t NO_LOOP = UINT32_MAX;
+
+        struct natural_loop {
+            t_block_id header;
+            uint32_t parent; // The loop it is nested in, NO_LOOP at the top
+            uint32_t depth; // 1 at the top
+
+            std::vector<t_block_id> block_list; // In reverse postorder, so the header comes first
+            std::vector<t_block_id> latch_list; // Sources of the back edges
+            std::vector<std::pair<t_block_id, t_block_id>> exit_list; // Edges leaving the loop, (from, to)
+        };
+
+        // Needs up to date predecessors. Unreachable blocks are in no loop.
+        struct loop_forest {
+            loop_forest(const ir_function& function, const dominator_tree& tree);
+
+            std::vector<natural_loop> loop_list; // Inner loops before the loops they are nested in
+            std::vector<uint32_t> innermost_list; // Per block, the innermost loop it is in or NO_LOOP
+
+            // Every block of a loop is in the loops it is nested in too.
+            bool contains(const uint32_t loop, const t_block_id block) const;
+
+            // 0 outside of every loop.
+            inline uint32_t depth(const t_block_id block) const {
+                return innermost_list[block] == NO_LOOP ? 0 : loop_list[innermost_list[block]].depth;
+            }
+        };
+    }
+}
@@ -0,0 +1,62 @@
+/*
+
+====================================================
+
+Native builds.
+
+Lowered files become native code one of two ways: as C units compiled by the system C compiler
+(generate.cc), or as ELF64 objects written straight from the IR (native.cc). Both put the files of
+a source file at the same place in the output path and give module level symbols the same link
+names, so objects made either way link with each other.
+
+Objects written directly are x86-64 code in the System V calling convention. SSA values live in
+registers picked by a linear scan allocator (regalloc.hh), which is cheap enough to keep a backend
+whose point is building fast, and in stack slots where registers run out.
+
+====================================================
+
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "core.hh"
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__FreeBSD__))
+    #define LICAN_NATIVE_OBJECTS 1
+#else
+    #define LICAN_NATIVE_OBJECTS 0
+#endif
+
+namespace core {
+    namespace semantic {
+        struct symbol;
+    }
+
+    namespace backend {
+        // Path of the files of a source file in the output path, without an extension.
+        std::string unit_path(const liprocess& process, const t_file_id file_id);
+
+        // Its header, relative to the output path, which is how units include each other.
+        std::string unit_include(const liprocess& process, const t_file_id file_id);
+
+        // Prefix of every name the file declares: its relative path, with anything C does not allow as '_'.
+        std::string unit_prefix(const liprocess& process, const t_file_id file_id);
+
+        // The prefix of the file of a module level symbol followed by its modules and its name, all
+        // joined by "__". 'math::add' in main.lican is main__math__add. Closures follow the functions
+        // they are declared in, so closure 'f' in 'main' is main__main__f.
+        std::string link_name(const liprocess& process, const semantic::symbol* declared);
+
+        // The parameterless 'main' at the top of the entry point, where executables start. nullptr if
+        // there is none or it was not lowered.
+        const semantic::symbol* entry_function(liprocess& process);
+
+        // Writes the object of every lowered file of file_list to the path of the same index unless it
+        // already holds the same bytes. Per file, failed_list tells if it could not be written,
+        // written_list if it was, and log_list gets what compiling it had to say.
+        void write_objects(liprocess& process, const std::vector<t_file_id>& file_list, const std::vector<std::string>& path_list, std::vector<uint8_t>& failed_list, std::vector<uint8_t>& written_list, std::vector<std::vector<lilog>>& log_list);
+    }
+}
@@ -0,0 +1,89 @@
+/*
+
+====================================================
+
+IR optimization.
+
+Scalar passes over one function at a time, run by a pass manager in the pipeline -O picks:
+
+-O0 leaves the IR as lowering built it.
+-O1 runs every pass once: CFG simplification, copy propagation, sparse conditional constant
+    propagation, loop invariant code motion, dead code elimination and CFG simplification again.
+-O2 adds global value numbering and induction variable simplification, and repeats the pipeline
+    until a round changes nothing.
+
+At -O1 and above every function first has the calls worth it inlined, bottom up over the call graph,
+so its pipeline sees the copied bodies (inline.hh).
+
+A pass returns how many changes it made, so the manager knows when to stop and -c can show what
+each pass was worth next to what it cost. Passes keep predecessors up to date and leave removed
+instructions behind as NOP; the function is compacted once at the end.
+
+Folding follows the VM to the bit: integers wrap at their width, f32 rounds after every operation
+and anything that would trap at run time (division by zero, a negative integer power) is left for
+run time to trap on.
+
+====================================================
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ir.hh"
+
+namespace core {
+    namespace backend {
+        // Each returns the number of changes it made.
+        uint32_t simplify_cfg(ir_function& function);
+        uint32_t propagate_copies(ir_function& function);
+        uint32_t propagate_constants(ir_function& function); // SCCP (Wegman and Zadeck)
+        uint32_t number_values(ir_function& function); // Dominator based GVN
+        uint32_t eliminate_dead_code(ir_function& function);
+
+        // Loop passes, in loop.cc.
+        uint32_t hoist_invariants(ir_function& function); // LICM
+        uint32_t reduce_induction_variables(ir_function& function); // Merges equal ones, strength reduces multiplies
+
+        // The instruction computes something from its operands alone, without side effects.
+        bool is_pure(const opcode op);
+
+        // Integer bits cut to the width of type and extended back, the way registers hold them.
+        uint64_t wrap_to(const uint64_t value, const ir_type type);
+
+        // Whether removing the instruction, if nothing uses it, could change what the program does.
+        // Division, modulo and integer power count unless they can be seen not to trap.
+        bool has_effect(const ir_function& function, const instruction& at, const uint32_t* operand_list);
+
+        struct ir_pass {
+            const char* name;
+            uint32_t (*run)(ir_function& function);
+        };
+
+        struct pass_statistics {
+            const char* name;
+            uint64_t nanoseconds = 0;
+            uint64_t change_count = 0;
+            uint64_t run_count = 0;
+        };
+
+        struct pass_manager {
+            explicit pass_manager(const uint8_t level);
+
+            std::vector<uint32_t> pipeline; // Indices into pass_list
+            uint32_t round_limit = 1;
+
+            // Runs the pipeline over a complete function. statistics has one entry per pass of pass_list.
+            void run(ir_function& function, std::vector<pass_statistics>& statistics) const;
+
+            // Every pass there is, in the order statistics are kept.
+            static const std::vector<ir_pass>& pass_list();
+        };
+
+        // Decast of liprocess::dump_pass_statistics
+        using t_pass_statistics_ptr = std::shared_ptr<std::vector<pass_statistics>>;
+    }
+}
@@ -0,0 +1,80 @@
+/*
+
+====================================================
+
+Qualified name paths.
+
+a..b..c looks 'a' up through the scopes around it like any other name. Everything after that only
+depends on the symbol 'a' resolved to, so the rest of the path is resolved once per process through
+a trie of interned names. Every trie node remembers what its path resolved to, and paths sharing a
+prefix (hash..map, hash..set) share its nodes.
+
+Member scopes of modules, structs and enums are complete once declarations are collected, which is
+the earliest anything resolves a path. Nodes never change after they are created.
+
+====================================================
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "core.hh"
+
+namespace core {
+    namespace semantic {
+        struct symbol;
+
+        using t_path_id = uint32_t;
+
+        constexpr t_path_id NO_PATH = UINT32_MAX;
+
+        struct path_node {
+            enum class e_failure : uint8_t {
+                NONE,
+                NO_MEMBERS,   // The parent has no member scope
+                NOT_A_MEMBER, // The parent has no member of this name
+            };
+
+            symbol* target; // nullptr if the path does not resolve
+            symbol* parent; // Target of the parent path
+
+            e_failure failure;
+        };
+
+        // Process-wide. Lookups from parallel workers only ever take a shared lock.
+        struct path_trie {
+            path_trie() = default;
+
+            path_trie(const path_trie&) = delete;
+            path_trie& operator=(const path_trie&) = delete;
+
+            // Path made of only start itself.
+            t_path_id root(symbol* start);
+
+            // parent..name. parent has to resolve.
+            t_path_id child(const t_path_id parent, const t_name_id name);
+
+            // The reference stays valid for the lifetime of the trie.
+            const path_node& get(const t_path_id id) const;
+
+            size_t size() const;
+
+        private:
+            mutable std::shared_mutex mutex;
+
+            std::deque<path_node> node_list;
+
+            std::unordered_map<const symbol*, t_path_id> root_map;
+            std::unordered_map<uint64_t, t_path_id> child_map; // parent << 32 | name
+        };
+
+        // Decast of liprocess::dump_path_trie
+        using t_path_trie_ptr = std::shared_ptr<path_trie>;
+    }
+}
@@ -0,0 +1,74 @@
+/*
+
+====================================================
+
+A fixed set of worker threads shared by every stage of the compiler.
+
+parallel_for hands out indices through a single atomic counter and the calling thread works along
+with the pool, so a pool of size 1 runs everything inline on the caller.
+
+====================================================
+
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace liutil {
+    struct worker_pool {
+        // 0 picks the hardware thread count.
+        explicit worker_pool(size_t thread_count = 0);
+        ~worker_pool();
+
+        worker_pool(const worker_pool&) = delete;
+        worker_pool& operator=(const worker_pool&) = delete;
+
+        // Number of threads that take part in a job, including the caller.
+        inline size_t size() const { return thread_list.size() + 1; }
+
+        // Calls func(i) for every i in [0, count). Returns once all calls have finished.
+        template <typename FUNC>
+        void parallel_for(const size_t count, const FUNC& func) {
+            if (count == 0)
+                return;
+
+            if (thread_list.empty() || count == 1) {
+                for (size_t i = 0; i < count; i++)
+                    func(i);
+
+                return;
+            }
+
+            std::atomic<size_t> next = 0;
+
+            run([&]() {
+                for (size_t i = next.fetch_add(1, std::memory_order_relaxed); i < count; i = next.fetch_add(1, std::memory_order_relaxed))
+                    func(i);
+            });
+        }
+
+    private:
+        // Runs job on every worker and the caller, then waits for all of them.
+        void run(const std::function<void()>& job);
+
+        void worker_loop();
+
+        std::vector<std::thread> thread_list;
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+
+        const std::function<void()>* current_job = nullptr;
+        size_t generation = 0;
+        size_t active_count = 0;
+        bool stopping = false;
+    };
+}
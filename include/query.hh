@@ -0,0 +1,179 @@
+/*
+
+====================================================
+
+Demand-driven semantic queries.
+
+A query is a fact computed on first use and memoized: the expansion of a typedec, the value of a
+const declaration... While a query is being computed, every other query it asks for is recorded
+as one of its dependencies. Inputs (the source of a file) sit at the bottom of that graph.
+
+Setting an input to a different value starts a new revision. A memoized query is only recomputed
+once asked for again, and only if one of its recorded dependencies actually changed since it was
+last verified. A query that recomputes to the same fingerprint keeps its old revision, so the
+queries that depend on it are not recomputed either.
+
+The engine outlives a single analysis. A long-lived host hands it from one build to the next, so
+nothing it memoizes may point into one analysis: queries name what they are about with subjects,
+ids for stable names like a declaration's file and qualified name, and the values they memoize are
+written in terms of subjects as well. How a kind of query is computed depends on the analysis that
+asks, so every analysis provides its computations again.
+
+Queries are computed on one thread, while declarations are resolved. Once that is done the results
+are copied where the parallel stages can read them without the engine.
+
+====================================================
+
+*/
+
+#pragma once
+
+#include <any>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace core {
+    namespace semantic {
+        using t_revision = uint64_t;
+
+        enum class query_kind : uint8_t {
+            FILE_SOURCE,        // Input. Subject is the file, the value its source hash.
+            DECLARATION_TYPE,   // Subject is a typedec. Its expansion.
+            CONSTANT_VALUE,     // Subject is a const declaration. Its value.
+            MEMBER_TYPES,       // Subject is a struct. The types of its properties, in declaration order.
+            IDENTIFIER_TARGET,  // Subject is a name path and the scope it is looked up from. The declaration it names.
+            COUNT,
+        };
+
+        const char* query_kind_name(const query_kind kind);
+
+        struct query_key {
+            query_kind kind;
+            uint64_t subject;
+
+            inline bool operator==(const query_key& other) const {
+                return kind == other.kind && subject == other.subject;
+            }
+        };
+
+        struct query_key_hash {
+            inline size_t operator()(const query_key& value) const {
+                const uint64_t hash = (value.subject ^ (static_cast<uint64_t>(value.kind) << 56)) * 0x9E3779B97F4A7C15ull;
+                return static_cast<size_t>(hash ^ (hash >> 32));
+            }
+        };
+
+        inline uint64_t query_fingerprint(const uint64_t value) { return value; }
+
+        struct query_engine {
+            // Fills in the value of the query about subject and its fingerprint. Two values with the same fingerprint are the same.
+            using t_provider = std::function<std::any(query_engine& engine, const uint64_t subject, uint64_t& fingerprint)>;
+
+            query_engine() = default;
+
+            query_engine(const query_engine&) = delete;
+            query_engine& operator=(const query_engine&) = delete;
+
+            // Starts an analysis. Statistics and reports are counted per analysis.
+            void begin_analysis();
+
+            // How queries of kind are computed from now on.
+            void provide(const query_kind kind, t_provider provider);
+
+            // compute is V(query_engine&, uint64_t subject). V needs a query_fingerprint overload.
+            template <typename V, typename COMPUTE>
+            void provide(const query_kind kind, const COMPUTE& compute) {
+                provide(kind, [compute](query_engine& engine, const uint64_t subject, uint64_t& fingerprint) -> std::any {
+                    V result = compute(engine, subject);
+                    fingerprint = query_fingerprint(result);
+                    return result;
+                });
+            }
+
+            // Returns true if the value changed, which starts a new revision.
+            bool set_input(const query_key& key, std::any value, const uint64_t fingerprint);
+
+            // nullptr if the input was never set.
+            const std::any* input(const query_key& key);
+
+            // Returns nullptr if key is already being computed further up, meaning it depends on itself.
+            const std::any* get(const query_key& key);
+
+            template <typename V>
+            const V* get(const query_key& key) {
+                const std::any* value = get(key);
+                return value ? std::any_cast<V>(value) : nullptr;
+            }
+
+            // The subject for a stable name. The same name gets the same subject for as long as the engine lives.
+            uint64_t subject(const std::string& name);
+            const std::string& subject_name(const uint64_t subject) const;
+
+            // True the first time in an analysis that a query is asked about, if its value was memoized in an
+            // earlier one. Whatever it reported back then has to be reported again.
+            bool should_replay(const query_key& key);
+
+            // True while any query is being computed. Its dependencies are being recorded.
+            inline bool computing() const { return !frame_list.empty(); }
+
+            inline t_revision revision() const { return current_revision; }
+
+            // Queries computed in this analysis, in order, as opposed to answered from memory.
+            inline const std::vector<query_key>& computed_list() const { return computed; }
+
+            // Queries asked for in this analysis that were answered from an earlier one.
+            inline size_t reuse_count() const { return reused; }
+
+        private:
+            struct slot {
+                query_key key;
+
+                std::any value;
+                uint64_t fingerprint = 0;
+
+                t_revision changed_at = 0;  // Last revision the value was different
+                t_revision verified_at = 0; // Last revision the value was known to be current
+
+                uint64_t computed_in = 0; // Analysis that last computed the value
+                uint64_t asked_in = 0;    // Analysis that last asked for it
+                uint64_t replayed_in = 0; // Analysis that last replayed what computing it reported
+
+                std::vector<query_key> dependency_list;
+
+                bool is_input = false;
+                bool active = false;
+            };
+
+            void record(const query_key& key);
+
+            // Brings key up to date and returns the revision its value last changed in.
+            t_revision refresh(slot& at);
+
+            void execute(slot& at);
+
+            // Node based, so slot references survive new queries.
+            std::unordered_map<query_key, slot, query_key_hash> slot_map;
+
+            // Dependencies of every query being computed, innermost last.
+            std::vector<std::vector<query_key>*> frame_list;
+
+            t_provider provider_list[static_cast<size_t>(query_kind::COUNT)];
+
+            std::unordered_map<std::string, uint64_t> subject_map;
+            std::vector<const std::string*> subject_name_list; // Keys of subject_map, by subject
+
+            t_revision current_revision = 1;
+            uint64_t analysis = 0;
+
+            std::vector<query_key> computed;
+            size_t reused = 0;
+        };
+
+        // Decast of liprocess::dump_query_engine
+        using t_query_engine_ptr = std::shared_ptr<query_engine>;
+    }
+}
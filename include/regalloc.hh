@@ -0,0 +1,175 @@
+/*
+
+====================================================
+
+Register allocation.
+
+Linear scan over live intervals (Poletto and Sarkar) with the interval splitting of Wimmer and
+Mössenböck, kept simple enough that allocation stays linear in the size of the code, which is what
+lets a JIT afford it as well as an ahead of time backend.
+
+Code is numbered two positions per instruction: operands are read at the even one and the result is
+written at the odd one after it. An interval runs from the definition of a value to its last use,
+without holes. Intervals are taken in order of their start; each gets the register that stays free
+the longest, or one taken from an interval that weighs less. The weight of an interval is what its
+uses are worth, 10 per level of loop nesting, over its length.
+
+An interval that loses its register, or could only have one for part of its life, is split: the rest
+waits in the stack slot of the value until its next use, where it competes for a register again.
+A value that ever waits in its slot is stored there when it is defined, so leaving a register costs
+nothing and only coming back is a load. Registers the target marks as caller saved are not held
+across calls; an interval that would is split at the call instead.
+
+The allocator only sees intervals and positions, so anything that can number its code can use it.
+Functions of the IR number their blocks in reverse postorder (ir_numbering), and the moves an
+allocation needs on top of the code, reloads and those along edges between blocks, phis included,
+are worked out here too so code generation and verification agree on them.
+
+verify_allocation simulates the allocation over the control flow graph, tracking which value every
+register holds and which slots have been written, and checks every value is found where the
+allocation says it is. It runs after every allocation with -v.
+
+====================================================
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ir.hh"
+
+namespace core {
+    namespace backend {
+        constexpr uint8_t NO_REGISTER = UINT8_MAX; // In its stack slot
+        constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+        enum class register_bank : uint8_t {
+            INTEGER,
+            FLOAT,
+        };
+
+        // What the allocator may hand out. Register numbers are the target's own, below 64 and unique
+        // across both banks.
+        struct register_target {
+            std::vector<uint8_t> register_list[2]; // Per bank, preferred first
+            uint64_t caller_saved_mask = 0; // Bit per register number
+
+            inline bool is_caller_saved(const uint8_t reg) const { return (caller_saved_mask >> reg) & 1; }
+        };
+
+        struct live_use {
+            uint32_t position;
+            float weight;
+        };
+
+        struct live_interval {
+            uint32_t value;
+            register_bank bank;
+            uint32_t start; // Inclusive, both of them
+            uint32_t end;
+            std::vector<live_use> use_list; // By position
+        };
+
+        struct interval_set {
+            std::vector<live_interval> interval_list; // At most one per value
+            std::vector<uint32_t> call_list; // Positions of instructions that clobber caller saved registers, sorted
+        };
+
+        // Where a value is from start to end.
+        struct allocation_piece {
+            uint32_t value;
+            uint32_t start;
+            uint32_t end;
+            uint8_t reg; // NO_REGISTER for the slot of the value
+        };
+
+        struct register_allocation {
+            std::vector<allocation_piece> piece_list; // By value, then start
+            std::vector<uint32_t> piece_begin_list; // Per value, one more than there are values
+            std::vector<uint32_t> slot_list; // Per value, NO_SLOT if it never waits in a slot
+            uint32_t slot_count = 0;
+            uint64_t used_mask = 0; // Every register handed out
+
+            // Register pieces that start at a use rather than at the definition, by start. Their value
+            // is loaded from its slot right before that position.
+            std::vector<allocation_piece> reload_list;
+
+            // Values with more than one piece, the only ones that can be in different places on
+            // either end of an edge.
+            std::vector<uint32_t> split_list;
+
+            // nullptr if the value has no location there.
+            const allocation_piece* piece_at(const uint32_t value, const uint32_t position) const;
+
+            inline uint8_t location(const uint32_t value, const uint32_t position) const {
+                const allocation_piece* piece = piece_at(value, position);
+                return piece ? piece->reg : NO_REGISTER;
+            }
+        };
+
+        register_allocation allocate_registers(const interval_set& intervals, const uint32_t value_count, const register_target& target);
+
+        /*
+
+        ====================================================
+
+        The IR
+
+        ====================================================
+
+        */
+
+        // Whether an instruction clobbers the caller saved registers of a target, which knows which
+        // instructions it turns into calls.
+        using t_call_predicate = bool (*)(const ir_function& function, const t_value_id id);
+
+        // Positions of the instructions of a function, blocks in reverse postorder. Parameters come
+        // first, so they are all defined before anything else runs.
+        struct ir_numbering {
+            explicit ir_numbering(const ir_function& function);
+
+            std::vector<t_block_id> block_order; // Reachable blocks only
+            std::vector<uint32_t> position_list; // Per value, its even position
+            std::vector<uint32_t> block_start_list; // Per block. Phis are defined at the start.
+            std::vector<uint32_t> block_end_list; // Per block, the position of its terminator
+
+            // Where the result of an instruction is written.
+            inline uint32_t definition(const ir_function& function, const t_value_id id) const {
+                const instruction& at = function.at(id);
+                return at.op == opcode::PHI ? block_start_list[at.block] : position_list[id] + 1;
+            }
+        };
+
+        inline register_bank bank_of(const ir_type type) {
+            return is_floating(type) ? register_bank::FLOAT : register_bank::INTEGER;
+        }
+
+        // Per value, whether instruction selection folded it into the instruction using it, which then
+        // reads its operands in its place. Folded values have no location. Empty if nothing is folded.
+        using t_folded_list = std::vector<bool>;
+
+        // A value lives from its definition to its last use. A phi operand is used at the end of the
+        // block it comes from, and a value that reaches into a loop lives to the end of it.
+        interval_set build_intervals(const ir_function& function, const ir_numbering& numbering, const t_call_predicate is_call, const t_folded_list& folded_list);
+
+        // value moves from where it is at the end of a block into where destination is at the start of
+        // the next: destination is a phi of that block, or value itself in another place. from and to
+        // are registers, or NO_REGISTER for the slot of value and of destination. A move from a
+        // register to itself moves nothing but still renames, so verification sees the phi there.
+        struct edge_move {
+            uint32_t value;
+            uint8_t from;
+            uint32_t destination;
+            uint8_t to;
+        };
+
+        // The moves along an edge, which are parallel: every source is read before anything is written.
+        std::vector<edge_move> edge_moves(const ir_function& function, const ir_numbering& numbering, const register_allocation& allocation, const t_block_id from, const t_block_id to);
+
+        // Empty if the allocation holds, else what is wrong with it.
+        std::string verify_allocation(const ir_function& function, const ir_numbering& numbering, const register_allocation& allocation, const register_target& target, const t_call_predicate is_call, const t_folded_list& folded_list);
+    }
+}
@@ -0,0 +1,105 @@
+/*
+
+====================================================
+
+Instruction selection for x86-64.
+
+Bottom up rewriting over the trees of the IR, the way BURS selectors do it. An instruction used
+once, by a later instruction of its block, can become part of that instruction instead of computing
+a value of its own, so the IR of a block is a forest of trees. Every node is labelled, leaves first,
+with the cheapest way to reach each goal: a register, an immediate, a scaled index, an address, or
+the flags of a comparison. Then the roots are reduced top down, and whatever the rules of a root
+take as something other than a register is folded into it.
+
+Rules are a table (select.cc) checked at compile time. What they find:
+  - constants that fit in 32 bits as immediates of add, sub, imul and cmp,
+  - sums of registers, constants and registers scaled by 1, 2, 4 or 8 as a single lea,
+  - comparisons only branched on as cmp or ucomisd followed by the jump, without a setcc.
+
+Integer results wrap to their type after the whole tree, which is the same as wrapping after every
+step since the arithmetic is modulo 2^64 to begin with.
+
+The selection only decides; native.cc emits what was decided, and the register allocator is told
+what is folded so folded values get no location and their operands live until the root reads them.
+
+====================================================
+
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "ir.hh"
+#include "regalloc.hh"
+
+namespace core {
+    namespace backend {
+        namespace x64 {
+            enum class goal : uint8_t {
+                REG,
+                IMM, // A constant that fits in a sign extended 32 bit immediate
+                SCALE, // A constant of 1, 2, 4 or 8
+                INDEX, // index * scale
+                BASE_INDEX, // base + index * scale
+                ADDRESS, // base + index * scale + displacement, any of them left out
+                CONDITION, // The flags of a comparison
+                COUNT,
+            };
+
+            constexpr size_t GOAL_COUNT = static_cast<size_t>(goal::COUNT);
+            constexpr uint8_t NO_RULE = UINT8_MAX;
+
+            enum class selection_action : uint8_t {
+                LEAF, // A constant taken as it is
+                CHAIN, // The same node reaching another goal, left
+                FOLD, // Operands are taken as the goals of the rule
+                LEA, // REG from ADDRESS
+                SET, // REG from CONDITION, setcc
+                IMMEDIATE, // REG from an operation with IMM, in place of its register
+            };
+
+            enum class constant_test : uint8_t {
+                NONE,
+                SIMM32,
+                SCALE,
+            };
+
+            // Which operands an operation applies to, told by the type of its first operand.
+            enum class operand_class : uint8_t {
+                ANY,
+                INTEGER,
+                FLOAT,
+            };
+
+            struct selection_rule {
+                goal result;
+                opcode op; // CONSTANT for leaves, NOP for chain rules, which apply to any node
+                goal left; // The goal a chain rule comes from
+                goal right;
+                operand_class operands;
+                constant_test test;
+                uint8_t cost;
+                selection_action action;
+            };
+
+            const selection_rule& rule(const uint8_t index);
+
+            struct instruction_selection {
+                // Per value and goal, the rule that reaches it cheapest, NO_RULE if none does. REG has
+                // no rule either when the instruction is emitted the plain way.
+                std::vector<std::array<uint8_t, GOAL_COUNT>> rule_table;
+                std::vector<goal> goal_list; // Per value, what it was reduced to
+
+                t_folded_list folded_list; // Constants every use takes as an immediate are folded too
+
+                inline uint8_t rule_of(const t_value_id id, const goal wanted) const { return rule_table[id][static_cast<size_t>(wanted)]; }
+                inline uint8_t rule_of(const t_value_id id) const { return rule_of(id, goal_list[id]); }
+            };
+
+            instruction_selection select_instructions(const ir_function& function);
+        }
+    }
+}
@@ -1,5 +1,191 @@
+/*
+
+====================================================
+
+Symbols and scopes for semantic analysis.
+
+Every file gets its own symbol_table. All symbols, scopes and scope maps of a file are allocated from
+arenas owned by the table (one for module level declarations, one per function body) and released
+together when the table dies.
+
+Scopes nest module -> struct -> function -> block. Every scope maps interned names to symbols with a
+flat open-addressing map, so a lookup is a handful of probes per scope no matter how many declarations
+a module has. Qualified names (a..b) go through the path trie in path.hh.
+
+====================================================
+
+*/
+
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "core.hh"
+#include "ast.hh"
+#include "arena.hh"
+#include "token.hh"
+#include "type.hh"
+#include "constant.hh"
+
 namespace core {
+    namespace semantic {
+        enum class symbol_kind : uint8_t {
+            MODULE,
+            STRUCT,
+            ENUM,
+            ENUM_SET,
+            TYPEDEC,
+            FUNCTION,
+            VARIANT,
+            PARAMETER,
+            TEMPLATE_PARAMETER,
+            PROPERTY,
+            METHOD,
+            OPERATOR, // Never declared by name. Reached through the operator table of its struct.
+
+            PRIMITIVE,
+            INTRINSIC,
+        };
+
+        enum class scope_kind : uint8_t {
+            BUILTIN,
+            MODULE,
+            STRUCT,
+            FUNCTION,
+            BLOCK,
+        };
+
+        constexpr ast::t_node_id NO_NODE = SIZE_MAX;
+        constexpr uint32_t NO_INTERFACE_INDEX = UINT32_MAX;
+
+        struct scope;
+        struct symbol;
+
+        // Operator overloads of a struct, indexed by operator token. Binary ones take the right hand side as their parameter.
+        struct operator_table {
+            symbol* unary_list[TOKEN_TYPE_COUNT];
+            symbol* binary_list[TOKEN_TYPE_COUNT];
+        };
+
+        struct symbol {
+            symbol_kind kind;
+            t_name_id name;
+            t_file_id file_id; // -1 for builtins
+
+            ast::t_node_id node; // Declaring node. NO_NODE for builtins and symbols loaded from an interface.
+            uint32_t interface_index; // Declaration index when loaded from an interface.
+
+            scope* parent; // Scope this symbol is declared in
+            scope* inner; // Member scope of modules, structs and enums. nullptr otherwise.
+
+            // Declared type of variants, parameters and properties, signature of functions and methods,
+            // the type itself for primitives, structs and enums and the expansion of typedecs.
+            t_type_id type;
+
+            // Template parameters of generic structs, functions, methods and typedecs, as TEMPLATE_PARAMETER types.
+            const t_type_id* template_list;
+            uint16_t template_count;
+
+            // Structs that overload at least one operator. nullptr otherwise.
+            operator_table* operators;
+
+            // Closures: locals of the functions around them that they read, and the closures declared
+            // there that they call, as long as those capture anything. In order of first use.
+            const symbol* const* capture_list;
+            uint16_t capture_count;
+        };
+
+        struct scope {
+            scope_kind kind;
+
+            scope* parent;
+            symbol* owner; // nullptr for blocks and file roots
+
+            liutil::flat_map<symbol*> table;
+        };
+
+        // Functions declared in a body, with 'dec f = |x| { ... }'.
+        inline bool is_closure(const symbol* found) {
+            return found && found->kind == symbol_kind::FUNCTION && found->parent && (found->parent->kind == scope_kind::BLOCK || found->parent->kind == scope_kind::FUNCTION);
+        }
+
+        struct symbol_table {
+            symbol_table(const t_file_id file_id, const size_t node_count, scope* builtin_scope);
+
+            symbol_table(const symbol_table&) = delete;
+            symbol_table& operator=(const symbol_table&) = delete;
+
+            // Module level symbols and scopes. Only touched by the serial declaration pass.
+            liutil::bump_arena arena;
+
+            // One per function body. Bodies are checked in parallel, so each gets its own arena.
+            std::vector<std::unique_ptr<liutil::bump_arena>> body_arena_list;
+
+            const t_file_id file_id;
+
+            scope* root; // Module scope of the file. Its parent is the builtin scope.
+
+            // node id -> symbol. Filled for identifiers, scope resolutions and declarations.
+            // Body workers write disjoint node ranges, so no locking is needed.
+            symbol** resolution_list;
+            const size_t node_count;
+
+            // Interface-only files: declaration index -> symbol. Reopened modules map to the first one.
+            std::vector<symbol*> interface_symbol_list;
+
+            // node id -> canonical type. Filled for type expressions, function nodes and the expressions of bodies. Same rules as above.
+            t_type_id* type_list;
+
+            // Declares into the given scope. Returns the symbol already using the name on a clash, nullptr otherwise.
+            static symbol* declare(scope* target, symbol* declared);
+
+            // Looks through a single scope only.
+            static symbol* lookup_in(const scope* target, const t_name_id name);
+
+            inline symbol* resolution(const ast::t_node_id id) const { return id < node_count ? resolution_list[id] : nullptr; }
+            inline void resolve(const ast::t_node_id id, symbol* target) { if (id < node_count) resolution_list[id] = target; }
+
+            // node id -> folded value. Filled for the roots of constant initializers, default values and conditions.
+            // Only written by the serial passes. Bodies fold into their own map, merged once they are done.
+            liutil::flat_map<constant> constant_map;
+
+            inline t_type_id type_of(const ast::t_node_id id) const { return id < node_count ? type_list[id] : NO_TYPE; }
+            inline void set_type(const ast::t_node_id id, const t_type_id type) { if (id < node_count) type_list[id] = type; }
+        };
+
+        // The scopes currently being walked. Everything it creates comes from the arena it was given.
+        struct scope_stack {
+            scope_stack(liutil::bump_arena& arena, const t_file_id file_id, scope* base)
+                : arena(arena), file_id(file_id), stack({ base }) {}
+
+            liutil::bump_arena& arena;
+            const t_file_id file_id;
+
+            symbol* make_symbol(const symbol_kind kind, const t_name_id name, const ast::t_node_id node);
+            scope* make_scope(const scope_kind kind, scope* parent, symbol* owner);
+
+            inline scope* current() const { return stack.back(); }
+
+            inline void enter(scope* target) { stack.push_back(target); }
+            inline scope* push_scope(const scope_kind kind, symbol* owner = nullptr) {
+                scope* created = make_scope(kind, current(), owner);
+                stack.push_back(created);
+                return created;
+            }
+            inline void pop_scope() { stack.pop_back(); }
+
+            inline symbol* declare(symbol* declared) { return symbol_table::declare(current(), declared); }
+
+            // Walks from the current scope out to the builtins.
+            symbol* lookup(const t_name_id name) const;
+
+        private:
+            std::vector<scope*> stack;
+        };
 
+        // Decast of liprocess::lifile::dump_symbol_table
+        using t_symbol_table_ptr = std::shared_ptr<symbol_table>;
+    }
 }
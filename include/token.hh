@@ -98,12 +98,16 @@ namespace core {
         RPTR,
     };
 
+    // Size of a table indexed by token_type.
+    constexpr size_t TOKEN_TYPE_COUNT = static_cast<size_t>(token_type::RPTR) + 1;
+
     struct token {
-        token(const token_type& type, const core::lisel& selection)
-            : type(type), selection(selection) {}
+        token(const token_type& type, const core::lisel& selection, const t_name_id name_id = NONE_NAME)
+            : type(type), selection(selection), name_id(name_id) {}
 
         const token_type type;
         const core::lisel selection;
+        const t_name_id name_id; // Set for identifiers and keywords.
 
         inline std::string pretty_debug(const liprocess& process) {
             return std::string("[") + selection.pretty_debug(process) + " (" + process.file_list[selection.file_id].path + ")]:\t" + (type == token_type::INVALID ? "INVALID" : (type == token_type::_EOF ? "EOF" : process.sub_source_code(selection)));
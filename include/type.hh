@@ -0,0 +1,139 @@
+/*
+
+====================================================
+
+Canonical types.
+
+Every distinct type in a process is stored exactly once and is referred to by a dense t_type_id, so two
+types are equal exactly when their ids are. Types are interned bottom-up from ids that already exist:
+hash..map[u64, @u8] becomes STRUCT(map) with the ids of u64 and @u8 as its arguments, and @u8 is
+POINTER with the id of u8 as its only argument. Pointers nest, so '@P' with 'typedec P = @u8' points to @u8.
+
+Primitives are seeded first and their ids equal their type_kind, so they never need a lookup.
+Typedecs are expanded on the way in and never get an id of their own. Generic ones are expanded per
+instance, see instance.hh.
+
+====================================================
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+#include "core.hh"
+#include "arena.hh"
+
+namespace core {
+    namespace semantic {
+        struct symbol;
+
+        using t_type_id = uint32_t;
+
+        enum class type_kind : uint8_t {
+            INVALID, // Anything that failed to resolve. Errors were already reported.
+
+            // Same order as the builtin primitive names.
+            U8, U16, U32, U64,
+            I8, I16, I32, I64,
+            F32, F64,
+            BOOL, CHAR, STRING, VOID,
+
+            NIL,
+
+            // Identified by their declaring symbol and template arguments.
+            STRUCT,
+            ENUM,
+            TEMPLATE_PARAMETER,
+
+            FUNCTION, // Arguments are the parameter types followed by the return type.
+            POINTER, // The only argument is the type pointed to.
+        };
+
+        enum type_flag : uint8_t {
+            TYPE_CONST = 1 << 0,
+            TYPE_LVALUE = 1 << 1,
+            TYPE_RVALUE = 1 << 2,
+        };
+
+        constexpr t_type_id INVALID_TYPE = 0;
+        constexpr t_type_id NIL_TYPE = static_cast<t_type_id>(type_kind::NIL);
+
+        // Declared types that were never written, like 'dec x = 1'.
+        constexpr t_type_id NO_TYPE = UINT32_MAX;
+
+        constexpr t_type_id primitive_type(const type_kind kind) { return static_cast<t_type_id>(kind); }
+
+        constexpr bool is_primitive(const type_kind kind) { return kind >= type_kind::U8 && kind <= type_kind::VOID; }
+
+        // Source name of a primitive kind, "u8" for U8.
+        const char* primitive_name(const type_kind kind);
+
+        struct type_entry {
+            type_kind kind;
+            uint8_t flags;
+            uint16_t argument_count;
+
+            t_type_id base; // The same type without flags. Its own id when flags is 0.
+
+            const symbol* source; // nullptr for primitives, NIL, functions and pointers
+            const t_type_id* argument_list; // Lives as long as the table
+        };
+
+        // Process-wide. Safe to read and write from multiple threads.
+        struct type_table {
+            type_table();
+
+            type_table(const type_table&) = delete;
+            type_table& operator=(const type_table&) = delete;
+
+            t_type_id intern(const type_kind kind, const symbol* source, const t_type_id* argument_list = nullptr, const uint16_t argument_count = 0, const uint8_t flags = 0);
+
+            // The same type with the given flags added.
+            t_type_id qualify(const t_type_id id, const uint8_t flags);
+
+            // A pointer to the given type, flags and all.
+            t_type_id pointer(const t_type_id pointee);
+
+            // Replaces every from[i] inside id with to[i], keeping flags. Used to instantiate templates.
+            t_type_id substitute(const t_type_id id, const t_type_id* from, const t_type_id* to, const uint16_t count);
+
+            // Returns a reference that stays valid for the lifetime of the table.
+            const type_entry& get(const t_type_id id) const;
+
+            size_t size() const;
+
+            // hash..map[u64, @u8] style. Uses the last name of the source only.
+            std::string pretty_debug(const liprocess& process, const t_type_id id) const;
+
+        private:
+            struct key {
+                type_kind kind;
+                uint8_t flags;
+                uint16_t argument_count;
+                const symbol* source;
+                const t_type_id* argument_list;
+
+                bool operator==(const key& other) const;
+            };
+
+            struct key_hash {
+                size_t operator()(const key& value) const;
+            };
+
+            mutable std::shared_mutex mutex;
+
+            liutil::bump_arena arena; // argument lists
+            std::deque<type_entry> entry_list;
+            std::unordered_map<key, t_type_id, key_hash> id_map; // Stored keys point into the arena.
+        };
+
+        // Decast of liprocess::dump_type_table
+        using t_type_table_ptr = std::shared_ptr<type_table>;
+    }
+}
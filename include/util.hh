@@ -10,7 +10,9 @@ Minor functions are are used in different locations of the compiler.
 
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <stdexcept>
 
@@ -38,6 +40,16 @@ namespace liutil {
         return buffer;
     }
 
+    // 64-bit FNV-1a. Stable across runs and platforms, which is what on-disk caches need.
+    inline uint64_t hash_bytes(const std::string_view bytes, uint64_t hash = 0xcbf29ce484222325ull) {
+        for (const char c : bytes) {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 0x100000001b3ull;
+        }
+
+        return hash;
+    }
+
     template <typename K, typename V>
     inline const K& find_map_key_by_value(const std::unordered_map<K, V>& map, const V& value) {
         for (const auto& pair : map) {
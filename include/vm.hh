@@ -0,0 +1,193 @@
+/*
+
+====================================================
+
+Bytecode virtual machine.
+
+Lowered functions are compiled to a register machine: every SSA value gets a register of its own in
+the frame of its function, so an instruction names its destination and operands directly and never
+touches a stack. Constants are registers too. A frame starts as a copy of a template that already
+holds them, so loading a constant costs nothing at run time.
+
+Registers are 64 bits wide. Integers are always kept sign or zero extended from their declared width,
+which lets every integer type share one register format and one set of comparisons. Arithmetic comes
+in one opcode per width, so a u8 add wraps at 8 bits without looking at any type while running.
+
+Instructions are 8 bytes. Targets of jumps and indices of globals take two of the operand fields.
+Calls are followed by the registers of their arguments, four per instruction word.
+
+Dispatch is threaded through computed gotos where the compiler supports them, and a plain switch
+everywhere else.
+
+Sequences that dominate profiles of loops are fused into superinstructions when the bytecode is
+compiled: a comparison feeding a branch, adding a small constant and the last phi copy of a back edge
+followed by its jump. Conversions rewrite themselves in place into a variant for their exact types
+the first time they run (quickening). Both can be turned off to measure what they are worth.
+
+====================================================
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "core.hh"
+#include "ir.hh"
+
+// Every integer width an arithmetic family comes in, in the order of vm_width.
+#define LICAN_VM_INTEGER_FAMILY(X, NAME) \
+    X(NAME##_S8) X(NAME##_S16) X(NAME##_S32) X(NAME##_S64) \
+    X(NAME##_U8) X(NAME##_U16) X(NAME##_U32) X(NAME##_U64)
+
+#define LICAN_VM_OPCODES(X) \
+    X(MOVE)             /* a = b */ \
+    X(CONVERT)          /* a = b converted, c = from << 8 | to (ir_type) */ \
+    X(LOAD_GLOBAL)      /* a = global b | c << 16 */ \
+    X(STORE_GLOBAL)     /* global b | c << 16 = a */ \
+    \
+    LICAN_VM_INTEGER_FAMILY(X, ADD) \
+    LICAN_VM_INTEGER_FAMILY(X, SUB) \
+    LICAN_VM_INTEGER_FAMILY(X, MUL) \
+    LICAN_VM_INTEGER_FAMILY(X, DIV) \
+    LICAN_VM_INTEGER_FAMILY(X, MOD) \
+    LICAN_VM_INTEGER_FAMILY(X, POW) \
+    LICAN_VM_INTEGER_FAMILY(X, NEG) \
+    \
+    X(ADD_F32) X(SUB_F32) X(MUL_F32) X(DIV_F32) X(MOD_F32) X(POW_F32) X(NEG_F32) \
+    X(ADD_F64) X(SUB_F64) X(MUL_F64) X(DIV_F64) X(MOD_F64) X(POW_F64) X(NEG_F64) \
+    \
+    X(NOT) \
+    X(EQ_I) X(NE_I) \
+    X(LT_S) X(LE_S) X(GT_S) X(GE_S) \
+    X(LT_U) X(LE_U) X(GT_U) X(GE_U) \
+    X(EQ_F) X(NE_F) X(LT_F) X(LE_F) X(GT_F) X(GE_F) \
+    \
+    /* Superinstructions. Jump targets are in the b and c of the word after them. */ \
+    LICAN_VM_INTEGER_FAMILY(X, ADDI)    /* a = b + c, c a signed 16 bit immediate */ \
+    X(JUMP_EQ_I) X(JUMP_NE_I) \
+    X(JUMP_LT_S) X(JUMP_LE_S) X(JUMP_GT_S) X(JUMP_GE_S) \
+    X(JUMP_LT_U) X(JUMP_LE_U) X(JUMP_GT_U) X(JUMP_GE_U)    /* if a compares to b */ \
+    X(MOVE_JUMP)        /* a = b, then jump */ \
+    \
+    /* Quickened conversions. */ \
+    LICAN_VM_INTEGER_FAMILY(X, EXTEND)  /* a = b, from another integer width */ \
+    X(S_TO_F32) X(S_TO_F64) X(U_TO_F32) X(U_TO_F64) X(F64_TO_F32) X(I_TO_BOOL) \
+    \
+    X(JUMP)             /* to b | c << 16 */ \
+    X(JUMP_IF)          /* to b | c << 16 if a is true */ \
+    X(JUMP_IF_NOT)      /* to b | c << 16 if a is false */ \
+    X(CALL)             /* a = function b (c arguments) */ \
+    X(RETURN)           /* a */ \
+    X(RETURN_VOID) \
+    X(UNREACHABLE)
+
+namespace core {
+    namespace backend {
+        enum class vm_op : uint16_t {
+#define LICAN_VM_ENUM(name) name,
+            LICAN_VM_OPCODES(LICAN_VM_ENUM)
+#undef LICAN_VM_ENUM
+            COUNT,
+        };
+
+        enum class vm_width : uint8_t {
+            S8, S16, S32, S64,
+            U8, U16, U32, U64,
+        };
+
+        // The member of an integer family for type. Bools and pointers count as unsigned.
+        vm_op integer_op(const vm_op family, const ir_type type);
+
+        const char* vm_op_name(const vm_op op);
+
+        // The specialized form of a conversion between two types. CONVERT itself if there is none.
+        vm_op quickened_convert(const ir_type from, const ir_type to);
+
+        struct vm_instruction {
+            vm_op op;
+            uint16_t a;
+            uint16_t b;
+            uint16_t c;
+        };
+
+        static_assert(sizeof(vm_instruction) == 8, "Bytecode instructions are 8 bytes.");
+
+        union vm_value {
+            int64_t i;
+            uint64_t u;
+            double f; // f32 values are stored already rounded
+        };
+
+        // Registers and instructions are addressed with 16 bits.
+        constexpr size_t VM_MAX_REGISTERS = UINT16_MAX;
+
+        struct jit_code;
+
+        struct vm_function {
+            const semantic::symbol* source = nullptr;
+            t_file_id file_id = 0;
+            std::string name;
+
+            std::vector<ir_type> parameter_type_list; // Parameters are the first registers.
+            ir_type return_type = ir_type::VOID;
+
+            std::vector<vm_instruction> code;
+            std::vector<vm_value> frame_template; // One per register. Constants are already in place.
+
+            // Indices of every function called, for checking what a function depends on.
+            std::vector<uint32_t> callee_list;
+
+            // Why the function can not run. Empty if it can.
+            std::string failure;
+
+            inline bool is_runnable() const { return failure.empty(); }
+
+            // Machine code, once the function got hot enough in the interpreter. See jit.hh.
+            std::shared_ptr<jit_code> native;
+            uint32_t call_count = 0;
+            uint32_t loop_count = 0; // Back edges taken
+            bool is_jit_failed = false;
+        };
+
+        struct vm_program {
+            std::vector<vm_function> function_list; // Every lowered function of every file, in file order
+
+            // Symbol of a function -> index into function_list.
+            std::unordered_map<const semantic::symbol*, uint32_t> function_map;
+
+            // Module level variants the functions use, with their initial values.
+            std::vector<vm_value> global_list;
+            std::unordered_map<const semantic::symbol*, uint32_t> global_map;
+
+            // Rewrite conversions into their specialized form when they first run.
+            bool quicken = true;
+
+            // Compile functions that get hot to machine code.
+            bool jit = true;
+
+            // How often each instruction ran right after another, indexed by previous * COUNT + next.
+            // Only counted if it is not empty when a run starts.
+            std::vector<uint64_t> pair_count_list;
+
+            // Index of a function declared at the top of file_id. UINT32_MAX if there is none by that name.
+            uint32_t find(const t_file_id file_id, const std::string& name) const;
+        };
+
+        // Runs function with one argument per parameter. Globals keep what the run left in them.
+        // Returns false and fills trap on a runtime error.
+        bool execute(vm_program& program, const uint32_t function, const std::vector<vm_value>& argument_list, vm_value& result, std::string& trap);
+
+        // Reads a value of type from text, like a command line argument.
+        bool parse_value(const std::string& text, const ir_type type, vm_value& result);
+
+        std::string pretty_debug(const vm_value value, const ir_type type);
+
+        // Decast of liprocess::dump_vm_program
+        using t_vm_program_ptr = std::shared_ptr<vm_program>;
+    }
+}
@@ -0,0 +1,419 @@
+/*
+
+====================================================
+
+x86-64 encoding.
+
+The pieces of machine code every backend that writes x86-64 shares: register numbers, condition
+codes and a byte buffer that knows how to encode a register against a [base + displacement]
+memory operand, REX prefixes included. Instructions themselves are spelled out as bytes by whoever
+emits them, with the mnemonic next to them.
+
+Moves between registers, [rbp] slots and immediates can go through move() instead, which holds the
+last one back and checks it against the next with the peephole rules below: a move back where a
+value came from is dropped, and a move reading what the last one wrote reads its source instead,
+registers over slots. Whatever else is emitted first lets the held move out, so moves never pass
+anything. The encoding is picked last too, xor for zero included, which clobbers the flags; nothing
+moves between setting the flags and using them here.
+
+====================================================
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+namespace core {
+    namespace backend {
+        namespace x64 {
+            enum gpr : uint8_t {
+                RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+                R8 = 8, R9 = 9, R10 = 10, R11 = 11, R12 = 12, R13 = 13, R14 = 14, R15 = 15,
+            };
+
+            // Low nibble of Jcc and SETcc.
+            enum condition : uint8_t {
+                C_B = 0x2, C_AE = 0x3, C_E = 0x4, C_NE = 0x5, C_BE = 0x6, C_A = 0x7,
+                C_S = 0x8, C_P = 0xA, C_NP = 0xB, C_L = 0xC, C_GE = 0xD, C_LE = 0xE, C_G = 0xF,
+            };
+
+            constexpr uint8_t REX = 0x40;
+            constexpr uint8_t REX_W = 0x48;
+
+            constexpr uint8_t NO_BASE = UINT8_MAX;
+
+            // Bits, so peephole rules can name several at once.
+            enum move_kind : uint8_t {
+                MOVE_GPR = 1,
+                MOVE_XMM = 2,
+                MOVE_SLOT = 4, // [rbp + displacement], 8 bytes
+                MOVE_IMMEDIATE = 8, // Only to gprs, and to slots when it fits in a sign extended imm32
+            };
+
+            constexpr uint8_t MOVE_REGISTER = MOVE_GPR | MOVE_XMM;
+            constexpr uint8_t MOVE_PLACE = MOVE_REGISTER | MOVE_SLOT;
+
+            struct move_operand {
+                move_kind kind;
+                uint8_t reg;
+                int32_t displacement;
+                uint64_t immediate;
+
+                constexpr bool operator==(const move_operand& other) const {
+                    if (kind != other.kind)
+                        return false;
+
+                    switch (kind) {
+                        case MOVE_SLOT: return displacement == other.displacement;
+                        case MOVE_IMMEDIATE: return immediate == other.immediate;
+                        default: return reg == other.reg;
+                    }
+                }
+
+                constexpr bool operator!=(const move_operand& other) const { return !(*this == other); }
+            };
+
+            constexpr move_operand gpr_operand(const gpr reg) { return { MOVE_GPR, reg, 0, 0 }; }
+            constexpr move_operand xmm_operand(const uint8_t xmm) { return { MOVE_XMM, xmm, 0, 0 }; }
+            constexpr move_operand slot_operand(const int32_t displacement) { return { MOVE_SLOT, 0, displacement, 0 }; }
+            constexpr move_operand immediate_operand(const uint64_t value) { return { MOVE_IMMEDIATE, 0, 0, value }; }
+
+            struct machine_move {
+                move_operand to;
+                move_operand from;
+            };
+
+            // How the second move of a pair relates to the first.
+            enum class move_link : uint8_t {
+                REVERSED, // Moves back what the first moved
+                READS_FIRST, // Reads what the first wrote
+                SAME_SOURCE, // Reads what the first read
+            };
+
+            enum class peephole_action : uint8_t {
+                DROP, // The second changes nothing
+                FROM_SOURCE, // The second reads where the first read instead
+                FROM_DESTINATION, // The second reads where the first wrote instead
+            };
+
+            struct peephole_rule {
+                uint8_t first_to; // Kinds, as bits
+                uint8_t first_from;
+                uint8_t second_to;
+                uint8_t second_from;
+                move_link link;
+                peephole_action action;
+            };
+
+            constexpr peephole_rule PEEPHOLE_RULE_LIST[] = {
+                // mov a, b; mov b, a
+                { MOVE_PLACE, MOVE_PLACE, MOVE_PLACE, MOVE_PLACE, move_link::REVERSED, peephole_action::DROP },
+                // mov [s], r; mov r2, [s] -> mov r2, r
+                { MOVE_SLOT, MOVE_REGISTER, MOVE_REGISTER, MOVE_SLOT, move_link::READS_FIRST, peephole_action::FROM_SOURCE },
+                // mov r, r2; mov x, r -> mov x, r2
+                { MOVE_REGISTER, MOVE_REGISTER, MOVE_PLACE, MOVE_REGISTER, move_link::READS_FIRST, peephole_action::FROM_SOURCE },
+                // mov r, [s]; mov r2, [s] -> mov r2, r
+                { MOVE_REGISTER, MOVE_SLOT, MOVE_REGISTER, MOVE_SLOT, move_link::SAME_SOURCE, peephole_action::FROM_DESTINATION },
+            };
+
+            constexpr bool matches(const peephole_rule& rule, const machine_move& first, const machine_move& second) {
+                if (!(rule.first_to & first.to.kind) || !(rule.first_from & first.from.kind) || !(rule.second_to & second.to.kind) || !(rule.second_from & second.from.kind))
+                    return false;
+
+                switch (rule.link) {
+                    case move_link::REVERSED: return second.from == first.to && second.to == first.from;
+                    case move_link::READS_FIRST: return second.from == first.to;
+                    default: return second.from == first.from;
+                }
+            }
+
+            // The second move of a pair, rewritten by the first rule that matches. DROP leaves it with
+            // to == from, which moves nothing.
+            constexpr machine_move rewrite(const machine_move& first, const machine_move& second) {
+                for (const peephole_rule& rule : PEEPHOLE_RULE_LIST) {
+                    if (!matches(rule, first, second))
+                        continue;
+
+                    switch (rule.action) {
+                        case peephole_action::DROP: return { second.to, second.to };
+                        case peephole_action::FROM_SOURCE: return { second.to, first.from };
+                        default: return { second.to, first.to };
+                    }
+                }
+
+                return second;
+            }
+
+            static_assert(rewrite({ slot_operand(-8), gpr_operand(R10) }, { gpr_operand(RAX), slot_operand(-8) }).from == gpr_operand(R10), "A reload of what was just stored reads the register.");
+            static_assert(rewrite({ gpr_operand(RAX), gpr_operand(R10) }, { gpr_operand(R10), gpr_operand(RAX) }).from == gpr_operand(R10), "Moving a value back is dropped.");
+
+            struct assembler {
+                std::vector<uint8_t> byte_list;
+
+                bool has_pending = false;
+                machine_move pending; // Held back by move
+
+                inline size_t size() {
+                    flush();
+                    return byte_list.size();
+                }
+
+                inline void emit(std::initializer_list<uint8_t> list) {
+                    flush();
+                    byte_list.insert(byte_list.end(), list);
+                }
+
+                inline void emit_u32(const uint32_t value) {
+                    flush();
+                    const size_t at = byte_list.size();
+                    byte_list.resize(at + 4);
+                    std::memcpy(byte_list.data() + at, &value, 4);
+                }
+
+                inline void emit_u64(const uint64_t value) {
+                    flush();
+                    const size_t at = byte_list.size();
+                    byte_list.resize(at + 8);
+                    std::memcpy(byte_list.data() + at, &value, 8);
+                }
+
+                inline void patch_u32(const size_t at, const uint32_t value) {
+                    std::memcpy(byte_list.data() + at, &value, 4);
+                }
+
+                // prefix (0 for none), REX if needed, opcode, then reg against [base + displacement].
+                // reg is a register number, an xmm number or the /digit of the opcode.
+                void memory(const uint8_t prefix, const bool wide, std::initializer_list<uint8_t> opcode, const uint8_t reg, const gpr base, const int32_t displacement) {
+                    flush();
+
+                    if (prefix)
+                        byte_list.push_back(prefix);
+
+                    const uint8_t rex = (wide ? REX_W : 0) | (reg & 8 ? 0x44 : 0) | (base & 8 ? 0x41 : 0);
+
+                    if (rex)
+                        byte_list.push_back(rex | REX);
+
+                    emit(opcode);
+
+                    const bool is_short = displacement >= -128 && displacement <= 127;
+                    const uint8_t mode = is_short ? 0x40 : 0x80;
+
+                    byte_list.push_back(static_cast<uint8_t>(mode | (reg & 7) << 3 | (base & 7)));
+
+                    // rsp and r12 as a base need a SIB byte.
+                    if ((base & 7) == RSP)
+                        byte_list.push_back(0x24);
+
+                    if (is_short)
+                        byte_list.push_back(static_cast<uint8_t>(displacement));
+                    else
+                        emit_u32(static_cast<uint32_t>(displacement));
+                }
+
+                // reg against [rip + rel32]. Returns where the rel32 is, which counts from the end of
+                // the instruction, so trailing immediates have to be accounted for by the caller.
+                size_t rip_relative(const uint8_t prefix, const bool wide, std::initializer_list<uint8_t> opcode, const uint8_t reg) {
+                    flush();
+
+                    if (prefix)
+                        byte_list.push_back(prefix);
+
+                    const uint8_t rex = (wide ? REX_W : 0) | (reg & 8 ? 0x44 : 0);
+
+                    if (rex)
+                        byte_list.push_back(rex | REX);
+
+                    emit(opcode);
+                    byte_list.push_back(static_cast<uint8_t>(0x05 | (reg & 7) << 3));
+
+                    const size_t at = byte_list.size();
+                    emit_u32(0);
+
+                    return at;
+                }
+
+                // Register to register, reg in the reg field and rm in the r/m field.
+                void registers(const uint8_t prefix, const bool wide, std::initializer_list<uint8_t> opcode, const uint8_t reg, const uint8_t rm) {
+                    flush();
+
+                    if (prefix)
+                        byte_list.push_back(prefix);
+
+                    const uint8_t rex = (wide ? REX_W : 0) | (reg & 8 ? 0x44 : 0) | (rm & 8 ? 0x41 : 0);
+
+                    if (rex)
+                        byte_list.push_back(rex | REX);
+
+                    emit(opcode);
+                    byte_list.push_back(static_cast<uint8_t>(0xC0 | (reg & 7) << 3 | (rm & 7)));
+                }
+
+                // reg against [base + index * scale + displacement]. base may be NO_BASE; index can not
+                // be rsp. scale is 1, 2, 4 or 8.
+                void indexed(const uint8_t prefix, const bool wide, std::initializer_list<uint8_t> opcode, const uint8_t reg, const uint8_t base, const gpr index, const uint8_t scale, const int32_t displacement) {
+                    flush();
+
+                    if (prefix)
+                        byte_list.push_back(prefix);
+
+                    const uint8_t rex = (wide ? REX_W : 0) | (reg & 8 ? 0x44 : 0) | (index & 8 ? 0x42 : 0) | (base != NO_BASE && base & 8 ? 0x41 : 0);
+
+                    if (rex)
+                        byte_list.push_back(rex | REX);
+
+                    emit(opcode);
+
+                    const uint8_t scale_bits = scale == 8 ? 3 : scale == 4 ? 2 : scale == 2 ? 1 : 0;
+                    const bool is_short = displacement >= -128 && displacement <= 127;
+
+                    // No base is mode 0 with base rbp, which takes a disp32. Mode 0 with base rbp or r13
+                    // means that too, so they always have a displacement.
+                    uint8_t mode;
+
+                    if (base == NO_BASE)
+                        mode = 0x00;
+                    else if (displacement == 0 && (base & 7) != RBP)
+                        mode = 0x00;
+                    else
+                        mode = is_short ? 0x40 : 0x80;
+
+                    byte_list.push_back(static_cast<uint8_t>(mode | (reg & 7) << 3 | RSP));
+                    byte_list.push_back(static_cast<uint8_t>(scale_bits << 6 | (index & 7) << 3 | (base == NO_BASE ? RBP : base & 7)));
+
+                    if (mode == 0x40)
+                        byte_list.push_back(static_cast<uint8_t>(displacement));
+                    else if (mode == 0x80 || base == NO_BASE)
+                        emit_u32(static_cast<uint32_t>(displacement));
+                }
+
+                // Held back for the peephole rules until anything else is emitted.
+                void move(const move_operand to, const move_operand from) {
+                    machine_move next = { to, from };
+
+                    if (has_pending)
+                        next = rewrite(pending, next);
+
+                    if (next.to == next.from)
+                        return;
+
+                    flush();
+
+                    pending = next;
+                    has_pending = true;
+                }
+
+                void flush() {
+                    if (!has_pending)
+                        return;
+
+                    has_pending = false;
+                    encode(pending.to, pending.from);
+                }
+
+                void encode(const move_operand& to, const move_operand& from) {
+                    if (to.kind == MOVE_GPR) {
+                        switch (from.kind) {
+                            case MOVE_GPR: registers(0, true, { 0x89 }, from.reg, to.reg); return; // mov to, from
+                            case MOVE_XMM: registers(0x66, true, { 0x0F, 0x7E }, from.reg, to.reg); return; // movq to, from
+                            case MOVE_SLOT: memory(0, true, { 0x8B }, to.reg, RBP, from.displacement); return; // mov to, [slot]
+                            default: break;
+                        }
+
+                        const uint8_t low = static_cast<uint8_t>(to.reg & 7);
+                        const uint8_t rex_b = to.reg & 8 ? 0x41 : 0;
+
+                        if (from.immediate == 0) {
+                            if (to.reg & 8)
+                                emit({ 0x45 });
+
+                            emit({ 0x31, static_cast<uint8_t>(0xC0 | low << 3 | low) }); // xor to32, to32
+                        }
+                        else if (from.immediate <= UINT32_MAX) {
+                            if (rex_b)
+                                emit({ rex_b });
+
+                            emit({ static_cast<uint8_t>(0xB8 + low) }); // mov to32, imm32, which zero extends
+                            emit_u32(static_cast<uint32_t>(from.immediate));
+                        }
+                        else if (static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(from.immediate))) == from.immediate) {
+                            emit({ static_cast<uint8_t>(REX_W | rex_b), 0xC7, static_cast<uint8_t>(0xC0 | low) }); // mov to, simm32
+                            emit_u32(static_cast<uint32_t>(from.immediate));
+                        }
+                        else {
+                            emit({ static_cast<uint8_t>(REX_W | rex_b), static_cast<uint8_t>(0xB8 + low) }); // movabs to, imm64
+                            emit_u64(from.immediate);
+                        }
+
+                        return;
+                    }
+
+                    if (to.kind == MOVE_XMM) {
+                        if (from.kind == MOVE_XMM)
+                            registers(0x66, false, { 0x0F, 0x28 }, to.reg, from.reg); // movapd to, from
+                        else if (from.kind == MOVE_GPR)
+                            registers(0x66, true, { 0x0F, 0x6E }, to.reg, from.reg); // movq to, from
+                        else
+                            memory(0xF2, false, { 0x0F, 0x10 }, to.reg, RBP, from.displacement); // movsd to, [slot]
+
+                        return;
+                    }
+
+                    switch (from.kind) {
+                        case MOVE_GPR: memory(0, true, { 0x89 }, from.reg, RBP, to.displacement); break; // mov [slot], from
+                        case MOVE_XMM: memory(0xF2, false, { 0x0F, 0x11 }, from.reg, RBP, to.displacement); break; // movsd [slot], from
+                        default:
+                            memory(0, true, { 0xC7 }, 0, RBP, to.displacement); // mov qword [slot], simm32
+                            emit_u32(static_cast<uint32_t>(from.immediate));
+                            break;
+                    }
+                }
+
+                // A short forward jump, landed later with land.
+                inline size_t short_jump(const uint8_t opcode) {
+                    emit({ opcode, 0 });
+                    return byte_list.size() - 1;
+                }
+
+                inline void land(const size_t at) {
+                    flush();
+                    byte_list[at] = static_cast<uint8_t>(byte_list.size() - at - 1);
+                }
+
+                // rel32 jumps whose target is filled in later. Returns where the rel32 is.
+                inline size_t jump() {
+                    emit({ 0xE9 });
+                    emit_u32(0);
+                    return byte_list.size() - 4;
+                }
+
+                inline size_t jump_if(const condition cc) {
+                    emit({ 0x0F, static_cast<uint8_t>(0x80 | cc) });
+                    emit_u32(0);
+                    return byte_list.size() - 4;
+                }
+
+                inline size_t call() {
+                    emit({ 0xE8 });
+                    emit_u32(0);
+                    return byte_list.size() - 4;
+                }
+
+                // Points the rel32 at to target, both offsets into this buffer.
+                inline void link(const size_t at, const size_t target) {
+                    patch_u32(at, static_cast<uint32_t>(target - (at + 4)));
+                }
+
+                // al = cc, extended to the whole of rax.
+                inline void set_bool(const condition cc) {
+                    emit({ 0x0F, static_cast<uint8_t>(0x90 | cc), 0xC0 });
+                    emit({ 0x0F, 0xB6, 0xC0 }); // movzx eax, al
+                }
+            };
+        }
+    }
+}
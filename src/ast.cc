@@ -155,7 +155,10 @@ void core::ast::ast_arena::pretty_debug(const liprocess& process, const t_node_i
         }
 
         case node_type::EXPR_CLOSURE: {
-            buffer += liutil::indent_repeat(indent) + "expr_closure (not implemented)\n";
+            const auto& v = std::get<expr_closure>(an._raw);
+            buffer += liutil::indent_repeat(indent) + "expr_closure\n";
+            buffer += liutil::indent_repeat(indent+1) + "function:\n";
+            pretty_debug(process, v.function, buffer, indent+2);
             break;
         }
 
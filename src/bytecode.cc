@@ -0,0 +1,576 @@
+#include "vm.hh"
+#include "ast.hh"
+#include "symbol.hh"
+
+using namespace core::ast;
+using namespace core::semantic;
+using namespace core::backend;
+
+/*
+
+====================================================
+
+Bytecode compilation
+Every SSA value becomes a register. Phis have no instruction of their own: each edge into a block
+with phis copies the incoming values into the phi registers, as one parallel move. Branch edges that
+need copies go through a small stub placed after the body.
+
+Unless turned off, a few sequences are fused while emitting: an integer comparison used only by the
+branch right after it, adding or subtracting a small constant, and the last copy of an edge with the
+jump that follows it. They were picked from instruction pair counts of loops (run -p).
+
+====================================================
+
+*/
+
+constexpr uint32_t NO_REGISTER = UINT32_MAX;
+
+static inline void set_target(vm_instruction& at, const uint32_t target) {
+    at.b = static_cast<uint16_t>(target & 0xFFFF);
+    at.c = static_cast<uint16_t>(target >> 16);
+}
+
+struct bytecode_state {
+    bytecode_state(const vm_program& program, const ir_function& function, vm_function& compiled, const bool superinstructions)
+        : program(program), function(function), compiled(compiled), superinstructions(superinstructions) {}
+
+    const vm_program& program;
+    const ir_function& function;
+    vm_function& compiled;
+    const bool superinstructions;
+
+    std::vector<uint32_t> register_map; // value -> register
+    uint16_t scratch = 0; // Breaks cycles in parallel moves
+
+    std::vector<uint32_t> block_offset_list;
+
+    // Jumps waiting for the offset of their target block.
+    std::vector<std::pair<size_t, t_block_id>> patch_list;
+
+    struct edge_stub {
+        size_t jump; // The jump to send through the stub
+        t_block_id from;
+        t_block_id to;
+    };
+
+    std::vector<edge_stub> stub_list;
+
+    std::vector<uint32_t> use_count_list; // value -> how many operands name it
+    std::vector<bool> fused_list; // value -> comparison left for its branch to emit
+
+    inline bool fail(const std::string& reason) {
+        if (compiled.failure.empty())
+            compiled.failure = reason;
+
+        return false;
+    }
+
+    inline uint16_t reg(const t_value_id value) const {
+        return static_cast<uint16_t>(register_map[value]);
+    }
+
+    inline void emit(const vm_op op, const uint16_t a = 0, const uint16_t b = 0, const uint16_t c = 0) {
+        compiled.code.push_back({ op, a, b, c });
+    }
+
+    void emit_jump(const vm_op op, const uint16_t condition, const t_block_id target) {
+        patch_list.emplace_back(compiled.code.size(), target);
+        emit(op, condition);
+    }
+
+    void count_uses() {
+        use_count_list.assign(function.instruction_list.size(), 0);
+        fused_list.assign(function.instruction_list.size(), false);
+
+        for (t_value_id id = 0; id < function.instruction_list.size(); id++) {
+            const instruction& at = function.at(id);
+            const uint32_t* operand_list = function.operands(id);
+
+            // Phi operands alternate between blocks and values.
+            const uint32_t first = at.op == opcode::PHI ? 1 : 0;
+            const uint32_t step = at.op == opcode::PHI ? 2 : 1;
+
+            for (uint32_t i = first; i < at.operand_count; i += step)
+                use_count_list[operand_list[i]]++;
+        }
+    }
+
+    bool has_phis(const t_block_id block) const {
+        const t_value_id first = function.block_list[block].first;
+        return first != NO_VALUE && function.at(first).op == opcode::PHI;
+    }
+
+    bool assign_registers() {
+        register_map.assign(function.instruction_list.size(), NO_REGISTER);
+
+        uint32_t count = static_cast<uint32_t>(function.parameter_type_list.size());
+
+        for (t_value_id id = 0; id < function.instruction_list.size(); id++) {
+            const instruction& at = function.at(id);
+
+            if (at.op == opcode::PARAMETER)
+                register_map[id] = static_cast<uint32_t>(at.immediate);
+            else if (at.op != opcode::NOP && at.type != ir_type::VOID)
+                register_map[id] = count++;
+        }
+
+        scratch = static_cast<uint16_t>(count++);
+
+        if (count > VM_MAX_REGISTERS)
+            return fail("it needs more than " + std::to_string(VM_MAX_REGISTERS) + " registers");
+
+        compiled.frame_template.assign(count, vm_value{ 0 });
+
+        for (t_value_id id = 0; id < function.instruction_list.size(); id++) {
+            if (function.at(id).op == opcode::CONSTANT)
+                compiled.frame_template[register_map[id]].u = function.at(id).immediate;
+        }
+
+        return true;
+    }
+
+    // The phis of to take their values for the edge from from, all at once. A move may overwrite
+    // a register another one still reads, so moves go in dependency order and cycles go through scratch.
+    void emit_edge_moves(const t_block_id from, const t_block_id to) {
+        std::vector<std::pair<uint16_t, uint16_t>> move_list; // (destination, source)
+
+        for (t_value_id id = function.block_list[to].first; id != NO_VALUE && function.at(id).op == opcode::PHI; id = function.at(id).next) {
+            const uint32_t* operand_list = function.operands(id);
+
+            for (uint32_t i = 0; i < function.at(id).operand_count; i += 2) {
+                if (operand_list[i] != from)
+                    continue;
+
+                if (reg(id) != reg(operand_list[i + 1]))
+                    move_list.emplace_back(reg(id), reg(operand_list[i + 1]));
+                break;
+            }
+        }
+
+        while (!move_list.empty()) {
+            bool progressed = false;
+
+            for (size_t i = 0; i < move_list.size(); i++) {
+                const uint16_t destination = move_list[i].first;
+
+                const bool is_read = std::any_of(move_list.begin(), move_list.end(), [destination](const std::pair<uint16_t, uint16_t>& move) {
+                    return move.second == destination;
+                });
+
+                if (is_read)
+                    continue;
+
+                emit(vm_op::MOVE, destination, move_list[i].second);
+                move_list.erase(move_list.begin() + i);
+                progressed = true;
+                break;
+            }
+
+            if (progressed)
+                continue;
+
+            // Only cycles are left. Save one destination aside and read it from there instead.
+            const uint16_t saved = move_list.front().first;
+            emit(vm_op::MOVE, scratch, saved);
+
+            for (std::pair<uint16_t, uint16_t>& move : move_list) {
+                if (move.second == saved)
+                    move.second = scratch;
+            }
+        }
+    }
+
+    bool emit_arithmetic(const t_value_id id, const instruction& at) {
+        static const vm_op INTEGER_FAMILY[] = { vm_op::ADD_S8, vm_op::SUB_S8, vm_op::MUL_S8, vm_op::DIV_S8, vm_op::MOD_S8, vm_op::POW_S8 };
+        static const vm_op F32_LIST[] = { vm_op::ADD_F32, vm_op::SUB_F32, vm_op::MUL_F32, vm_op::DIV_F32, vm_op::MOD_F32, vm_op::POW_F32 };
+        static const vm_op F64_LIST[] = { vm_op::ADD_F64, vm_op::SUB_F64, vm_op::MUL_F64, vm_op::DIV_F64, vm_op::MOD_F64, vm_op::POW_F64 };
+
+        const size_t index = static_cast<size_t>(at.op) - static_cast<size_t>(opcode::ADD);
+        const uint32_t* operand_list = function.operands(id);
+
+        vm_op op;
+
+        if (at.type == ir_type::F32)
+            op = F32_LIST[index];
+        else if (at.type == ir_type::F64)
+            op = F64_LIST[index];
+        else if (is_integer(at.type))
+            op = integer_op(INTEGER_FAMILY[index], at.type);
+        else
+            return fail(std::string("it does arithmetic on ") + type_name(at.type));
+
+        if (superinstructions && is_integer(at.type) && (at.op == opcode::ADD || at.op == opcode::SUB)) {
+            int16_t immediate = 0;
+
+            if (small_constant(operand_list[1], at.op == opcode::SUB, immediate)) {
+                emit(integer_op(vm_op::ADDI_S8, at.type), reg(id), reg(operand_list[0]), static_cast<uint16_t>(immediate));
+                return true;
+            }
+
+            if (at.op == opcode::ADD && small_constant(operand_list[0], false, immediate)) {
+                emit(integer_op(vm_op::ADDI_S8, at.type), reg(id), reg(operand_list[1]), static_cast<uint16_t>(immediate));
+                return true;
+            }
+        }
+
+        emit(op, reg(id), reg(operand_list[0]), reg(operand_list[1]));
+        return true;
+    }
+
+    // Whether value is a constant that fits ADDI, negated if negate. Adding wraps the same way
+    // at every width, so only the 64 bit value matters.
+    bool small_constant(const t_value_id value, const bool negate, int16_t& immediate) const {
+        const instruction& at = function.at(value);
+
+        if (at.op != opcode::CONSTANT)
+            return false;
+
+        const int64_t number = negate ? static_cast<int64_t>(0 - at.immediate) : static_cast<int64_t>(at.immediate);
+
+        if (number < INT16_MIN || number > INT16_MAX)
+            return false;
+
+        immediate = static_cast<int16_t>(number);
+        return true;
+    }
+
+    // A comparison that only feeds the branch right after it is emitted by the branch instead.
+    bool is_fusable(const t_value_id id, const instruction& at) const {
+        if (!superinstructions || use_count_list[id] != 1 || at.next == NO_VALUE)
+            return false;
+
+        const instruction& next = function.at(at.next);
+
+        return next.op == opcode::BRANCH && function.operands(at.next)[0] == id
+            && !is_floating(function.at(function.operands(id)[0]).type);
+    }
+
+    // The fused jump taken when the comparison id holds, or when it does not if inverted.
+    vm_instruction compare_jump(const t_value_id id, const bool inverted) const {
+        static const vm_op SIGNED_LIST[] = { vm_op::JUMP_EQ_I, vm_op::JUMP_NE_I, vm_op::JUMP_LT_S, vm_op::JUMP_LE_S, vm_op::JUMP_GT_S, vm_op::JUMP_GE_S };
+        static const vm_op UNSIGNED_LIST[] = { vm_op::JUMP_EQ_I, vm_op::JUMP_NE_I, vm_op::JUMP_LT_U, vm_op::JUMP_LE_U, vm_op::JUMP_GT_U, vm_op::JUMP_GE_U };
+        static const size_t INVERSE[] = { 1, 0, 5, 4, 3, 2 };
+
+        const instruction& at = function.at(id);
+        const uint32_t* operand_list = function.operands(id);
+
+        size_t index = static_cast<size_t>(at.op) - static_cast<size_t>(opcode::EQ);
+        if (inverted)
+            index = INVERSE[index];
+
+        const vm_op op = is_signed(function.at(operand_list[0]).type) ? SIGNED_LIST[index] : UNSIGNED_LIST[index];
+        return { op, reg(operand_list[0]), reg(operand_list[1]), 0 };
+    }
+
+    void emit_comparison(const t_value_id id, const instruction& at) {
+        const uint32_t* operand_list = function.operands(id);
+        const ir_type type = function.at(operand_list[0]).type;
+
+        const size_t index = static_cast<size_t>(at.op) - static_cast<size_t>(opcode::EQ);
+
+        static const vm_op SIGNED_LIST[] = { vm_op::EQ_I, vm_op::NE_I, vm_op::LT_S, vm_op::LE_S, vm_op::GT_S, vm_op::GE_S };
+        static const vm_op UNSIGNED_LIST[] = { vm_op::EQ_I, vm_op::NE_I, vm_op::LT_U, vm_op::LE_U, vm_op::GT_U, vm_op::GE_U };
+        static const vm_op FLOAT_LIST[] = { vm_op::EQ_F, vm_op::NE_F, vm_op::LT_F, vm_op::LE_F, vm_op::GT_F, vm_op::GE_F };
+
+        const vm_op op = is_floating(type) ? FLOAT_LIST[index] : is_signed(type) ? SIGNED_LIST[index] : UNSIGNED_LIST[index];
+
+        emit(op, reg(id), reg(operand_list[0]), reg(operand_list[1]));
+    }
+
+    bool emit_call(const t_value_id id, const instruction& at) {
+        auto it = program.function_map.find(at.symbol);
+
+        if (it == program.function_map.end() || it->second > UINT16_MAX)
+            return fail("it calls '" + function_name(at.symbol) + "', which has no bytecode");
+
+        const uint32_t* operand_list = function.operands(id);
+
+        emit(vm_op::CALL, at.type == ir_type::VOID ? 0 : reg(id), static_cast<uint16_t>(it->second), at.operand_count);
+
+        // Four argument registers per word.
+        for (uint32_t i = 0; i < at.operand_count; i += 4) {
+            uint16_t word[4] = { 0, 0, 0, 0 };
+
+            for (uint32_t j = 0; j < 4 && i + j < at.operand_count; j++)
+                word[j] = reg(operand_list[i + j]);
+
+            emit(static_cast<vm_op>(word[0]), word[1], word[2], word[3]);
+        }
+
+        compiled.callee_list.push_back(it->second);
+        return true;
+    }
+
+    std::string function_name(const symbol* source) const {
+        auto it = program.function_map.find(source);
+        return it != program.function_map.end() ? program.function_list[it->second].name : "a function";
+    }
+
+    bool emit_global(const t_value_id id, const instruction& at) {
+        auto it = program.global_map.find(at.symbol);
+        if (it == program.global_map.end())
+            return fail("it uses a module level variant whose initial value is not a constant");
+
+        vm_instruction created = { at.op == opcode::LOAD_GLOBAL ? vm_op::LOAD_GLOBAL : vm_op::STORE_GLOBAL, 0, 0, 0 };
+        created.a = at.op == opcode::LOAD_GLOBAL ? reg(id) : reg(function.operands(id)[0]);
+        set_target(created, it->second);
+
+        compiled.code.push_back(created);
+        return true;
+    }
+
+    // Emits head as a jump to to. Fused compare and jumps keep their target in a second word.
+    void emit_branch_edge(const vm_instruction head, const t_block_id from, const t_block_id to) {
+        compiled.code.push_back(head);
+
+        if (head.op >= vm_op::JUMP_EQ_I && head.op <= vm_op::JUMP_GE_U)
+            emit(vm_op::JUMP);
+
+        const size_t target_at = compiled.code.size() - 1;
+
+        if (has_phis(to))
+            stub_list.push_back({ target_at, from, to });
+        else
+            patch_list.emplace_back(target_at, to);
+    }
+
+    // The copies of the edge, then a jump to to. The last copy and the jump become one MOVE_JUMP.
+    void emit_edge_jump(const t_block_id from, const t_block_id to) {
+        const size_t start = compiled.code.size();
+        emit_edge_moves(from, to);
+
+        if (superinstructions && compiled.code.size() > start && compiled.code.back().op == vm_op::MOVE)
+            compiled.code.back().op = vm_op::MOVE_JUMP; // Reads its target from the jump and skips it
+
+        emit_jump(vm_op::JUMP, 0, to);
+    }
+
+    bool emit_terminator(const t_block_id block, const t_value_id id, const instruction& at) {
+        const t_block_id next = block + 1;
+
+        switch (at.op) {
+            case opcode::JUMP:
+                if (at.target[0] != next)
+                    emit_edge_jump(block, at.target[0]);
+                else
+                    emit_edge_moves(block, at.target[0]);
+                return true;
+            case opcode::BRANCH: {
+                const t_value_id condition = function.operands(id)[0];
+                const t_block_id on_true = at.target[0];
+                const t_block_id on_false = at.target[1];
+
+                const bool fused = fused_list[condition];
+                const vm_instruction if_true = fused ? compare_jump(condition, false) : vm_instruction{ vm_op::JUMP_IF, reg(condition), 0, 0 };
+                const vm_instruction if_false = fused ? compare_jump(condition, true) : vm_instruction{ vm_op::JUMP_IF_NOT, reg(condition), 0, 0 };
+
+                // Fall through into whichever target comes next, if it needs no copies.
+                if (on_true == next && !has_phis(on_true))
+                    emit_branch_edge(if_false, block, on_false);
+                else if (on_false == next && !has_phis(on_false))
+                    emit_branch_edge(if_true, block, on_true);
+                else {
+                    emit_branch_edge(if_true, block, on_true);
+                    emit_branch_edge({ vm_op::JUMP, 0, 0, 0 }, block, on_false);
+                }
+                return true;
+            }
+            case opcode::RETURN:
+                if (at.operand_count == 0)
+                    emit(vm_op::RETURN_VOID);
+                else
+                    emit(vm_op::RETURN, reg(function.operands(id)[0]));
+                return true;
+            default:
+                emit(vm_op::UNREACHABLE);
+                return true;
+        }
+    }
+
+    bool emit_instruction(const t_block_id block, const t_value_id id) {
+        const instruction& at = function.at(id);
+        const uint32_t* operand_list = function.operands(id);
+
+        switch (at.op) {
+            case opcode::NOP:
+            case opcode::PARAMETER:
+            case opcode::CONSTANT:
+            case opcode::UNDEFINED:
+            case opcode::PHI:
+                return true;
+            case opcode::COPY:
+                emit(vm_op::MOVE, reg(id), reg(operand_list[0]));
+                return true;
+            case opcode::CONVERT: {
+                const ir_type from = function.at(operand_list[0]).type;
+                emit(vm_op::CONVERT, reg(id), reg(operand_list[0]), static_cast<uint16_t>(static_cast<uint16_t>(from) << 8 | static_cast<uint16_t>(at.type)));
+                return true;
+            }
+            case opcode::NEG:
+                if (at.type == ir_type::F32)
+                    emit(vm_op::NEG_F32, reg(id), reg(operand_list[0]));
+                else if (at.type == ir_type::F64)
+                    emit(vm_op::NEG_F64, reg(id), reg(operand_list[0]));
+                else if (is_integer(at.type))
+                    emit(integer_op(vm_op::NEG_S8, at.type), reg(id), reg(operand_list[0]));
+                else
+                    return fail(std::string("it negates a ") + type_name(at.type));
+                return true;
+            case opcode::NOT:
+                emit(vm_op::NOT, reg(id), reg(operand_list[0]));
+                return true;
+            case opcode::ADD:
+            case opcode::SUB:
+            case opcode::MUL:
+            case opcode::DIV:
+            case opcode::MOD:
+            case opcode::POW:
+                return emit_arithmetic(id, at);
+            case opcode::EQ:
+            case opcode::NE:
+            case opcode::LT:
+            case opcode::LE:
+            case opcode::GT:
+            case opcode::GE:
+                if (is_fusable(id, at))
+                    fused_list[id] = true;
+                else
+                    emit_comparison(id, at);
+                return true;
+            case opcode::LOAD_GLOBAL:
+            case opcode::STORE_GLOBAL:
+                return emit_global(id, at);
+            case opcode::CALL:
+                return emit_call(id, at);
+            default:
+                return emit_terminator(block, id, at);
+        }
+    }
+
+    bool compile() {
+        if (!function.complete)
+            return fail("it uses something the IR can not express yet");
+
+        if (!assign_registers())
+            return false;
+
+        count_uses();
+        block_offset_list.assign(function.block_list.size(), 0);
+
+        for (t_block_id block = 0; block < function.block_list.size(); block++) {
+            block_offset_list[block] = static_cast<uint32_t>(compiled.code.size());
+
+            for (t_value_id id = function.block_list[block].first; id != NO_VALUE; id = function.at(id).next) {
+                if (!emit_instruction(block, id))
+                    return false;
+            }
+        }
+
+        for (const edge_stub& stub : stub_list) {
+            set_target(compiled.code[stub.jump], static_cast<uint32_t>(compiled.code.size()));
+
+            emit_edge_jump(stub.from, stub.to);
+        }
+
+        for (const auto& [at, block] : patch_list)
+            set_target(compiled.code[at], block_offset_list[block]);
+
+        return true;
+    }
+};
+
+// Initial values of the module level variants lowered code reads or writes. Only constants for now.
+static void collect_globals(core::liprocess& process, vm_program& program, const ir_function& function) {
+    for (const instruction& at : function.instruction_list) {
+        if (at.op != opcode::LOAD_GLOBAL && at.op != opcode::STORE_GLOBAL)
+            continue;
+
+        const symbol* variable = at.symbol;
+
+        if (program.global_map.count(variable) || variable->node == NO_NODE || process.file_list[variable->file_id].is_interface_only())
+            continue;
+
+        const ast_arena& ast = std::any_cast<const ast_arena&>(process.file_list[variable->file_id].dump_ast_arena);
+        const t_node_id value = ast.get_as<variant_declaration>(variable->node).value;
+
+        vm_value initial;
+        initial.u = 0;
+
+        if (ast.get_base_ptr(value)->type != node_type::EXPR_NONE) {
+            const symbol_table& table = *std::any_cast<const t_symbol_table_ptr&>(process.file_list[variable->file_id].dump_symbol_table);
+            const constant* folded = table.constant_map.find(static_cast<uint32_t>(value));
+
+            if (!folded)
+                continue;
+
+            initial.u = constant_bits(*folded);
+        }
+
+        program.global_map.emplace(variable, static_cast<uint32_t>(program.global_list.size()));
+        program.global_list.push_back(initial);
+    }
+}
+
+// Compiles every lowered function. A function that can not run leaves everything that calls it
+// unable to run too, with the reason passed along.
+bool core::backend::compile_bytecode(liprocess& process, const t_file_id /*entry*/) {
+    auto program = std::make_shared<vm_program>();
+    const bool superinstructions = !process.config._basic_bytecode;
+
+    program->quicken = superinstructions;
+    program->jit = !process.config._interpret_only;
+
+    std::vector<const ir_function*> source_list;
+
+    for (liprocess::lifile& file : process.file_list) {
+        if (!file.dump_ir_module.has_value())
+            continue;
+
+        for (const ir_function& function : std::any_cast<const t_ir_module_ptr&>(file.dump_ir_module)->function_list) {
+            program->function_map.emplace(function.source, static_cast<uint32_t>(source_list.size()));
+            source_list.push_back(&function);
+
+            collect_globals(process, *program, function);
+        }
+    }
+
+    program->function_list.resize(source_list.size());
+
+    process.pool.parallel_for(source_list.size(), [&](const size_t i) {
+        const ir_function& function = *source_list[i];
+        vm_function& compiled = program->function_list[i];
+
+        compiled.source = function.source;
+        compiled.file_id = function.file_id;
+        compiled.name = function.name;
+        compiled.parameter_type_list = function.parameter_type_list;
+        compiled.return_type = function.return_type;
+
+        bytecode_state state(*program, function, compiled, superinstructions);
+        state.compile();
+    });
+
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (vm_function& compiled : program->function_list) {
+            if (!compiled.is_runnable())
+                continue;
+
+            for (const uint32_t callee : compiled.callee_list) {
+                const vm_function& called = program->function_list[callee];
+
+                if (called.is_runnable())
+                    continue;
+
+                compiled.failure = "it calls '" + called.name + "', and " + called.failure;
+                changed = true;
+                break;
+            }
+        }
+    }
+
+    process.dump_vm_program = program;
+
+    return true;
+}
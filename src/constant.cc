@@ -0,0 +1,652 @@
+#include <cmath>
+#include <cstdlib>
+
+#include "constant.hh"
+#include "symbol.hh"
+
+using namespace core::ast;
+using namespace core::semantic;
+
+/*
+
+====================================================
+
+Width-exact arithmetic
+Narrow integers are computed in 64 bits and range checked afterwards. Only 64-bit operations need the
+overflow checks themselves.
+
+====================================================
+
+*/
+
+static uint8_t byte_width(const type_kind kind) {
+    switch (kind) {
+        case type_kind::U8: case type_kind::I8: case type_kind::BOOL: return 1;
+        case type_kind::U16: case type_kind::I16: return 2;
+        case type_kind::U32: case type_kind::I32: case type_kind::F32: return 4;
+        default: return 8;
+    }
+}
+
+static int64_t signed_min(const type_kind kind) {
+    return byte_width(kind) == 8 ? INT64_MIN : -(int64_t(1) << (byte_width(kind) * 8 - 1));
+}
+
+static int64_t signed_max(const type_kind kind) {
+    return byte_width(kind) == 8 ? INT64_MAX : (int64_t(1) << (byte_width(kind) * 8 - 1)) - 1;
+}
+
+static uint64_t unsigned_max(const type_kind kind) {
+    return byte_width(kind) == 8 ? UINT64_MAX : (uint64_t(1) << (byte_width(kind) * 8)) - 1;
+}
+
+static bool add_overflows(const int64_t a, const int64_t b, int64_t& result) {
+    if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b))
+        return true;
+
+    result = a + b;
+    return false;
+}
+
+static bool sub_overflows(const int64_t a, const int64_t b, int64_t& result) {
+    if ((b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b))
+        return true;
+
+    result = a - b;
+    return false;
+}
+
+static bool mul_overflows(const int64_t a, const int64_t b, int64_t& result) {
+    if (a == 0 || b == 0) {
+        result = 0;
+        return false;
+    }
+
+    if ((a == -1 && b == INT64_MIN) || (b == -1 && a == INT64_MIN))
+        return true;
+
+    const int64_t wrapped = static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b));
+    if (wrapped / b != a)
+        return true;
+
+    result = wrapped;
+    return false;
+}
+
+static bool mul_overflows(const uint64_t a, const uint64_t b, uint64_t& result) {
+    result = a * b;
+    return a != 0 && result / a != b;
+}
+
+/*
+
+====================================================
+
+Folding
+
+====================================================
+
+*/
+
+static void report(constant_context& context, const t_node_id id, const std::string& message) {
+    context.log_sink.emplace_back(core::lilog::log_level::ERROR, context.ast.get_base_ptr(id)->selection, message);
+    context.success = false;
+}
+
+static void report_overflow(constant_context& context, const t_node_id id, const type_kind kind) {
+    report(context, id, std::string("Constant expression overflows ") + primitive_name(kind) + '.');
+}
+
+// Returns false if the digits do not fit in 64 bits.
+static bool parse_integer(const std::string& text, uint64_t& value) {
+    value = 0;
+
+    for (const char c : text) {
+        if (c < '0' || c > '9')
+            continue;
+
+        const uint64_t digit = static_cast<uint64_t>(c - '0');
+        if (value > (UINT64_MAX - digit) / 10)
+            return false;
+
+        value = value * 10 + digit;
+    }
+
+    return true;
+}
+
+// An integer literal as kind. negate folds '-literal' in one step, so i8 can hold -128.
+static bool fold_integer_literal(constant_context& context, const t_node_id id, const type_kind kind, const bool negate, constant& result) {
+    const std::string text = context.process.sub_source_code(context.ast.get_base_ptr(id)->selection);
+    uint64_t magnitude;
+
+    result.kind = kind;
+
+    if (is_floating(kind)) {
+        result.f = std::strtod(text.c_str(), nullptr);
+
+        if (kind == type_kind::F32)
+            result.f = static_cast<float>(result.f);
+        if (negate)
+            result.f = -result.f;
+
+        return true;
+    }
+
+    if (!is_integer(kind))
+        return false;
+
+    bool fits = parse_integer(text, magnitude);
+
+    if (fits && is_signed_integer(kind)) {
+        const uint64_t limit = negate ? static_cast<uint64_t>(signed_max(kind)) + 1 : static_cast<uint64_t>(signed_max(kind));
+        fits = magnitude <= limit;
+
+        if (fits)
+            result.i = negate ? static_cast<int64_t>(0 - magnitude) : static_cast<int64_t>(magnitude);
+    }
+    else if (fits) {
+        fits = magnitude <= unsigned_max(kind) && (!negate || magnitude == 0);
+        result.u = magnitude;
+    }
+
+    if (!fits)
+        report(context, id, std::string("'") + (negate ? "-" : "") + text + "' does not fit in " + primitive_name(kind) + '.');
+
+    return fits;
+}
+
+// Converts between kinds without losing anything. Used for names of const declarations.
+static bool convert(const constant& value, const type_kind kind, constant& result) {
+    result.kind = kind;
+
+    if (value.kind == kind) {
+        result = value;
+        return true;
+    }
+
+    if (is_floating(kind)) {
+        if (is_floating(value.kind))
+            result.f = kind == type_kind::F32 ? static_cast<float>(value.f) : value.f;
+        else if (is_signed_integer(value.kind))
+            result.f = static_cast<double>(value.i);
+        else if (is_unsigned_integer(value.kind))
+            result.f = static_cast<double>(value.u);
+        else
+            return false;
+
+        return true;
+    }
+
+    if (is_signed_integer(kind)) {
+        if (is_signed_integer(value.kind) && value.i >= signed_min(kind) && value.i <= signed_max(kind))
+            result.i = value.i;
+        else if (is_unsigned_integer(value.kind) && value.u <= static_cast<uint64_t>(signed_max(kind)))
+            result.i = static_cast<int64_t>(value.u);
+        else
+            return false;
+
+        return true;
+    }
+
+    if (is_unsigned_integer(kind)) {
+        if (is_unsigned_integer(value.kind) && value.u <= unsigned_max(kind))
+            result.u = value.u;
+        else if (is_signed_integer(value.kind) && value.i >= 0 && static_cast<uint64_t>(value.i) <= unsigned_max(kind))
+            result.u = static_cast<uint64_t>(value.i);
+        else
+            return false;
+
+        return true;
+    }
+
+    return false;
+}
+
+static bool arithmetic_signed(constant_context& context, const t_node_id id, const core::token_type opr, const type_kind kind, const int64_t a, const int64_t b, constant& result) {
+    int64_t value = 0;
+    bool overflow = false;
+
+    switch (opr) {
+        case core::token_type::PLUS: overflow = add_overflows(a, b, value); break;
+        case core::token_type::MINUS: overflow = sub_overflows(a, b, value); break;
+        case core::token_type::ASTERISK: overflow = mul_overflows(a, b, value); break;
+        case core::token_type::SLASH:
+        case core::token_type::PERCENT:
+            if (b == 0) {
+                report(context, id, "Division by zero in a constant expression.");
+                return false;
+            }
+
+            if (b == -1) {
+                // INT64_MIN / -1 traps on most hardware. The range check below still catches narrow widths.
+                overflow = opr == core::token_type::SLASH && a == INT64_MIN;
+                value = opr == core::token_type::SLASH ? (overflow ? 0 : -a) : 0;
+            }
+            else
+                value = opr == core::token_type::SLASH ? a / b : a % b;
+            break;
+        case core::token_type::CARET: {
+            if (b < 0) {
+                report(context, id, "Integer constants can not be raised to a negative power.");
+                return false;
+            }
+
+            // 0, 1 and -1 never overflow. Anything else overflows within 64 steps.
+            if (a == 0 || a == 1)
+                value = b == 0 ? 1 : a;
+            else if (a == -1)
+                value = b % 2 == 0 ? 1 : -1;
+            else {
+                value = 1;
+                for (int64_t i = 0; i < b && !overflow; i++)
+                    overflow = mul_overflows(value, a, value) || value < signed_min(kind) || value > signed_max(kind);
+            }
+            break;
+        }
+        default:
+            return false;
+    }
+
+    if (overflow || value < signed_min(kind) || value > signed_max(kind)) {
+        report_overflow(context, id, kind);
+        return false;
+    }
+
+    result.kind = kind;
+    result.i = value;
+    return true;
+}
+
+static bool arithmetic_unsigned(constant_context& context, const t_node_id id, const core::token_type opr, const type_kind kind, const uint64_t a, const uint64_t b, constant& result) {
+    uint64_t value = 0;
+    bool overflow = false;
+
+    switch (opr) {
+        case core::token_type::PLUS:
+            value = a + b;
+            overflow = value < a;
+            break;
+        case core::token_type::MINUS:
+            overflow = a < b;
+            value = a - b;
+            break;
+        case core::token_type::ASTERISK:
+            overflow = mul_overflows(a, b, value);
+            break;
+        case core::token_type::SLASH:
+        case core::token_type::PERCENT:
+            if (b == 0) {
+                report(context, id, "Division by zero in a constant expression.");
+                return false;
+            }
+
+            value = opr == core::token_type::SLASH ? a / b : a % b;
+            break;
+        case core::token_type::CARET:
+            if (a <= 1)
+                value = b == 0 ? 1 : a;
+            else {
+                value = 1;
+                for (uint64_t i = 0; i < b && !overflow; i++)
+                    overflow = mul_overflows(value, a, value) || value > unsigned_max(kind);
+            }
+            break;
+        default:
+            return false;
+    }
+
+    if (overflow || value > unsigned_max(kind)) {
+        report_overflow(context, id, kind);
+        return false;
+    }
+
+    result.kind = kind;
+    result.u = value;
+    return true;
+}
+
+static bool arithmetic_floating(constant_context& context, const t_node_id id, const core::token_type opr, const type_kind kind, const double a, const double b, constant& result) {
+    double value;
+
+    switch (opr) {
+        case core::token_type::PLUS: value = a + b; break;
+        case core::token_type::MINUS: value = a - b; break;
+        case core::token_type::ASTERISK: value = a * b; break;
+        case core::token_type::SLASH:
+        case core::token_type::PERCENT:
+            if (b == 0) {
+                report(context, id, "Division by zero in a constant expression.");
+                return false;
+            }
+
+            value = opr == core::token_type::SLASH ? a / b : std::fmod(a, b);
+            break;
+        case core::token_type::CARET: value = std::pow(a, b); break;
+        default:
+            return false;
+    }
+
+    if (kind == type_kind::F32)
+        value = static_cast<float>(value);
+
+    if (std::isinf(value) && !std::isinf(a) && !std::isinf(b)) {
+        report_overflow(context, id, kind);
+        return false;
+    }
+
+    result.kind = kind;
+    result.f = value;
+    return true;
+}
+
+static bool compare(const core::token_type opr, const constant& a, const constant& b, bool& result) {
+    int order;
+
+    if (is_floating(a.kind)) {
+        if (std::isnan(a.f) || std::isnan(b.f)) {
+            result = opr == core::token_type::BANG_EQUAL;
+            return true;
+        }
+
+        order = a.f < b.f ? -1 : (a.f > b.f ? 1 : 0);
+    }
+    else if (is_signed_integer(a.kind))
+        order = a.i < b.i ? -1 : (a.i > b.i ? 1 : 0);
+    else if (is_unsigned_integer(a.kind))
+        order = a.u < b.u ? -1 : (a.u > b.u ? 1 : 0);
+    else
+        order = a.b == b.b ? 0 : (a.b ? 1 : -1);
+
+    switch (opr) {
+        case core::token_type::LARROW: result = order < 0; return true;
+        case core::token_type::LESS_EQUAL: result = order <= 0; return true;
+        case core::token_type::RARROW: result = order > 0; return true;
+        case core::token_type::GREATER_EQUAL: result = order >= 0; return true;
+        case core::token_type::DOUBLE_EQUAL: result = order == 0; return true;
+        case core::token_type::BANG_EQUAL: result = order != 0; return true;
+        default: return false;
+    }
+}
+
+static bool is_arithmetic(const core::token_type opr) {
+    switch (opr) {
+        case core::token_type::PLUS:
+        case core::token_type::MINUS:
+        case core::token_type::ASTERISK:
+        case core::token_type::SLASH:
+        case core::token_type::PERCENT:
+        case core::token_type::CARET:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool is_comparison(const core::token_type opr) {
+    switch (opr) {
+        case core::token_type::LARROW:
+        case core::token_type::LESS_EQUAL:
+        case core::token_type::RARROW:
+        case core::token_type::GREATER_EQUAL:
+        case core::token_type::DOUBLE_EQUAL:
+        case core::token_type::BANG_EQUAL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// The kind both sides of a binary expression are computed in.
+static type_kind common_kind(const type_kind a, const type_kind b) {
+    if (a == type_kind::INVALID || b == type_kind::INVALID)
+        return type_kind::INVALID;
+
+    if (a == b)
+        return a;
+
+    if (a == type_kind::BOOL || b == type_kind::BOOL)
+        return type_kind::INVALID;
+
+    if (is_floating(a) || is_floating(b))
+        return a == type_kind::F64 || b == type_kind::F64 ? type_kind::F64 : type_kind::F32;
+
+    if (byte_width(a) != byte_width(b))
+        return byte_width(a) > byte_width(b) ? a : b;
+
+    return is_unsigned_integer(a) ? a : b;
+}
+
+static const constant* lookup_name(constant_context& context, const t_node_id id) {
+    const symbol* found = context.table.resolution(id);
+    return found && context.lookup ? context.lookup(found) : nullptr;
+}
+
+type_kind core::semantic::natural_kind(constant_context& context, const t_node_id id) {
+    const node* base = context.ast.get_base_ptr(id);
+
+    switch (base->type) {
+        case node_type::EXPR_LITERAL:
+            switch (context.ast.get_as<expr_literal>(id).literal_type) {
+                case expr_literal::e_literal_type::INT: {
+                    uint64_t value;
+                    if (!parse_integer(context.process.sub_source_code(base->selection), value))
+                        return type_kind::U64;
+
+                    return value <= INT32_MAX ? type_kind::I32 : (value <= INT64_MAX ? type_kind::I64 : type_kind::U64);
+                }
+                case expr_literal::e_literal_type::FLOAT:
+                    return type_kind::F64;
+                case expr_literal::e_literal_type::BOOL:
+                    return type_kind::BOOL;
+                default:
+                    return type_kind::INVALID;
+            }
+        case node_type::EXPR_IDENTIFIER: {
+            const constant* value = lookup_name(context, id);
+            return value ? value->kind : type_kind::INVALID;
+        }
+        case node_type::EXPR_UNARY: {
+            const expr_unary& unary = context.ast.get_as<expr_unary>(id);
+
+            if (unary.post)
+                return type_kind::INVALID;
+            if (unary.opr.type == core::token_type::BANG)
+                return type_kind::BOOL;
+            if (unary.opr.type == core::token_type::MINUS)
+                return natural_kind(context, unary.operand);
+
+            return type_kind::INVALID;
+        }
+        case node_type::EXPR_BINARY: {
+            const expr_binary& binary = context.ast.get_as<expr_binary>(id);
+            const core::token_type opr = binary.opr.type;
+
+            if (opr == core::token_type::DOUBLE_DOT) {
+                const constant* value = lookup_name(context, id);
+                return value ? value->kind : type_kind::INVALID;
+            }
+
+            if (is_comparison(opr) || opr == core::token_type::DOUBLE_AMPERSAND || opr == core::token_type::DOUBLE_PIPE)
+                return type_kind::BOOL;
+
+            if (is_arithmetic(opr))
+                return common_kind(natural_kind(context, binary.first), natural_kind(context, binary.second));
+
+            return type_kind::INVALID;
+        }
+        case node_type::EXPR_TERNARY: {
+            const expr_ternary& ternary = context.ast.get_as<expr_ternary>(id);
+            return common_kind(natural_kind(context, ternary.second), natural_kind(context, ternary.third));
+        }
+        default:
+            return type_kind::INVALID;
+    }
+}
+
+bool core::semantic::fold(constant_context& context, const t_node_id id, const type_kind kind, constant& result) {
+    if (!is_foldable(kind))
+        return false;
+
+    const node* base = context.ast.get_base_ptr(id);
+
+    switch (base->type) {
+        case node_type::EXPR_LITERAL: {
+            const expr_literal& literal = context.ast.get_as<expr_literal>(id);
+
+            switch (literal.literal_type) {
+                case expr_literal::e_literal_type::INT:
+                    return fold_integer_literal(context, id, kind, false, result);
+                case expr_literal::e_literal_type::FLOAT: {
+                    if (!is_floating(kind))
+                        return false;
+
+                    const double value = std::strtod(context.process.sub_source_code(base->selection).c_str(), nullptr);
+
+                    result.kind = kind;
+                    result.f = kind == type_kind::F32 ? static_cast<float>(value) : value;
+
+                    if (std::isinf(result.f)) {
+                        report_overflow(context, id, kind);
+                        return false;
+                    }
+
+                    return true;
+                }
+                case expr_literal::e_literal_type::BOOL:
+                    if (kind != type_kind::BOOL)
+                        return false;
+
+                    result.kind = kind;
+                    result.b = context.process.sub_source_code(base->selection) == "true";
+                    return true;
+                default:
+                    return false;
+            }
+        }
+        case node_type::EXPR_IDENTIFIER: {
+            const constant* value = lookup_name(context, id);
+            return value && convert(*value, kind, result);
+        }
+        case node_type::EXPR_UNARY: {
+            const expr_unary& unary = context.ast.get_as<expr_unary>(id);
+
+            if (unary.post)
+                return false;
+
+            if (unary.opr.type == core::token_type::BANG) {
+                if (kind != type_kind::BOOL || !fold(context, unary.operand, kind, result))
+                    return false;
+
+                result.b = !result.b;
+                return true;
+            }
+
+            if (unary.opr.type != core::token_type::MINUS || kind == type_kind::BOOL)
+                return false;
+
+            const node* operand = context.ast.get_base_ptr(unary.operand);
+            if (operand->type == node_type::EXPR_LITERAL && context.ast.get_as<expr_literal>(unary.operand).literal_type == expr_literal::e_literal_type::INT)
+                return fold_integer_literal(context, unary.operand, kind, true, result);
+
+            if (!fold(context, unary.operand, kind, result))
+                return false;
+
+            if (is_floating(kind))
+                result.f = -result.f;
+            else if (is_signed_integer(kind)) {
+                if (result.i == signed_min(kind)) {
+                    report_overflow(context, id, kind);
+                    return false;
+                }
+
+                result.i = -result.i;
+            }
+            else if (result.u != 0) {
+                report_overflow(context, id, kind);
+                return false;
+            }
+
+            return true;
+        }
+        case node_type::EXPR_BINARY: {
+            const expr_binary& binary = context.ast.get_as<expr_binary>(id);
+            const core::token_type opr = binary.opr.type;
+
+            if (opr == core::token_type::DOUBLE_DOT) {
+                const constant* value = lookup_name(context, id);
+                return value && convert(*value, kind, result);
+            }
+
+            if (opr == core::token_type::DOUBLE_AMPERSAND || opr == core::token_type::DOUBLE_PIPE) {
+                constant first, second;
+
+                if (kind != type_kind::BOOL || !fold(context, binary.first, kind, first) || !fold(context, binary.second, kind, second))
+                    return false;
+
+                result.kind = kind;
+                result.b = opr == core::token_type::DOUBLE_AMPERSAND ? first.b && second.b : first.b || second.b;
+                return true;
+            }
+
+            if (is_comparison(opr)) {
+                const type_kind operand_kind = common_kind(natural_kind(context, binary.first), natural_kind(context, binary.second));
+                constant first, second;
+
+                if (kind != type_kind::BOOL || !is_foldable(operand_kind))
+                    return false;
+
+                // Only == and != make sense for bools.
+                if (operand_kind == type_kind::BOOL && opr != core::token_type::DOUBLE_EQUAL && opr != core::token_type::BANG_EQUAL)
+                    return false;
+
+                if (!fold(context, binary.first, operand_kind, first) || !fold(context, binary.second, operand_kind, second))
+                    return false;
+
+                result.kind = kind;
+                return compare(opr, first, second, result.b);
+            }
+
+            if (!is_arithmetic(opr) || kind == type_kind::BOOL)
+                return false;
+
+            constant first, second;
+
+            if (!fold(context, binary.first, kind, first) || !fold(context, binary.second, kind, second))
+                return false;
+
+            if (is_floating(kind))
+                return arithmetic_floating(context, id, opr, kind, first.f, second.f, result);
+            if (is_signed_integer(kind))
+                return arithmetic_signed(context, id, opr, kind, first.i, second.i, result);
+
+            return arithmetic_unsigned(context, id, opr, kind, first.u, second.u, result);
+        }
+        case node_type::EXPR_TERNARY: {
+            const expr_ternary& ternary = context.ast.get_as<expr_ternary>(id);
+            constant condition;
+
+            if (!fold(context, ternary.first, type_kind::BOOL, condition))
+                return false;
+
+            return fold(context, condition.b ? ternary.second : ternary.third, kind, result);
+        }
+        default:
+            return false;
+    }
+}
+
+std::string core::semantic::pretty_debug(const constant& value) {
+    std::string buffer;
+
+    if (is_floating(value.kind))
+        buffer = std::to_string(value.f);
+    else if (is_signed_integer(value.kind))
+        buffer = std::to_string(value.i);
+    else if (is_unsigned_integer(value.kind))
+        buffer = std::to_string(value.u);
+    else
+        buffer = value.b ? "true" : "false";
+
+    return buffer + ": " + primitive_name(value.kind);
+}
@@ -1,3 +1,6 @@
+#include <filesystem>
+#include <mutex>
+
 #include "core.hh"
 
 bool core::frontend::init(liprocess& process) {
@@ -68,4 +71,53 @@ bool core::liprocess::add_file(const std::string& path) {
     file_list.emplace_back(path, contents);
 
     return true;
+}
+
+core::t_file_id core::liprocess::find_file(const std::string& path) const {
+    const std::string normal = std::filesystem::path(path).lexically_normal().generic_string();
+
+    for (size_t i = 0; i < file_list.size(); i++) {
+        if (std::filesystem::path(file_list[i].path).lexically_normal().generic_string() == normal)
+            return static_cast<t_file_id>(i);
+    }
+
+    return -1;
+}
+
+core::liname_table::liname_table() {
+    name_list.emplace_back();
+    id_map.emplace(name_list.back(), NONE_NAME);
+}
+
+core::t_name_id core::liname_table::intern(const std::string_view name) {
+    {
+        std::shared_lock lock(mutex);
+
+        auto it = id_map.find(name);
+        if (it != id_map.end())
+            return it->second;
+    }
+
+    std::unique_lock lock(mutex);
+
+    // Another thread may have beaten us to it between the locks.
+    auto it = id_map.find(name);
+    if (it != id_map.end())
+        return it->second;
+
+    const t_name_id id = static_cast<t_name_id>(name_list.size());
+    name_list.emplace_back(name);
+    id_map.emplace(name_list.back(), id);
+
+    return id;
+}
+
+const std::string& core::liname_table::get(const t_name_id id) const {
+    std::shared_lock lock(mutex);
+    return name_list[id];
+}
+
+size_t core::liname_table::size() const {
+    std::shared_lock lock(mutex);
+    return name_list.size();
 }
\ No newline at end of file
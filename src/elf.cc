@@ -0,0 +1,300 @@
+#include <cstring>
+
+#include "elf.hh"
+
+using namespace core::backend;
+
+/*
+
+====================================================
+
+Layout
+Header, section contents in section order, then the tables, then the section headers. Every part is
+sized before anything is written, so the file is one buffer filled front to back with memcpy.
+
+====================================================
+
+*/
+
+namespace {
+    struct elf64_header {
+        uint8_t ident[16];
+        uint16_t type;
+        uint16_t machine;
+        uint32_t version;
+        uint64_t entry;
+        uint64_t program_header_offset;
+        uint64_t section_header_offset;
+        uint32_t flags;
+        uint16_t header_size;
+        uint16_t program_header_size;
+        uint16_t program_header_count;
+        uint16_t section_header_size;
+        uint16_t section_header_count;
+        uint16_t section_name_index;
+    };
+
+    struct elf64_section_header {
+        uint32_t name;
+        uint32_t type;
+        uint64_t flags;
+        uint64_t address;
+        uint64_t offset;
+        uint64_t size;
+        uint32_t link;
+        uint32_t info;
+        uint64_t alignment;
+        uint64_t entry_size;
+    };
+
+    struct elf64_symbol {
+        uint32_t name;
+        uint8_t info;
+        uint8_t other;
+        uint16_t section;
+        uint64_t value;
+        uint64_t size;
+    };
+
+    struct elf64_rela {
+        uint64_t offset;
+        uint64_t info;
+        int64_t addend;
+    };
+
+    static_assert(sizeof(elf64_header) == 64, "ELF64 headers are 64 bytes.");
+    static_assert(sizeof(elf64_section_header) == 64, "ELF64 section headers are 64 bytes.");
+    static_assert(sizeof(elf64_symbol) == 24, "ELF64 symbols are 24 bytes.");
+    static_assert(sizeof(elf64_rela) == 24, "ELF64 relocations are 24 bytes.");
+
+    constexpr uint32_t SHT_PROGBITS = 1;
+    constexpr uint32_t SHT_SYMTAB = 2;
+    constexpr uint32_t SHT_STRTAB = 3;
+    constexpr uint32_t SHT_RELA = 4;
+    constexpr uint32_t SHT_NOBITS = 8;
+
+    constexpr uint64_t SHF_WRITE = 0x1;
+    constexpr uint64_t SHF_ALLOC = 0x2;
+    constexpr uint64_t SHF_EXECINSTR = 0x4;
+    constexpr uint64_t SHF_INFO_LINK = 0x40;
+
+    constexpr uint8_t STB_LOCAL = 0;
+    constexpr uint8_t STB_GLOBAL = 1;
+    constexpr uint8_t STT_NOTYPE = 0;
+    constexpr uint8_t STT_OBJECT = 1;
+    constexpr uint8_t STT_FUNC = 2;
+    constexpr uint8_t STT_SECTION = 3;
+
+    constexpr size_t SECTION_COUNT = static_cast<size_t>(elf_section::COUNT);
+
+    // Section header indices. Contents first, one relocation section per content section, then the tables.
+    constexpr uint16_t content_index(const size_t section) { return static_cast<uint16_t>(1 + section); }
+    constexpr uint16_t RELA_BEGIN = 1 + SECTION_COUNT;
+    constexpr uint16_t SYMTAB_INDEX = RELA_BEGIN + SECTION_COUNT;
+    constexpr uint16_t STRTAB_INDEX = SYMTAB_INDEX + 1;
+    constexpr uint16_t SHSTRTAB_INDEX = STRTAB_INDEX + 1;
+    constexpr uint16_t STACK_NOTE_INDEX = SHSTRTAB_INDEX + 1;
+    constexpr uint16_t HEADER_COUNT = STACK_NOTE_INDEX + 1;
+
+    const char* const SECTION_NAME_LIST[] = { ".text", ".data", ".bss", ".rodata" };
+    const uint64_t SECTION_FLAG_LIST[] = { SHF_ALLOC | SHF_EXECINSTR, SHF_ALLOC | SHF_WRITE, SHF_ALLOC | SHF_WRITE, SHF_ALLOC };
+
+    inline uint64_t align_up(const uint64_t value, const uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    struct string_table {
+        std::string buffer = std::string(1, '\0');
+
+        uint32_t add(const std::string& name) {
+            const uint32_t at = static_cast<uint32_t>(buffer.size());
+            buffer += name;
+            buffer += '\0';
+            return at;
+        }
+    };
+
+    struct writer {
+        std::vector<uint8_t> buffer;
+        size_t at = 0;
+
+        inline void write(const void* source, const size_t size) {
+            if (size > 0)
+                std::memcpy(buffer.data() + at, source, size);
+
+            at += size;
+        }
+
+        inline void pad_to(const size_t offset) {
+            at = offset; // The buffer starts zeroed
+        }
+    };
+}
+
+uint64_t elf_object::align(const elf_section section, const uint64_t alignment) {
+    if (section == elf_section::BSS) {
+        bss_size = align_up(bss_size, alignment);
+        return bss_size;
+    }
+
+    std::vector<uint8_t>& bytes = data(section);
+    bytes.resize(align_up(bytes.size(), alignment), section == elf_section::TEXT ? 0xCC : 0); // int3 between functions
+    return bytes.size();
+}
+
+uint32_t elf_object::add_symbol(const std::string& name, const elf_section section, const uint64_t value, const uint64_t size, const bool is_global, const bool is_function) {
+    auto found = symbol_map.find(name);
+
+    // Defining a symbol that was referenced before keeps its index.
+    if (found != symbol_map.end()) {
+        symbol_list[found->second] = { name, section, value, size, is_global, is_function };
+        return found->second;
+    }
+
+    const uint32_t index = static_cast<uint32_t>(symbol_list.size());
+
+    symbol_list.push_back({ name, section, value, size, is_global, is_function });
+    symbol_map.emplace(name, index);
+
+    return index;
+}
+
+uint32_t elf_object::reference(const std::string& name) {
+    auto found = symbol_map.find(name);
+
+    if (found != symbol_map.end())
+        return found->second;
+
+    return add_symbol(name, elf_section::UNDEFINED, 0, 0, true, false);
+}
+
+std::vector<uint8_t> elf_object::serialize() const {
+    // Symbols: null, one per section, then locals, then globals.
+    std::vector<uint32_t> final_index(symbol_list.size());
+    uint32_t next = 1 + SECTION_COUNT;
+
+    for (size_t i = 0; i < symbol_list.size(); i++) {
+        if (!symbol_list[i].is_global)
+            final_index[i] = next++;
+    }
+
+    const uint32_t first_global = next;
+
+    for (size_t i = 0; i < symbol_list.size(); i++) {
+        if (symbol_list[i].is_global)
+            final_index[i] = next++;
+    }
+
+    string_table strings;
+    std::vector<elf64_symbol> symbol_table(next, elf64_symbol{});
+
+    for (size_t s = 0; s < SECTION_COUNT; s++)
+        symbol_table[1 + s] = { 0, static_cast<uint8_t>(STB_LOCAL << 4 | STT_SECTION), 0, content_index(s), 0, 0 };
+
+    for (size_t i = 0; i < symbol_list.size(); i++) {
+        const elf_symbol& symbol = symbol_list[i];
+        const bool is_defined = symbol.section != elf_section::UNDEFINED;
+        const uint8_t type = !is_defined ? STT_NOTYPE : symbol.is_function ? STT_FUNC : STT_OBJECT;
+
+        symbol_table[final_index[i]] = {
+            strings.add(symbol.name),
+            static_cast<uint8_t>((symbol.is_global ? STB_GLOBAL : STB_LOCAL) << 4 | type),
+            0,
+            static_cast<uint16_t>(is_defined ? content_index(static_cast<size_t>(symbol.section)) : 0),
+            symbol.value,
+            symbol.size,
+        };
+    }
+
+    std::vector<elf64_rela> rela_list[SECTION_COUNT];
+
+    for (const elf_relocation& relocation : relocation_list) {
+        const uint64_t symbol = relocation.symbol >= SECTION_SYMBOL ? 1 + (relocation.symbol - SECTION_SYMBOL) : final_index[relocation.symbol];
+        rela_list[static_cast<size_t>(relocation.section)].push_back({ relocation.offset, symbol << 32 | relocation.type, relocation.addend });
+    }
+
+    string_table section_names;
+    elf64_section_header header_list[HEADER_COUNT] = {};
+
+    // Offsets of everything, in file order.
+    uint64_t offset = sizeof(elf64_header);
+
+    for (size_t s = 0; s < SECTION_COUNT; s++) {
+        elf64_section_header& header = header_list[content_index(s)];
+        const bool is_bss = static_cast<elf_section>(s) == elf_section::BSS;
+
+        offset = align_up(offset, alignment_list[s]);
+
+        header = { section_names.add(SECTION_NAME_LIST[s]), is_bss ? SHT_NOBITS : SHT_PROGBITS, SECTION_FLAG_LIST[s], 0, offset, is_bss ? bss_size : data_list[s].size(), 0, 0, alignment_list[s], 0 };
+
+        if (!is_bss)
+            offset += data_list[s].size();
+    }
+
+    offset = align_up(offset, 8);
+
+    for (size_t s = 0; s < SECTION_COUNT; s++) {
+        const uint64_t size = rela_list[s].size() * sizeof(elf64_rela);
+
+        header_list[RELA_BEGIN + s] = { section_names.add(std::string(".rela") + SECTION_NAME_LIST[s]), SHT_RELA, SHF_INFO_LINK, 0, offset, size, SYMTAB_INDEX, content_index(s), 8, sizeof(elf64_rela) };
+        offset += size;
+    }
+
+    const uint64_t symtab_size = symbol_table.size() * sizeof(elf64_symbol);
+    header_list[SYMTAB_INDEX] = { section_names.add(".symtab"), SHT_SYMTAB, 0, 0, offset, symtab_size, STRTAB_INDEX, first_global, 8, sizeof(elf64_symbol) };
+    offset += symtab_size;
+
+    header_list[STRTAB_INDEX] = { section_names.add(".strtab"), SHT_STRTAB, 0, 0, offset, strings.buffer.size(), 0, 0, 1, 0 };
+    offset += strings.buffer.size();
+
+    // Without it linkers assume the stack has to be executable.
+    header_list[STACK_NOTE_INDEX] = { section_names.add(".note.GNU-stack"), SHT_PROGBITS, 0, 0, offset, 0, 0, 0, 1, 0 };
+
+    const uint32_t shstrtab_name = section_names.add(".shstrtab");
+    header_list[SHSTRTAB_INDEX] = { shstrtab_name, SHT_STRTAB, 0, 0, offset, section_names.buffer.size(), 0, 0, 1, 0 };
+    offset += section_names.buffer.size();
+
+    offset = align_up(offset, 8);
+    const uint64_t section_header_offset = offset;
+    offset += sizeof(header_list);
+
+    elf64_header header = {};
+    const uint8_t ident[] = { 0x7F, 'E', 'L', 'F', 2 /* 64 bit */, 1 /* little endian */, 1 /* version */ };
+    std::memcpy(header.ident, ident, sizeof(ident));
+
+    header.type = 1; // Relocatable
+    header.machine = 62; // x86-64
+    header.version = 1;
+    header.section_header_offset = section_header_offset;
+    header.header_size = sizeof(elf64_header);
+    header.section_header_size = sizeof(elf64_section_header);
+    header.section_header_count = HEADER_COUNT;
+    header.section_name_index = SHSTRTAB_INDEX;
+
+    writer out;
+    out.buffer.assign(offset, 0);
+
+    out.write(&header, sizeof(header));
+
+    for (size_t s = 0; s < SECTION_COUNT; s++) {
+        if (static_cast<elf_section>(s) == elf_section::BSS)
+            continue;
+
+        out.pad_to(header_list[content_index(s)].offset);
+        out.write(data_list[s].data(), data_list[s].size());
+    }
+
+    for (size_t s = 0; s < SECTION_COUNT; s++) {
+        out.pad_to(header_list[RELA_BEGIN + s].offset);
+        out.write(rela_list[s].data(), rela_list[s].size() * sizeof(elf64_rela));
+    }
+
+    out.write(symbol_table.data(), symtab_size);
+    out.write(strings.buffer.data(), strings.buffer.size());
+    out.write(section_names.buffer.data(), section_names.buffer.size());
+
+    out.pad_to(section_header_offset);
+    out.write(header_list, sizeof(header_list));
+
+    return std::move(out.buffer);
+}
@@ -1,12 +1,1230 @@
+#include <cctype>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <sstream>
+
 #include "core.hh"
 #include "ast.hh"
+#include "symbol.hh"
+#include "constant.hh"
+#include "interface.hh"
+#include "ir.hh"
+#include "native.hh"
+#include "util.hh"
+
+using namespace core::ast;
+using namespace core::semantic;
+using namespace core::backend;
+
+/*
+
+====================================================
+
+C generation
+Every parsed file becomes one translation unit of portable C99 in the output path, next to its
+interface: a header with its structs, enums, globals and prototypes, and a source file with the
+definitions. Modules are name prefixes, so 'math::add' in main.lican is main__math__add.
+
+Function bodies are translated from the IR, one label per block and one local per value. Integer
+arithmetic goes through an unsigned type of the same width or wider, so it wraps exactly like the
+VM does instead of being undefined. Whatever the VM traps on calls into lican_runtime.h instead.
+
+Units are generated in parallel, and then the bodies of the functions of every unit together, each
+into a buffer of its own that goes back where the function is declared once all of them are done. A
+unit is the same byte for byte however many threads made it. The first line of a unit holds the hash of everything after it,
+and a unit whose hash did not change is not written again, so the C compiler and make-like tools
+see the old timestamp. With -n the units are compiled with the system C compiler, again only when
+something they include is newer than their object file, and linked into an executable.
+
+====================================================
+
+*/
+
+constexpr const char* RUNTIME_NAME = "lican_runtime.h";
+
+static const char* const RUNTIME_SOURCE = R"(/* Runtime of C generated by the lican compiler. */
+#ifndef LICAN_RUNTIME_H
+#define LICAN_RUNTIME_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+    #define LICAN_NORETURN __attribute__((noreturn))
+#else
+    #define LICAN_NORETURN
+#endif
+
+static LICAN_NORETURN void lican_trap(const char* message) {
+    fputs(message, stderr);
+    fputc('\n', stderr);
+    exit(1);
+}
+
+#define LICAN_UNSIGNED_DIVISION(T, NAME) \
+    static inline T lican_div_##NAME(T x, T y) { if (y == 0) lican_trap("Division by zero."); return (T)(x / y); } \
+    static inline T lican_mod_##NAME(T x, T y) { if (y == 0) lican_trap("Division by zero."); return (T)(x % y); }
+
+/* Dividing by -1 negates, which wraps instead of overflowing. */
+#define LICAN_SIGNED_DIVISION(T, NAME) \
+    static inline T lican_div_##NAME(T x, T y) { if (y == 0) lican_trap("Division by zero."); return y == -1 ? (T)(0u - (uint64_t)x) : (T)(x / y); } \
+    static inline T lican_mod_##NAME(T x, T y) { if (y == 0) lican_trap("Division by zero."); return y == -1 ? (T)0 : (T)(x % y); }
+
+LICAN_SIGNED_DIVISION(int8_t, i8)
+LICAN_SIGNED_DIVISION(int16_t, i16)
+LICAN_SIGNED_DIVISION(int32_t, i32)
+LICAN_SIGNED_DIVISION(int64_t, i64)
+LICAN_UNSIGNED_DIVISION(uint8_t, u8)
+LICAN_UNSIGNED_DIVISION(uint16_t, u16)
+LICAN_UNSIGNED_DIVISION(uint32_t, u32)
+LICAN_UNSIGNED_DIVISION(uint64_t, u64)
+
+static inline uint64_t lican_pow(uint64_t base, uint64_t exponent) {
+    uint64_t result = 1;
+
+    while (exponent) {
+        if (exponent & 1)
+            result *= base;
+
+        base *= base;
+        exponent >>= 1;
+    }
+
+    return result;
+}
+
+static inline uint64_t lican_pow_signed(int64_t base, int64_t exponent) {
+    if (exponent < 0)
+        lican_trap("Integer raised to a negative power.");
+
+    return lican_pow((uint64_t)base, (uint64_t)exponent);
+}
+
+/* Floats that do not fit the integer they are converted to become 0. */
+static inline int64_t lican_f2i(double value) {
+    return value >= -9223372036854775808.0 && value < 9223372036854775808.0 ? (int64_t)value : 0;
+}
+
+static inline uint64_t lican_f2u(double value) {
+    return value >= 0 && value < 18446744073709551616.0 ? (uint64_t)value : 0;
+}
+
+#endif
+)";
+
+static const char* const C_KEYWORD_LIST[] = {
+    "auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else", "enum",
+    "extern", "float", "for", "goto", "if", "inline", "int", "long", "register", "restrict", "return",
+    "short", "signed", "sizeof", "static", "struct", "switch", "typedef", "union", "unsigned", "void",
+    "volatile", "while", "bool", "true", "false", "self",
+};
+
+static inline const symbol_table& file_table(const core::liprocess& process, const core::t_file_id file_id) {
+    return *std::any_cast<const t_symbol_table_ptr&>(process.file_list[file_id].dump_symbol_table);
+}
+
+static std::string member_name(const std::string& name) {
+    for (const char* keyword : C_KEYWORD_LIST) {
+        if (name == keyword)
+            return name + '_';
+    }
+
+    return name;
+}
+
+static bool lower_kind(const type_kind kind, ir_type& result) {
+    switch (kind) {
+        case type_kind::U8: result = ir_type::U8; return true;
+        case type_kind::U16: result = ir_type::U16; return true;
+        case type_kind::U32: result = ir_type::U32; return true;
+        case type_kind::U64: result = ir_type::U64; return true;
+        case type_kind::I8: result = ir_type::I8; return true;
+        case type_kind::I16: result = ir_type::I16; return true;
+        case type_kind::I32: result = ir_type::I32; return true;
+        case type_kind::I64: result = ir_type::I64; return true;
+        case type_kind::F32: result = ir_type::F32; return true;
+        case type_kind::F64: result = ir_type::F64; return true;
+        case type_kind::BOOL: result = ir_type::BOOL; return true;
+        default: return false;
+    }
+}
+
+static const char* c_type_of(const ir_type type) {
+    switch (type) {
+        case ir_type::VOID: return "void";
+        case ir_type::BOOL: return "bool";
+        case ir_type::I8: return "int8_t";
+        case ir_type::I16: return "int16_t";
+        case ir_type::I32: return "int32_t";
+        case ir_type::I64: return "int64_t";
+        case ir_type::U8: return "uint8_t";
+        case ir_type::U16: return "uint16_t";
+        case ir_type::U32: return "uint32_t";
+        case ir_type::U64: return "uint64_t";
+        case ir_type::F32: return "float";
+        case ir_type::F64: return "double";
+        case ir_type::PTR: return "void*";
+    }
+
+    UNREACHABLE();
+}
+
+// The unsigned type integer arithmetic of a width is done in, so overflow wraps.
+static inline const char* wide_type_of(const ir_type type) {
+    return bit_width(type) > 32 ? "uint64_t" : "uint32_t";
+}
+
+static std::string literal(const ir_type type, const uint64_t bits) {
+    const std::string cast = std::string("(") + c_type_of(type) + ")";
+
+    switch (type) {
+        case ir_type::BOOL:
+            return bits ? "true" : "false";
+        case ir_type::PTR:
+            return "((void*)0)";
+        case ir_type::F32:
+        case ir_type::F64: {
+            double value;
+            std::memcpy(&value, &bits, sizeof(double));
+
+            if (std::isnan(value))
+                return cast + "NAN";
+
+            if (std::isinf(value))
+                return cast + (value < 0 ? "-HUGE_VAL" : "HUGE_VAL");
+
+            // Hexadecimal floats are exact.
+            char buffer[64];
+            std::snprintf(buffer, sizeof(buffer), "%a", value);
+
+            return cast + buffer;
+        }
+        default:
+            break;
+    }
+
+    if (is_signed(type)) {
+        const int64_t value = static_cast<int64_t>(bits);
+
+        if (value == INT64_MIN)
+            return cast + "INT64_MIN";
+
+        return cast + "INT64_C(" + std::to_string(value) + ")";
+    }
+
+    return cast + "UINT64_C(" + std::to_string(bits) + ")";
+}
+
+// A function body, generated apart from its unit so the bodies of a build can be spread over the
+// worker pool.
+struct function_body {
+    const ir_function* function;
+    size_t offset; // Where it goes in the definitions of its unit
+
+    std::string text;
+    std::set<core::t_file_id> include_set;
+};
 
 struct generate_state {
     generate_state(core::liprocess& process, const core::t_file_id file_id)
-        : process(process), file_id(file_id), ast(*(std::any_cast<const std::unique_ptr<core::ast::ast_root>&>(process.file_list[file_id].dump_ast_arena))) {}
+        : process(process), file_id(file_id), ast(std::any_cast<const ast_arena&>(process.file_list[file_id].dump_ast_arena)), table(file_table(process, file_id)),
+        types(*std::any_cast<const t_type_table_ptr&>(process.dump_type_table)), module(*std::any_cast<const t_ir_module_ptr&>(process.file_list[file_id].dump_ir_module)),
+        prefix(unit_prefix(process, file_id)) {}
 
     core::liprocess& process;
-
     const core::t_file_id file_id;
-    const core::ast::ast_root& ast;
-};
\ No newline at end of file
+
+    const ast_arena& ast;
+    const symbol_table& table;
+    type_table& types;
+    const ir_module& module;
+
+    const std::string prefix;
+
+    std::vector<core::lilog> log_list; // Merged into the process once every unit is done
+
+    std::set<core::t_file_id> include_set; // Other units whose names are used
+
+    // Sections of the header, in order.
+    std::string type_declarations;
+    std::string struct_definitions;
+    std::string declarations;
+
+    std::string global_definitions;
+    std::string definitions;
+
+    std::vector<function_body> body_list; // In declaration order
+
+    bool has_entry = false; // Defines the C main
+
+    std::vector<const symbol*> struct_list; // Non-generic structs, in declaration order
+    std::vector<uint8_t> struct_state_list; // 0 not emitted, 1 being emitted, 2 done
+
+    inline void warning(const t_node_id node, const std::string& message) {
+        log_list.emplace_back(core::lilog::log_level::WARNING, core::lisel(file_id, ast.get_base_ptr(node)->selection.start), message);
+    }
+
+    inline const std::string& name_of(const core::t_name_id name) const {
+        return process.name_table.get(name);
+    }
+
+    // Module level name of a symbol of any file.
+    std::string mangle(const symbol* declared) {
+        if (declared->file_id != file_id)
+            include_set.insert(declared->file_id);
+
+        return link_name(process, declared);
+    }
+
+    // Anything C can not name directly, like generic structs and functions as values, is an opaque pointer.
+    std::string c_type(const t_type_id id) {
+        if (id == NO_TYPE)
+            return "void*";
+
+        const type_entry& entry = types.get(id);
+        ir_type lowered;
+
+        // A move of a scalar is a copy of it, the way lowering passes '&&' ones.
+        if ((entry.flags & TYPE_RVALUE) && !(entry.flags & TYPE_LVALUE) && lower_kind(entry.kind, lowered))
+            return c_type_of(lowered);
+
+        if (entry.flags & (TYPE_LVALUE | TYPE_RVALUE))
+            return c_type(entry.base) + "*";
+
+        if (lower_kind(entry.kind, lowered))
+            return c_type_of(lowered);
+
+        switch (entry.kind) {
+            case type_kind::CHAR: return "char";
+            case type_kind::STRING: return "const char*";
+            case type_kind::VOID: return "void";
+            case type_kind::ENUM: return mangle(entry.source);
+            case type_kind::POINTER: return c_type(entry.argument_list[0]) + "*";
+            case type_kind::STRUCT:
+                if (entry.argument_count == 0 && entry.source->template_count == 0)
+                    return mangle(entry.source);
+                return "void*";
+            default:
+                return "void*";
+        }
+    }
+
+    bool is_scalar(const t_type_id id) const {
+        return id == NO_TYPE || types.get(id).flags != 0 || types.get(id).kind != type_kind::STRUCT;
+    }
+
+    std::string constant_literal(const constant& folded) {
+        ir_type type;
+        return lower_kind(folded.kind, type) ? literal(type, constant_bits(folded)) : "0";
+    }
+
+    // 'R name(A0 p0, A1 p1)' for a function type. Parameters are named by position.
+    std::string signature(const std::string& name, const t_type_id function_type, const std::string& self = "") {
+        const type_entry& entry = types.get(function_type);
+        const uint16_t parameter_count = entry.argument_count - 1;
+
+        std::string buffer = (self.empty() ? c_type(entry.argument_list[parameter_count]) : "void") + ' ' + name + '(' + self;
+
+        for (uint16_t i = 0; i < parameter_count; i++) {
+            if (i > 0 || !self.empty())
+                buffer += ", ";
+
+            buffer += c_type(entry.argument_list[i]) + " p" + std::to_string(i);
+        }
+
+        if (parameter_count == 0 && self.empty())
+            buffer += "void";
+
+        return buffer + ')';
+    }
+
+    /*
+
+    ====================================================
+
+    Declarations
+
+    ====================================================
+
+    */
+
+    void collect(const t_node_id id) {
+        switch (ast.get_base_ptr(id)->type) {
+            case node_type::ITEM_MODULE:
+                collect(ast.get_as<item_module>(id).content);
+                break;
+            case node_type::ITEM_BODY:
+                for (const t_node_id item : ast.get_as<item_body>(id).item_list)
+                    collect(item);
+                break;
+            case node_type::ITEM_STRUCT_DECLARATION: {
+                const symbol* declared = table.resolution(id);
+
+                if (declared && declared->template_count == 0) {
+                    type_declarations += "typedef struct " + mangle(declared) + ' ' + mangle(declared) + ";\n";
+                    struct_list.push_back(declared);
+                }
+                break;
+            }
+            case node_type::ITEM_ENUM:
+                add_enum(id);
+                break;
+            case node_type::VARIANT_DECLARATION: {
+                const symbol* declared = table.resolution(id);
+
+                if (!declared)
+                    break;
+
+                if (declared->kind == symbol_kind::FUNCTION)
+                    add_function(id, declared);
+                else if (declared->kind == symbol_kind::VARIANT)
+                    add_global(id, declared);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    // Enums are plain integers. Sets without a value count up from the one before, like in C.
+    void add_enum(const t_node_id id) {
+        const symbol* declared = table.resolution(id);
+
+        if (!declared)
+            return;
+
+        const std::string name = mangle(declared);
+        std::string set_buffer;
+
+        for (const t_node_id set_id : ast.get_as<item_enum>(id).set_list) {
+            const symbol* set = table.resolution(set_id);
+
+            if (!set || ast.get_base_ptr(set_id)->type != node_type::EXPR_ENUM_SET)
+                continue;
+
+            set_buffer += "    " + name + "__" + name_of(set->name);
+
+            const t_node_id value = ast.get_as<expr_enum_set>(set_id).value;
+
+            if (ast.get_base_ptr(value)->type != node_type::EXPR_NONE) {
+                const constant* folded = table.constant_map.find(static_cast<uint32_t>(value));
+
+                if (folded && !core::semantic::is_floating(folded->kind))
+                    set_buffer += " = " + (folded->kind == type_kind::BOOL ? std::to_string(folded->b) : std::to_string(folded->i));
+                else
+                    warning(value, "The value of '" + name_of(set->name) + "' is not a constant integer, so C counts on from the set before it.");
+            }
+
+            set_buffer += ",\n";
+        }
+
+        type_declarations += "typedef int64_t " + name + ";\n";
+
+        if (!set_buffer.empty())
+            type_declarations += "enum {\n" + set_buffer + "};\n";
+    }
+
+    void add_global(const t_node_id id, const symbol* declared) {
+        const variant_declaration& declaration = ast.get_as<variant_declaration>(id);
+        const constant* folded = nullptr;
+
+        if (ast.get_base_ptr(declaration.value)->type != node_type::EXPR_NONE) {
+            folded = table.constant_map.find(static_cast<uint32_t>(declaration.value));
+
+            if (!folded)
+                warning(declaration.value, "Only constant initializers are generated to C so far. '" + name_of(declared->name) + "' starts out as zero.");
+        }
+
+        std::string type;
+        ir_type folded_type;
+
+        if (declared->type == NO_TYPE && folded && lower_kind(folded->kind, folded_type))
+            type = c_type_of(folded_type);
+        else
+            type = c_type(declared->type);
+
+        const std::string name = mangle(declared);
+
+        declarations += "extern " + type + ' ' + name + ";\n";
+        global_definitions += type + ' ' + name + " = " + (folded ? constant_literal(*folded) : is_scalar(declared->type) ? "0" : "{0}") + ";\n";
+    }
+
+    /*
+
+    ====================================================
+
+    Structs
+
+    ====================================================
+
+    */
+
+    // Structs held by value have to be complete first, so those of this unit go out in dependency order.
+    void emit_struct(const size_t index) {
+        if (struct_state_list[index] != 0)
+            return;
+
+        struct_state_list[index] = 1;
+
+        const symbol* declared = struct_list[index];
+        const item_struct_declaration& declaration = ast.get_as<item_struct_declaration>(declared->node);
+
+        std::string field_buffer;
+
+        for (const t_node_id member : declaration.member_list) {
+            if (ast.get_base_ptr(member)->type != node_type::EXPR_PROPERTY)
+                continue;
+
+            const symbol* property = table.resolution(member);
+
+            if (!property)
+                continue;
+
+            if (!is_scalar(property->type)) {
+                const symbol* held = types.get(property->type).source;
+
+                for (size_t i = 0; i < struct_list.size(); i++) {
+                    if (struct_list[i] == held)
+                        emit_struct(i);
+                }
+            }
+
+            field_buffer += "    " + c_type(property->type) + ' ' + member_name(name_of(property->name)) + ";\n";
+        }
+
+        // Empty structs are not C.
+        if (field_buffer.empty())
+            field_buffer = "    char lican_empty;\n";
+
+        struct_definitions += (struct_definitions.empty() ? "struct " : "\nstruct ") + mangle(declared) + " {\n" + field_buffer + "};\n";
+        struct_state_list[index] = 2;
+
+        add_lifetime(declared, declaration);
+    }
+
+    // Constructors assign property defaults, then their initializers. Only constants and parameters
+    // can be generated there so far, and bodies not at all.
+    void add_lifetime(const symbol* declared, const item_struct_declaration& declaration) {
+        const std::string name = mangle(declared);
+        size_t constructor_count = 0;
+
+        std::string defaults;
+
+        for (const t_node_id member : declaration.member_list) {
+            if (ast.get_base_ptr(member)->type != node_type::EXPR_PROPERTY)
+                continue;
+
+            const expr_property& property = ast.get_as<expr_property>(member);
+            const symbol* declared_property = table.resolution(member);
+
+            if (!declared_property || ast.get_base_ptr(property.default_value)->type == node_type::EXPR_NONE)
+                continue;
+
+            if (const constant* folded = table.constant_map.find(static_cast<uint32_t>(property.default_value)))
+                defaults += "    self->" + member_name(name_of(declared_property->name)) + " = " + constant_literal(*folded) + ";\n";
+            else
+                warning(property.default_value, "Only constant defaults are generated to C so far.");
+        }
+
+        for (const t_node_id member : declaration.member_list) {
+            switch (ast.get_base_ptr(member)->type) {
+                case node_type::EXPR_CONSTRUCTOR: {
+                    const expr_constructor& constructor = ast.get_as<expr_constructor>(member);
+                    const t_type_id function_type = table.type_of(constructor.function);
+
+                    if (function_type == NO_TYPE)
+                        break;
+
+                    const std::string constructor_name = name + "__ctor" + std::to_string(constructor_count++);
+                    const std::string head = signature(constructor_name, function_type, name + "* self");
+
+                    declarations += head + ";\n";
+                    definitions += '\n' + head + " {\n" + defaults;
+
+                    const expr_function& function = ast.get_as<expr_function>(constructor.function);
+
+                    for (const t_node_id set_id : constructor.initializer_list) {
+                        const expr_initializer_set& set = ast.get_as<expr_initializer_set>(set_id);
+                        const symbol* property = table.resolution(set.property_name);
+
+                        if (!property)
+                            continue;
+
+                        std::string value;
+
+                        if (const constant* folded = table.constant_map.find(static_cast<uint32_t>(set.value)))
+                            value = constant_literal(*folded);
+                        else if (const symbol* read = table.resolution(set.value); read && read->kind == symbol_kind::PARAMETER) {
+                            for (size_t i = 0; i < function.parameter_list.size(); i++) {
+                                if (function.parameter_list[i] == read->node)
+                                    value = 'p' + std::to_string(i);
+                            }
+                        }
+
+                        if (value.empty()) {
+                            warning(set.value, "Only constants and parameters can initialize properties in C so far.");
+                            continue;
+                        }
+
+                        definitions += "    self->" + member_name(name_of(property->name)) + " = " + value + ";\n";
+                    }
+
+                    if (!is_empty_body(function.body)) {
+                        warning(member, "Constructor bodies are not generated to C yet. This one traps.");
+                        definitions += "    lican_trap(\"A constructor body of '" + name_of(declared->name) + "' can not run in C yet.\");\n";
+                    }
+
+                    definitions += "}\n";
+                    break;
+                }
+                case node_type::EXPR_DESTRUCTOR: {
+                    const std::string head = "void " + name + "__dtor(" + name + "* self)";
+
+                    declarations += head + ";\n";
+                    definitions += '\n' + head + " {\n    (void)self;\n";
+
+                    if (!is_empty_body(ast.get_as<expr_destructor>(member).body)) {
+                        warning(member, "Destructor bodies are not generated to C yet. This one traps.");
+                        definitions += "    lican_trap(\"The destructor of '" + name_of(declared->name) + "' can not run in C yet.\");\n";
+                    }
+
+                    definitions += "}\n";
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+
+    bool is_empty_body(const t_node_id body) const {
+        const node_type type = ast.get_base_ptr(body)->type;
+        return type == node_type::EXPR_NONE || (type == node_type::ITEM_BODY && ast.get_as<item_body>(body).item_list.empty());
+    }
+
+    /*
+
+    ====================================================
+
+    Functions
+
+    ====================================================
+
+    */
+
+    void add_function(const t_node_id id, const symbol* declared) {
+        if (declared->template_count != 0 || declared->type == NO_TYPE)
+            return;
+
+        const ir_function* function = module.find(declared);
+
+        if (!function)
+            return;
+
+        const std::string head = signature(mangle(declared), declared->type);
+
+        declarations += head + ";\n";
+        definitions += '\n' + head + " {\n";
+
+        if (function->complete)
+            body_list.push_back({ function, definitions.size(), {}, {} });
+        else {
+            warning(id, "'" + function->name + "' uses something C generation does not support yet. It traps when called.");
+            definitions += "    lican_trap(\"'" + function->name + "' can not run in C yet.\");\n";
+        }
+
+        definitions += "}\n";
+    }
+
+    // Lifted closures take their environment after their parameters, so their signature is the one
+    // of their IR. Only complete ones make it into a module.
+    void add_closure(const ir_function& function) {
+        std::string head = std::string(c_type_of(function.return_type)) + ' ' + mangle(function.source) + '(';
+
+        for (size_t i = 0; i < function.parameter_type_list.size(); i++)
+            head += (i > 0 ? ", " : "") + std::string(c_type_of(function.parameter_type_list[i])) + " p" + std::to_string(i);
+
+        head += function.parameter_type_list.empty() ? "void)" : ")";
+
+        declarations += head + ";\n";
+        definitions += '\n' + head + " {\n";
+
+        body_list.push_back({ &function, definitions.size(), {}, {} });
+
+        definitions += "}\n";
+    }
+
+    inline std::string value(const t_value_id id) const {
+        return 'v' + std::to_string(id);
+    }
+
+    // mangle for bodies, which only ever touch their own buffer.
+    std::string body_name(function_body& body, const symbol* declared) const {
+        if (declared->file_id != file_id)
+            body.include_set.insert(declared->file_id);
+
+        return link_name(process, declared);
+    }
+
+    // Copies the phis of to take on the edge from from. All of them read before any is written.
+    std::string edge_copies(const ir_function& function, const t_block_id from, const t_block_id to, const char* indent) const {
+        std::vector<std::pair<t_value_id, t_value_id>> copy_list;
+
+        for (t_value_id at = function.block_list[to].first; at != NO_VALUE && function.at(at).op == opcode::PHI; at = function.at(at).next) {
+            const uint32_t* operands = function.operands(at);
+
+            for (uint16_t i = 0; i < function.at(at).operand_count; i += 2) {
+                if (operands[i] == from && operands[i + 1] != at)
+                    copy_list.emplace_back(at, operands[i + 1]);
+            }
+        }
+
+        if (copy_list.size() == 1)
+            return indent + value(copy_list[0].first) + " = " + value(copy_list[0].second) + ";\n";
+
+        std::string buffer;
+
+        for (size_t i = 0; i < copy_list.size(); i++)
+            buffer += std::string(indent) + c_type_of(function.at(copy_list[i].first).type) + " t" + std::to_string(i) + " = " + value(copy_list[i].second) + ";\n";
+
+        for (size_t i = 0; i < copy_list.size(); i++)
+            buffer += indent + value(copy_list[i].first) + " = t" + std::to_string(i) + ";\n";
+
+        return copy_list.empty() ? buffer : std::string(indent) + "{\n" + buffer + indent + "}\n";
+    }
+
+    std::string arithmetic(const instruction& at, const uint32_t* operands) const {
+        const std::string x = value(operands[0]);
+        const std::string y = at.operand_count > 1 ? value(operands[1]) : "";
+        const ir_type type = at.type;
+        const std::string cast = std::string("(") + c_type_of(type) + ")";
+
+        if (is_floating(type)) {
+            switch (at.op) {
+                case opcode::NEG: return "-" + x;
+                case opcode::ADD: return x + " + " + y;
+                case opcode::SUB: return x + " - " + y;
+                case opcode::MUL: return x + " * " + y;
+                case opcode::DIV: return x + " / " + y;
+                case opcode::MOD: return cast + "fmod(" + x + ", " + y + ")";
+                case opcode::POW: return cast + "pow(" + x + ", " + y + ")";
+                default: UNREACHABLE();
+            }
+        }
+
+        const std::string wide = std::string("(") + wide_type_of(type) + ")";
+
+        switch (at.op) {
+            case opcode::NEG: return cast + "(0u - " + wide + x + ")";
+            case opcode::ADD: return cast + "(" + wide + x + " + " + wide + y + ")";
+            case opcode::SUB: return cast + "(" + wide + x + " - " + wide + y + ")";
+            case opcode::MUL: return cast + "(" + wide + x + " * " + wide + y + ")";
+            case opcode::DIV: return std::string("lican_div_") + type_name(type) + "(" + x + ", " + y + ")";
+            case opcode::MOD: return std::string("lican_mod_") + type_name(type) + "(" + x + ", " + y + ")";
+            case opcode::POW:
+                if (is_signed(type))
+                    return cast + "lican_pow_signed(" + x + ", " + y + ")";
+                return cast + "lican_pow(" + x + ", " + y + ")";
+            default: UNREACHABLE();
+        }
+    }
+
+    std::string conversion(const ir_function& function, const instruction& at, const t_value_id operand) const {
+        const ir_type from = function.at(operand).type;
+        const ir_type to = at.type;
+        const std::string x = value(operand);
+
+        if (to == ir_type::BOOL)
+            return x + " != 0";
+
+        if (is_floating(from) && !is_floating(to))
+            return std::string("(") + c_type_of(to) + ")" + (is_signed(to) ? "lican_f2i(" : "lican_f2u(") + x + ")";
+
+        // Through double, like the VM, so integers round the same way on their way to f32.
+        if (to == ir_type::F32 && !is_floating(from))
+            return "(float)(double)" + x;
+
+        return std::string("(") + c_type_of(to) + ")" + x;
+    }
+
+    static const char* comparison(const opcode op) {
+        switch (op) {
+            case opcode::EQ: return " == ";
+            case opcode::NE: return " != ";
+            case opcode::LT: return " < ";
+            case opcode::LE: return " <= ";
+            case opcode::GT: return " > ";
+            case opcode::GE: return " >= ";
+            default: UNREACHABLE();
+        }
+    }
+
+    // Runs on any worker, alongside bodies of this unit and others.
+    void emit_body(function_body& body) const {
+        const ir_function& function = *body.function;
+        std::string& out = body.text;
+
+        // Every value is a local declared up front, so gotos never jump over a declaration.
+        for (t_value_id id = 0; id < function.instruction_list.size(); id++) {
+            const instruction& at = function.at(id);
+
+            if (at.type == ir_type::VOID || at.op == opcode::NOP)
+                continue;
+
+            out += std::string("    ") + c_type_of(at.type) + ' ' + value(id) + " = ";
+
+            switch (at.op) {
+                case opcode::CONSTANT: out += literal(at.type, at.immediate); break;
+                case opcode::PARAMETER: out += 'p' + std::to_string(at.immediate); break;
+                default: out += '0'; break;
+            }
+
+            out += ";\n";
+        }
+
+        std::vector<bool> target_list(function.block_list.size(), false);
+
+        for (t_block_id block = 0; block < function.block_list.size(); block++) {
+            for (uint32_t i = 0; i < function.successor_count(block); i++)
+                target_list[function.successor(block, i)] = true;
+        }
+
+        for (t_block_id block = 0; block < function.block_list.size(); block++) {
+            if (function.block_list[block].is_removed)
+                continue;
+
+            if (target_list[block])
+                out += "b" + std::to_string(block) + ": ;\n";
+
+            for (t_value_id id = function.block_list[block].first; id != NO_VALUE; id = function.at(id).next) {
+                const instruction& at = function.at(id);
+                const uint32_t* operands = function.operands(id);
+
+                switch (at.op) {
+                    case opcode::NOP:
+                    case opcode::PARAMETER:
+                    case opcode::CONSTANT:
+                    case opcode::UNDEFINED:
+                    case opcode::PHI:
+                        break;
+                    case opcode::COPY:
+                        out += "    " + value(id) + " = " + value(operands[0]) + ";\n";
+                        break;
+                    case opcode::CONVERT:
+                        out += "    " + value(id) + " = " + conversion(function, at, operands[0]) + ";\n";
+                        break;
+                    case opcode::NOT:
+                        out += "    " + value(id) + " = !" + value(operands[0]) + ";\n";
+                        break;
+                    case opcode::NEG:
+                    case opcode::ADD:
+                    case opcode::SUB:
+                    case opcode::MUL:
+                    case opcode::DIV:
+                    case opcode::MOD:
+                    case opcode::POW:
+                        out += "    " + value(id) + " = " + arithmetic(at, operands) + ";\n";
+                        break;
+                    case opcode::EQ:
+                    case opcode::NE:
+                    case opcode::LT:
+                    case opcode::LE:
+                    case opcode::GT:
+                    case opcode::GE:
+                        out += "    " + value(id) + " = " + value(operands[0]) + comparison(at.op) + value(operands[1]) + ";\n";
+                        break;
+                    case opcode::LOAD_GLOBAL:
+                        out += "    " + value(id) + " = " + body_name(body, at.symbol) + ";\n";
+                        break;
+                    case opcode::STORE_GLOBAL:
+                        out += "    " + body_name(body, at.symbol) + " = " + value(operands[0]) + ";\n";
+                        break;
+                    case opcode::CALL: {
+                        std::string call = body_name(body, at.symbol) + '(';
+
+                        for (uint16_t i = 0; i < at.operand_count; i++)
+                            call += (i > 0 ? ", " : "") + value(operands[i]);
+
+                        out += "    " + (at.type == ir_type::VOID ? "" : value(id) + " = ") + call + ");\n";
+                        break;
+                    }
+                    case opcode::JUMP:
+                        out += edge_copies(function, block, at.target[0], "    ");
+                        out += "    goto b" + std::to_string(at.target[0]) + ";\n";
+                        break;
+                    case opcode::BRANCH: {
+                        const std::string copies = edge_copies(function, block, at.target[0], "        ");
+
+                        if (copies.empty())
+                            out += "    if (" + value(operands[0]) + ") goto b" + std::to_string(at.target[0]) + ";\n";
+                        else
+                            out += "    if (" + value(operands[0]) + ") {\n" + copies + "        goto b" + std::to_string(at.target[0]) + ";\n    }\n";
+
+                        out += edge_copies(function, block, at.target[1], "    ");
+                        out += "    goto b" + std::to_string(at.target[1]) + ";\n";
+                        break;
+                    }
+                    case opcode::RETURN:
+                        out += at.operand_count > 0 ? "    return " + value(operands[0]) + ";\n" : "    return;\n";
+                        break;
+                    case opcode::UNREACHABLE:
+                        out += "    lican_trap(\"'" + function.name + "' ended without returning a value.\");\n";
+                        break;
+                }
+            }
+        }
+    }
+
+    // The entry unit gets a C main when it declares a parameterless main at its top.
+    void add_entry() {
+        const symbol* entry = entry_function(process);
+
+        if (!entry)
+            return;
+
+        const type_entry& signature = types.get(entry->type);
+        ir_type result;
+        const bool is_status = lower_kind(types.get(signature.argument_list[0]).kind, result) && is_integer(result);
+
+        definitions += "\nint main(void) {\n";
+        definitions += is_status ? "    return (int)" + mangle(entry) + "();\n" : "    " + mangle(entry) + "();\n    return 0;\n";
+        definitions += "}\n";
+        has_entry = true;
+    }
+
+    /*
+
+    ====================================================
+
+    Units
+
+    ====================================================
+
+    */
+
+    void generate() {
+        for (const t_node_id item : ast.get_as<ast_root>(0).item_list)
+            collect(item);
+
+        for (const ir_function& function : module.function_list) {
+            if (is_closure(function.source))
+                add_closure(function);
+        }
+
+        struct_state_list.assign(struct_list.size(), 0);
+
+        for (size_t i = 0; i < struct_list.size(); i++)
+            emit_struct(i);
+
+        if (file_id == 0)
+            add_entry();
+    }
+
+    // Puts the bodies back in their functions once they are all generated.
+    void place_bodies() {
+        std::string buffer;
+        size_t at = 0;
+
+        for (function_body& body : body_list) {
+            buffer.append(definitions, at, body.offset - at);
+            buffer += body.text;
+            at = body.offset;
+
+            include_set.insert(body.include_set.begin(), body.include_set.end());
+        }
+
+        buffer.append(definitions, at, std::string::npos);
+        definitions = std::move(buffer);
+        body_list.clear();
+    }
+
+    std::string header() const {
+        std::string guard = "LICAN_UNIT_" + prefix + "_H";
+
+        for (char& c : guard)
+            c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+
+        std::string buffer = "#ifndef " + guard + "\n#define " + guard + "\n\n#include \"" + RUNTIME_NAME + "\"\n";
+
+        for (const core::t_file_id used : include_set)
+            buffer += "#include \"" + unit_include(process, used) + "\"\n";
+
+        for (const std::string* section : { &type_declarations, &struct_definitions, &declarations }) {
+            if (!section->empty())
+                buffer += '\n' + *section;
+        }
+
+        return buffer + "\n#endif\n";
+    }
+
+    std::string source() const {
+        return "#include \"" + unit_include(process, file_id) + "\"\n" + (global_definitions.empty() ? "" : '\n' + global_definitions) + definitions;
+    }
+};
+
+static std::string unit_head(const std::string& content) {
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "/* lican unit %016" PRIx64 " */\n", liutil::hash_bytes(content));
+    return buffer;
+}
+
+// Writes content unless the file already holds it. Returns false if writing failed.
+static bool write_unit(const std::string& path, const std::string& content, bool& is_written) {
+    const std::string head = unit_head(content);
+
+    is_written = false;
+
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::string old_head;
+
+        if (in.is_open() && std::getline(in, old_head) && old_head + '\n' == head)
+            return true;
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+
+    if (!out.is_open())
+        return false;
+
+    out << head << content;
+    is_written = true;
+
+    return out.good();
+}
+
+/*
+
+====================================================
+
+Native builds
+
+====================================================
+
+*/
+
+static inline std::string quote(const std::string& path) {
+    return '"' + path + '"';
+}
+
+static inline bool is_older(const std::filesystem::path& target, const std::filesystem::path& source) {
+    std::error_code error;
+    const auto source_time = std::filesystem::last_write_time(source, error);
+
+    // What does not exist can not have changed.
+    if (error)
+        return false;
+
+    const auto target_time = std::filesystem::last_write_time(target, error);
+
+    return error || target_time < source_time;
+}
+
+static bool build_native(core::liprocess& process, const std::vector<core::t_file_id>& unit_list, const std::vector<std::set<core::t_file_id>>& include_list, const bool has_entry) {
+    const char* compiler = std::getenv("CC");
+    const std::string cc = compiler && *compiler ? compiler : "cc";
+    const std::filesystem::path runtime = std::filesystem::path(process.config.output_path) / RUNTIME_NAME;
+
+    const bool is_direct = process.config._direct_objects && LICAN_NATIVE_OBJECTS;
+
+    if (process.config._direct_objects && !is_direct)
+        process.add_log(core::lilog::log_level::WARNING, core::lisel(0, 0), "Objects can only be written directly for x86-64 ELF targets. Compiling the C units instead.");
+
+    std::vector<uint8_t> failed_list(unit_list.size(), 0);
+    std::vector<uint8_t> compiled_list(unit_list.size(), 0);
+    std::vector<std::vector<core::lilog>> log_list(unit_list.size());
+
+    // Writing an object is about as cheap as checking if it is stale, so it is always redone. Only one
+    // whose bytes changed counts as compiled and relinks.
+    if (is_direct) {
+        std::vector<std::string> object_list;
+
+        for (const core::t_file_id unit : unit_list)
+            object_list.push_back(unit_path(process, unit) + ".o");
+
+        write_objects(process, unit_list, object_list, failed_list, compiled_list, log_list);
+    }
+    else {
+        process.pool.parallel_for(unit_list.size(), [&](const size_t i) {
+            const std::string path = unit_path(process, unit_list[i]);
+            const std::filesystem::path object = path + ".o";
+
+            // Everything the unit includes, through other units of this build too.
+            std::vector<std::filesystem::path> dependency_list = { path + ".c", path + ".h", runtime };
+            std::set<core::t_file_id> seen = include_list[i];
+            std::vector<core::t_file_id> pending(seen.begin(), seen.end());
+
+            while (!pending.empty()) {
+                const core::t_file_id used = pending.back();
+                pending.pop_back();
+
+                dependency_list.push_back(unit_path(process, used) + ".h");
+
+                for (size_t j = 0; j < unit_list.size(); j++) {
+                    if (unit_list[j] != used)
+                        continue;
+
+                    for (const core::t_file_id next : include_list[j]) {
+                        if (seen.insert(next).second)
+                            pending.push_back(next);
+                    }
+                }
+            }
+
+            bool is_stale = !std::filesystem::exists(object);
+
+            for (const std::filesystem::path& dependency : dependency_list)
+                is_stale = is_stale || is_older(object, dependency);
+
+            if (!is_stale)
+                return;
+
+            const std::string command = cc + " -std=c99 -O2 -I" + quote(process.config.output_path) + " -c " + quote(path + ".c") + " -o " + quote(object.generic_string());
+
+            compiled_list[i] = 1;
+            failed_list[i] = std::system(command.c_str()) != 0;
+        });
+    }
+
+    bool success = true;
+    bool is_relinked = false;
+
+    for (size_t i = 0; i < unit_list.size(); i++) {
+        is_relinked = is_relinked || compiled_list[i];
+
+        for (core::lilog& log : log_list[i])
+            process.log_list.push_back(log);
+
+        if (failed_list[i]) {
+            const std::string message = is_direct ? "Failed to write '" + unit_path(process, unit_list[i]) + ".o'." : "The C compiler failed on '" + unit_path(process, unit_list[i]) + ".c'.";
+
+            process.add_log(core::lilog::log_level::ERROR, core::lisel(unit_list[i], 0), message);
+            success = false;
+        }
+    }
+
+    if (!success)
+        return false;
+
+    // Objects of modules that were only loaded as interfaces are left from the build that made them.
+    std::vector<std::string> object_list;
+
+    for (size_t i = 0; i < process.file_list.size(); i++) {
+        const std::string object = unit_path(process, static_cast<core::t_file_id>(i)) + ".o";
+
+        if (std::filesystem::exists(object))
+            object_list.push_back(object);
+        else if (process.file_list[i].is_interface_only())
+            process.add_log(core::lilog::log_level::WARNING, core::lisel(static_cast<core::t_file_id>(i), 0), "'" + object + "' is missing. Rebuild with -r to compile this module again.");
+    }
+
+    if (!has_entry) {
+        process.add_log(core::lilog::log_level::WARNING, core::lisel(0, 0), "There is no parameterless 'main' in the entry point, so nothing was linked.");
+        return true;
+    }
+
+    const std::string executable = (std::filesystem::path(process.config.output_path) / std::filesystem::path(process.file_list[0].path).stem()).generic_string();
+
+    if (!is_relinked && std::filesystem::exists(executable))
+        return true;
+
+    std::string command = cc + " -o " + quote(executable);
+
+    for (const std::string& object : object_list)
+        command += ' ' + quote(object);
+
+    command += " -lm";
+
+    if (std::system(command.c_str()) != 0) {
+        process.add_log(core::lilog::log_level::ERROR, core::lisel(0, 0), "Linking '" + executable + "' failed.");
+        return false;
+    }
+
+    return true;
+}
+
+// Generates a C unit for every parsed file, and builds natively with -n, compiling the units or with
+// -e writing objects directly. Needs the output path to be a directory, like interfaces do.
+bool core::backend::generate(liprocess& process, const t_file_id file_id) {
+    if (!std::filesystem::is_directory(process.config.output_path))
+        return true;
+
+    std::vector<t_file_id> unit_list;
+
+    for (size_t i = 0; i < process.file_list.size(); i++) {
+        if (process.file_list[i].dump_ir_module.has_value())
+            unit_list.push_back(static_cast<t_file_id>(i));
+    }
+
+    bool is_written;
+    if (!write_unit((std::filesystem::path(process.config.output_path) / RUNTIME_NAME).generic_string(), RUNTIME_SOURCE, is_written)) {
+        process.add_log(lilog::log_level::WARNING, lisel(file_id, 0), std::string("Failed to write '") + RUNTIME_NAME + "'.");
+        return false;
+    }
+
+    std::vector<std::vector<lilog>> log_list(unit_list.size());
+    std::vector<std::set<t_file_id>> include_list(unit_list.size());
+    bool has_entry = false;
+
+    std::deque<generate_state> state_list;
+
+    for (const t_file_id unit : unit_list)
+        state_list.emplace_back(process, unit);
+
+    process.pool.parallel_for(unit_list.size(), [&](const size_t i) {
+        state_list[i].generate();
+    });
+
+    // Bodies of every unit in one go, since the pool runs one job at a time.
+    std::vector<std::pair<size_t, size_t>> body_list;
+
+    for (size_t i = 0; i < unit_list.size(); i++) {
+        for (size_t j = 0; j < state_list[i].body_list.size(); j++)
+            body_list.emplace_back(i, j);
+    }
+
+    process.pool.parallel_for(body_list.size(), [&](const size_t i) {
+        generate_state& state = state_list[body_list[i].first];
+        state.emit_body(state.body_list[body_list[i].second]);
+    });
+
+    process.pool.parallel_for(unit_list.size(), [&](const size_t i) {
+        generate_state& state = state_list[i];
+        state.place_bodies();
+
+        const std::string path = unit_path(process, unit_list[i]);
+
+        std::error_code error;
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+        bool is_written;
+        if (!write_unit(path + ".h", state.header(), is_written) || !write_unit(path + ".c", state.source(), is_written))
+            state.log_list.emplace_back(lilog::log_level::WARNING, lisel(unit_list[i], 0), "Failed to write C unit '" + path + "'.");
+
+        log_list[i] = std::move(state.log_list);
+        include_list[i] = std::move(state.include_set);
+
+        if (unit_list[i] == 0)
+            has_entry = state.has_entry;
+    });
+
+    for (std::vector<lilog>& unit_log_list : log_list) {
+        for (lilog& log : unit_log_list)
+            process.log_list.push_back(log);
+    }
+
+    if (!process.config._native_build)
+        return true;
+
+    return build_native(process, unit_list, include_list, has_entry);
+}
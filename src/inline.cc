@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <string>
+
+#include "inline.hh"
+
+using namespace core::backend;
+
+uint32_t core::backend::function_size(const ir_function& function) {
+    uint32_t size = 0;
+
+    for (const ir_block& block : function.block_list) {
+        for (t_value_id id = block.first; id != NO_VALUE; id = function.at(id).next)
+            size++;
+    }
+
+    return size;
+}
+
+bool core::backend::can_inline(const ir_function& callee) {
+    // The copied entry is jumped to from the block of the call, which its phis would not know of.
+    if (!callee.complete || callee.block_list.empty() || callee.block_list[0].predecessor_count > 0)
+        return false;
+
+    for (const ir_block& block : callee.block_list) {
+        if (!block.is_removed && block.last != NO_VALUE && callee.at(block.last).op == opcode::RETURN)
+            return true;
+    }
+
+    return false;
+}
+
+void core::backend::inline_call(ir_function& caller, const t_value_id call, const ir_function& callee) {
+    const t_block_id block = caller.at(call).block;
+    const t_value_id after = caller.at(call).next;
+
+    // Calls are never terminators, so something always follows.
+    const t_block_id rest = caller.split_block(after);
+
+    std::vector<t_block_id> block_map(callee.block_list.size(), NO_BLOCK);
+    std::vector<t_value_id> value_map(callee.instruction_list.size(), NO_VALUE);
+
+    for (t_block_id at = 0; at < callee.block_list.size(); at++) {
+        if (!callee.block_list[at].is_removed)
+            block_map[at] = caller.make_block();
+    }
+
+    // Ids are handed out in the order the copies are appended below, so operands can refer to values
+    // copied later, the way phis do around loops.
+    t_value_id next = static_cast<t_value_id>(caller.instruction_list.size());
+    const uint32_t* argument_list = caller.operands(call);
+
+    for (t_block_id at = 0; at < callee.block_list.size(); at++) {
+        if (callee.block_list[at].is_removed)
+            continue;
+
+        for (t_value_id id = callee.block_list[at].first; id != NO_VALUE; id = callee.at(id).next)
+            value_map[id] = callee.at(id).op == opcode::PARAMETER ? argument_list[callee.at(id).immediate] : next++;
+    }
+
+    std::vector<uint32_t> result_list; // (block, value) pairs for the phi of the results
+
+    for (t_block_id at = 0; at < callee.block_list.size(); at++) {
+        if (callee.block_list[at].is_removed)
+            continue;
+
+        for (t_value_id id = callee.block_list[at].first; id != NO_VALUE; id = callee.at(id).next) {
+            const instruction& copied = callee.at(id);
+            const uint32_t* operands = callee.operands(id);
+
+            if (copied.op == opcode::PARAMETER)
+                continue;
+
+            if (copied.op == opcode::RETURN) {
+                if (copied.operand_count > 0) {
+                    result_list.push_back(block_map[at]);
+                    result_list.push_back(value_map[operands[0]]);
+                }
+
+                caller.at(caller.append(block_map[at], opcode::JUMP, ir_type::VOID)).target[0] = rest;
+                continue;
+            }
+
+            std::vector<uint32_t> operand_list(operands, operands + copied.operand_count);
+
+            for (uint32_t i = 0; i < operand_list.size(); i++) {
+                const bool is_block = copied.op == opcode::PHI && i % 2 == 0;
+                operand_list[i] = is_block ? block_map[operand_list[i]] : value_map[operand_list[i]];
+            }
+
+            const t_value_id created = caller.append(block_map[at], copied.op, copied.type, operand_list, copied.immediate);
+            instruction& target = caller.at(created);
+
+            target.symbol = copied.symbol;
+
+            for (uint32_t i = 0; i < 2; i++)
+                target.target[i] = copied.target[i] != NO_BLOCK ? block_map[copied.target[i]] : NO_BLOCK;
+        }
+    }
+
+    caller.at(caller.append(block, opcode::JUMP, ir_type::VOID)).target[0] = block_map[0];
+
+    if (caller.at(call).type != ir_type::VOID) {
+        t_value_id result = result_list.empty() ? NO_VALUE : result_list[1];
+
+        if (result_list.size() > 2)
+            result = caller.insert_before(caller.block_list[rest].first, opcode::PHI, caller.at(call).type, result_list);
+
+        caller.replace_all_uses(call, result);
+    }
+
+    caller.remove(call);
+    caller.compute_predecessors();
+}
+
+call_graph::call_graph(const std::vector<ir_function*>& function_list) : function_list(function_list) {
+    const uint32_t function_count = static_cast<uint32_t>(function_list.size());
+
+    for (uint32_t i = 0; i < function_count; i++)
+        index_map.emplace(function_list[i]->source, i);
+
+    callee_list.resize(function_count);
+
+    for (uint32_t i = 0; i < function_count; i++) {
+        const ir_function& function = *function_list[i];
+
+        for (const ir_block& block : function.block_list) {
+            for (t_value_id id = block.first; id != NO_VALUE; id = function.at(id).next) {
+                if (function.at(id).op != opcode::CALL)
+                    continue;
+
+                auto it = index_map.find(function.at(id).symbol);
+
+                if (it != index_map.end() && std::find(callee_list[i].begin(), callee_list[i].end(), it->second) == callee_list[i].end())
+                    callee_list[i].push_back(it->second);
+            }
+        }
+    }
+
+    // Tarjan, walked with a stack of its own so long call chains do not run out of the native one.
+    std::vector<uint32_t> order_list(function_count, UINT32_MAX);
+    std::vector<uint32_t> low_list(function_count, 0);
+    std::vector<uint8_t> on_stack(function_count, 0);
+
+    std::vector<uint32_t> stack;
+    std::vector<std::pair<uint32_t, uint32_t>> walk; // Function and the next of its callees to visit
+    uint32_t order = 0;
+
+    component_of.assign(function_count, UINT32_MAX);
+
+    auto visit = [&](const uint32_t function) {
+        order_list[function] = low_list[function] = order++;
+        on_stack[function] = 1;
+        stack.push_back(function);
+        walk.push_back({ function, 0 });
+    };
+
+    for (uint32_t root = 0; root < function_count; root++) {
+        if (order_list[root] != UINT32_MAX)
+            continue;
+
+        visit(root);
+
+        while (!walk.empty()) {
+            const uint32_t function = walk.back().first;
+
+            if (walk.back().second < callee_list[function].size()) {
+                const uint32_t callee = callee_list[function][walk.back().second++];
+
+                if (order_list[callee] == UINT32_MAX)
+                    visit(callee);
+                else if (on_stack[callee])
+                    low_list[function] = std::min(low_list[function], order_list[callee]);
+
+                continue;
+            }
+
+            walk.pop_back();
+
+            if (!walk.empty())
+                low_list[walk.back().first] = std::min(low_list[walk.back().first], low_list[function]);
+
+            if (low_list[function] != order_list[function])
+                continue;
+
+            std::vector<uint32_t> component;
+            uint32_t member;
+
+            do {
+                member = stack.back();
+                stack.pop_back();
+                on_stack[member] = 0;
+
+                component_of[member] = static_cast<uint32_t>(component_list.size());
+                component.push_back(member);
+            } while (member != function);
+
+            // Declaration order, so the order functions are worked on in does not depend on the walk.
+            std::sort(component.begin(), component.end());
+            component_list.push_back(std::move(component));
+        }
+    }
+
+    // Components come callees first, so the levels of everything a component calls are known by then.
+    std::vector<uint32_t> level_of(component_list.size(), 0);
+
+    for (uint32_t component = 0; component < component_list.size(); component++) {
+        for (const uint32_t function : component_list[component]) {
+            for (const uint32_t callee : callee_list[function]) {
+                if (component_of[callee] != component)
+                    level_of[component] = std::max(level_of[component], level_of[component_of[callee]] + 1);
+            }
+        }
+
+        if (level_of[component] >= level_list.size())
+            level_list.resize(level_of[component] + 1);
+
+        for (const uint32_t function : component_list[component])
+            level_list[level_of[component]].push_back(function);
+    }
+
+    for (std::vector<uint32_t>& level : level_list)
+        std::sort(level.begin(), level.end());
+}
+
+// The callee with every parameter that gets a constant argument at call turned into that constant,
+// run through the pipeline again.
+static ir_function specialize(const ir_function& caller, const t_value_id call, const ir_function& callee, const pass_manager& manager, std::vector<pass_statistics>& statistics) {
+    ir_function specialized = callee;
+    const uint32_t* argument_list = caller.operands(call);
+
+    for (instruction& at : specialized.instruction_list) {
+        if (at.op != opcode::PARAMETER || at.immediate >= caller.at(call).operand_count)
+            continue;
+
+        const instruction& argument = caller.at(argument_list[at.immediate]);
+
+        if (argument.op == opcode::CONSTANT) {
+            at.op = opcode::CONSTANT;
+            at.immediate = argument.immediate;
+        }
+    }
+
+    manager.run(specialized, statistics);
+    return specialized;
+}
+
+uint32_t core::backend::inline_calls(const call_graph& graph, const uint32_t index, const uint8_t level, const pass_manager& manager, std::vector<pass_statistics>& statistics) {
+    ir_function& caller = *graph.function_list[index];
+
+    const uint32_t threshold = level >= 2 ? INLINE_THRESHOLD_O2 : INLINE_THRESHOLD_O1;
+    uint32_t size = function_size(caller);
+    const uint32_t size_limit = size * INLINE_GROWTH_FACTOR + INLINE_GROWTH_FLOOR;
+
+    // Copied bodies only bring calls their callee already chose to keep, so the calls there are now
+    // are all there is to look at.
+    std::vector<t_value_id> call_list;
+
+    for (const ir_block& block : caller.block_list) {
+        for (t_value_id id = block.first; id != NO_VALUE; id = caller.at(id).next) {
+            if (caller.at(id).op == opcode::CALL)
+                call_list.push_back(id);
+        }
+    }
+
+    // Keyed by the callee and its constant arguments, since the same call tends to repeat.
+    std::unordered_map<std::string, ir_function> specialization_map;
+    uint32_t inline_count = 0;
+
+    for (const t_value_id call : call_list) {
+        auto it = graph.index_map.find(caller.at(call).symbol);
+
+        if (it == graph.index_map.end() || graph.component_of[it->second] == graph.component_of[index])
+            continue;
+
+        const ir_function& callee = *graph.function_list[it->second];
+
+        if (!can_inline(callee))
+            continue;
+
+        // What the call costs by itself: the call, moving its arguments in and returning.
+        const uint32_t call_cost = caller.at(call).operand_count + 2;
+
+        const ir_function* copied = &callee;
+        uint32_t copied_size = function_size(callee);
+
+        std::string key = std::to_string(it->second);
+        const uint32_t* argument_list = caller.operands(call);
+
+        for (uint32_t i = 0; i < caller.at(call).operand_count; i++) {
+            if (caller.at(argument_list[i]).op == opcode::CONSTANT)
+                key += ',' + std::to_string(i) + '=' + std::to_string(caller.at(argument_list[i]).immediate);
+        }
+
+        const bool has_constant = key.find('=') != std::string::npos;
+
+        if (has_constant && copied_size <= threshold * INLINE_SPECIALIZE_FACTOR + call_cost) {
+            auto found = specialization_map.find(key);
+
+            if (found == specialization_map.end())
+                found = specialization_map.emplace(key, specialize(caller, call, callee, manager, statistics)).first;
+
+            if (can_inline(found->second)) {
+                copied = &found->second;
+                copied_size = function_size(found->second);
+            }
+        }
+
+        if (copied_size > threshold + call_cost || size + copied_size > size_limit)
+            continue;
+
+        inline_call(caller, call, *copied);
+
+        size += copied_size;
+        inline_count++;
+    }
+
+    return inline_count;
+}
@@ -0,0 +1,47 @@
+#include <cstring>
+
+#include "instance.hh"
+
+bool core::semantic::instance_cache::key::operator==(const key& other) const {
+    return declaration == other.declaration && argument_count == other.argument_count &&
+        (argument_count == 0 || std::memcmp(argument_list, other.argument_list, sizeof(t_type_id) * argument_count) == 0);
+}
+
+size_t core::semantic::instance_cache::key_hash::operator()(const key& value) const {
+    uint64_t hash = reinterpret_cast<uintptr_t>(value.declaration) * 0x9E3779B97F4A7C15ull;
+
+    for (uint16_t i = 0; i < value.argument_count; i++)
+        hash = (hash ^ value.argument_list[i]) * 0x9E3779B97F4A7C15ull;
+
+    return static_cast<size_t>(hash ^ (hash >> 32));
+}
+
+core::semantic::instance& core::semantic::instance_cache::get(const symbol* declaration, const t_type_id* argument_list, const uint16_t argument_count) {
+    const key lookup_key = { declaration, argument_list, argument_count };
+
+    {
+        std::shared_lock lock(mutex);
+
+        auto it = instance_map.find(lookup_key);
+        if (it != instance_map.end())
+            return *it->second;
+    }
+
+    std::unique_lock lock(mutex);
+
+    // Another thread may have beaten us to it between the locks.
+    auto it = instance_map.find(lookup_key);
+    if (it != instance_map.end())
+        return *it->second;
+
+    t_type_id* stored_argument_list = nullptr;
+    if (argument_count != 0) {
+        stored_argument_list = arena.make_array<t_type_id>(argument_count);
+        std::memcpy(stored_argument_list, argument_list, sizeof(t_type_id) * argument_count);
+    }
+
+    instance& created = instance_list.emplace_back(declaration, stored_argument_list, argument_count);
+    instance_map.emplace(key{ declaration, stored_argument_list, argument_count }, &created);
+
+    return created;
+}
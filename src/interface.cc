@@ -0,0 +1,713 @@
+/*
+
+====================================================
+
+Writes and maps precompiled module interfaces. Check interface.hh for the file layout.
+
+====================================================
+
+*/
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "interface.hh"
+#include "ast.hh"
+#include "symbol.hh"
+#include "util.hh"
+
+using namespace core::frontend;
+using namespace core::ast;
+using namespace core::semantic;
+
+/*
+
+====================================================
+
+Mapping
+
+====================================================
+
+*/
+
+core::frontend::module_interface::~module_interface() {
+    if (!data)
+        return;
+
+#if defined(_WIN32)
+    UnmapViewOfFile(data);
+    CloseHandle(static_cast<HANDLE>(map_handle));
+#else
+    munmap(const_cast<char*>(data), size);
+#endif
+}
+
+std::shared_ptr<module_interface> core::frontend::module_interface::open(liprocess& process, const std::string& path) {
+    std::shared_ptr<module_interface> iface(new module_interface());
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return nullptr;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+
+    if (!mapping)
+        return nullptr;
+
+    iface->map_handle = mapping;
+    iface->size = static_cast<size_t>(file_size.QuadPart);
+    iface->data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+
+    if (!iface->data)
+        return nullptr;
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapped == MAP_FAILED)
+        return nullptr;
+
+    iface->data = static_cast<const char*>(mapped);
+    iface->size = static_cast<size_t>(st.st_size);
+#endif
+
+    if (!iface->validate()) {
+        process.add_log(lilog::log_level::WARNING, lisel(0, 0), "Ignoring malformed module interface '" + path + "'.");
+        return nullptr;
+    }
+
+    const lii::header& head = iface->header();
+
+    iface->name_map.reserve(head.name_count);
+    for (uint32_t i = 0; i < head.name_count; i++) {
+        const lii::name_entry& entry = iface->name_entry(i);
+        iface->name_map.push_back(process.name_table.intern(iface->text(entry.offset, entry.length)));
+    }
+
+    return iface;
+}
+
+bool core::frontend::module_interface::validate() const {
+    if (size < sizeof(lii::header))
+        return false;
+
+    const lii::header& head = header();
+
+    if (head.magic != INTERFACE_MAGIC || head.version != INTERFACE_VERSION)
+        return false;
+
+    auto fits = [&](const uint32_t offset, const uint64_t count, const size_t element_size) {
+        return offset % 8 == 0 && static_cast<uint64_t>(offset) + count * element_size <= size;
+    };
+
+    if (!fits(head.name_offset, head.name_count, sizeof(lii::name_entry))
+        || !fits(head.type_offset, head.type_count, sizeof(lii::type_entry))
+        || !fits(head.decl_offset, head.decl_count, sizeof(lii::decl_entry))
+        || !fits(head.member_offset, head.member_count, sizeof(lii::member_entry))
+        || !fits(head.index_offset, head.index_count, sizeof(uint32_t))
+        || !fits(head.text_offset, head.text_size, 1))
+        return false;
+
+    // Everything below is read without further checks, so every index is checked once here.
+    auto fits_text = [&](const uint32_t offset, const uint32_t length) {
+        return static_cast<uint64_t>(offset) + length <= head.text_size;
+    };
+
+    auto fits_pool = [&](const uint32_t begin, const uint32_t count) {
+        return static_cast<uint64_t>(begin) + count <= head.index_count;
+    };
+
+    auto is_name = [&](const uint32_t index) { return index == INTERFACE_NONE || index < head.name_count; };
+    auto is_type = [&](const uint32_t index) { return index == INTERFACE_NONE || index < head.type_count; };
+
+    auto are_names = [&](const uint32_t begin, const uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (index(begin + i) >= head.name_count)
+                return false;
+        }
+
+        return true;
+    };
+
+    auto are_types = [&](const uint32_t begin, const uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (!is_type(index(begin + i)))
+                return false;
+        }
+
+        return true;
+    };
+
+    for (uint32_t i = 0; i < head.name_count; i++) {
+        const lii::name_entry& entry = name_entry(i);
+
+        if (!fits_text(entry.offset, entry.length))
+            return false;
+    }
+
+    // Arguments are written before the type they belong to, so types can not refer to themselves.
+    for (uint32_t i = 0; i < head.type_count; i++) {
+        const lii::type_entry& entry = type(i);
+
+        if (!fits_pool(entry.path_begin, entry.path_count) || !fits_pool(entry.argument_begin, entry.argument_count) || !are_names(entry.path_begin, entry.path_count))
+            return false;
+
+        for (uint32_t a = 0; a < entry.argument_count; a++) {
+            const uint32_t argument = index(entry.argument_begin + a);
+
+            if (argument != INTERFACE_NONE && argument >= i)
+                return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < head.member_count; i++) {
+        const lii::member_entry& entry = member(i);
+
+        if (entry.kind > lii::member_kind::ENUM_SET || !is_name(entry.name) || !is_type(entry.type)
+            || !fits_pool(entry.parameter_begin, entry.parameter_count) || !are_types(entry.parameter_begin, entry.parameter_count))
+            return false;
+    }
+
+    for (uint32_t i = 0; i < head.decl_count; i++) {
+        const lii::decl_entry& entry = decl(i);
+
+        if (entry.kind > lii::decl_kind::TYPEDEC || !is_name(entry.name) || !is_type(entry.type))
+            return false;
+
+        // Parents come first, and only modules have children.
+        if (entry.parent != INTERFACE_NONE && (entry.parent >= i || decl(entry.parent).kind != lii::decl_kind::MODULE))
+            return false;
+
+        if (!fits_pool(entry.parameter_begin, entry.parameter_count) || !are_types(entry.parameter_begin, entry.parameter_count)
+            || !fits_pool(entry.template_begin, entry.template_count) || !are_names(entry.template_begin, entry.template_count))
+            return false;
+
+        if (static_cast<uint64_t>(entry.member_begin) + entry.member_count > head.member_count)
+            return false;
+
+        // Uses are read through their text, which every use has.
+        if (entry.text_offset == INTERFACE_NONE ? entry.kind == lii::decl_kind::USE : !fits_text(entry.text_offset, entry.text_length))
+            return false;
+    }
+
+    return true;
+}
+
+bool core::frontend::module_interface::matches_source(const std::string& source_code) const {
+    return header().source_size == source_code.size() && header().source_hash == liutil::hash_bytes(source_code);
+}
+
+/*
+
+====================================================
+
+Emission
+
+====================================================
+
+*/
+
+struct interface_writer {
+    interface_writer(core::liprocess& process, const core::t_file_id file_id)
+        : process(process), file(process.file_list[file_id]), ast(std::any_cast<const ast_arena&>(process.file_list[file_id].dump_ast_arena)),
+          table(*std::any_cast<const t_symbol_table_ptr&>(process.file_list[file_id].dump_symbol_table)) {}
+
+    core::liprocess& process;
+    core::liprocess::lifile& file;
+
+    const ast_arena& ast;
+    const symbol_table& table;
+
+    std::vector<lii::name_entry> name_list;
+    std::vector<lii::type_entry> type_list;
+    std::vector<lii::decl_entry> decl_list;
+    std::vector<lii::member_entry> member_list;
+    std::vector<uint32_t> index_list;
+    std::string text;
+
+    std::unordered_map<std::string, uint32_t> name_map;
+    std::unordered_map<std::string, uint32_t> type_map; // Encoded type -> index. This is what makes the types canonical.
+
+    inline std::string source_of(const t_node_id id) const {
+        return process.sub_source_code(ast.get_base_ptr(id)->selection);
+    }
+
+    inline uint32_t add_text(const std::string_view value) {
+        const uint32_t offset = static_cast<uint32_t>(text.size());
+        text += value;
+        return offset;
+    }
+
+    uint32_t add_name(const std::string& name) {
+        auto it = name_map.find(name);
+        if (it != name_map.end())
+            return it->second;
+
+        const uint32_t index = static_cast<uint32_t>(name_list.size());
+        name_list.push_back({ add_text(name), static_cast<uint32_t>(name.size()) });
+        name_map.emplace(name, index);
+
+        return index;
+    }
+
+    inline uint32_t add_index_list(const std::vector<uint32_t>& list) {
+        const uint32_t begin = static_cast<uint32_t>(index_list.size());
+        index_list.insert(index_list.end(), list.begin(), list.end());
+        return begin;
+    }
+
+    // Flattens identifier and scope resolution chains. Returns false for anything else.
+    bool flatten_path(const t_node_id id, std::vector<uint32_t>& path) {
+        const node* base = ast.get_base_ptr(id);
+
+        if (base->type == node_type::EXPR_IDENTIFIER) {
+            path.push_back(add_name(source_of(id)));
+            return true;
+        }
+
+        if (base->type == node_type::EXPR_BINARY) {
+            const expr_binary& binary = ast.get_as<expr_binary>(id);
+            return binary.opr.type == core::token_type::DOUBLE_DOT && flatten_path(binary.first, path) && flatten_path(binary.second, path);
+        }
+
+        return false;
+    }
+
+    uint32_t add_type(const t_node_id id) {
+        if (ast.get_base_ptr(id)->type != node_type::EXPR_TYPE)
+            return INTERFACE_NONE;
+
+        const expr_type& type = ast.get_as<expr_type>(id);
+
+        std::vector<uint32_t> path;
+        if (!flatten_path(type.source, path))
+            return INTERFACE_NONE;
+
+        std::vector<uint32_t> argument_list;
+        for (const t_node_id argument : type.argument_list)
+            argument_list.push_back(add_type(argument));
+
+        uint8_t flags = 0;
+        if (type.is_const) flags |= lii::TYPE_CONST;
+        if (type.is_pointer) flags |= lii::TYPE_POINTER;
+        if (type.reference_type == expr_type::e_reference_type::LVALUE) flags |= lii::TYPE_LVALUE;
+        if (type.reference_type == expr_type::e_reference_type::RVALUE) flags |= lii::TYPE_RVALUE;
+
+        std::string key(1, static_cast<char>(flags));
+        for (const uint32_t name : path) key.append(reinterpret_cast<const char*>(&name), sizeof(name));
+        key += '|';
+        for (const uint32_t argument : argument_list) key.append(reinterpret_cast<const char*>(&argument), sizeof(argument));
+
+        auto it = type_map.find(key);
+        if (it != type_map.end())
+            return it->second;
+
+        lii::type_entry entry = {};
+        entry.path_count = static_cast<uint32_t>(path.size());
+        entry.path_begin = add_index_list(path);
+        entry.argument_count = static_cast<uint32_t>(argument_list.size());
+        entry.argument_begin = add_index_list(argument_list);
+        entry.flags = flags;
+
+        const uint32_t index = static_cast<uint32_t>(type_list.size());
+        type_list.push_back(entry);
+        type_map.emplace(std::move(key), index);
+
+        return index;
+    }
+
+    void add_parameter_list(const t_node_list& parameter_list, uint32_t& begin, uint32_t& count) {
+        std::vector<uint32_t> type_list;
+
+        for (const t_node_id parameter : parameter_list)
+            type_list.push_back(add_type(ast.get_as<expr_parameter>(parameter).value_type));
+
+        begin = add_index_list(type_list);
+        count = static_cast<uint32_t>(type_list.size());
+    }
+
+    void add_template_list(const t_node_list& template_list, uint32_t& begin, uint32_t& count) {
+        std::vector<uint32_t> name_list;
+
+        for (const t_node_id name : template_list)
+            name_list.push_back(add_name(source_of(name)));
+
+        begin = add_index_list(name_list);
+        count = static_cast<uint32_t>(name_list.size());
+    }
+
+    lii::decl_entry make_decl(const lii::decl_kind kind, const uint32_t name, const uint32_t parent) {
+        lii::decl_entry entry = {};
+        entry.kind = kind;
+        entry.name = name;
+        entry.parent = parent;
+        entry.type = INTERFACE_NONE;
+        entry.text_offset = INTERFACE_NONE;
+
+        return entry;
+    }
+
+    inline uint32_t push_decl(const lii::decl_entry& entry) {
+        decl_list.push_back(entry);
+        return static_cast<uint32_t>(decl_list.size() - 1);
+    }
+
+    lii::member_entry make_function_member(const lii::member_kind kind, const uint32_t name, const t_node_id function_id) {
+        const expr_function& function = ast.get_as<expr_function>(function_id);
+
+        lii::member_entry entry = {};
+        entry.kind = kind;
+        entry.name = name;
+        entry.type = add_type(function.return_type);
+        add_parameter_list(function.parameter_list, entry.parameter_begin, entry.parameter_count);
+
+        return entry;
+    }
+
+    void add_struct(const t_node_id id, const uint32_t parent) {
+        const item_struct_declaration& declaration = ast.get_as<item_struct_declaration>(id);
+
+        if (ast.get_base_ptr(declaration.name)->type != node_type::EXPR_IDENTIFIER)
+            return;
+
+        lii::decl_entry entry = make_decl(lii::decl_kind::STRUCT, add_name(source_of(declaration.name)), parent);
+        add_template_list(declaration.template_parameter_list, entry.template_begin, entry.template_count);
+
+        if (entry.template_count > 0) {
+            const std::string source = source_of(id);
+            entry.text_offset = add_text(source);
+            entry.text_length = static_cast<uint32_t>(source.size());
+        }
+
+        // Members go to a scratch list first so the layout stays contiguous in the member table.
+        std::vector<lii::member_entry> layout;
+
+        for (const t_node_id member_id : declaration.member_list) {
+            const node* base = ast.get_base_ptr(member_id);
+
+            switch (base->type) {
+                case node_type::EXPR_PROPERTY: {
+                    const expr_property& property = ast.get_as<expr_property>(member_id);
+
+                    lii::member_entry member = {};
+                    member.kind = lii::member_kind::PROPERTY;
+                    member.flags = property.is_private ? lii::MEMBER_PRIVATE : 0;
+                    member.name = add_name(source_of(property.name));
+                    member.type = add_type(property.value_type);
+                    layout.push_back(member);
+                    break;
+                }
+                case node_type::EXPR_METHOD: {
+                    const expr_method& method = ast.get_as<expr_method>(member_id);
+
+                    lii::member_entry member = make_function_member(lii::member_kind::METHOD, add_name(source_of(method.name)), method.function);
+                    member.flags = (method.is_private ? lii::MEMBER_PRIVATE : 0) | (method.is_const ? lii::MEMBER_CONST : 0);
+                    layout.push_back(member);
+                    break;
+                }
+                case node_type::EXPR_OPERATOR: {
+                    const expr_operator& opr = ast.get_as<expr_operator>(member_id);
+
+                    lii::member_entry member = make_function_member(lii::member_kind::OPERATOR, INTERFACE_NONE, opr.function);
+                    member.flags = opr.is_const ? lii::MEMBER_CONST : 0;
+                    member.opr = static_cast<uint16_t>(opr.opr);
+                    layout.push_back(member);
+                    break;
+                }
+                case node_type::EXPR_CONSTRUCTOR: {
+                    const expr_constructor& constructor = ast.get_as<expr_constructor>(member_id);
+                    const bool is_named = ast.get_base_ptr(constructor.name)->type == node_type::EXPR_IDENTIFIER;
+
+                    layout.push_back(make_function_member(lii::member_kind::CONSTRUCTOR, is_named ? add_name(source_of(constructor.name)) : INTERFACE_NONE, constructor.function));
+                    break;
+                }
+                case node_type::EXPR_DESTRUCTOR: {
+                    lii::member_entry member = {};
+                    member.kind = lii::member_kind::DESTRUCTOR;
+                    member.name = INTERFACE_NONE;
+                    member.type = INTERFACE_NONE;
+                    layout.push_back(member);
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+
+        entry.member_begin = static_cast<uint32_t>(member_list.size());
+        entry.member_count = static_cast<uint32_t>(layout.size());
+        member_list.insert(member_list.end(), layout.begin(), layout.end());
+
+        push_decl(entry);
+    }
+
+    void add_enum(const t_node_id id, const uint32_t parent) {
+        const item_enum& declaration = ast.get_as<item_enum>(id);
+
+        if (ast.get_base_ptr(declaration.name)->type != node_type::EXPR_IDENTIFIER)
+            return;
+
+        lii::decl_entry entry = make_decl(lii::decl_kind::ENUM, add_name(source_of(declaration.name)), parent);
+        entry.member_begin = static_cast<uint32_t>(member_list.size());
+
+        for (const t_node_id set_id : declaration.set_list) {
+            if (ast.get_base_ptr(set_id)->type != node_type::EXPR_ENUM_SET)
+                continue;
+
+            const expr_enum_set& set = ast.get_as<expr_enum_set>(set_id);
+
+            lii::member_entry member = {};
+            member.kind = lii::member_kind::ENUM_SET;
+            member.name = add_name(source_of(set.name));
+            member.type = INTERFACE_NONE;
+
+            // Semantic analysis already folded (and range checked) whatever value was written.
+            const constant* folded = table.constant_map.find(static_cast<uint32_t>(set.value));
+
+            if (folded && !is_floating(folded->kind)) {
+                member.flags = lii::MEMBER_VALUE;
+                member.value = folded->kind == type_kind::BOOL ? static_cast<uint64_t>(folded->b) : folded->u;
+            }
+
+            member_list.push_back(member);
+        }
+
+        entry.member_count = static_cast<uint32_t>(member_list.size()) - entry.member_begin;
+
+        push_decl(entry);
+    }
+
+    void add_item(const t_node_id id, const uint32_t parent) {
+        const node* base = ast.get_base_ptr(id);
+
+        switch (base->type) {
+            case node_type::ITEM_USE: {
+                std::string path = source_of(ast.get_as<item_use>(id).path);
+                path = path.size() >= 2 ? path.substr(1, path.size() - 2) : ""; // Strip quotes
+
+                lii::decl_entry entry = make_decl(lii::decl_kind::USE, INTERFACE_NONE, parent);
+                entry.text_offset = add_text(path);
+                entry.text_length = static_cast<uint32_t>(path.size());
+                push_decl(entry);
+                break;
+            }
+            case node_type::ITEM_MODULE: {
+                const item_module& module = ast.get_as<item_module>(id);
+                const uint32_t index = push_decl(make_decl(lii::decl_kind::MODULE, add_name(source_of(module.name)), parent));
+
+                add_item(module.content, index);
+                break;
+            }
+            case node_type::ITEM_BODY:
+                for (const t_node_id item : ast.get_as<item_body>(id).item_list)
+                    add_item(item, parent);
+                break;
+            case node_type::VARIANT_DECLARATION: {
+                const variant_declaration& declaration = ast.get_as<variant_declaration>(id);
+
+                // Qualified declarations (dec a..b) extend another module and are not exports of this one.
+                if (ast.get_base_ptr(declaration.name)->type != node_type::EXPR_IDENTIFIER)
+                    break;
+
+                const uint32_t name = add_name(source_of(declaration.name));
+
+                if (ast.get_base_ptr(declaration.value)->type != node_type::EXPR_FUNCTION) {
+                    lii::decl_entry entry = make_decl(lii::decl_kind::VARIANT, name, parent);
+                    entry.type = add_type(declaration.value_type);
+                    push_decl(entry);
+                    break;
+                }
+
+                const expr_function& function = ast.get_as<expr_function>(declaration.value);
+
+                lii::decl_entry entry = make_decl(lii::decl_kind::FUNCTION, name, parent);
+                entry.type = add_type(function.return_type);
+                add_parameter_list(function.parameter_list, entry.parameter_begin, entry.parameter_count);
+                add_template_list(function.template_parameter_list, entry.template_begin, entry.template_count);
+
+                if (entry.template_count > 0) {
+                    const std::string source = source_of(id);
+                    entry.text_offset = add_text(source);
+                    entry.text_length = static_cast<uint32_t>(source.size());
+                }
+
+                push_decl(entry);
+                break;
+            }
+            case node_type::ITEM_TYPE_DECLARATION: {
+                const item_type_declaration& declaration = ast.get_as<item_type_declaration>(id);
+
+                if (ast.get_base_ptr(declaration.name)->type != node_type::EXPR_IDENTIFIER)
+                    break;
+
+                lii::decl_entry entry = make_decl(lii::decl_kind::TYPEDEC, add_name(source_of(declaration.name)), parent);
+                entry.type = add_type(declaration.type_value);
+                add_template_list(declaration.parameter_list, entry.template_begin, entry.template_count);
+                push_decl(entry);
+                break;
+            }
+            case node_type::ITEM_STRUCT_DECLARATION:
+                add_struct(id, parent);
+                break;
+            case node_type::ITEM_ENUM:
+                add_enum(id, parent);
+                break;
+            default:
+                break;
+        }
+    }
+
+    template <typename T>
+    static uint32_t append_section(std::string& buffer, const std::vector<T>& list) {
+        while (buffer.size() % 8 != 0)
+            buffer += '\0';
+
+        const uint32_t offset = static_cast<uint32_t>(buffer.size());
+        buffer.append(reinterpret_cast<const char*>(list.data()), list.size() * sizeof(T));
+
+        return offset;
+    }
+
+    std::string serialize() {
+        lii::header head = {};
+        head.magic = INTERFACE_MAGIC;
+        head.version = INTERFACE_VERSION;
+        head.source_hash = liutil::hash_bytes(file.source_code);
+        head.source_size = file.source_code.size();
+
+        std::string buffer(sizeof(lii::header), '\0');
+
+        head.name_count = static_cast<uint32_t>(name_list.size());
+        head.name_offset = append_section(buffer, name_list);
+        head.type_count = static_cast<uint32_t>(type_list.size());
+        head.type_offset = append_section(buffer, type_list);
+        head.decl_count = static_cast<uint32_t>(decl_list.size());
+        head.decl_offset = append_section(buffer, decl_list);
+        head.member_count = static_cast<uint32_t>(member_list.size());
+        head.member_offset = append_section(buffer, member_list);
+        head.index_count = static_cast<uint32_t>(index_list.size());
+        head.index_offset = append_section(buffer, index_list);
+        head.text_size = static_cast<uint32_t>(text.size());
+        head.text_offset = append_section(buffer, std::vector<char>(text.begin(), text.end()));
+
+        std::memcpy(buffer.data(), &head, sizeof(head));
+
+        return buffer;
+    }
+};
+
+std::string core::frontend::interface_path(const liprocess& process, const t_file_id file_id) {
+    const std::filesystem::path root = std::filesystem::path(process.file_list[0].path).parent_path();
+    const std::filesystem::path source = std::filesystem::path(process.file_list[file_id].path).lexically_normal();
+
+    std::string relative = source.lexically_relative(root.lexically_normal()).replace_extension(INTERFACE_EXTENSION).generic_string();
+
+    // Keep modules from outside of the project inside the output path.
+    for (size_t at = relative.find("../"); at != std::string::npos; at = relative.find("../", at))
+        relative.replace(at, 3, "__/");
+
+    return (std::filesystem::path(process.config.output_path) / relative).generic_string();
+}
+
+bool core::frontend::emit_interface(liprocess& process, const t_file_id file_id) {
+    if (!std::filesystem::is_directory(process.config.output_path))
+        return true;
+
+    liprocess::lifile& file = process.file_list[file_id];
+
+    if (!file.dump_ast_arena.has_value() || !file.dump_symbol_table.has_value())
+        return true;
+
+    interface_writer writer(process, file_id);
+
+    for (const t_node_id item : writer.ast.get_as<ast_root>(0).item_list)
+        writer.add_item(item, INTERFACE_NONE);
+
+    const std::string path = interface_path(process, file_id);
+    const std::string buffer = writer.serialize();
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+
+    if (!out.is_open()) {
+        process.add_log(lilog::log_level::WARNING, lisel(file_id, 0), "Failed to write module interface '" + path + "'.");
+        return false;
+    }
+
+    out.write(buffer.data(), buffer.size());
+
+    return true;
+}
+
+void core::frontend::emit_interfaces(liprocess& process) {
+    std::vector<uint8_t> error_list(process.file_list.size(), 0);
+
+    for (const lilog& log : process.log_list) {
+        const t_file_id file_id = log.selection.file_id;
+
+        if (log.level >= lilog::log_level::ERROR && file_id >= 0 && static_cast<size_t>(file_id) < error_list.size())
+            error_list[file_id] = 1;
+    }
+
+    for (size_t i = 0; i < process.file_list.size(); i++) {
+        if (!error_list[i] && !process.file_list[i].is_interface_only())
+            emit_interface(process, static_cast<t_file_id>(i));
+    }
+}
+
+bool core::frontend::mark_whole_program_only(liprocess& process, const t_file_id file_id) {
+    const std::string path = interface_path(process, file_id);
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+
+    if (!file.is_open())
+        return true;
+
+    lii::header head = {};
+    file.read(reinterpret_cast<char*>(&head), sizeof(head));
+
+    if (!file || head.magic != INTERFACE_MAGIC || head.version != INTERFACE_VERSION)
+        return true;
+
+    head.flags |= INTERFACE_WHOLE_PROGRAM_ONLY;
+
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&head), sizeof(head));
+
+    if (!file.good()) {
+        process.add_log(lilog::log_level::WARNING, lisel(file_id, 0), "Failed to update module interface '" + path + "'.");
+        return false;
+    }
+
+    return true;
+}
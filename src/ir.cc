@@ -0,0 +1,627 @@
+#include <algorithm>
+#include <cstring>
+
+#include "ir.hh"
+#include "symbol.hh"
+
+using namespace core::backend;
+
+static const char* const TYPE_NAME_LIST[] = {
+    "void", "bool",
+    "i8", "i16", "i32", "i64",
+    "u8", "u16", "u32", "u64",
+    "f32", "f64",
+    "ptr",
+};
+
+static const char* const OPCODE_NAME_LIST[] = {
+    "nop",
+    "parameter", "constant", "undefined", "phi", "copy", "convert",
+    "neg", "not",
+    "add", "sub", "mul", "div", "mod", "pow",
+    "eq", "ne", "lt", "le", "gt", "ge",
+    "load_global", "store_global", "call",
+    "jump", "branch", "return", "unreachable",
+};
+
+uint8_t core::backend::bit_width(const ir_type type) {
+    switch (type) {
+        case ir_type::BOOL: return 1;
+        case ir_type::I8: case ir_type::U8: return 8;
+        case ir_type::I16: case ir_type::U16: return 16;
+        case ir_type::I32: case ir_type::U32: case ir_type::F32: return 32;
+        case ir_type::I64: case ir_type::U64: case ir_type::F64: case ir_type::PTR: return 64;
+        default: return 0;
+    }
+}
+
+const char* core::backend::type_name(const ir_type type) {
+    return TYPE_NAME_LIST[static_cast<uint8_t>(type)];
+}
+
+const char* core::backend::opcode_name(const opcode op) {
+    return OPCODE_NAME_LIST[static_cast<uint8_t>(op)];
+}
+
+uint64_t core::backend::constant_bits(const semantic::constant& value) {
+    if (value.kind == semantic::type_kind::BOOL)
+        return value.b ? 1 : 0;
+
+    if (semantic::is_floating(value.kind)) {
+        uint64_t bits;
+        std::memcpy(&bits, &value.f, sizeof(double));
+        return bits;
+    }
+
+    return value.u;
+}
+
+t_block_id ir_function::make_block() {
+    block_list.push_back({ NO_VALUE, NO_VALUE, 0, 0, false });
+    return static_cast<t_block_id>(block_list.size() - 1);
+}
+
+static inline instruction make_instruction(std::vector<uint32_t>& operand_pool, const t_block_id block, const opcode op, const ir_type type, const std::vector<uint32_t>& operand_list, const uint64_t immediate) {
+    instruction created;
+
+    created.op = op;
+    created.type = type;
+    created.operand_count = static_cast<uint16_t>(operand_list.size());
+    created.operand_begin = static_cast<uint32_t>(operand_pool.size());
+    created.block = block;
+    created.prev = NO_VALUE;
+    created.next = NO_VALUE;
+    created.immediate = immediate;
+    created.target[0] = NO_BLOCK;
+    created.target[1] = NO_BLOCK;
+    created.symbol = nullptr;
+
+    operand_pool.insert(operand_pool.end(), operand_list.begin(), operand_list.end());
+
+    return created;
+}
+
+t_value_id ir_function::append(const t_block_id block, const opcode op, const ir_type type, const std::vector<uint32_t>& operand_list, const uint64_t immediate) {
+    const t_value_id id = static_cast<t_value_id>(instruction_list.size());
+    instruction_list.push_back(make_instruction(operand_pool, block, op, type, operand_list, immediate));
+
+    ir_block& target = block_list[block];
+
+    instruction_list[id].prev = target.last;
+
+    if (target.last != NO_VALUE)
+        instruction_list[target.last].next = id;
+    else
+        target.first = id;
+
+    target.last = id;
+
+    return id;
+}
+
+t_value_id ir_function::insert_before(const t_value_id at, const opcode op, const ir_type type, const std::vector<uint32_t>& operand_list, const uint64_t immediate) {
+    const t_block_id block = instruction_list[at].block;
+
+    const t_value_id id = static_cast<t_value_id>(instruction_list.size());
+    instruction_list.push_back(make_instruction(operand_pool, block, op, type, operand_list, immediate));
+
+    instruction& created = instruction_list[id];
+    instruction& next = instruction_list[at];
+
+    created.prev = next.prev;
+    created.next = at;
+
+    if (next.prev != NO_VALUE)
+        instruction_list[next.prev].next = id;
+    else
+        block_list[block].first = id;
+
+    next.prev = id;
+
+    return id;
+}
+
+// Takes the instruction out of its block, leaving it linked to nothing.
+static void unlink(std::vector<instruction>& instruction_list, std::vector<ir_block>& block_list, const t_value_id id) {
+    instruction& removed = instruction_list[id];
+    ir_block& block = block_list[removed.block];
+
+    if (removed.prev != NO_VALUE)
+        instruction_list[removed.prev].next = removed.next;
+    else
+        block.first = removed.next;
+
+    if (removed.next != NO_VALUE)
+        instruction_list[removed.next].prev = removed.prev;
+    else
+        block.last = removed.prev;
+
+    removed.prev = NO_VALUE;
+    removed.next = NO_VALUE;
+}
+
+void ir_function::remove(const t_value_id id) {
+    instruction& removed = instruction_list[id];
+
+    if (removed.op == opcode::NOP)
+        return;
+
+    unlink(instruction_list, block_list, id);
+
+    removed.op = opcode::NOP;
+    removed.operand_count = 0;
+}
+
+void ir_function::move_before(const t_value_id id, const t_value_id at) {
+    unlink(instruction_list, block_list, id);
+
+    instruction& moved = instruction_list[id];
+    instruction& next = instruction_list[at];
+
+    moved.block = next.block;
+    moved.prev = next.prev;
+    moved.next = at;
+
+    if (next.prev != NO_VALUE)
+        instruction_list[next.prev].next = id;
+    else
+        block_list[next.block].first = id;
+
+    next.prev = id;
+}
+
+t_block_id ir_function::split_block(const t_value_id at) {
+    const t_block_id from = instruction_list[at].block;
+    const t_block_id to = make_block();
+
+    ir_block& head = block_list[from];
+    ir_block& tail = block_list[to];
+
+    tail.first = at;
+    tail.last = head.last;
+    head.last = instruction_list[at].prev;
+
+    if (head.last != NO_VALUE)
+        instruction_list[head.last].next = NO_VALUE;
+    else
+        head.first = NO_VALUE;
+
+    instruction_list[at].prev = NO_VALUE;
+
+    for (t_value_id id = at; id != NO_VALUE; id = instruction_list[id].next)
+        instruction_list[id].block = to;
+
+    for (uint32_t i = 0; i < successor_count(to); i++) {
+        const t_block_id next = successor(to, i);
+
+        // Both targets of a branch can be the same block, which is renamed once.
+        if (i == 1 && next == successor(to, 0))
+            break;
+
+        for (t_value_id id = block_list[next].first; id != NO_VALUE && instruction_list[id].op == opcode::PHI; id = instruction_list[id].next) {
+            uint32_t* operand_list = operands(id);
+
+            for (uint32_t j = 0; j < instruction_list[id].operand_count; j += 2) {
+                if (operand_list[j] == from)
+                    operand_list[j] = to;
+            }
+        }
+    }
+
+    return to;
+}
+
+void ir_function::set_operands(const t_value_id id, const std::vector<uint32_t>& operand_list) {
+    instruction& target = instruction_list[id];
+
+    // Shrinking fits where the old ones were.
+    if (operand_list.size() > target.operand_count) {
+        target.operand_begin = static_cast<uint32_t>(operand_pool.size());
+        operand_pool.resize(operand_pool.size() + operand_list.size());
+    }
+
+    std::copy(operand_list.begin(), operand_list.end(), operand_pool.begin() + target.operand_begin);
+    target.operand_count = static_cast<uint16_t>(operand_list.size());
+}
+
+void ir_function::replace_all_uses(const t_value_id from, const t_value_id to) {
+    for (const ir_block& block : block_list) {
+        for (t_value_id id = block.first; id != NO_VALUE; id = instruction_list[id].next) {
+            const instruction& user = instruction_list[id];
+            uint32_t* operand_list = operands(id);
+
+            // Phi operands alternate between blocks and values.
+            const uint32_t step = user.op == opcode::PHI ? 2 : 1;
+
+            for (uint32_t i = step - 1; i < user.operand_count; i += step) {
+                if (operand_list[i] == from)
+                    operand_list[i] = to;
+            }
+        }
+    }
+}
+
+uint32_t ir_function::successor_count(const t_block_id block) const {
+    const t_value_id last = block_list[block].last;
+    if (last == NO_VALUE)
+        return 0;
+
+    switch (instruction_list[last].op) {
+        case opcode::JUMP: return 1;
+        case opcode::BRANCH: return 2;
+        default: return 0;
+    }
+}
+
+t_block_id ir_function::successor(const t_block_id block, const uint32_t i) const {
+    return instruction_list[block_list[block].last].target[i];
+}
+
+void ir_function::compute_predecessors() {
+    std::vector<uint32_t> count_list(block_list.size(), 0);
+
+    for (t_block_id block = 0; block < block_list.size(); block++) {
+        for (uint32_t i = 0; i < successor_count(block); i++)
+            count_list[successor(block, i)]++;
+    }
+
+    uint32_t begin = 0;
+    for (t_block_id block = 0; block < block_list.size(); block++) {
+        block_list[block].predecessor_begin = begin;
+        block_list[block].predecessor_count = 0;
+        begin += count_list[block];
+    }
+
+    predecessor_pool.assign(begin, NO_BLOCK);
+
+    // A branch with both targets the same counts the edge twice, like a phi would.
+    for (t_block_id block = 0; block < block_list.size(); block++) {
+        for (uint32_t i = 0; i < successor_count(block); i++) {
+            ir_block& target = block_list[successor(block, i)];
+            predecessor_pool[target.predecessor_begin + target.predecessor_count++] = block;
+        }
+    }
+}
+
+bool ir_function::remove_unreachable_blocks() {
+    std::vector<uint8_t> reached(block_list.size(), 0);
+    std::vector<t_block_id> stack = { 0 };
+
+    reached[0] = 1;
+
+    while (!stack.empty()) {
+        const t_block_id block = stack.back();
+        stack.pop_back();
+
+        for (uint32_t i = 0; i < successor_count(block); i++) {
+            const t_block_id next = successor(block, i);
+
+            if (!reached[next]) {
+                reached[next] = 1;
+                stack.push_back(next);
+            }
+        }
+    }
+
+    bool changed = false;
+
+    for (t_block_id block = 0; block < block_list.size(); block++) {
+        if (reached[block] || block_list[block].is_removed)
+            continue;
+
+        while (block_list[block].first != NO_VALUE)
+            remove(block_list[block].first);
+
+        block_list[block].is_removed = true;
+        changed = true;
+    }
+
+    if (!changed)
+        return false;
+
+    for (t_block_id block = 0; block < block_list.size(); block++) {
+        for (t_value_id id = block_list[block].first; id != NO_VALUE; id = instruction_list[id].next) {
+            if (instruction_list[id].op != opcode::PHI)
+                continue;
+
+            const uint32_t* operand_list = operands(id);
+            std::vector<uint32_t> kept;
+
+            for (uint32_t i = 0; i < instruction_list[id].operand_count; i += 2) {
+                if (reached[operand_list[i]]) {
+                    kept.push_back(operand_list[i]);
+                    kept.push_back(operand_list[i + 1]);
+                }
+            }
+
+            set_operands(id, kept);
+        }
+    }
+
+    compute_predecessors();
+    return true;
+}
+
+void ir_function::compact() {
+    std::vector<t_block_id> block_map(block_list.size(), NO_BLOCK);
+    std::vector<t_value_id> value_map(instruction_list.size(), NO_VALUE);
+
+    t_block_id block_count = 0;
+    t_value_id value_count = 0;
+
+    for (t_block_id block = 0; block < block_list.size(); block++) {
+        if (block_list[block].is_removed)
+            continue;
+
+        block_map[block] = block_count++;
+
+        for (t_value_id id = block_list[block].first; id != NO_VALUE; id = instruction_list[id].next)
+            value_map[id] = value_count++;
+    }
+
+    std::vector<instruction> new_instruction_list;
+    std::vector<uint32_t> new_operand_pool;
+    std::vector<ir_block> new_block_list;
+
+    new_instruction_list.reserve(value_count);
+    new_operand_pool.reserve(operand_pool.size());
+    new_block_list.reserve(block_count);
+
+    for (t_block_id block = 0; block < block_list.size(); block++) {
+        if (block_list[block].is_removed)
+            continue;
+
+        ir_block& created = new_block_list.emplace_back(ir_block{ NO_VALUE, NO_VALUE, 0, 0, false });
+
+        for (t_value_id id = block_list[block].first; id != NO_VALUE; id = instruction_list[id].next) {
+            instruction moved = instruction_list[id];
+            const uint32_t* operand_list = operands(id);
+
+            moved.operand_begin = static_cast<uint32_t>(new_operand_pool.size());
+            moved.block = block_map[block];
+            moved.prev = created.last;
+            moved.next = NO_VALUE;
+
+            for (uint32_t i = 0; i < moved.operand_count; i++) {
+                const bool is_block = moved.op == opcode::PHI && i % 2 == 0;
+                new_operand_pool.push_back(is_block ? block_map[operand_list[i]] : value_map[operand_list[i]]);
+            }
+
+            for (t_block_id& target : moved.target) {
+                if (target != NO_BLOCK)
+                    target = block_map[target];
+            }
+
+            const t_value_id new_id = static_cast<t_value_id>(new_instruction_list.size());
+
+            if (created.last != NO_VALUE)
+                new_instruction_list[created.last].next = new_id;
+            else
+                created.first = new_id;
+
+            created.last = new_id;
+            new_instruction_list.push_back(moved);
+        }
+    }
+
+    instruction_list = std::move(new_instruction_list);
+    operand_pool = std::move(new_operand_pool);
+    block_list = std::move(new_block_list);
+
+    compute_predecessors();
+}
+
+std::string ir_function::pretty_debug(const liprocess& process) const {
+    std::string buffer = "fn " + name + '(';
+
+    for (size_t i = 0; i < parameter_type_list.size(); i++) {
+        if (i != 0)
+            buffer += ", ";
+        buffer += type_name(parameter_type_list[i]);
+    }
+
+    buffer += std::string("): ") + type_name(return_type);
+
+    if (!complete)
+        return buffer + " - not lowered\n";
+
+    buffer += '\n';
+
+    for (t_block_id block = 0; block < block_list.size(); block++) {
+        if (block_list[block].is_removed)
+            continue;
+
+        buffer += "  b" + std::to_string(block) + ':';
+
+        if (block_list[block].predecessor_count != 0) {
+            buffer += " ; from";
+
+            for (uint32_t i = 0; i < block_list[block].predecessor_count; i++)
+                buffer += " b" + std::to_string(predecessors(block)[i]);
+        }
+
+        buffer += '\n';
+
+        for (t_value_id id = block_list[block].first; id != NO_VALUE; id = instruction_list[id].next) {
+            const instruction& at = instruction_list[id];
+            const uint32_t* operand_list = operands(id);
+
+            buffer += "    ";
+
+            if (at.type != ir_type::VOID)
+                buffer += 'v' + std::to_string(id) + " = ";
+
+            buffer += opcode_name(at.op);
+
+            if (at.type != ir_type::VOID)
+                buffer += std::string(".") + type_name(at.type);
+
+            switch (at.op) {
+                case opcode::PARAMETER:
+                    buffer += ' ' + std::to_string(at.immediate);
+                    break;
+                case opcode::CONSTANT:
+                    if (is_signed(at.type))
+                        buffer += ' ' + std::to_string(static_cast<int64_t>(at.immediate));
+                    else if (is_floating(at.type)) {
+                        double value;
+                        std::memcpy(&value, &at.immediate, sizeof(double));
+                        buffer += ' ' + std::to_string(value);
+                    }
+                    else
+                        buffer += ' ' + std::to_string(at.immediate);
+                    break;
+                case opcode::PHI:
+                    for (uint32_t i = 0; i < at.operand_count; i += 2)
+                        buffer += std::string(i == 0 ? " " : ", ") + "[b" + std::to_string(operand_list[i]) + ": v" + std::to_string(operand_list[i + 1]) + ']';
+                    break;
+                case opcode::LOAD_GLOBAL:
+                case opcode::STORE_GLOBAL:
+                case opcode::CALL:
+                    buffer += ' ' + process.name_table.get(at.symbol->name);
+                    break;
+                default:
+                    break;
+            }
+
+            if (at.op != opcode::PHI) {
+                for (uint32_t i = 0; i < at.operand_count; i++)
+                    buffer += std::string(i == 0 && at.op != opcode::CALL && at.op != opcode::STORE_GLOBAL ? " " : ", ") + 'v' + std::to_string(operand_list[i]);
+            }
+
+            for (const t_block_id target : at.target) {
+                if (target != NO_BLOCK)
+                    buffer += (at.op == opcode::JUMP ? " b" : ", b") + std::to_string(target);
+            }
+
+            buffer += '\n';
+        }
+    }
+
+    return buffer;
+}
+
+dominator_tree::dominator_tree(const ir_function& function) {
+    const size_t block_count = function.block_list.size();
+
+    order_list.assign(block_count, UINT32_MAX);
+    immediate_dominator.assign(block_count, NO_BLOCK);
+    child_begin_list.assign(block_count + 1, 0);
+
+    if (block_count == 0)
+        return;
+
+    // Postorder without recursion. Each stack entry remembers the next successor to visit.
+    std::vector<std::pair<t_block_id, uint32_t>> stack = { { 0, 0 } };
+    std::vector<uint8_t> visited(block_count, 0);
+
+    visited[0] = 1;
+
+    while (!stack.empty()) {
+        auto& [block, next] = stack.back();
+
+        if (next < function.successor_count(block)) {
+            const t_block_id successor = function.successor(block, next++);
+
+            if (!visited[successor]) {
+                visited[successor] = 1;
+                stack.push_back({ successor, 0 });
+            }
+
+            continue;
+        }
+
+        reverse_postorder.push_back(block);
+        stack.pop_back();
+    }
+
+    std::reverse(reverse_postorder.begin(), reverse_postorder.end());
+
+    for (uint32_t i = 0; i < reverse_postorder.size(); i++)
+        order_list[reverse_postorder[i]] = i;
+
+    auto intersect = [&](t_block_id a, t_block_id b) {
+        while (a != b) {
+            while (order_list[a] > order_list[b])
+                a = immediate_dominator[a];
+            while (order_list[b] > order_list[a])
+                b = immediate_dominator[b];
+        }
+
+        return a;
+    };
+
+    immediate_dominator[0] = 0;
+
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (uint32_t i = 1; i < reverse_postorder.size(); i++) {
+            const t_block_id block = reverse_postorder[i];
+            t_block_id dominator = NO_BLOCK;
+
+            for (uint32_t p = 0; p < function.block_list[block].predecessor_count; p++) {
+                const t_block_id predecessor = function.predecessors(block)[p];
+
+                if (immediate_dominator[predecessor] == NO_BLOCK)
+                    continue;
+
+                dominator = dominator == NO_BLOCK ? predecessor : intersect(predecessor, dominator);
+            }
+
+            if (immediate_dominator[block] != dominator) {
+                immediate_dominator[block] = dominator;
+                changed = true;
+            }
+        }
+    }
+
+    immediate_dominator[0] = NO_BLOCK;
+
+    for (t_block_id block = 0; block < block_count; block++) {
+        if (immediate_dominator[block] != NO_BLOCK)
+            child_begin_list[immediate_dominator[block] + 1]++;
+    }
+
+    for (size_t i = 1; i <= block_count; i++)
+        child_begin_list[i] += child_begin_list[i - 1];
+
+    child_pool.assign(child_begin_list[block_count], NO_BLOCK);
+    std::vector<uint32_t> fill_list(child_begin_list.begin(), child_begin_list.end() - 1);
+
+    // Children end up in reverse postorder, which keeps walks over the tree deterministic.
+    for (const t_block_id block : reverse_postorder) {
+        if (immediate_dominator[block] != NO_BLOCK)
+            child_pool[fill_list[immediate_dominator[block]]++] = block;
+    }
+
+    preorder_list.assign(block_count, 0);
+    postorder_list.assign(block_count, 0);
+
+    uint32_t clock = 0;
+    std::vector<std::pair<t_block_id, uint32_t>> walk = { { 0, 0 } };
+
+    preorder_list[0] = clock++;
+
+    while (!walk.empty()) {
+        auto& [block, next] = walk.back();
+
+        if (next < child_count(block)) {
+            const t_block_id child = children(block)[next++];
+
+            preorder_list[child] = clock++;
+            walk.push_back({ child, 0 });
+            continue;
+        }
+
+        postorder_list[block] = clock++;
+        walk.pop_back();
+    }
+}
+
+bool dominator_tree::dominates(const t_block_id a, const t_block_id b) const {
+    if (!is_reachable(a) || !is_reachable(b))
+        return false;
+
+    return preorder_list[a] <= preorder_list[b] && postorder_list[b] <= postorder_list[a];
+}
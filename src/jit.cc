@@ -0,0 +1,539 @@
+#include <cmath>
+#include <cstring>
+
+#include "jit.hh"
+#include "x64.hh"
+
+#if LICAN_JIT_AVAILABLE
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+using namespace core::backend;
+
+/*
+
+====================================================
+
+Code generation
+rbx holds the frame and r12 the machine for the whole function. rax, rcx, rdx, rsi, rdi and xmm0-1
+are scratch inside one template, nothing lives in them across bytecode instructions.
+
+Every function starts with the same prologue, which jumps to the entry it was given. The epilogue
+returns whatever is in eax.
+
+====================================================
+
+*/
+
+core::backend::jit_code::~jit_code() {
+#if LICAN_JIT_AVAILABLE
+    munmap(memory, size);
+#endif
+}
+
+#if LICAN_JIT_AVAILABLE
+
+namespace {
+    using namespace core::backend::x64;
+
+    // Where a rel32 has to point once everything is placed.
+    enum class label : uint8_t { BYTECODE, EPILOGUE, TRAPPED };
+
+    struct fixup {
+        size_t at; // The rel32
+        label kind;
+        uint32_t target; // Bytecode instruction, for BYTECODE
+    };
+
+    struct x64_assembler : assembler {
+        std::vector<fixup> fixup_list;
+
+        // [rbx + register * 8]
+        inline void frame_operand(const uint8_t reg, const uint16_t vm_register) {
+            emit({ static_cast<uint8_t>(0x83 | reg << 3) });
+            emit_u32(static_cast<uint32_t>(vm_register) * 8);
+        }
+
+        inline void load(const gpr reg, const uint16_t vm_register) {
+            emit({ 0x48, 0x8B });
+            frame_operand(reg, vm_register);
+        }
+
+        inline void store(const uint16_t vm_register, const gpr reg) {
+            emit({ 0x48, 0x89 });
+            frame_operand(reg, vm_register);
+        }
+
+        inline void load_double(const uint8_t xmm, const uint16_t vm_register) {
+            emit({ 0xF2, 0x0F, 0x10 });
+            frame_operand(xmm, vm_register);
+        }
+
+        inline void store_double(const uint16_t vm_register, const uint8_t xmm) {
+            emit({ 0xF2, 0x0F, 0x11 });
+            frame_operand(xmm, vm_register);
+        }
+
+        inline void move_immediate(const gpr reg, const uint64_t value) {
+            emit({ 0x48, static_cast<uint8_t>(0xB8 + reg) });
+            emit_u64(value);
+        }
+
+        // Follows the SysV calling convention like any compiled function, so helpers are plain C++.
+        inline void call(const void* helper) {
+            move_immediate(RAX, reinterpret_cast<uint64_t>(helper));
+            emit({ 0xFF, 0xD0 }); // call rax
+        }
+
+        inline void jump(const label kind, const uint32_t target = 0) {
+            emit({ 0xE9 });
+            fixup_list.push_back({ byte_list.size(), kind, target });
+            emit_u32(0);
+        }
+
+        inline void jump_if(const condition cc, const label kind, const uint32_t target = 0) {
+            emit({ 0x0F, static_cast<uint8_t>(0x80 | cc) });
+            fixup_list.push_back({ byte_list.size(), kind, target });
+            emit_u32(0);
+        }
+
+        // Extends rax from width, like the interpreter keeps every integer.
+        void wrap(const vm_width width) {
+            switch (width) {
+                case vm_width::S8: emit({ 0x48, 0x0F, 0xBE, 0xC0 }); break; // movsx rax, al
+                case vm_width::S16: emit({ 0x48, 0x0F, 0xBF, 0xC0 }); break; // movsx rax, ax
+                case vm_width::S32: emit({ 0x48, 0x63, 0xC0 }); break; // movsxd rax, eax
+                case vm_width::U8: emit({ 0x0F, 0xB6, 0xC0 }); break; // movzx eax, al
+                case vm_width::U16: emit({ 0x0F, 0xB7, 0xC0 }); break; // movzx eax, ax
+                case vm_width::U32: emit({ 0x89, 0xC0 }); break; // mov eax, eax
+                default: break;
+            }
+        }
+
+        // xmm0 rounded to f32 and back.
+        inline void round_f32() {
+            emit({ 0xF2, 0x0F, 0x5A, 0xC0 }); // cvtsd2ss xmm0, xmm0
+            emit({ 0xF3, 0x0F, 0x5A, 0xC0 }); // cvtss2sd xmm0, xmm0
+        }
+
+        // Leaves for the interpreter, which continues at bytecode instruction at.
+        inline void deoptimize(const uint32_t at) {
+            emit({ 0xB8 }); // mov eax, at
+            emit_u32(at);
+            jump(label::EPILOGUE);
+        }
+
+        inline void deoptimize_if(const condition cc, const uint32_t at) {
+            const size_t skip = short_jump(static_cast<uint8_t>(0x70 | (cc ^ 1)));
+            deoptimize(at);
+            land(skip);
+        }
+    };
+
+    double jit_fmod(const double x, const double y) {
+        return std::fmod(x, y);
+    }
+
+    double jit_pow(const double x, const double y) {
+        return std::pow(x, y);
+    }
+
+    inline bool in_family(const vm_op op, const vm_op family) {
+        return op >= family && static_cast<uint16_t>(op) < static_cast<uint16_t>(family) + 8;
+    }
+
+    inline vm_width width_in(const vm_op op, const vm_op family) {
+        return static_cast<vm_width>(static_cast<uint16_t>(op) - static_cast<uint16_t>(family));
+    }
+
+    inline bool is_signed_width(const vm_width width) {
+        return width <= vm_width::S64;
+    }
+
+    inline uint32_t target_of(const vm_instruction& at) {
+        return static_cast<uint32_t>(at.b) | static_cast<uint32_t>(at.c) << 16;
+    }
+
+    struct jit_state {
+        jit_state(const vm_program& program, const vm_function& function)
+            : program(program), function(function) {}
+
+        const vm_program& program;
+        const vm_function& function;
+
+        x64_assembler code;
+
+        void emit_integer_arithmetic(const vm_op op, const vm_instruction& at, const uint32_t index) {
+            vm_op family = vm_op::ADD_S8;
+
+            for (const vm_op candidate : { vm_op::ADD_S8, vm_op::SUB_S8, vm_op::MUL_S8, vm_op::DIV_S8, vm_op::MOD_S8, vm_op::POW_S8, vm_op::NEG_S8, vm_op::ADDI_S8, vm_op::EXTEND_S8 }) {
+                if (in_family(op, candidate))
+                    family = candidate;
+            }
+
+            const vm_width width = width_in(op, family);
+
+            if (family == vm_op::POW_S8) {
+                code.load(RDI, at.b);
+                code.load(RSI, at.c);
+
+                if (is_signed_width(width)) {
+                    code.emit({ 0x48, 0x85, 0xF6 }); // test rsi, rsi
+                    code.deoptimize_if(C_S, index);
+                }
+
+                code.call(reinterpret_cast<const void*>(&jit_power));
+                code.wrap(width);
+                code.store(at.a, RAX);
+                return;
+            }
+
+            code.load(RAX, at.b);
+
+            if (family == vm_op::ADD_S8 || family == vm_op::SUB_S8 || family == vm_op::MUL_S8 || family == vm_op::DIV_S8 || family == vm_op::MOD_S8)
+                code.load(RCX, at.c);
+
+            if (family == vm_op::ADD_S8)
+                code.emit({ 0x48, 0x01, 0xC8 }); // add rax, rcx
+            else if (family == vm_op::SUB_S8)
+                code.emit({ 0x48, 0x29, 0xC8 }); // sub rax, rcx
+            else if (family == vm_op::MUL_S8)
+                code.emit({ 0x48, 0x0F, 0xAF, 0xC1 }); // imul rax, rcx
+            else if (family == vm_op::NEG_S8)
+                code.emit({ 0x48, 0xF7, 0xD8 }); // neg rax
+            else if (family == vm_op::ADDI_S8) {
+                code.emit({ 0x48, 0x05 }); // add rax, imm32
+                code.emit_u32(static_cast<uint32_t>(static_cast<int32_t>(static_cast<int16_t>(at.c))));
+            }
+            else if (family == vm_op::DIV_S8 || family == vm_op::MOD_S8) {
+                const bool is_modulo = family == vm_op::MOD_S8;
+
+                code.emit({ 0x48, 0x85, 0xC9 }); // test rcx, rcx
+                code.deoptimize_if(C_E, index);
+
+                if (is_signed_width(width)) {
+                    // idiv faults on INT64_MIN / -1, which wraps in lican.
+                    code.emit({ 0x48, 0x83, 0xF9, 0xFF }); // cmp rcx, -1
+                    const size_t divide = code.short_jump(0x75); // jne
+
+                    if (is_modulo)
+                        code.emit({ 0x31, 0xC0 }); // xor eax, eax
+                    else
+                        code.emit({ 0x48, 0xF7, 0xD8 }); // neg rax
+
+                    const size_t done = code.short_jump(0xEB); // jmp
+                    code.land(divide);
+                    code.emit({ 0x48, 0x99 }); // cqo
+                    code.emit({ 0x48, 0xF7, 0xF9 }); // idiv rcx
+
+                    if (is_modulo)
+                        code.emit({ 0x48, 0x89, 0xD0 }); // mov rax, rdx
+
+                    code.land(done);
+                }
+                else {
+                    code.emit({ 0x31, 0xD2 }); // xor edx, edx
+                    code.emit({ 0x48, 0xF7, 0xF1 }); // div rcx
+
+                    if (is_modulo)
+                        code.emit({ 0x48, 0x89, 0xD0 }); // mov rax, rdx
+                }
+            }
+
+            code.wrap(width);
+            code.store(at.a, RAX);
+        }
+
+        void emit_float_arithmetic(const vm_op op, const vm_instruction& at) {
+            const bool is_f32 = op <= vm_op::NEG_F32;
+            const uint16_t index = static_cast<uint16_t>(op) - static_cast<uint16_t>(is_f32 ? vm_op::ADD_F32 : vm_op::ADD_F64);
+
+            // NEG flips the sign bit, which keeps an f32 value rounded.
+            if (index == 6) {
+                code.load(RAX, at.b);
+                code.emit({ 0x48, 0x0F, 0xBA, 0xF8, 0x3F }); // btc rax, 63
+                code.store(at.a, RAX);
+                return;
+            }
+
+            code.load_double(0, at.b);
+            code.load_double(1, at.c);
+
+            static const uint8_t SSE_LIST[] = { 0x58, 0x5C, 0x59, 0x5E }; // add, sub, mul, div
+
+            if (index < 4)
+                code.emit({ 0xF2, 0x0F, SSE_LIST[index], 0xC1 });
+            else
+                code.call(reinterpret_cast<const void*>(index == 4 ? &jit_fmod : &jit_pow));
+
+            if (is_f32)
+                code.round_f32();
+
+            code.store_double(at.a, 0);
+        }
+
+        void emit_comparison(const vm_op op, const vm_instruction& at) {
+            if (op >= vm_op::EQ_F) {
+                code.load_double(0, at.b);
+                code.load_double(1, at.c);
+
+                switch (op) {
+                    case vm_op::EQ_F:
+                    case vm_op::NE_F:
+                        // Unordered (NaN) sets the parity flag, and is never equal.
+                        code.emit({ 0x66, 0x0F, 0x2E, 0xC1 }); // ucomisd xmm0, xmm1
+                        code.emit({ 0x0F, static_cast<uint8_t>(0x90 | (op == vm_op::EQ_F ? C_E : C_NE)), 0xC0 });
+                        code.emit({ 0x0F, static_cast<uint8_t>(0x90 | (op == vm_op::EQ_F ? C_NP : C_P)), 0xC1 });
+                        code.emit({ static_cast<uint8_t>(op == vm_op::EQ_F ? 0x20 : 0x08), 0xC8 }); // and/or al, cl
+                        code.emit({ 0x0F, 0xB6, 0xC0 });
+                        break;
+                    case vm_op::LT_F:
+                    case vm_op::LE_F:
+                        code.emit({ 0x66, 0x0F, 0x2E, 0xC8 }); // ucomisd xmm1, xmm0
+                        code.set_bool(op == vm_op::LT_F ? C_A : C_AE);
+                        break;
+                    default:
+                        code.emit({ 0x66, 0x0F, 0x2E, 0xC1 }); // ucomisd xmm0, xmm1
+                        code.set_bool(op == vm_op::GT_F ? C_A : C_AE);
+                        break;
+                }
+
+                code.store(at.a, RAX);
+                return;
+            }
+
+            static const condition CONDITION_LIST[] = { C_E, C_NE, C_L, C_LE, C_G, C_GE, C_B, C_BE, C_A, C_AE };
+
+            code.load(RAX, at.b);
+            code.load(RCX, at.c);
+            code.emit({ 0x48, 0x39, 0xC8 }); // cmp rax, rcx
+            code.set_bool(CONDITION_LIST[static_cast<uint16_t>(op) - static_cast<uint16_t>(vm_op::EQ_I)]);
+            code.store(at.a, RAX);
+        }
+
+        void emit_convert(const vm_op op, const vm_instruction& at) {
+            switch (op) {
+                case vm_op::S_TO_F32:
+                case vm_op::S_TO_F64:
+                    code.load(RAX, at.b);
+                    code.emit({ 0xF2, 0x48, 0x0F, 0x2A, 0xC0 }); // cvtsi2sd xmm0, rax
+                    if (op == vm_op::S_TO_F32)
+                        code.round_f32();
+                    code.store_double(at.a, 0);
+                    return;
+                case vm_op::F64_TO_F32:
+                    code.load_double(0, at.b);
+                    code.round_f32();
+                    code.store_double(at.a, 0);
+                    return;
+                case vm_op::I_TO_BOOL:
+                    code.load(RAX, at.b);
+                    code.emit({ 0x48, 0x85, 0xC0 }); // test rax, rax
+                    code.set_bool(C_NE);
+                    code.store(at.a, RAX);
+                    return;
+                default:
+                    break;
+            }
+
+            // Everything else goes through the interpreter's conversion. Unsigned sources are
+            // zero extended, so any unsigned type reads them right.
+            uint32_t types = at.c;
+
+            if (op == vm_op::U_TO_F32 || op == vm_op::U_TO_F64)
+                types = static_cast<uint32_t>(ir_type::U64) << 8 | static_cast<uint32_t>(op == vm_op::U_TO_F32 ? ir_type::F32 : ir_type::F64);
+
+            code.load(RDI, at.b);
+            code.emit({ 0xBE }); // mov esi, types
+            code.emit_u32(types);
+            code.call(reinterpret_cast<const void*>(&jit_convert));
+            code.store(at.a, RAX);
+        }
+
+        // Emits the instruction at index. Returns how many words it takes.
+        uint32_t emit_instruction(const uint32_t index) {
+            const vm_instruction& at = function.code[index];
+            vm_op op = at.op;
+
+            if (op == vm_op::CONVERT) {
+                op = quickened_convert(static_cast<ir_type>(at.c >> 8), static_cast<ir_type>(at.c & 0xFF));
+
+                if (op == vm_op::CONVERT) {
+                    emit_convert(op, at);
+                    return 1;
+                }
+            }
+
+            if (in_family(op, vm_op::EXTEND_S8)) {
+                code.load(RAX, at.b);
+                code.wrap(width_in(op, vm_op::EXTEND_S8));
+                code.store(at.a, RAX);
+                return 1;
+            }
+
+            if (op >= vm_op::S_TO_F32 && op <= vm_op::I_TO_BOOL) {
+                emit_convert(op, at);
+                return 1;
+            }
+
+            if ((op >= vm_op::ADD_S8 && op <= vm_op::NEG_U64) || in_family(op, vm_op::ADDI_S8)) {
+                emit_integer_arithmetic(op, at, index);
+                return 1;
+            }
+
+            if (op >= vm_op::ADD_F32 && op <= vm_op::NEG_F64) {
+                emit_float_arithmetic(op, at);
+                return 1;
+            }
+
+            if (op >= vm_op::EQ_I && op <= vm_op::GE_F) {
+                emit_comparison(op, at);
+                return 1;
+            }
+
+            if (op >= vm_op::JUMP_EQ_I && op <= vm_op::JUMP_GE_U) {
+                static const condition CONDITION_LIST[] = { C_E, C_NE, C_L, C_LE, C_G, C_GE, C_B, C_BE, C_A, C_AE };
+
+                code.load(RAX, at.a);
+                code.load(RCX, at.b);
+                code.emit({ 0x48, 0x39, 0xC8 }); // cmp rax, rcx
+                code.jump_if(CONDITION_LIST[static_cast<uint16_t>(op) - static_cast<uint16_t>(vm_op::JUMP_EQ_I)], label::BYTECODE, target_of(function.code[index + 1]));
+                return 2;
+            }
+
+            switch (op) {
+                case vm_op::MOVE:
+                case vm_op::MOVE_JUMP:
+                    code.load(RAX, at.b);
+                    code.store(at.a, RAX);
+
+                    if (op == vm_op::MOVE)
+                        return 1;
+
+                    code.jump(label::BYTECODE, target_of(function.code[index + 1]));
+                    return 2;
+                case vm_op::LOAD_GLOBAL:
+                    code.move_immediate(RCX, reinterpret_cast<uint64_t>(program.global_list.data() + target_of(at)));
+                    code.emit({ 0x48, 0x8B, 0x01 }); // mov rax, [rcx]
+                    code.store(at.a, RAX);
+                    return 1;
+                case vm_op::STORE_GLOBAL:
+                    code.load(RAX, at.a);
+                    code.move_immediate(RCX, reinterpret_cast<uint64_t>(program.global_list.data() + target_of(at)));
+                    code.emit({ 0x48, 0x89, 0x01 }); // mov [rcx], rax
+                    return 1;
+                case vm_op::NOT:
+                    code.load(RAX, at.b);
+                    code.emit({ 0x48, 0x85, 0xC0 }); // test rax, rax
+                    code.set_bool(C_E);
+                    code.store(at.a, RAX);
+                    return 1;
+                case vm_op::JUMP:
+                    code.jump(label::BYTECODE, target_of(at));
+                    return 1;
+                case vm_op::JUMP_IF:
+                case vm_op::JUMP_IF_NOT:
+                    code.load(RAX, at.a);
+                    code.emit({ 0x48, 0x85, 0xC0 }); // test rax, rax
+                    code.jump_if(op == vm_op::JUMP_IF ? C_NE : C_E, label::BYTECODE, target_of(at));
+                    return 1;
+                case vm_op::CALL:
+                    code.emit({ 0x4C, 0x89, 0xE7 }); // mov rdi, r12
+                    code.emit({ 0x48, 0x89, 0xDE }); // mov rsi, rbx
+                    code.move_immediate(RDX, reinterpret_cast<uint64_t>(&function));
+                    code.emit({ 0xB9 }); // mov ecx, index
+                    code.emit_u32(index);
+                    code.call(reinterpret_cast<const void*>(&jit_call));
+                    code.emit({ 0x84, 0xC0 }); // test al, al
+                    code.jump_if(C_E, label::TRAPPED);
+                    return 1 + (at.c + 3) / 4;
+                case vm_op::RETURN:
+                    code.load(RAX, at.a);
+                    code.emit({ 0x48, 0x89, 0x03 }); // mov [rbx], rax
+                    [[fallthrough]];
+                case vm_op::RETURN_VOID:
+                    code.emit({ 0xB8 }); // mov eax, JIT_RETURNED
+                    code.emit_u32(JIT_RETURNED);
+                    code.jump(label::EPILOGUE);
+                    return 1;
+                default:
+                    // UNREACHABLE traps, which the interpreter reports.
+                    code.deoptimize(index);
+                    return 1;
+            }
+        }
+
+        std::shared_ptr<jit_code> compile() {
+            code.emit({ 0x53 }); // push rbx
+            code.emit({ 0x41, 0x54 }); // push r12
+            code.emit({ 0x41, 0x55 }); // push r13, which keeps calls 16 byte aligned
+            code.emit({ 0x48, 0x89, 0xFB }); // mov rbx, rdi
+            code.emit({ 0x49, 0x89, 0xF4 }); // mov r12, rsi
+            code.emit({ 0xFF, 0xE2 }); // jmp rdx
+
+            std::vector<uint32_t> offset_list(function.code.size(), 0);
+
+            for (uint32_t index = 0; index < function.code.size();) {
+                const uint32_t start = static_cast<uint32_t>(code.byte_list.size());
+                const uint32_t length = emit_instruction(index);
+
+                for (uint32_t i = 0; i < length && index + i < function.code.size(); i++)
+                    offset_list[index + i] = start;
+
+                index += length;
+            }
+
+            const uint32_t trapped = static_cast<uint32_t>(code.byte_list.size());
+            code.emit({ 0xB8 }); // mov eax, JIT_TRAPPED
+            code.emit_u32(JIT_TRAPPED);
+
+            const uint32_t epilogue = static_cast<uint32_t>(code.byte_list.size());
+            code.emit({ 0x41, 0x5D }); // pop r13
+            code.emit({ 0x41, 0x5C }); // pop r12
+            code.emit({ 0x5B }); // pop rbx
+            code.emit({ 0xC3 }); // ret
+
+            for (const fixup& at : code.fixup_list) {
+                const uint32_t target = at.kind == label::EPILOGUE ? epilogue : at.kind == label::TRAPPED ? trapped : offset_list[at.target];
+                const uint32_t relative = target - static_cast<uint32_t>(at.at + 4);
+
+                std::memcpy(code.byte_list.data() + at.at, &relative, 4);
+            }
+
+            // Written while writable, then made executable. Never both at once.
+            const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            const size_t size = (code.byte_list.size() + page - 1) / page * page;
+
+            void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory == MAP_FAILED)
+                return nullptr;
+
+            std::memcpy(memory, code.byte_list.data(), code.byte_list.size());
+
+            auto compiled = std::make_shared<jit_code>(static_cast<uint8_t*>(memory), size);
+            compiled->offset_list = std::move(offset_list);
+
+            if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0)
+                return nullptr;
+
+            return compiled;
+        }
+    };
+}
+
+std::shared_ptr<jit_code> core::backend::jit_compile(const vm_program& program, const vm_function& function) {
+    if (!function.is_runnable() || function.code.empty())
+        return nullptr;
+
+    jit_state state(program, function);
+    return state.compile();
+}
+
+#else
+
+std::shared_ptr<jit_code> core::backend::jit_compile(const vm_program&, const vm_function&) {
+    return nullptr;
+}
+
+#endif
@@ -246,13 +246,16 @@ bool core::frontend::lex(core::liprocess& process, const core::t_file_id file_id
 			lisel selection(state.file_id, start_pos, state.pos - 1);
 
 			state.buffer = process.sub_source_code(selection);
+
+            // Keywords get a name too since some of them (ctor) double as identifiers.
+            const t_name_id name_id = process.name_table.intern(state.buffer);
 			
 			if (token_keyword_map.find(state.buffer) != token_keyword_map.end()) {
-                token_list.emplace_back(token_keyword_map.at(state.buffer), selection);
+                token_list.emplace_back(token_keyword_map.at(state.buffer), selection, name_id);
                 continue;
 			}
 
-            token_list.emplace_back(token_type::IDENTIFIER, selection);
+            token_list.emplace_back(token_type::IDENTIFIER, selection, name_id);
 
 			continue;
 		}
@@ -1,3 +1,4 @@
+#include <cctype>
 #include <fstream>
 #include <iostream>
 #include <filesystem>
@@ -6,11 +7,27 @@
 #include "core.hh"
 #include "token.hh"
 #include "ast.hh"
+#include "ir.hh"
+#include "optimize.hh"
+#include "query.hh"
+#include "vm.hh"
 
 static inline bool contains_flag(const std::vector<std::string>& flags, const std::string& flag) {
     return std::find(flags.begin(), flags.end(), flag) != flags.end();
 }
 
+// The last -O<level> given, capped at the highest level there is.
+static inline uint8_t optimization_level(const std::vector<std::string>& flags) {
+    uint8_t level = 0;
+
+    for (const std::string& flag : flags) {
+        if (flag.size() == 3 && flag[0] == '-' && flag[1] == 'O' && std::isdigit(static_cast<unsigned char>(flag[2])))
+            level = static_cast<uint8_t>(std::min(flag[2] - '0', 2));
+    }
+
+    return level;
+}
+
 licanapi::liconfig::liconfig(const liconfig_init init) : 
     project_path(init.project_path), 
     entry_point_path(init.project_path + (init.project_path.length() > 0 ? "/" : "") + init.entry_point_subpath),
@@ -19,7 +36,19 @@ licanapi::liconfig::liconfig(const liconfig_init init) :
     _dump_ast(contains_flag(init.flag_list, "-a")),
     _dump_logs(contains_flag(init.flag_list, "-l")),
     _dump_chrono(contains_flag(init.flag_list, "-c")),
-    _show_cascading_logs(contains_flag(init.flag_list, "-s")) {}
+    _show_cascading_logs(contains_flag(init.flag_list, "-s")),
+    _ignore_interfaces(contains_flag(init.flag_list, "-r")),
+    _dump_ir(contains_flag(init.flag_list, "-i")),
+    _basic_bytecode(contains_flag(init.flag_list, "-b")),
+    _profile_vm(contains_flag(init.flag_list, "-p")),
+    _interpret_only(contains_flag(init.flag_list, "-x")),
+    _native_build(contains_flag(init.flag_list, "-n") || contains_flag(init.flag_list, "-e")),
+    _direct_objects(contains_flag(init.flag_list, "-e")),
+    _verify_allocation(contains_flag(init.flag_list, "-v")),
+    _whole_program(contains_flag(init.flag_list, "-w")),
+    _dump_queries(contains_flag(init.flag_list, "-q")),
+    optimization_level(::optimization_level(init.flag_list)),
+    thread_count(contains_flag(init.flag_list, "-u") ? 1 : init.thread_count) {}
 
 const std::string WRITE_CMD_TEMP_LOCATION = "LICANWRITE0";
 
@@ -42,12 +71,41 @@ bool run(core::liprocess& process) {
     if (!core::frontend::parse(process, 0))
         return false;
 
+    if (!core::frontend::resolve_uses(process, 0))
+        return false;
+
     if (!core::frontend::semantic_analyze(process, 0))
         return false;
 
+    if (!core::backend::lower(process, 0))
+        return false;
+
+    if (!core::backend::optimize(process, 0))
+        return false;
+
+    if (!core::backend::link(process, 0))
+        return false;
+
+    if (!core::backend::generate(process, 0))
+        return false;
+
     return true;
 }
 
+// Time summed over every function and thread, and how much each pass changed.
+static void dump_pass_statistics(const core::liprocess& process) {
+    if (!process.dump_pass_statistics.has_value())
+        return;
+
+    for (const core::backend::pass_statistics& pass : *std::any_cast<const core::backend::t_pass_statistics_ptr&>(process.dump_pass_statistics)) {
+        if (pass.run_count == 0)
+            continue;
+
+        std::cout << "  " << pass.name << ": " << static_cast<double>(pass.nanoseconds) / 1000000.0 << "ms, "
+            << pass.change_count << " change(s) in " << pass.run_count << " run(s)\n";
+    }
+}
+
 bool run_chrono(core::liprocess& process) {
     if (!core::frontend::init(process)) return false;
 
@@ -63,6 +121,43 @@ bool run_chrono(core::liprocess& process) {
     if (!parse.first) 
         return false;
 
+    std::cout << "Starting module resolution:\n";
+    auto resolve = measure_func(core::frontend::resolve_uses, process);
+    std::cout << "Resolve time: " << resolve.second.count() << "ms\n";
+    if (!resolve.first)
+        return false;
+
+    std::cout << "Starting semantic analysis:\n";
+    auto semantic = measure_func(core::frontend::semantic_analyze, process);
+    std::cout << "Semantic time: " << semantic.second.count() << "ms\n";
+    if (!semantic.first)
+        return false;
+
+    std::cout << "Starting IR lowering:\n";
+    auto lower = measure_func(core::backend::lower, process);
+    std::cout << "Lower time: " << lower.second.count() << "ms\n";
+    if (!lower.first)
+        return false;
+
+    std::cout << "Starting IR optimization:\n";
+    auto optimize = measure_func(core::backend::optimize, process);
+    std::cout << "Optimize time: " << optimize.second.count() << "ms\n";
+    dump_pass_statistics(process);
+    if (!optimize.first)
+        return false;
+
+    std::cout << "Starting whole program optimization:\n";
+    auto link = measure_func(core::backend::link, process);
+    std::cout << "Link time: " << link.second.count() << "ms\n";
+    if (!link.first)
+        return false;
+
+    std::cout << "Starting C generation:\n";
+    auto generate = measure_func(core::backend::generate, process);
+    std::cout << "Generate time: " << generate.second.count() << "ms\n";
+    if (!generate.first)
+        return false;
+
     return true;
 }
 
@@ -80,7 +175,45 @@ bool create_temp_file(const std::string& name, const std::string& content) {
     return true;
 }
 
-bool licanapi::build_project(const licanapi::liconfig_init& config) {
+// Runs the pipeline with what the session memoized, then hands it back for the next build.
+static bool run_in_session(core::liprocess& process, licanapi::lisession* session) {
+    if (session)
+        process.dump_query_engine = session->query_engine;
+
+    const bool run_success = process.config._dump_chrono ? run_chrono(process) : run(process);
+
+    if (session && process.dump_query_engine.has_value())
+        session->query_engine = process.dump_query_engine;
+
+    return run_success;
+}
+
+// Subjects are written as file..outer..name, with a name path after the declaration it is looked up from.
+static void dump_queries(const core::liprocess& process) {
+    if (!process.dump_query_engine.has_value())
+        return;
+
+    const core::semantic::query_engine& queries = *std::any_cast<const core::semantic::t_query_engine_ptr&>(process.dump_query_engine);
+
+    std::cout << "Queries: " << queries.computed_list().size() << " ran, " << queries.reuse_count() << " answered from memory.\n";
+
+    for (const core::semantic::query_key& key : queries.computed_list()) {
+        std::string subject;
+
+        for (const char c : queries.subject_name(key.subject)) {
+            if (c == '\0')
+                subject += "..";
+            else if (c == '\1')
+                subject += ' ';
+            else
+                subject += c;
+        }
+
+        std::cout << "  " << core::semantic::query_kind_name(key.kind) << ' ' << subject << '\n';
+    }
+}
+
+bool licanapi::build_project(const licanapi::liconfig_init& config, licanapi::lisession* session) {
     std::cout << "Building (";
 
     if (config.flag_list.size() == 0)
@@ -94,7 +227,10 @@ bool licanapi::build_project(const licanapi::liconfig_init& config) {
     
     core::liprocess process(config);
     
-    bool run_success = process.config._dump_chrono ? run_chrono(process) : run(process);
+    bool run_success = run_in_session(process, session);
+
+    if (process.config._dump_queries)
+        dump_queries(process);
 
     if (process.config._dump_logs) {
         std::cout << "Logs:\n";
@@ -125,8 +261,129 @@ bool licanapi::build_project(const licanapi::liconfig_init& config) {
             ast_arena.pretty_debug(process, 0, buffer, 0);
             std::cout << buffer << '\n';
         }
+
+        if (process.config._dump_ir && file.dump_ir_module.has_value()) {
+            std::cout << "IR:\n";
+            for (auto& function : std::any_cast<const core::backend::t_ir_module_ptr&>(file.dump_ir_module)->function_list) {
+                std::cout << function.pretty_debug(process);
+            }
+        }
+    }
+
+    return true;
+}
+
+// The instruction pairs that ran most, which is what superinstructions are chosen from.
+static void dump_pair_profile(const core::backend::vm_program& program) {
+    const size_t count = static_cast<size_t>(core::backend::vm_op::COUNT);
+
+    std::vector<size_t> pair_list;
+    uint64_t total = 0;
+
+    for (size_t i = 0; i < program.pair_count_list.size(); i++) {
+        total += program.pair_count_list[i];
+
+        if (program.pair_count_list[i] > 0)
+            pair_list.push_back(i);
+    }
+
+    std::sort(pair_list.begin(), pair_list.end(), [&program](const size_t x, const size_t y) {
+        return program.pair_count_list[x] > program.pair_count_list[y];
+    });
+
+    if (pair_list.size() > 10)
+        pair_list.resize(10);
+
+    std::cout << "Hottest instruction pairs:\n";
+
+    for (const size_t pair : pair_list) {
+        const uint64_t ran = program.pair_count_list[pair];
+
+        std::cout << "  " << core::backend::vm_op_name(static_cast<core::backend::vm_op>(pair / count))
+            << " -> " << core::backend::vm_op_name(static_cast<core::backend::vm_op>(pair % count))
+            << ": " << ran << " (" << (100.0 * static_cast<double>(ran) / static_cast<double>(total)) << "%)\n";
+    }
+}
+
+bool licanapi::run_project(const licanapi::liconfig_init& config, const std::string& function_name, const std::vector<std::string>& argument_list, licanapi::lisession* session) {
+    core::liprocess process(config);
+
+    bool run_success = run_in_session(process, session);
+
+    if (process.config._dump_queries)
+        dump_queries(process);
+
+    if (run_success) {
+        if (process.config._dump_chrono) {
+            std::cout << "Starting bytecode compilation:\n";
+            auto compile = measure_func(core::backend::compile_bytecode, process);
+            std::cout << "Bytecode time: " << compile.second.count() << "ms\n";
+            run_success = compile.first;
+        }
+        else
+            run_success = core::backend::compile_bytecode(process, 0);
+    }
+
+    if (process.config._dump_logs || !run_success) {
+        for (auto& log : process.log_list) {
+            std::cout << log.pretty_debug(process) << '\n';
+        }
+    }
+
+    if (!run_success) {
+        std::cout << "Nothing was run. One or more processes resulted in termination of the compiler.\n";
+        return false;
+    }
+
+    core::backend::vm_program& program = *std::any_cast<const core::backend::t_vm_program_ptr&>(process.dump_vm_program);
+
+    const uint32_t function = program.find(0, function_name);
+
+    if (function == UINT32_MAX) {
+        std::cout << "The entry point declares no function '" << function_name << "'.\n";
+        return false;
+    }
+
+    const core::backend::vm_function& entry = program.function_list[function];
+
+    if (argument_list.size() != entry.parameter_type_list.size()) {
+        std::cout << "'" << function_name << "' takes " << entry.parameter_type_list.size() << " argument(s), " << argument_list.size() << " given.\n";
+        return false;
+    }
+
+    std::vector<core::backend::vm_value> value_list(argument_list.size());
+
+    for (size_t i = 0; i < argument_list.size(); i++) {
+        if (!core::backend::parse_value(argument_list[i], entry.parameter_type_list[i], value_list[i])) {
+            std::cout << "'" << argument_list[i] << "' is not a valid " << core::backend::type_name(entry.parameter_type_list[i]) << ".\n";
+            return false;
+        }
     }
 
+    core::backend::vm_value result;
+    std::string trap;
+
+    if (process.config._profile_vm)
+        program.pair_count_list.assign(static_cast<size_t>(core::backend::vm_op::COUNT) * static_cast<size_t>(core::backend::vm_op::COUNT), 0);
+
+    std::chrono::time_point start = std::chrono::high_resolution_clock::now();
+    const bool execute_success = core::backend::execute(program, function, value_list, result, trap);
+    std::chrono::duration run_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start);
+
+    if (process.config._profile_vm)
+        dump_pair_profile(program);
+
+    if (!execute_success) {
+        std::cout << trap << '\n';
+        return false;
+    }
+
+    if (entry.return_type != core::backend::ir_type::VOID)
+        std::cout << "'" << function_name << "' returned " << core::backend::pretty_debug(result, entry.return_type) << ".\n";
+
+    if (process.config._dump_chrono)
+        std::cout << "Run time: " << run_time.count() << "ms\n";
+
     return true;
 }
 
@@ -0,0 +1,756 @@
+/*
+
+====================================================
+
+Writes and reads the IR of modules, and optimizes the program as a whole. Check link.hh for the
+file layout.
+
+====================================================
+
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "link.hh"
+#include "ast.hh"
+#include "symbol.hh"
+#include "ir.hh"
+#include "inline.hh"
+#include "interface.hh"
+#include "native.hh"
+#include "optimize.hh"
+#include "util.hh"
+
+using namespace core::ast;
+using namespace core::semantic;
+using namespace core::backend;
+
+// Functions up to this many instructions are inlined into other modules.
+constexpr uint32_t LINK_INLINE_SIZE = 32;
+
+std::string core::backend::link_ir_path(const liprocess& process, const t_file_id file_id) {
+    return unit_path(process, file_id) + LINK_IR_EXTENSION;
+}
+
+bool core::backend::has_link_ir(const liprocess& process, const t_file_id file_id) {
+    std::ifstream in(link_ir_path(process, file_id), std::ios::binary);
+
+    lir::header head = {};
+
+    if (!in.is_open() || !in.read(reinterpret_cast<char*>(&head), sizeof(head)))
+        return false;
+
+    const std::string& source_code = process.file_list[file_id].source_code;
+
+    return head.magic == LINK_IR_MAGIC && head.version == LINK_IR_VERSION && head.source_size == source_code.size() && head.source_hash == liutil::hash_bytes(source_code);
+}
+
+/*
+
+====================================================
+
+Writing
+
+====================================================
+
+*/
+
+namespace {
+    struct link_writer {
+        link_writer(core::liprocess& process, const core::t_file_id file_id, const std::unordered_set<const symbol*>* dropped_set)
+            : process(process), file_id(file_id), dropped_set(dropped_set) {}
+
+        core::liprocess& process;
+        const core::t_file_id file_id;
+
+        const std::unordered_set<const symbol*>* dropped_set; // nullptr if nothing was dropped
+
+        std::vector<const symbol*> symbol_list;
+        std::unordered_map<const symbol*, uint32_t> symbol_map;
+
+        std::vector<lir::constant> constant_list;
+        std::string body; // Functions, which add the symbols they refer to as they go
+
+        template <typename T>
+        inline void put(std::string& buffer, const T& value) {
+            buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        template <typename T>
+        inline void put_list(std::string& buffer, const std::vector<T>& list) {
+            put(buffer, static_cast<uint32_t>(list.size()));
+            buffer.append(reinterpret_cast<const char*>(list.data()), list.size() * sizeof(T));
+        }
+
+        inline void put_text(std::string& buffer, const std::string& text) {
+            put(buffer, static_cast<uint32_t>(text.size()));
+            buffer += text;
+        }
+
+        uint32_t add_symbol(const symbol* referenced) {
+            if (!referenced)
+                return LINK_IR_NONE;
+
+            auto it = symbol_map.find(referenced);
+            if (it != symbol_map.end())
+                return it->second;
+
+            const uint32_t index = static_cast<uint32_t>(symbol_list.size());
+            symbol_list.push_back(referenced);
+            symbol_map.emplace(referenced, index);
+
+            return index;
+        }
+
+        void add_function(const ir_function& function) {
+            put(body, add_symbol(function.source));
+            put_text(body, function.name);
+            const bool is_dropped = dropped_set && dropped_set->count(function.source);
+            put(body, static_cast<uint8_t>((function.complete ? lir::FUNCTION_COMPLETE : 0) | (is_dropped ? lir::FUNCTION_DROPPED : 0)));
+            put(body, function.return_type);
+            put_list(body, function.parameter_type_list);
+
+            std::vector<lir::instruction> instruction_list;
+            std::vector<lir::block> block_list;
+
+            for (const instruction& at : function.instruction_list) {
+                instruction_list.push_back({ at.immediate, at.operand_begin, at.block, at.prev, at.next, { at.target[0], at.target[1] },
+                    add_symbol(at.symbol), at.operand_count, static_cast<uint8_t>(at.op), static_cast<uint8_t>(at.type) });
+            }
+
+            for (const ir_block& block : function.block_list)
+                block_list.push_back({ block.first, block.last, static_cast<uint8_t>(block.is_removed), {} });
+
+            put_list(body, instruction_list);
+            put_list(body, function.operand_pool);
+            put_list(body, block_list);
+        }
+
+        // Module level consts of the file folded by semantic analysis, the ones lowering folds when
+        // it has the source of their module.
+        void add_constants(const scope* target) {
+            const symbol_table& table = *std::any_cast<const t_symbol_table_ptr&>(process.file_list[file_id].dump_symbol_table);
+            const type_table& types = *std::any_cast<const t_type_table_ptr&>(process.dump_type_table);
+            const ast_arena& ast = std::any_cast<const ast_arena&>(process.file_list[file_id].dump_ast_arena);
+
+            std::vector<const symbol*> variable_list;
+
+            target->table.for_each([&](const uint32_t, symbol* declared) {
+                if (declared->kind == symbol_kind::MODULE && declared->inner && declared->file_id == file_id)
+                    add_constants(declared->inner);
+                else if (declared->kind == symbol_kind::VARIANT && declared->file_id == file_id && declared->node != NO_NODE && declared->type != NO_TYPE && (types.get(declared->type).flags & TYPE_CONST))
+                    variable_list.push_back(declared);
+            });
+
+            // The map is in hash order, declarations are not.
+            std::sort(variable_list.begin(), variable_list.end(), [](const symbol* x, const symbol* y) { return x->node < y->node; });
+
+            for (const symbol* variable : variable_list) {
+                const t_node_id value = ast.get_as<variant_declaration>(variable->node).value;
+
+                if (const constant* folded = table.constant_map.find(static_cast<uint32_t>(value)))
+                    constant_list.push_back({ constant_bits(*folded), add_symbol(variable), 0 });
+            }
+        }
+
+        std::string serialize() {
+            const core::liprocess::lifile& file = process.file_list[file_id];
+            const ir_module& module = *std::any_cast<const t_ir_module_ptr&>(file.dump_ir_module);
+
+            for (const ir_function& function : module.function_list)
+                add_function(function);
+
+            add_constants(std::any_cast<const t_symbol_table_ptr&>(file.dump_symbol_table)->root);
+
+            lir::header head = {};
+            head.magic = LINK_IR_MAGIC;
+            head.version = LINK_IR_VERSION;
+            head.source_hash = liutil::hash_bytes(file.source_code);
+            head.source_size = file.source_code.size();
+            head.symbol_count = static_cast<uint32_t>(symbol_list.size());
+            head.constant_count = static_cast<uint32_t>(constant_list.size());
+            head.function_count = static_cast<uint32_t>(module.function_list.size());
+
+            std::string buffer;
+            put(buffer, head);
+
+            for (const symbol* referenced : symbol_list)
+                put_text(buffer, link_name(process, referenced));
+
+            for (const lir::constant& folded : constant_list)
+                put(buffer, folded);
+
+            return buffer + body;
+        }
+    };
+}
+
+// Unless the file already holds the same bytes, so builds that did not change anything leave it be.
+static bool write_link_ir(core::liprocess& process, const core::t_file_id file_id, const std::unordered_set<const symbol*>* dropped_set = nullptr) {
+    const std::string path = link_ir_path(process, file_id);
+    const std::string buffer = link_writer(process, file_id, dropped_set).serialize();
+
+    {
+        std::ifstream in(path, std::ios::binary);
+
+        if (in.is_open() && std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()) == buffer)
+            return true;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+
+    if (!out.is_open())
+        return false;
+
+    out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+
+    return out.good();
+}
+
+/*
+
+====================================================
+
+Reading
+
+====================================================
+
+*/
+
+using t_link_symbol_map = std::unordered_map<std::string, const symbol*>;
+
+// Module level functions and variants of a file by link name, which is how the IR of a module refers
+// to anything. Modules of other files seen through a use are theirs to collect.
+static void collect_link_symbols(const core::liprocess& process, const core::t_file_id file_id, const scope* target, t_link_symbol_map& symbol_map) {
+    target->table.for_each([&](const uint32_t, symbol* declared) {
+        if (declared->file_id != file_id)
+            return;
+
+        switch (declared->kind) {
+            case symbol_kind::MODULE:
+                if (declared->inner)
+                    collect_link_symbols(process, file_id, declared->inner, symbol_map);
+                break;
+            case symbol_kind::FUNCTION:
+            case symbol_kind::VARIANT:
+                symbol_map.emplace(link_name(process, declared), declared);
+                break;
+            default:
+                break;
+        }
+    });
+}
+
+namespace {
+    struct link_reader {
+        link_reader(const std::string& data, const t_link_symbol_map& symbol_map)
+            : data(data), symbol_map(symbol_map) {}
+
+        const std::string& data;
+        const t_link_symbol_map& symbol_map;
+
+        size_t at = 0;
+        bool is_valid = true;
+
+        std::vector<const symbol*> symbol_list; // nullptr where the symbol is not in this build
+
+        template <typename T>
+        T take() {
+            T value = {};
+
+            if (!is_valid || data.size() - at < sizeof(T)) {
+                is_valid = false;
+                return value;
+            }
+
+            std::memcpy(&value, data.data() + at, sizeof(T));
+            at += sizeof(T);
+
+            return value;
+        }
+
+        template <typename T>
+        std::vector<T> take_list() {
+            const uint32_t count = take<uint32_t>();
+
+            if (!is_valid || (data.size() - at) / sizeof(T) < count) {
+                is_valid = false;
+                return {};
+            }
+
+            std::vector<T> list(count);
+            std::memcpy(list.data(), data.data() + at, count * sizeof(T));
+            at += count * sizeof(T);
+
+            return list;
+        }
+
+        std::string take_text() {
+            const std::vector<char> text = take_list<char>();
+            return std::string(text.begin(), text.end());
+        }
+
+        inline const symbol* take_symbol(const uint32_t index) {
+            if (index == LINK_IR_NONE)
+                return nullptr;
+
+            if (index >= symbol_list.size()) {
+                is_valid = false;
+                return nullptr;
+            }
+
+            return symbol_list[index];
+        }
+
+        static inline bool is_type(const uint8_t type) { return type <= static_cast<uint8_t>(ir_type::PTR); }
+        static inline bool is_index(const uint32_t index, const size_t count) { return index == UINT32_MAX || index < count; }
+
+        // False if the function refers to something this build does not have, in which case it can
+        // only be called, never looked into.
+        bool take_function(ir_function& function, bool& is_dropped) {
+            const uint32_t source = take<uint32_t>();
+            function.source = take_symbol(source);
+            function.name = take_text();
+
+            const uint8_t flags = take<uint8_t>();
+            function.complete = flags & lir::FUNCTION_COMPLETE;
+            is_dropped = flags & lir::FUNCTION_DROPPED;
+
+            const uint8_t return_type = take<uint8_t>();
+            const std::vector<uint8_t> parameter_type_list = take_list<uint8_t>();
+
+            const std::vector<lir::instruction> instruction_list = take_list<lir::instruction>();
+            function.operand_pool = take_list<uint32_t>();
+            const std::vector<lir::block> block_list = take_list<lir::block>();
+
+            is_valid = is_valid && is_type(return_type);
+            function.return_type = static_cast<ir_type>(return_type);
+
+            for (const uint8_t type : parameter_type_list) {
+                is_valid = is_valid && is_type(type);
+                function.parameter_type_list.push_back(static_cast<ir_type>(type));
+            }
+
+            bool is_resolved = function.source != nullptr;
+
+            for (const lir::instruction& at : instruction_list) {
+                const opcode op = static_cast<opcode>(at.op);
+
+                is_valid = is_valid && at.op <= static_cast<uint8_t>(opcode::UNREACHABLE) && is_type(at.type)
+                    && static_cast<uint64_t>(at.operand_begin) + at.operand_count <= function.operand_pool.size()
+                    && at.block < block_list.size() && is_index(at.prev, instruction_list.size()) && is_index(at.next, instruction_list.size())
+                    && is_index(at.target[0], block_list.size()) && is_index(at.target[1], block_list.size());
+
+                if (!is_valid)
+                    return false;
+
+                // Phis alternate blocks and values.
+                for (uint32_t i = 0; i < at.operand_count; i++)
+                    is_valid = is_valid && function.operand_pool[at.operand_begin + i] < (op == opcode::PHI && i % 2 == 0 ? block_list.size() : instruction_list.size());
+
+                const symbol* referenced = take_symbol(at.symbol);
+                is_resolved = is_resolved && (at.symbol == LINK_IR_NONE || referenced);
+
+                function.instruction_list.push_back({ op, static_cast<ir_type>(at.type), at.operand_count, at.operand_begin,
+                    at.block, at.prev, at.next, at.immediate, { at.target[0], at.target[1] }, referenced });
+            }
+
+            for (const lir::block& block : block_list) {
+                is_valid = is_valid && is_index(block.first, instruction_list.size()) && is_index(block.last, instruction_list.size());
+                function.block_list.push_back({ block.first, block.last, 0, 0, block.is_removed != 0 });
+            }
+
+            if (!is_valid)
+                return false;
+
+            function.compute_predecessors();
+            return is_resolved;
+        }
+    };
+}
+
+// The IR of an interface-only module, nullptr if it has none or it is out of date. Its consts go into
+// constant_map and the functions its object does not have into dropped_set.
+static std::shared_ptr<ir_module> read_link_ir(core::liprocess& process, const core::t_file_id file_id, const t_link_symbol_map& symbol_map, std::unordered_map<const symbol*, uint64_t>& constant_map, std::unordered_set<const symbol*>& dropped_set) {
+    const std::string path = link_ir_path(process, file_id);
+    std::ifstream in(path, std::ios::binary);
+
+    if (!in.is_open())
+        return nullptr;
+
+    const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const core::liprocess::lifile& file = process.file_list[file_id];
+
+    link_reader reader(data, symbol_map);
+    const lir::header head = reader.take<lir::header>();
+
+    if (!reader.is_valid || head.magic != LINK_IR_MAGIC || head.version != LINK_IR_VERSION)
+        return nullptr;
+
+    if (head.source_size != file.source_code.size() || head.source_hash != liutil::hash_bytes(file.source_code))
+        return nullptr;
+
+    for (uint32_t i = 0; i < head.symbol_count && reader.is_valid; i++) {
+        auto it = symbol_map.find(reader.take_text());
+        reader.symbol_list.push_back(it != symbol_map.end() ? it->second : nullptr);
+    }
+
+    std::vector<std::pair<const symbol*, uint64_t>> constant_list;
+    std::vector<const symbol*> dropped_list;
+
+    for (uint32_t i = 0; i < head.constant_count && reader.is_valid; i++) {
+        const lir::constant folded = reader.take<lir::constant>();
+
+        if (const symbol* variable = reader.take_symbol(folded.symbol))
+            constant_list.emplace_back(variable, folded.bits);
+    }
+
+    std::shared_ptr<ir_module> module = std::make_shared<ir_module>();
+
+    for (uint32_t i = 0; i < head.function_count && reader.is_valid; i++) {
+        ir_function function;
+        function.file_id = file_id;
+
+        bool is_dropped = false;
+
+        if (!reader.take_function(function, is_dropped))
+            function.complete = false;
+
+        if (function.source && is_dropped)
+            dropped_list.push_back(function.source);
+
+        if (function.source) {
+            module->function_map.emplace(function.source, static_cast<uint32_t>(module->function_list.size()));
+            module->function_list.push_back(std::move(function));
+        }
+    }
+
+    if (!reader.is_valid) {
+        process.add_log(core::lilog::log_level::WARNING, core::lisel(file_id, 0), "Ignoring malformed module IR '" + path + "'.");
+        return nullptr;
+    }
+
+    constant_map.insert(constant_list.begin(), constant_list.end());
+    dropped_set.insert(dropped_list.begin(), dropped_list.end());
+    return module;
+}
+
+/*
+
+====================================================
+
+Whole program
+
+====================================================
+
+*/
+
+static bool has_calls(const ir_function& function) {
+    for (const ir_block& block : function.block_list) {
+        for (t_value_id id = block.first; id != NO_VALUE; id = function.at(id).next) {
+            if (function.at(id).op == opcode::CALL)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+static uint32_t fold_constants(ir_function& function, const std::unordered_map<const symbol*, uint64_t>& constant_map) {
+    uint32_t change_count = 0;
+
+    for (const ir_block& block : function.block_list) {
+        for (t_value_id id = block.first; id != NO_VALUE; id = function.at(id).next) {
+            instruction& at = function.at(id);
+
+            if (at.op != opcode::LOAD_GLOBAL)
+                continue;
+
+            auto it = constant_map.find(at.symbol);
+            if (it == constant_map.end())
+                continue;
+
+            at.op = opcode::CONSTANT;
+            at.immediate = it->second;
+            at.symbol = nullptr;
+            change_count++;
+        }
+    }
+
+    return change_count;
+}
+
+// Small functions that call nothing themselves, and so are never inlined into. They can be copied
+// while other functions are.
+static bool is_inlined(const ir_function& callee) {
+    return can_inline(callee) && function_size(callee) <= LINK_INLINE_SIZE && !has_calls(callee);
+}
+
+// Calls of functions of other modules in inline_map.
+static uint32_t inline_leaf_calls(ir_function& function, const std::unordered_map<const symbol*, const ir_function*>& inline_map) {
+    std::vector<std::pair<t_value_id, const ir_function*>> call_list;
+
+    for (const ir_block& block : function.block_list) {
+        for (t_value_id id = block.first; id != NO_VALUE; id = function.at(id).next) {
+            const instruction& at = function.at(id);
+
+            if (at.op != opcode::CALL)
+                continue;
+
+            auto it = inline_map.find(at.symbol);
+
+            if (it != inline_map.end() && it->second->file_id != function.file_id)
+                call_list.emplace_back(id, it->second);
+        }
+    }
+
+    for (const auto& [call, callee] : call_list)
+        inline_call(function, call, *callee);
+
+    return static_cast<uint32_t>(call_list.size());
+}
+
+// Drops functions of lowered modules that nothing reachable calls. The object of a module that lost
+// some only serves whole program builds, so its interface is marked as such and its IR is written
+// again without them. Closures are not part of any interface, and the ones inlined everywhere they
+// were called are simply gone.
+static void eliminate_dead_functions(core::liprocess& process, const std::vector<const ir_function*>& root_list, const std::unordered_map<const symbol*, const ir_function*>& function_map, const bool has_output) {
+    std::unordered_map<const symbol*, bool> reached;
+    std::vector<const ir_function*> stack = root_list;
+
+    for (const ir_function* root : root_list)
+        reached[root->source] = true;
+
+    while (!stack.empty()) {
+        const ir_function& function = *stack.back();
+        stack.pop_back();
+
+        for (const ir_block& block : function.block_list) {
+            for (t_value_id id = block.first; id != NO_VALUE; id = function.at(id).next) {
+                const instruction& at = function.at(id);
+
+                if (at.op != opcode::CALL || reached[at.symbol])
+                    continue;
+
+                reached[at.symbol] = true;
+
+                auto it = function_map.find(at.symbol);
+                if (it != function_map.end())
+                    stack.push_back(it->second);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < process.file_list.size(); i++) {
+        if (!process.file_list[i].dump_ir_module.has_value())
+            continue;
+
+        ir_module& module = *std::any_cast<const t_ir_module_ptr&>(process.file_list[i].dump_ir_module);
+
+        if (std::all_of(module.function_list.begin(), module.function_list.end(), [&](const ir_function& function) { return reached[function.source] || is_closure(function.source); }))
+            continue;
+
+        const core::t_file_id file_id = static_cast<core::t_file_id>(i);
+
+        // Written while the dropped functions are still around, so later builds can inline them.
+        if (has_output) {
+            std::unordered_set<const symbol*> dropped_set;
+
+            for (const ir_function& function : module.function_list) {
+                if (!reached[function.source])
+                    dropped_set.insert(function.source);
+            }
+
+            core::frontend::mark_whole_program_only(process, file_id);
+
+            if (!write_link_ir(process, file_id, &dropped_set))
+                process.add_log(core::lilog::log_level::WARNING, core::lisel(file_id, 0), "Failed to write module IR '" + link_ir_path(process, file_id) + "'.");
+        }
+
+        std::vector<ir_function> kept;
+
+        for (ir_function& function : module.function_list) {
+            if (reached[function.source])
+                kept.push_back(std::move(function));
+        }
+
+        module.function_list = std::move(kept);
+        module.function_map.clear();
+
+        for (uint32_t i = 0; i < module.function_list.size(); i++)
+            module.function_map.emplace(module.function_list[i].source, i);
+    }
+}
+
+// Calls left over after inlining of functions an earlier whole program build dropped from the object
+// of their module. Those would only fail once the program is linked.
+static bool check_dropped_calls(core::liprocess& process, const std::vector<ir_function*>& function_list, const std::unordered_set<const symbol*>& dropped_set) {
+    bool success = true;
+
+    for (const ir_function* function : function_list) {
+        for (const ir_block& block : function->block_list) {
+            for (t_value_id id = block.first; id != NO_VALUE; id = function->at(id).next) {
+                const instruction& at = function->at(id);
+
+                if (at.op != opcode::CALL || !dropped_set.count(at.symbol))
+                    continue;
+
+                process.add_log(core::lilog::log_level::ERROR, core::lisel(function->file_id, 0), "'" + function->name + "' calls '" + link_name(process, at.symbol) +
+                    "', which an earlier whole program build dropped from '" + process.file_list[at.symbol->file_id].path + "'. Build with -r to compile the module again.");
+                success = false;
+            }
+        }
+    }
+
+    return success;
+}
+
+// With -w, writes the IR of every lowered module and optimizes the program as a whole. Check link.hh.
+bool core::backend::link(liprocess& process, const t_file_id /*entry*/) {
+    if (!process.config._whole_program)
+        return true;
+
+    const bool has_output = std::filesystem::is_directory(process.config.output_path);
+
+    std::vector<t_file_id> lowered_list;
+    std::vector<t_file_id> imported_list;
+
+    for (size_t i = 0; i < process.file_list.size(); i++) {
+        if (process.file_list[i].dump_ir_module.has_value())
+            lowered_list.push_back(static_cast<t_file_id>(i));
+        else if (process.file_list[i].is_interface_only())
+            imported_list.push_back(static_cast<t_file_id>(i));
+    }
+
+    if (has_output) {
+        std::vector<uint8_t> failed_list(lowered_list.size(), 0);
+
+        process.pool.parallel_for(lowered_list.size(), [&](const size_t i) {
+            failed_list[i] = !write_link_ir(process, lowered_list[i]);
+        });
+
+        for (size_t i = 0; i < lowered_list.size(); i++) {
+            if (failed_list[i])
+                process.add_log(lilog::log_level::WARNING, lisel(lowered_list[i], 0), "Failed to write module IR '" + link_ir_path(process, lowered_list[i]) + "'.");
+        }
+    }
+
+    t_link_symbol_map symbol_map;
+
+    for (size_t i = 0; i < process.file_list.size(); i++) {
+        if (process.file_list[i].dump_symbol_table.has_value())
+            collect_link_symbols(process, static_cast<t_file_id>(i), std::any_cast<const t_symbol_table_ptr&>(process.file_list[i].dump_symbol_table)->root, symbol_map);
+    }
+
+    // Read back in the order of the files, so the same build always merges the same way.
+    std::vector<std::shared_ptr<ir_module>> imported_module_list;
+    std::unordered_map<const symbol*, uint64_t> constant_map;
+    std::unordered_set<const symbol*> dropped_set;
+    bool is_whole = true;
+
+    for (const t_file_id imported : imported_list) {
+        std::shared_ptr<ir_module> module = has_output ? read_link_ir(process, imported, symbol_map, constant_map, dropped_set) : nullptr;
+
+        if (module) {
+            imported_module_list.push_back(std::move(module));
+            continue;
+        }
+
+        process.add_log(lilog::log_level::WARNING, lisel(imported, 0), "'" + process.file_list[imported].path + "' has no readable module IR, so the program is not optimized as a whole. Build with -r to compile it again.");
+        is_whole = false;
+    }
+
+    std::unordered_map<const symbol*, const ir_function*> function_map;
+    std::vector<ir_function*> function_list; // Lowered and complete, the ones that can change
+
+    for (const t_file_id lowered : lowered_list) {
+        for (ir_function& function : std::any_cast<const t_ir_module_ptr&>(process.file_list[lowered].dump_ir_module)->function_list) {
+            function_map.emplace(function.source, &function);
+
+            if (function.complete)
+                function_list.push_back(&function);
+        }
+    }
+
+    for (const std::shared_ptr<ir_module>& module : imported_module_list) {
+        for (const ir_function& function : module->function_list)
+            function_map.emplace(function.source, &function);
+    }
+
+    // Folding first, so the functions inlined next come with their consts folded. Inlining only
+    // ever copies functions it does not change.
+    std::vector<uint8_t> changed_list(function_list.size(), 0);
+
+    process.pool.parallel_for(function_list.size(), [&](const size_t i) {
+        changed_list[i] = fold_constants(*function_list[i], constant_map) > 0;
+    });
+
+    std::unordered_map<const symbol*, const ir_function*> inline_map;
+
+    for (const auto& [source, function] : function_map) {
+        if (is_inlined(*function))
+            inline_map.emplace(source, function);
+    }
+
+    process.pool.parallel_for(function_list.size(), [&](const size_t i) {
+        changed_list[i] = inline_leaf_calls(*function_list[i], inline_map) > 0 || changed_list[i];
+    });
+
+    const pass_manager manager(process.config.optimization_level);
+    std::vector<std::vector<pass_statistics>> statistics_list(function_list.size());
+
+    process.pool.parallel_for(function_list.size(), [&](const size_t i) {
+        if (!changed_list[i])
+            return;
+
+        for (const ir_pass& pass : pass_manager::pass_list())
+            statistics_list[i].push_back({ pass.name });
+
+        function_list[i]->compact();
+        manager.run(*function_list[i], statistics_list[i]);
+    });
+
+    if (process.dump_pass_statistics.has_value()) {
+        std::vector<pass_statistics>& total = *std::any_cast<const t_pass_statistics_ptr&>(process.dump_pass_statistics);
+
+        for (const std::vector<pass_statistics>& statistics : statistics_list) {
+            for (size_t i = 0; i < statistics.size(); i++) {
+                total[i].nanoseconds += statistics[i].nanoseconds;
+                total[i].change_count += statistics[i].change_count;
+                total[i].run_count += statistics[i].run_count;
+            }
+        }
+    }
+
+    if (!check_dropped_calls(process, function_list, dropped_set))
+        return false;
+
+    if (!is_whole || lowered_list.empty() || lowered_list[0] != 0)
+        return true;
+
+    // The entry point is the program, and whatever modules built before call stays in use.
+    std::vector<const ir_function*> root_list;
+
+    for (const ir_function& function : std::any_cast<const t_ir_module_ptr&>(process.file_list[0].dump_ir_module)->function_list)
+        root_list.push_back(&function);
+
+    for (const std::shared_ptr<ir_module>& module : imported_module_list) {
+        for (const ir_function& function : module->function_list) {
+            if (!dropped_set.count(function.source))
+                root_list.push_back(&function);
+        }
+    }
+
+    eliminate_dead_functions(process, root_list, function_map, has_output);
+
+    return true;
+}
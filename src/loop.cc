@@ -0,0 +1,512 @@
+#include <algorithm>
+#include <utility>
+
+#include "loop.hh"
+#include "optimize.hh"
+
+using namespace core::backend;
+
+/*
+
+====================================================
+
+Loop forest
+
+====================================================
+
+*/
+
+loop_forest::loop_forest(const ir_function& function, const dominator_tree& tree) {
+    const size_t block_count = function.block_list.size();
+    innermost_list.assign(block_count, NO_LOOP);
+
+    // Headers in reverse postorder, so a loop is found before the loops nested in it.
+    std::vector<natural_loop> found;
+
+    for (const t_block_id header : tree.reverse_postorder) {
+        natural_loop loop{ header, NO_LOOP, 1, {}, {}, {} };
+
+        const t_block_id* predecessor_list = function.predecessors(header);
+
+        for (uint32_t i = 0; i < function.block_list[header].predecessor_count; i++) {
+            const t_block_id from = predecessor_list[i];
+
+            if (tree.is_reachable(from) && tree.dominates(header, from) && std::find(loop.latch_list.begin(), loop.latch_list.end(), from) == loop.latch_list.end())
+                loop.latch_list.push_back(from);
+        }
+
+        if (!loop.latch_list.empty())
+            found.push_back(std::move(loop));
+    }
+
+    std::vector<uint32_t> mark_list(block_count, NO_LOOP);
+    std::vector<t_block_id> work;
+
+    for (uint32_t index = 0; index < found.size(); index++) {
+        natural_loop& loop = found[index];
+
+        // Walk back from the latches until the header.
+        mark_list[loop.header] = index;
+        work.clear();
+
+        for (const t_block_id latch : loop.latch_list)
+            work.push_back(latch);
+
+        while (!work.empty()) {
+            const t_block_id block = work.back();
+            work.pop_back();
+
+            if (mark_list[block] == index)
+                continue;
+
+            mark_list[block] = index;
+
+            const t_block_id* predecessor_list = function.predecessors(block);
+
+            for (uint32_t i = 0; i < function.block_list[block].predecessor_count; i++) {
+                if (tree.is_reachable(predecessor_list[i]) && mark_list[predecessor_list[i]] != index)
+                    work.push_back(predecessor_list[i]);
+            }
+        }
+
+        for (const t_block_id block : tree.reverse_postorder) {
+            if (mark_list[block] == index)
+                loop.block_list.push_back(block);
+        }
+
+        for (const t_block_id block : loop.block_list) {
+            for (uint32_t i = 0; i < function.successor_count(block); i++) {
+                const t_block_id to = function.successor(block, i);
+
+                if (mark_list[to] != index)
+                    loop.exit_list.push_back({ block, to });
+            }
+        }
+
+        // Outer loops were found first and have marked their blocks already.
+        loop.parent = innermost_list[loop.header];
+        loop.depth = loop.parent == NO_LOOP ? 1 : found[loop.parent].depth + 1;
+
+        for (const t_block_id block : loop.block_list)
+            innermost_list[block] = index;
+    }
+
+    // Inner loops first, which is the order passes want them in.
+    const uint32_t loop_count = static_cast<uint32_t>(found.size());
+    const auto flip = [loop_count](const uint32_t index) { return index == NO_LOOP ? NO_LOOP : loop_count - 1 - index; };
+
+    for (natural_loop& loop : found)
+        loop.parent = flip(loop.parent);
+
+    for (uint32_t& index : innermost_list)
+        index = flip(index);
+
+    loop_list.assign(std::make_move_iterator(found.rbegin()), std::make_move_iterator(found.rend()));
+}
+
+bool loop_forest::contains(const uint32_t loop, const t_block_id block) const {
+    for (uint32_t at = innermost_list[block]; at != NO_LOOP; at = loop_list[at].parent) {
+        if (at == loop)
+            return true;
+    }
+
+    return false;
+}
+
+/*
+
+====================================================
+
+Helpers
+
+====================================================
+
+*/
+
+// The block every entry into the loop goes through, right before the header. The single block
+// outside the loop that jumps to the header is one already, which is what lowering leaves behind for
+// a while without an else. Otherwise, like for the first test of a while with an else, a new block
+// takes over the edges from outside and the phi operands coming along them.
+// Returns NO_BLOCK if the loop can not be entered.
+static t_block_id ensure_preheader(ir_function& function, loop_forest& forest, const uint32_t index) {
+    const t_block_id header = forest.loop_list[index].header;
+    std::vector<t_block_id> outside_list;
+
+    const t_block_id* predecessor_list = function.predecessors(header);
+
+    for (uint32_t i = 0; i < function.block_list[header].predecessor_count; i++) {
+        const t_block_id from = predecessor_list[i];
+
+        if (!forest.contains(index, from) && std::find(outside_list.begin(), outside_list.end(), from) == outside_list.end())
+            outside_list.push_back(from);
+    }
+
+    if (outside_list.empty())
+        return NO_BLOCK;
+
+    if (outside_list.size() == 1 && function.at(function.block_list[outside_list[0]].last).op == opcode::JUMP)
+        return outside_list[0];
+
+    const t_block_id preheader = function.make_block();
+
+    for (const t_block_id from : outside_list) {
+        instruction& terminator = function.at(function.block_list[from].last);
+
+        for (t_block_id& target : terminator.target) {
+            if (target == header)
+                target = preheader;
+        }
+    }
+
+    for (t_value_id id = function.block_list[header].first; id != NO_VALUE && function.at(id).op == opcode::PHI; id = function.at(id).next) {
+        const uint32_t* operand_list = function.operands(id);
+        std::vector<uint32_t> kept, moved;
+
+        for (uint32_t i = 0; i < function.at(id).operand_count; i += 2) {
+            const bool is_outside = std::find(outside_list.begin(), outside_list.end(), operand_list[i]) != outside_list.end();
+            std::vector<uint32_t>& into = is_outside ? moved : kept;
+
+            into.push_back(operand_list[i]);
+            into.push_back(operand_list[i + 1]);
+        }
+
+        bool is_same = true;
+
+        for (size_t i = 3; i < moved.size(); i += 2)
+            is_same = is_same && moved[i] == moved[1];
+
+        const t_value_id entering = is_same ? moved[1] : function.append(preheader, opcode::PHI, function.at(id).type, moved);
+
+        kept.push_back(preheader);
+        kept.push_back(entering);
+        function.set_operands(id, kept);
+    }
+
+    const t_value_id jump = function.append(preheader, opcode::JUMP, ir_type::VOID);
+    function.at(jump).target[0] = header;
+
+    function.compute_predecessors();
+
+    // The new block is inside every loop the loop is nested in, right before its header.
+    forest.innermost_list.push_back(forest.loop_list[index].parent);
+
+    for (uint32_t at = forest.loop_list[index].parent; at != NO_LOOP; at = forest.loop_list[at].parent) {
+        std::vector<t_block_id>& block_list = forest.loop_list[at].block_list;
+        block_list.insert(std::find(block_list.begin(), block_list.end(), header), preheader);
+    }
+
+    return preheader;
+}
+
+// Defined outside the loop, so it has the same value on every iteration.
+static inline bool is_outside(const ir_function& function, const loop_forest& forest, const uint32_t index, const t_value_id value) {
+    return !forest.contains(index, function.at(value).block);
+}
+
+/*
+
+====================================================
+
+Loop invariant code motion
+Pure instructions whose operands all come from outside the loop move to the preheader, inner loops
+first, so an invariant can move out of several loops in one run. The preheader always goes on to the
+header, but a while without an else may leave from there without running the body, so what can trap
+(division, modulo and integer power, unless by a constant that makes them safe) only moves out of the
+header, and only while nothing before it in the header has an effect: it ran first on every entry
+anyway.
+
+====================================================
+
+*/
+
+// runs_first is set for instructions of the header that nothing with an effect comes before.
+static bool is_invariant(const ir_function& function, const loop_forest& forest, const uint32_t index, const t_value_id id, const bool runs_first) {
+    const instruction& at = function.at(id);
+    const uint32_t* operand_list = function.operands(id);
+
+    if (!is_pure(at.op) || (!runs_first && has_effect(function, at, operand_list)))
+        return false;
+
+    for (uint32_t i = 0; i < at.operand_count; i++) {
+        if (!is_outside(function, forest, index, operand_list[i]))
+            return false;
+    }
+
+    return true;
+}
+
+uint32_t core::backend::hoist_invariants(ir_function& function) {
+    const dominator_tree tree(function);
+    loop_forest forest(function, tree);
+
+    uint32_t change_count = 0;
+
+    for (uint32_t index = 0; index < forest.loop_list.size(); index++) {
+        t_block_id preheader = NO_BLOCK;
+
+        // In reverse postorder, an operand moves before its users are looked at.
+        for (const t_block_id block : forest.loop_list[index].block_list) {
+            bool runs_first = block == forest.loop_list[index].header;
+
+            for (t_value_id id = function.block_list[block].first; id != NO_VALUE;) {
+                const t_value_id next = function.at(id).next;
+
+                if (is_invariant(function, forest, index, id, runs_first)) {
+                    if (preheader == NO_BLOCK)
+                        preheader = ensure_preheader(function, forest, index);
+
+                    if (preheader == NO_BLOCK)
+                        break;
+
+                    function.move_before(id, function.block_list[preheader].last);
+                    change_count++;
+                }
+                else if (has_effect(function, function.at(id), function.operands(id)))
+                    runs_first = false;
+
+                id = next;
+            }
+        }
+    }
+
+    return change_count;
+}
+
+/*
+
+====================================================
+
+Induction variables
+A basic induction variable is a header phi that every back edge gives the same phi + step or
+phi - step, with the step from outside the loop. Two that start from the same values and step the
+same way are the same variable, so one replaces the other. A multiply of one by something from
+outside the loop becomes a variable of its own, started at init * c in the preheader and stepped by
+step * c next to the original step. Integers wrap at their width, so this holds to the bit.
+
+====================================================
+
+*/
+
+struct induction_variable {
+    t_value_id phi;
+    t_value_id next; // phi + step or phi - step, the value along every back edge
+    t_value_id step;
+    opcode op; // ADD or SUB
+    std::vector<uint32_t> entry_list; // Operands coming from outside the loop, sorted by block
+};
+
+static bool find_induction_variable(const ir_function& function, const loop_forest& forest, const uint32_t index, const t_value_id phi, induction_variable& found) {
+    const instruction& at = function.at(phi);
+
+    if (!is_integer(at.type))
+        return false;
+
+    const uint32_t* operand_list = function.operands(phi);
+    std::vector<std::pair<uint32_t, uint32_t>> entry_list;
+
+    t_value_id next = NO_VALUE;
+
+    for (uint32_t i = 0; i < at.operand_count; i += 2) {
+        if (!forest.contains(index, operand_list[i])) {
+            entry_list.push_back({ operand_list[i], operand_list[i + 1] });
+            continue;
+        }
+
+        if (next != NO_VALUE && next != operand_list[i + 1])
+            return false;
+
+        next = operand_list[i + 1];
+    }
+
+    if (next == NO_VALUE || is_outside(function, forest, index, next))
+        return false;
+
+    const instruction& update = function.at(next);
+    const uint32_t* update_list = function.operands(next);
+
+    if ((update.op != opcode::ADD && update.op != opcode::SUB) || update.type != at.type)
+        return false;
+
+    t_value_id step = NO_VALUE;
+
+    if (update_list[0] == phi)
+        step = update_list[1];
+    else if (update.op == opcode::ADD && update_list[1] == phi)
+        step = update_list[0];
+
+    if (step == NO_VALUE || !is_outside(function, forest, index, step))
+        return false;
+
+    std::sort(entry_list.begin(), entry_list.end());
+
+    found = { phi, next, step, update.op, {} };
+
+    for (const auto& [block, value] : entry_list) {
+        found.entry_list.push_back(block);
+        found.entry_list.push_back(value);
+    }
+
+    return true;
+}
+
+static bool is_same_value(const ir_function& function, const t_value_id a, const t_value_id b) {
+    if (a == b)
+        return true;
+
+    const instruction& left = function.at(a);
+    const instruction& right = function.at(b);
+
+    return left.op == opcode::CONSTANT && right.op == opcode::CONSTANT && left.type == right.type && left.immediate == right.immediate;
+}
+
+static bool is_same_variable(const ir_function& function, const induction_variable& a, const induction_variable& b) {
+    if (function.at(a.phi).type != function.at(b.phi).type || a.op != b.op || !is_same_value(function, a.step, b.step) || a.entry_list.size() != b.entry_list.size())
+        return false;
+
+    for (size_t i = 0; i < a.entry_list.size(); i += 2) {
+        if (a.entry_list[i] != b.entry_list[i] || !is_same_value(function, a.entry_list[i + 1], b.entry_list[i + 1]))
+            return false;
+    }
+
+    return true;
+}
+
+// a * b placed before at, folded when either side is a constant that makes that easy.
+static t_value_id multiply_before(ir_function& function, const t_value_id at, const ir_type type, const t_value_id a, const t_value_id b) {
+    const instruction& left = function.at(a);
+    const instruction& right = function.at(b);
+
+    if (left.op == opcode::CONSTANT && right.op == opcode::CONSTANT)
+        return function.insert_before(at, opcode::CONSTANT, type, {}, wrap_to(left.immediate * right.immediate, type));
+
+    if ((left.op == opcode::CONSTANT && left.immediate == 0) || (right.op == opcode::CONSTANT && right.immediate == 1))
+        return a;
+
+    if ((right.op == opcode::CONSTANT && right.immediate == 0) || (left.op == opcode::CONSTANT && left.immediate == 1))
+        return b;
+
+    return function.insert_before(at, opcode::MUL, type, { a, b });
+}
+
+// A multiply of an induction variable by a factor from outside the loop.
+struct reducible_multiply {
+    t_value_id id;
+    uint32_t variable; // Into the induction variables of the loop
+    t_value_id factor;
+};
+
+uint32_t core::backend::reduce_induction_variables(ir_function& function) {
+    const dominator_tree tree(function);
+    loop_forest forest(function, tree);
+
+    uint32_t change_count = 0;
+
+    for (uint32_t index = 0; index < forest.loop_list.size(); index++) {
+        const t_block_id header = forest.loop_list[index].header;
+        std::vector<induction_variable> variable_list;
+
+        for (t_value_id id = function.block_list[header].first; id != NO_VALUE && function.at(id).op == opcode::PHI; id = function.at(id).next) {
+            induction_variable found;
+
+            if (!find_induction_variable(function, forest, index, id, found))
+                continue;
+
+            const auto same = std::find_if(variable_list.begin(), variable_list.end(), [&](const induction_variable& kept) { return is_same_variable(function, kept, found); });
+
+            // Equal on entry and stepped alike, so equal on every iteration. Its update is left to GVN.
+            if (same != variable_list.end()) {
+                function.replace_all_uses(id, same->phi);
+                change_count++;
+                continue;
+            }
+
+            variable_list.push_back(std::move(found));
+        }
+
+        if (variable_list.empty())
+            continue;
+
+        std::vector<reducible_multiply> multiply_list;
+
+        for (const t_block_id block : forest.loop_list[index].block_list) {
+            for (t_value_id id = function.block_list[block].first; id != NO_VALUE; id = function.at(id).next) {
+                const instruction& at = function.at(id);
+
+                if (at.op != opcode::MUL || !is_integer(at.type))
+                    continue;
+
+                const uint32_t* operand_list = function.operands(id);
+
+                for (uint32_t side = 0; side < 2; side++) {
+                    const auto variable = std::find_if(variable_list.begin(), variable_list.end(), [&](const induction_variable& v) { return v.phi == operand_list[side]; });
+                    const t_value_id factor = operand_list[1 - side];
+
+                    if (variable == variable_list.end() || !is_outside(function, forest, index, factor))
+                        continue;
+
+                    multiply_list.push_back({ id, static_cast<uint32_t>(variable - variable_list.begin()), factor });
+                    break;
+                }
+            }
+        }
+
+        if (multiply_list.empty())
+            continue;
+
+        const t_block_id preheader = ensure_preheader(function, forest, index);
+
+        if (preheader == NO_BLOCK)
+            continue;
+
+        // The same variable times the same factor is reduced once.
+        std::vector<std::pair<std::pair<uint32_t, t_value_id>, t_value_id>> reduced_list;
+
+        for (const reducible_multiply& multiply : multiply_list) {
+            const auto reduced = std::find_if(reduced_list.begin(), reduced_list.end(), [&](const auto& entry) { return entry.first.first == multiply.variable && entry.first.second == multiply.factor; });
+
+            if (reduced != reduced_list.end()) {
+                function.replace_all_uses(multiply.id, reduced->second);
+                function.remove(multiply.id);
+                change_count++;
+                continue;
+            }
+
+            const induction_variable& variable = variable_list[multiply.variable];
+            const ir_type type = function.at(variable.phi).type;
+
+            // The preheader is the only way in now, so the phi has one operand from outside.
+            t_value_id init = NO_VALUE;
+            const uint32_t* operand_list = function.operands(variable.phi);
+
+            for (uint32_t i = 0; i < function.at(variable.phi).operand_count; i += 2) {
+                if (operand_list[i] == preheader)
+                    init = operand_list[i + 1];
+            }
+
+            const t_value_id terminator = function.block_list[preheader].last;
+            const t_value_id start = multiply_before(function, terminator, type, init, multiply.factor);
+            const t_value_id step = multiply_before(function, terminator, type, variable.step, multiply.factor);
+
+            const t_value_id phi = function.insert_before(function.block_list[header].first, opcode::PHI, type);
+            const t_value_id next = function.insert_before(function.at(variable.next).next, variable.op, type, { phi, step });
+
+            std::vector<uint32_t> pair_list;
+            const t_block_id* predecessor_list = function.predecessors(header);
+
+            for (uint32_t i = 0; i < function.block_list[header].predecessor_count; i++) {
+                pair_list.push_back(predecessor_list[i]);
+                pair_list.push_back(predecessor_list[i] == preheader ? start : next);
+            }
+
+            function.set_operands(phi, pair_list);
+
+            function.replace_all_uses(multiply.id, phi);
+            function.remove(multiply.id);
+
+            reduced_list.push_back({ { multiply.variable, multiply.factor }, phi });
+            change_count++;
+        }
+    }
+
+    return change_count;
+}
@@ -0,0 +1,1294 @@
+#include <cstring>
+#include <unordered_map>
+
+#include "core.hh"
+#include "ast.hh"
+#include "symbol.hh"
+#include "ir.hh"
+
+using namespace core::ast;
+using namespace core::semantic;
+using namespace core::backend;
+
+/*
+
+====================================================
+
+Lowering
+Turns every checked, non-generic module level function into SSA form in one walk over its body.
+Variables are never stored anywhere: each write records the value for its block and each read looks
+it up, placing phis only where a block has several predecessors that disagree (Braun et al., "Simple
+and Efficient Construction of Static Single Assignment Form"). No dominance frontiers, no renaming.
+
+A block is sealed once all of its predecessors are known. Reads in a block that is not sealed yet
+(loop headers while their body is lowered) get a placeholder phi that is completed on sealing.
+
+Closures are lifted into functions of their own, lowered right where they are declared so the types
+of what they capture are known. They take their captures after their parameters: the values the
+captured locals hold at the declaration, and for a captured closure everything that one captured.
+That environment stays in the values of the function declaring the closure and is passed along with
+every call, which is a direct call of the lifted function. Nothing is allocated anywhere, and the
+inliner can take the calls apart like any other.
+
+====================================================
+
+*/
+
+struct lower_task {
+    core::t_file_id file_id;
+    t_node_id function; // expr_function
+    const symbol* source;
+};
+
+struct loop_target {
+    t_block_id continue_block;
+    t_block_id break_block;
+};
+
+static inline const ast_arena& file_ast(core::liprocess& process, const core::t_file_id file_id) {
+    return std::any_cast<const ast_arena&>(process.file_list[file_id].dump_ast_arena);
+}
+
+static inline const symbol_table& file_table(core::liprocess& process, const core::t_file_id file_id) {
+    return *std::any_cast<const t_symbol_table_ptr&>(process.file_list[file_id].dump_symbol_table);
+}
+
+static bool lower_kind(const type_kind kind, ir_type& result) {
+    switch (kind) {
+        case type_kind::U8: result = ir_type::U8; return true;
+        case type_kind::U16: result = ir_type::U16; return true;
+        case type_kind::U32: result = ir_type::U32; return true;
+        case type_kind::U64: result = ir_type::U64; return true;
+        case type_kind::I8: result = ir_type::I8; return true;
+        case type_kind::I16: result = ir_type::I16; return true;
+        case type_kind::I32: result = ir_type::I32; return true;
+        case type_kind::I64: result = ir_type::I64; return true;
+        case type_kind::F32: result = ir_type::F32; return true;
+        case type_kind::F64: result = ir_type::F64; return true;
+        case type_kind::BOOL: result = ir_type::BOOL; return true;
+        case type_kind::VOID: result = ir_type::VOID; return true;
+        default: return false;
+    }
+}
+
+// Value types only. Strings, structs and references are not expressible yet.
+static bool lower_type(const type_table& types, const t_type_id id, ir_type& result) {
+    if (id == NO_TYPE)
+        return false;
+
+    const type_entry& entry = types.get(id);
+
+    // '&&' values are moved in and nobody can look at them after, so they are passed like any other.
+    if (entry.flags & TYPE_LVALUE)
+        return false;
+
+    if (entry.kind == type_kind::POINTER) {
+        result = ir_type::PTR;
+        return true;
+    }
+
+    return lower_kind(entry.kind, result);
+}
+
+// Types of what each capture of a closure holds: one value for a local, everything it captured for a closure.
+using t_environment_layout = std::vector<std::vector<ir_type>>;
+
+static void lower_function(core::liprocess& process, const lower_task& task, ir_function& function, std::vector<ir_function>& closure_sink, const t_environment_layout& layout = {});
+
+static inline uint64_t double_bits(const double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(double));
+    return bits;
+}
+
+struct lower_state {
+    lower_state(core::liprocess& process, const lower_task& task, ir_function& function, std::vector<ir_function>& closure_sink)
+        : process(process), file_id(task.file_id), ast(file_ast(process, task.file_id)), table(file_table(process, task.file_id)),
+        types(*std::any_cast<const t_type_table_ptr&>(process.dump_type_table)), function(function), closure_sink(closure_sink) {}
+
+    core::liprocess& process;
+    const core::t_file_id file_id;
+
+    const ast_arena& ast;
+    const symbol_table& table;
+    const type_table& types;
+
+    ir_function& function;
+
+    // Lifted closures of the function, nested ones included.
+    std::vector<ir_function>& closure_sink;
+
+    t_block_id current = NO_BLOCK;
+
+    // Per block: the value every variable holds at its end, as far as it was written there.
+    std::vector<std::unordered_map<const symbol*, t_value_id>> definition_list;
+    std::vector<std::vector<t_block_id>> predecessor_list;
+    std::vector<std::vector<std::pair<const symbol*, t_value_id>>> incomplete_list;
+    std::vector<uint8_t> sealed_list;
+
+    // Trivial phi -> the value it stands for. Followed on every read, resolved for good at the end.
+    std::unordered_map<t_value_id, t_value_id> forward_map;
+
+    // Locals declared without a type take the type of their value.
+    std::unordered_map<const symbol*, ir_type> variable_type_map;
+
+    std::vector<loop_target> loop_stack;
+
+    // Closure -> its environment, passed after the arguments of every call.
+    std::unordered_map<const symbol*, std::vector<t_value_id>> environment_map;
+
+    inline const node* base(const t_node_id id) const {
+        return ast.get_base_ptr(id);
+    }
+
+    // Anything the IR can not express yet gives up on the whole function.
+    inline void unsupported() {
+        function.complete = false;
+    }
+
+    t_block_id make_block() {
+        const t_block_id block = function.make_block();
+
+        definition_list.emplace_back();
+        predecessor_list.emplace_back();
+        incomplete_list.emplace_back();
+        sealed_list.push_back(0);
+
+        return block;
+    }
+
+    inline t_value_id emit(const opcode op, const ir_type type, const std::vector<uint32_t>& operand_list = {}, const uint64_t immediate = 0) {
+        return function.append(current, op, type, operand_list, immediate);
+    }
+
+    // Phis and placeholders go to the top of their block.
+    t_value_id emit_at_top(const t_block_id block, const opcode op, const ir_type type) {
+        const t_value_id first = function.block_list[block].first;
+        return first == NO_VALUE ? function.append(block, op, type) : function.insert_before(first, op, type);
+    }
+
+    inline t_value_id make_constant(const ir_type type, const uint64_t bits) {
+        return emit(opcode::CONSTANT, type, {}, bits);
+    }
+
+    inline ir_type type_of(const t_value_id value) const {
+        return function.at(value).type;
+    }
+
+    bool is_terminated() const {
+        const t_value_id last = function.block_list[current].last;
+        return last != NO_VALUE && is_terminator(function.at(last).op);
+    }
+
+    // Code after a jump, break or return still gets lowered, into a block nothing reaches.
+    void continue_in_dead_block() {
+        current = make_block();
+        sealed_list[current] = 1;
+    }
+
+    void jump(const t_block_id target) {
+        const t_value_id id = emit(opcode::JUMP, ir_type::VOID);
+        function.at(id).target[0] = target;
+        predecessor_list[target].push_back(current);
+    }
+
+    void branch(const t_value_id condition, const t_block_id on_true, const t_block_id on_false) {
+        const t_value_id id = emit(opcode::BRANCH, ir_type::VOID, { condition });
+        function.at(id).target[0] = on_true;
+        function.at(id).target[1] = on_false;
+        predecessor_list[on_true].push_back(current);
+        predecessor_list[on_false].push_back(current);
+    }
+
+    // Converts unless value already has the type. Conversions to bool test against zero.
+    t_value_id coerce(const t_value_id value, const ir_type type) {
+        if (value == NO_VALUE || type_of(value) == type || type == ir_type::VOID)
+            return value;
+
+        return emit(opcode::CONVERT, type, { value });
+    }
+
+    t_value_id zero(const ir_type type) {
+        return make_constant(type, 0);
+    }
+
+    /*
+        SSA construction
+    */
+
+    t_value_id resolve(t_value_id value) const {
+        for (auto it = forward_map.find(value); it != forward_map.end(); it = forward_map.find(value))
+            value = it->second;
+
+        return value;
+    }
+
+    inline void write_variable(const symbol* variable, const t_block_id block, const t_value_id value) {
+        definition_list[block][variable] = value;
+    }
+
+    t_value_id read_variable(const symbol* variable, const t_block_id block, const ir_type type) {
+        auto it = definition_list[block].find(variable);
+        if (it != definition_list[block].end())
+            return resolve(it->second);
+
+        t_value_id value;
+
+        if (!sealed_list[block]) {
+            value = emit_at_top(block, opcode::PHI, type);
+            incomplete_list[block].emplace_back(variable, value);
+        }
+        else if (predecessor_list[block].size() == 1)
+            value = read_variable(variable, predecessor_list[block][0], type);
+        else if (predecessor_list[block].empty())
+            value = emit_at_top(block, opcode::UNDEFINED, type);
+        else {
+            // Written first so a loop reading the variable back finds the phi instead of recursing.
+            value = emit_at_top(block, opcode::PHI, type);
+            write_variable(variable, block, value);
+            value = complete_phi(variable, value, type);
+        }
+
+        write_variable(variable, block, value);
+        return value;
+    }
+
+    t_value_id complete_phi(const symbol* variable, const t_value_id phi, const ir_type type) {
+        const t_block_id block = function.at(phi).block;
+
+        std::vector<uint32_t> operand_list;
+        operand_list.reserve(predecessor_list[block].size() * 2);
+
+        for (const t_block_id predecessor : predecessor_list[block]) {
+            operand_list.push_back(predecessor);
+            operand_list.push_back(read_variable(variable, predecessor, type));
+        }
+
+        function.set_operands(phi, operand_list);
+
+        return remove_trivial_phi(phi);
+    }
+
+    // A phi that only ever sees one value besides itself is that value.
+    t_value_id remove_trivial_phi(const t_value_id phi) {
+        const uint32_t* operand_list = function.operands(phi);
+        t_value_id same = NO_VALUE;
+
+        for (uint32_t i = 1; i < function.at(phi).operand_count; i += 2) {
+            const t_value_id value = resolve(operand_list[i]);
+
+            if (value == same || value == phi)
+                continue;
+
+            if (same != NO_VALUE)
+                return phi;
+
+            same = value;
+        }
+
+        if (same == NO_VALUE)
+            same = emit_at_top(function.at(phi).block, opcode::UNDEFINED, function.at(phi).type);
+
+        function.remove(phi);
+        forward_map[phi] = same;
+
+        return same;
+    }
+
+    void seal(const t_block_id block) {
+        for (const auto& [variable, phi] : incomplete_list[block])
+            complete_phi(variable, phi, function.at(phi).type);
+
+        incomplete_list[block].clear();
+        sealed_list[block] = 1;
+    }
+
+    // Rewrites every operand through the forwards, then drops phis made trivial by that until nothing changes.
+    void finish_phis() {
+        bool changed = true;
+
+        while (changed) {
+            changed = false;
+
+            for (const ir_block& block : function.block_list) {
+                for (t_value_id id = block.first; id != NO_VALUE; id = function.at(id).next) {
+                    const instruction& user = function.at(id);
+                    uint32_t* operand_list = function.operands(id);
+                    const uint32_t step = user.op == opcode::PHI ? 2 : 1;
+
+                    for (uint32_t i = step - 1; i < user.operand_count; i += step)
+                        operand_list[i] = resolve(operand_list[i]);
+                }
+            }
+
+            for (const ir_block& block : function.block_list) {
+                for (t_value_id id = block.first; id != NO_VALUE;) {
+                    const t_value_id next = function.at(id).next;
+
+                    if (function.at(id).op == opcode::PHI && remove_trivial_phi(id) != id)
+                        changed = true;
+
+                    id = next;
+                }
+            }
+        }
+    }
+
+    /*
+        Variables
+    */
+
+    // Parameters and locals live in SSA values. Module level variants are memory.
+    const symbol* local_variable(const t_node_id id) const {
+        const symbol* found = table.resolution(id);
+
+        if (!found || (found->kind != symbol_kind::PARAMETER && found->kind != symbol_kind::VARIANT))
+            return nullptr;
+
+        if (found->kind == symbol_kind::VARIANT && (!found->parent || found->parent->kind == scope_kind::MODULE))
+            return nullptr;
+
+        return found;
+    }
+
+    const symbol* global_variable(const t_node_id id) const {
+        const symbol* found = table.resolution(id);
+
+        if (!found || found->kind != symbol_kind::VARIANT || !found->parent || found->parent->kind != scope_kind::MODULE)
+            return nullptr;
+
+        return found;
+    }
+
+    bool variable_type(const symbol* variable, ir_type& result) {
+        auto it = variable_type_map.find(variable);
+        if (it != variable_type_map.end()) {
+            result = it->second;
+            return true;
+        }
+
+        return lower_type(types, variable->type, result) && result != ir_type::VOID;
+    }
+
+    // Value of a module level const, folded by semantic analysis in the file that declares it.
+    const constant* global_constant(const symbol* variable) {
+        if (variable->node == NO_NODE || variable->file_id < 0 || process.file_list[variable->file_id].is_interface_only())
+            return nullptr;
+
+        const ast_arena& declaring = file_ast(process, variable->file_id);
+        const t_node_id value = declaring.get_as<variant_declaration>(variable->node).value;
+
+        if (variable->type == NO_TYPE || !(types.get(variable->type).flags & TYPE_CONST))
+            return nullptr;
+
+        return file_table(process, variable->file_id).constant_map.find(static_cast<uint32_t>(value));
+    }
+
+    /*
+        Expressions
+    */
+
+    // The type an expression produces, if it can be told without lowering it. VOID if it adapts to its context.
+    ir_type peek_type(const t_node_id id) {
+        ir_type result = ir_type::VOID;
+
+        switch (base(id)->type) {
+            case node_type::EXPR_IDENTIFIER: {
+                const symbol* variable = local_variable(id);
+                if (!variable)
+                    variable = global_variable(id);
+
+                if (variable && !variable_type(variable, result))
+                    result = ir_type::VOID;
+                break;
+            }
+            case node_type::EXPR_UNARY: {
+                const expr_unary& unary = ast.get_as<expr_unary>(id);
+                result = unary.opr.type == core::token_type::BANG ? ir_type::BOOL : peek_type(unary.operand);
+                break;
+            }
+            case node_type::EXPR_BINARY: {
+                const expr_binary& binary = ast.get_as<expr_binary>(id);
+
+                if (binary.opr.type == core::token_type::DOUBLE_DOT) {
+                    if (const symbol* variable = global_variable(id))
+                        variable_type(variable, result);
+                    break;
+                }
+
+                if (is_condition_operator(binary.opr.type))
+                    return ir_type::BOOL;
+
+                result = peek_type(binary.first);
+                if (result == ir_type::VOID && !is_assignment_operator(binary.opr.type))
+                    result = peek_type(binary.second);
+                break;
+            }
+            case node_type::EXPR_TERNARY: {
+                const expr_ternary& ternary = ast.get_as<expr_ternary>(id);
+
+                result = peek_type(ternary.second);
+                if (result == ir_type::VOID)
+                    result = peek_type(ternary.third);
+                break;
+            }
+            case node_type::EXPR_CALL: {
+                const symbol* callee = table.resolution(ast.get_as<expr_call>(id).callee);
+
+                if (callee && callee->kind == symbol_kind::FUNCTION && callee->type != NO_TYPE) {
+                    const type_entry& signature = types.get(callee->type);
+
+                    if (signature.kind == type_kind::FUNCTION && !lower_type(types, signature.argument_list[signature.argument_count - 1], result))
+                        result = ir_type::VOID;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+
+        return result;
+    }
+
+    static bool is_condition_operator(const core::token_type opr) {
+        switch (opr) {
+            case core::token_type::LARROW:
+            case core::token_type::RARROW:
+            case core::token_type::LESS_EQUAL:
+            case core::token_type::GREATER_EQUAL:
+            case core::token_type::DOUBLE_EQUAL:
+            case core::token_type::BANG_EQUAL:
+            case core::token_type::DOUBLE_AMPERSAND:
+            case core::token_type::DOUBLE_PIPE:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static bool is_assignment_operator(const core::token_type opr) {
+        switch (opr) {
+            case core::token_type::EQUAL:
+            case core::token_type::PLUS_EQUAL:
+            case core::token_type::MINUS_EQUAL:
+            case core::token_type::ASTERISK_EQUAL:
+            case core::token_type::SLASH_EQUAL:
+            case core::token_type::PERCENT_EQUAL:
+            case core::token_type::CARET_EQUAL:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static opcode arithmetic_opcode(const core::token_type opr) {
+        switch (opr) {
+            case core::token_type::PLUS: case core::token_type::PLUS_EQUAL: return opcode::ADD;
+            case core::token_type::MINUS: case core::token_type::MINUS_EQUAL: return opcode::SUB;
+            case core::token_type::ASTERISK: case core::token_type::ASTERISK_EQUAL: return opcode::MUL;
+            case core::token_type::SLASH: case core::token_type::SLASH_EQUAL: return opcode::DIV;
+            case core::token_type::PERCENT: case core::token_type::PERCENT_EQUAL: return opcode::MOD;
+            case core::token_type::CARET: case core::token_type::CARET_EQUAL: return opcode::POW;
+            default: return opcode::NOP;
+        }
+    }
+
+    static opcode comparison_opcode(const core::token_type opr) {
+        switch (opr) {
+            case core::token_type::LARROW: return opcode::LT;
+            case core::token_type::RARROW: return opcode::GT;
+            case core::token_type::LESS_EQUAL: return opcode::LE;
+            case core::token_type::GREATER_EQUAL: return opcode::GE;
+            case core::token_type::DOUBLE_EQUAL: return opcode::EQ;
+            case core::token_type::BANG_EQUAL: return opcode::NE;
+            default: return opcode::NOP;
+        }
+    }
+
+    // Type to carry out arithmetic on two operands in: whichever side is known, else what is asked for, else i32.
+    ir_type operand_type(const t_node_id first, const t_node_id second, const ir_type hint) {
+        ir_type result = peek_type(first);
+
+        if (result == ir_type::VOID)
+            result = peek_type(second);
+        if (result == ir_type::VOID)
+            result = hint != ir_type::VOID && hint != ir_type::BOOL ? hint : ir_type::I32;
+
+        return result;
+    }
+
+    t_value_id lower_literal(const t_node_id id, const ir_type hint) {
+        const expr_literal& literal = ast.get_as<expr_literal>(id);
+
+        switch (literal.literal_type) {
+            case expr_literal::e_literal_type::BOOL:
+                return make_constant(ir_type::BOOL, process.sub_source_code(literal.selection) == "true" ? 1 : 0);
+            case expr_literal::e_literal_type::NIL:
+                return make_constant(ir_type::PTR, 0);
+            case expr_literal::e_literal_type::INT:
+            case expr_literal::e_literal_type::FLOAT: {
+                const bool is_float = literal.literal_type == expr_literal::e_literal_type::FLOAT;
+                ir_type type = hint;
+
+                if (!is_integer(type) && !is_floating(type))
+                    type = is_float ? ir_type::F64 : ir_type::I32;
+                else if (is_float && !is_floating(type))
+                    type = ir_type::F64;
+
+                std::vector<core::lilog> discarded;
+                constant_context context(process, ast, table, discarded);
+
+                constant value;
+                type_kind kind = type_kind::INVALID;
+
+                for (uint8_t i = static_cast<uint8_t>(type_kind::U8); i <= static_cast<uint8_t>(type_kind::F64); i++) {
+                    ir_type lowered;
+                    if (lower_kind(static_cast<type_kind>(i), lowered) && lowered == type)
+                        kind = static_cast<type_kind>(i);
+                }
+
+                // Too big for what it is used as. Semantic analysis only checks constant declarations.
+                if (!fold(context, id, kind, value)) {
+                    unsupported();
+                    return NO_VALUE;
+                }
+
+                return make_constant(type, constant_bits(value));
+            }
+            default:
+                unsupported();
+                return NO_VALUE;
+        }
+    }
+
+    t_value_id lower_identifier(const t_node_id id) {
+        if (const symbol* variable = local_variable(id)) {
+            ir_type type;
+
+            if (!variable_type(variable, type)) {
+                unsupported();
+                return NO_VALUE;
+            }
+
+            return read_variable(variable, current, type);
+        }
+
+        if (const symbol* variable = global_variable(id)) {
+            ir_type type;
+
+            if (!variable_type(variable, type)) {
+                unsupported();
+                return NO_VALUE;
+            }
+
+            if (const constant* value = global_constant(variable))
+                return make_constant(type, constant_bits(*value));
+
+            const t_value_id load = emit(opcode::LOAD_GLOBAL, type);
+            function.at(load).symbol = variable;
+            return load;
+        }
+
+        // Functions as values, enum sets and everything else.
+        unsupported();
+        return NO_VALUE;
+    }
+
+    void assign(const t_node_id target, const t_value_id value) {
+        if (const symbol* variable = local_variable(target)) {
+            write_variable(variable, current, value);
+            return;
+        }
+
+        const t_value_id store = emit(opcode::STORE_GLOBAL, ir_type::VOID, { value });
+        function.at(store).symbol = global_variable(target);
+    }
+
+    // Only names can be written to so far. Members and dereferences can not.
+    bool assignable_type(const t_node_id target, ir_type& result) {
+        const symbol* variable = local_variable(target);
+        if (!variable)
+            variable = global_variable(target);
+
+        if (!variable || !variable_type(variable, result)) {
+            unsupported();
+            return false;
+        }
+
+        return true;
+    }
+
+    t_value_id lower_unary(const t_node_id id, const ir_type hint) {
+        const expr_unary& unary = ast.get_as<expr_unary>(id);
+
+        switch (unary.opr.type) {
+            case core::token_type::MINUS: {
+                const t_value_id operand = lower_expression(unary.operand, hint);
+                return operand == NO_VALUE ? NO_VALUE : emit(opcode::NEG, type_of(operand), { operand });
+            }
+            case core::token_type::BANG: {
+                const t_value_id operand = coerce(lower_expression(unary.operand, ir_type::BOOL), ir_type::BOOL);
+                return operand == NO_VALUE ? NO_VALUE : emit(opcode::NOT, ir_type::BOOL, { operand });
+            }
+            case core::token_type::DOUBLE_PLUS:
+            case core::token_type::DOUBLE_MINUS: {
+                ir_type type;
+                if (!assignable_type(unary.operand, type))
+                    return NO_VALUE;
+
+                const t_value_id old_value = lower_expression(unary.operand, type);
+                if (old_value == NO_VALUE)
+                    return NO_VALUE;
+
+                const t_value_id one = make_constant(type, is_floating(type) ? double_bits(1.0) : 1);
+                const t_value_id new_value = emit(unary.opr.type == core::token_type::DOUBLE_PLUS ? opcode::ADD : opcode::SUB, type, { old_value, one });
+
+                assign(unary.operand, new_value);
+                return unary.post ? old_value : new_value;
+            }
+            default:
+                // Address-of and dereference.
+                unsupported();
+                return NO_VALUE;
+        }
+    }
+
+    // && and || only evaluate the right side when it matters.
+    t_value_id lower_logical(const expr_binary& binary) {
+        const bool is_and = binary.opr.type == core::token_type::DOUBLE_AMPERSAND;
+
+        const t_value_id first = coerce(lower_expression(binary.first, ir_type::BOOL), ir_type::BOOL);
+        if (first == NO_VALUE)
+            return NO_VALUE;
+
+        const t_block_id from = current;
+        const t_block_id right = make_block();
+        const t_block_id merge = make_block();
+
+        if (is_and)
+            branch(first, right, merge);
+        else
+            branch(first, merge, right);
+
+        seal(right);
+        current = right;
+
+        const t_value_id second = coerce(lower_expression(binary.second, ir_type::BOOL), ir_type::BOOL);
+        if (second == NO_VALUE)
+            return NO_VALUE;
+
+        const t_block_id right_end = current;
+        jump(merge);
+        seal(merge);
+
+        current = merge;
+
+        // The short circuit edge carries the left side, which decided the result.
+        const t_value_id phi = emit(opcode::PHI, ir_type::BOOL);
+        function.set_operands(phi, { from, first, right_end, second });
+
+        return phi;
+    }
+
+    t_value_id lower_binary(const t_node_id id, const ir_type hint) {
+        const expr_binary& binary = ast.get_as<expr_binary>(id);
+        const core::token_type opr = binary.opr.type;
+
+        if (opr == core::token_type::DOUBLE_DOT)
+            return lower_identifier(id);
+
+        if (opr == core::token_type::DOUBLE_AMPERSAND || opr == core::token_type::DOUBLE_PIPE)
+            return lower_logical(binary);
+
+        // Overloads and member access.
+        if (table.resolution(id) || opr == core::token_type::DOT) {
+            unsupported();
+            return NO_VALUE;
+        }
+
+        if (is_assignment_operator(opr)) {
+            ir_type type;
+            if (!assignable_type(binary.first, type))
+                return NO_VALUE;
+
+            t_value_id value = coerce(lower_expression(binary.second, type), type);
+            if (value == NO_VALUE)
+                return NO_VALUE;
+
+            if (opr != core::token_type::EQUAL) {
+                const t_value_id old_value = lower_expression(binary.first, type);
+                if (old_value == NO_VALUE)
+                    return NO_VALUE;
+
+                value = emit(arithmetic_opcode(opr), type, { old_value, value });
+            }
+
+            assign(binary.first, value);
+            return value;
+        }
+
+        const opcode comparison = comparison_opcode(opr);
+        const ir_type type = operand_type(binary.first, binary.second, comparison == opcode::NOP ? hint : ir_type::VOID);
+
+        const t_value_id first = coerce(lower_expression(binary.first, type), type);
+        const t_value_id second = coerce(lower_expression(binary.second, type), type);
+
+        if (first == NO_VALUE || second == NO_VALUE)
+            return NO_VALUE;
+
+        if (comparison != opcode::NOP)
+            return emit(comparison, ir_type::BOOL, { first, second });
+
+        const opcode arithmetic = arithmetic_opcode(opr);
+
+        if (arithmetic == opcode::NOP) {
+            unsupported();
+            return NO_VALUE;
+        }
+
+        return emit(arithmetic, type, { first, second });
+    }
+
+    t_value_id lower_ternary(const t_node_id id, const ir_type hint) {
+        const expr_ternary& ternary = ast.get_as<expr_ternary>(id);
+
+        ir_type type = peek_type(ternary.second);
+        if (type == ir_type::VOID)
+            type = peek_type(ternary.third);
+        if (type == ir_type::VOID)
+            type = hint;
+
+        const t_value_id condition = coerce(lower_expression(ternary.first, ir_type::BOOL), ir_type::BOOL);
+        if (condition == NO_VALUE)
+            return NO_VALUE;
+
+        const t_block_id on_true = make_block();
+        const t_block_id on_false = make_block();
+        const t_block_id merge = make_block();
+
+        branch(condition, on_true, on_false);
+        seal(on_true);
+        seal(on_false);
+
+        current = on_true;
+        const t_value_id first = coerce(lower_expression(ternary.second, type), type);
+        const t_block_id true_end = current;
+        jump(merge);
+
+        current = on_false;
+        const t_value_id second = coerce(lower_expression(ternary.third, type), type);
+        const t_block_id false_end = current;
+        jump(merge);
+
+        seal(merge);
+        current = merge;
+
+        if (first == NO_VALUE || second == NO_VALUE)
+            return NO_VALUE;
+
+        if (type == ir_type::VOID) {
+            // Neither side says what it is. Let the true side decide.
+            type = type_of(first);
+
+            if (type_of(second) != type) {
+                unsupported();
+                return NO_VALUE;
+            }
+        }
+
+        const t_value_id phi = emit(opcode::PHI, type);
+        function.set_operands(phi, { true_end, first, false_end, second });
+
+        return phi;
+    }
+
+    t_value_id lower_call(const t_node_id id) {
+        const expr_call& call = ast.get_as<expr_call>(id);
+        const symbol* callee = table.resolution(call.callee);
+
+        // Intrinsics, methods, generic functions and anything called through a value.
+        if (!callee || callee->kind != symbol_kind::FUNCTION || callee->template_count != 0 || !call.template_argument_list.empty() || callee->type == NO_TYPE) {
+            unsupported();
+            return NO_VALUE;
+        }
+
+        const type_entry& signature = types.get(callee->type);
+        const size_t parameter_count = signature.argument_count - 1;
+
+        // Default arguments are not lowered yet.
+        if (signature.kind != type_kind::FUNCTION || call.argument_list.size() != parameter_count) {
+            unsupported();
+            return NO_VALUE;
+        }
+
+        ir_type return_type;
+        if (!lower_type(types, signature.argument_list[parameter_count], return_type)) {
+            unsupported();
+            return NO_VALUE;
+        }
+
+        std::vector<uint32_t> argument_list;
+        argument_list.reserve(parameter_count);
+
+        for (size_t i = 0; i < parameter_count; i++) {
+            ir_type parameter_type;
+
+            if (!lower_type(types, signature.argument_list[i], parameter_type)) {
+                unsupported();
+                return NO_VALUE;
+            }
+
+            const t_value_id argument = coerce(lower_expression(call.argument_list[i], parameter_type), parameter_type);
+            if (argument == NO_VALUE)
+                return NO_VALUE;
+
+            argument_list.push_back(argument);
+        }
+
+        if (callee->capture_count > 0) {
+            auto it = environment_map.find(callee);
+
+            if (it == environment_map.end()) {
+                unsupported();
+                return NO_VALUE;
+            }
+
+            for (const t_value_id value : it->second)
+                argument_list.push_back(resolve(value));
+        }
+
+        const t_value_id result = emit(opcode::CALL, return_type, argument_list);
+        function.at(result).symbol = callee;
+
+        return result;
+    }
+
+    // hint is the type the value is going to be used as. Literals take it, everything else keeps its own.
+    t_value_id lower_expression(const t_node_id id, const ir_type hint) {
+        if (!function.complete)
+            return NO_VALUE;
+
+        // Whatever semantic analysis already folded.
+        if (const constant* value = table.constant_map.find(static_cast<uint32_t>(id))) {
+            ir_type type;
+
+            if (lower_kind(value->kind, type))
+                return make_constant(type, constant_bits(*value));
+        }
+
+        switch (base(id)->type) {
+            case node_type::EXPR_LITERAL:
+                return lower_literal(id, hint);
+            case node_type::EXPR_IDENTIFIER:
+                return lower_identifier(id);
+            case node_type::EXPR_UNARY:
+                return lower_unary(id, hint);
+            case node_type::EXPR_BINARY:
+                return lower_binary(id, hint);
+            case node_type::EXPR_TERNARY:
+                return lower_ternary(id, hint);
+            case node_type::EXPR_CALL:
+                return lower_call(id);
+            default:
+                unsupported();
+                return NO_VALUE;
+        }
+    }
+
+    /*
+        Statements
+    */
+
+    t_value_id lower_condition(const t_node_id id) {
+        return coerce(lower_expression(id, ir_type::BOOL), ir_type::BOOL);
+    }
+
+    // Captures what the closure needs and lifts it. A closure that can not be lowered takes the
+    // function declaring it down with it, so every closure that makes it into a module is complete.
+    void lower_closure(const t_node_id id, const symbol* closure) {
+        std::vector<t_value_id> environment;
+        t_environment_layout layout(closure->capture_count);
+
+        for (uint16_t i = 0; i < closure->capture_count; i++) {
+            const symbol* captured = closure->capture_list[i];
+
+            if (captured->kind == symbol_kind::FUNCTION) {
+                auto it = environment_map.find(captured);
+
+                if (it == environment_map.end()) {
+                    unsupported();
+                    return;
+                }
+
+                for (const t_value_id value : it->second) {
+                    environment.push_back(resolve(value));
+                    layout[i].push_back(type_of(environment.back()));
+                }
+
+                continue;
+            }
+
+            ir_type type;
+
+            if (!variable_type(captured, type)) {
+                unsupported();
+                return;
+            }
+
+            environment.push_back(read_variable(captured, current, type));
+            layout[i].push_back(type);
+        }
+
+        ir_function lifted;
+        lower_function(process, { file_id, ast.get_as<expr_closure>(ast.get_as<variant_declaration>(id).value).function, closure }, lifted, closure_sink, layout);
+
+        if (!lifted.complete) {
+            unsupported();
+            return;
+        }
+
+        closure_sink.push_back(std::move(lifted));
+        environment_map[closure] = std::move(environment);
+    }
+
+    void lower_declaration(const t_node_id id) {
+        const variant_declaration& declaration = ast.get_as<variant_declaration>(id);
+        const symbol* variable = table.resolution(id);
+
+        if (variable && base(declaration.value)->type == node_type::EXPR_CLOSURE) {
+            lower_closure(id, variable);
+            return;
+        }
+
+        if (!variable || base(declaration.value)->type == node_type::EXPR_FUNCTION) {
+            unsupported();
+            return;
+        }
+
+        ir_type type = ir_type::VOID;
+
+        if (variable->type != NO_TYPE && (!lower_type(types, variable->type, type) || type == ir_type::VOID)) {
+            unsupported();
+            return;
+        }
+
+        t_value_id value;
+
+        if (base(declaration.value)->type == node_type::EXPR_NONE) {
+            if (type == ir_type::VOID) {
+                unsupported();
+                return;
+            }
+
+            value = zero(type);
+        }
+        else {
+            value = lower_expression(declaration.value, type);
+            if (value == NO_VALUE)
+                return;
+
+            if (type == ir_type::VOID)
+                type = type_of(value);
+            else
+                value = coerce(value, type);
+        }
+
+        variable_type_map[variable] = type;
+        write_variable(variable, current, value);
+    }
+
+    void lower_if(const t_node_id id) {
+        const stmt_if& statement = ast.get_as<stmt_if>(id);
+
+        const t_value_id condition = lower_condition(statement.condition);
+        if (condition == NO_VALUE)
+            return;
+
+        const bool has_else = base(statement.alternate)->type != node_type::STMT_NONE;
+
+        const t_block_id consequent = make_block();
+        const t_block_id merge = make_block();
+        const t_block_id alternate = has_else ? make_block() : merge;
+
+        branch(condition, consequent, alternate);
+        seal(consequent);
+
+        current = consequent;
+        lower_statement(statement.consequent);
+        if (!is_terminated())
+            jump(merge);
+
+        if (has_else) {
+            seal(alternate);
+
+            current = alternate;
+            lower_statement(statement.alternate);
+            if (!is_terminated())
+                jump(merge);
+        }
+
+        seal(merge);
+        current = merge;
+    }
+
+    // The else of a while runs when the condition fails the first time it is tested, never after the
+    // body ran. A while with an else tests its condition once on the way in, where the false edge goes
+    // to the else, and again in the header after every iteration, where it goes to the exit.
+    void lower_while(const t_node_id id) {
+        const stmt_while& statement = ast.get_as<stmt_while>(id);
+        const bool has_else = base(statement.alternate)->type != node_type::STMT_NONE;
+
+        const t_block_id header = make_block();
+        const t_block_id body = make_block();
+        const t_block_id exit = make_block();
+
+        if (has_else) {
+            const t_value_id first = lower_condition(statement.condition);
+            if (first == NO_VALUE)
+                return;
+
+            const t_block_id alternate = make_block();
+
+            branch(first, body, alternate);
+            seal(alternate);
+
+            current = alternate;
+            lower_statement(statement.alternate);
+            if (!is_terminated())
+                jump(exit);
+        }
+        else
+            jump(header);
+
+        current = header;
+
+        const t_value_id condition = lower_condition(statement.condition);
+        if (condition == NO_VALUE)
+            return;
+
+        branch(condition, body, exit);
+        seal(body);
+
+        loop_stack.push_back({ header, exit });
+
+        current = body;
+        lower_statement(statement.consequent);
+        if (!is_terminated())
+            jump(header);
+
+        loop_stack.pop_back();
+
+        // Every continue and the back edge are known now.
+        seal(header);
+        seal(exit);
+        current = exit;
+    }
+
+    void lower_return(const t_node_id id) {
+        const t_node_id expression = ast.get_as<stmt_return>(id).expression;
+
+        if (base(expression)->type == node_type::EXPR_NONE) {
+            emit(opcode::RETURN, ir_type::VOID);
+        }
+        else {
+            const t_value_id value = coerce(lower_expression(expression, function.return_type), function.return_type);
+            if (value == NO_VALUE)
+                return;
+
+            emit(opcode::RETURN, ir_type::VOID, { value });
+        }
+
+        continue_in_dead_block();
+    }
+
+    void lower_statement(const t_node_id id) {
+        if (!function.complete)
+            return;
+
+        switch (base(id)->type) {
+            case node_type::ITEM_BODY:
+                for (const t_node_id statement : ast.get_as<item_body>(id).item_list)
+                    lower_statement(statement);
+                break;
+            case node_type::VARIANT_DECLARATION:
+                lower_declaration(id);
+                break;
+            case node_type::STMT_IF:
+                lower_if(id);
+                break;
+            case node_type::STMT_WHILE:
+                lower_while(id);
+                break;
+            case node_type::STMT_RETURN:
+                lower_return(id);
+                break;
+            case node_type::STMT_BREAK:
+            case node_type::STMT_CONTINUE:
+                if (loop_stack.empty()) {
+                    unsupported();
+                    break;
+                }
+
+                jump(base(id)->type == node_type::STMT_BREAK ? loop_stack.back().break_block : loop_stack.back().continue_block);
+                continue_in_dead_block();
+                break;
+            case node_type::STMT_NONE:
+                break;
+            case node_type::ITEM_TYPE_DECLARATION:
+            case node_type::STMT_INVALID:
+                unsupported();
+                break;
+            default:
+                lower_expression(id, ir_type::VOID);
+        }
+    }
+};
+
+// layout is set for closures, which take their environment after their parameters.
+static void lower_function(core::liprocess& process, const lower_task& task, ir_function& function, std::vector<ir_function>& closure_sink, const t_environment_layout& layout) {
+    lower_state state(process, task, function, closure_sink);
+
+    const expr_function& source = state.ast.get_as<expr_function>(task.function);
+
+    function.source = task.source;
+    function.file_id = task.file_id;
+    function.name = process.name_table.get(task.source->name);
+
+    const type_entry& signature = state.types.get(task.source->type);
+
+    for (size_t i = 0; i + 1 < signature.argument_count; i++) {
+        ir_type parameter_type;
+
+        if (!lower_type(state.types, signature.argument_list[i], parameter_type) || parameter_type == ir_type::VOID)
+            function.complete = false;
+
+        function.parameter_type_list.push_back(function.complete ? parameter_type : ir_type::VOID);
+    }
+
+    for (const std::vector<ir_type>& capture : layout)
+        function.parameter_type_list.insert(function.parameter_type_list.end(), capture.begin(), capture.end());
+
+    if (!lower_type(state.types, signature.argument_list[signature.argument_count - 1], function.return_type))
+        function.complete = false;
+
+    if (!function.complete)
+        return;
+
+    state.current = state.make_block();
+    state.sealed_list[state.current] = 1;
+
+    for (size_t i = 0; i < source.parameter_list.size(); i++) {
+        const symbol* parameter = state.table.resolution(source.parameter_list[i]);
+        const t_value_id value = state.emit(opcode::PARAMETER, function.parameter_type_list[i], {}, i);
+
+        if (parameter)
+            state.write_variable(parameter, state.current, value);
+    }
+
+    uint64_t index = source.parameter_list.size();
+
+    for (size_t i = 0; i < layout.size(); i++) {
+        const symbol* captured = task.source->capture_list[i];
+        std::vector<t_value_id> value_list;
+
+        for (const ir_type type : layout[i])
+            value_list.push_back(state.emit(opcode::PARAMETER, type, {}, index++));
+
+        if (captured->kind == symbol_kind::FUNCTION)
+            state.environment_map[captured] = std::move(value_list);
+        else {
+            state.variable_type_map[captured] = layout[i][0];
+            state.write_variable(captured, state.current, value_list[0]);
+        }
+    }
+
+    state.lower_statement(source.body);
+
+    if (!function.complete)
+        return;
+
+    // Falling off the end is only fine for void functions.
+    if (!state.is_terminated())
+        state.emit(function.return_type == ir_type::VOID ? opcode::RETURN : opcode::UNREACHABLE, ir_type::VOID);
+
+    function.compute_predecessors();
+    function.remove_unreachable_blocks();
+    state.finish_phis();
+    function.compact();
+}
+
+// Non-generic functions declared at module level, in declaration order.
+static void collect_functions(core::liprocess& process, const core::t_file_id file_id, const ast_arena& ast, const t_node_id id, std::vector<lower_task>& task_list) {
+    const symbol_table& table = file_table(process, file_id);
+
+    switch (ast.get_base_ptr(id)->type) {
+        case node_type::ITEM_MODULE:
+            collect_functions(process, file_id, ast, ast.get_as<item_module>(id).content, task_list);
+            break;
+        case node_type::ITEM_BODY:
+            for (const t_node_id item : ast.get_as<item_body>(id).item_list)
+                collect_functions(process, file_id, ast, item, task_list);
+            break;
+        case node_type::VARIANT_DECLARATION: {
+            const variant_declaration& declaration = ast.get_as<variant_declaration>(id);
+            const symbol* declared = table.resolution(id);
+
+            if (ast.get_base_ptr(declaration.value)->type != node_type::EXPR_FUNCTION || !declared)
+                break;
+
+            if (declared->kind == symbol_kind::FUNCTION && declared->template_count == 0 && declared->type != NO_TYPE)
+                task_list.push_back({ file_id, declaration.value, declared });
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Lowers every file that was parsed. Bodies are independent, so they are lowered in parallel.
+bool core::backend::lower(liprocess& process, const t_file_id /*entry*/) {
+    std::vector<lower_task> task_list;
+
+    for (size_t i = 0; i < process.file_list.size(); i++) {
+        const liprocess::lifile& file = process.file_list[i];
+
+        if (file.is_interface_only())
+            continue;
+
+        const ast_arena& ast = std::any_cast<const ast_arena&>(file.dump_ast_arena);
+
+        for (const t_node_id item : ast.get_as<ast_root>(0).item_list)
+            collect_functions(process, static_cast<t_file_id>(i), ast, item, task_list);
+    }
+
+    std::vector<ir_function> function_list(task_list.size());
+    std::vector<std::vector<ir_function>> closure_list(task_list.size());
+
+    process.pool.parallel_for(task_list.size(), [&](const size_t i) {
+        lower_function(process, task_list[i], function_list[i], closure_list[i]);
+
+        // Only ever called from a function that can not run.
+        if (!function_list[i].complete)
+            closure_list[i].clear();
+    });
+
+    for (size_t i = 0; i < process.file_list.size(); i++) {
+        if (!process.file_list[i].is_interface_only())
+            process.file_list[i].dump_ir_module = std::make_shared<ir_module>();
+    }
+
+    // Task order is declaration order, so modules come out the same however the work was split.
+    for (size_t i = 0; i < task_list.size(); i++) {
+        ir_module& module = *std::any_cast<const t_ir_module_ptr&>(process.file_list[task_list[i].file_id].dump_ir_module);
+
+        module.function_map.emplace(task_list[i].source, static_cast<uint32_t>(module.function_list.size()));
+        module.function_list.push_back(std::move(function_list[i]));
+
+        for (ir_function& closure : closure_list[i]) {
+            module.function_map.emplace(closure.source, static_cast<uint32_t>(module.function_list.size()));
+            module.function_list.push_back(std::move(closure));
+        }
+    }
+
+    return true;
+}
@@ -23,6 +23,9 @@ To see where flags are used throughout the compiler, ctrl+shift+f their name.
 // Note: Index 0 is the command name
 using t_command_data = std::vector<std::string>;
 
+// Builds from this prompt reuse whatever did not change since the last one.
+static licanapi::lisession session;
+
 std::string get_line() {
     std::string line;
     std::getline(std::cin, line);
@@ -36,9 +39,16 @@ t_command_data parse_string_command(const std::string& line) {
 
     auto push_buffer = [&](const std::string& buf) {
         if (buf.empty()) return;
-        // Check for grouped short options (e.g. -rf)
-        if (buf.size() > 1 && buf[0] == '-' && buf[1] != '-') {
+        // Check for grouped short options (e.g. -rf). Negative numbers are arguments.
+        if (buf.size() > 1 && buf[0] == '-' && buf[1] != '-' && !std::isdigit(static_cast<unsigned char>(buf[1]))) {
             for (size_t i = 1; i < buf.size(); i++) {
+                // -O takes its level with it.
+                if (buf[i] == 'O' && i + 1 < buf.size() && std::isdigit(static_cast<unsigned char>(buf[i + 1]))) {
+                    args.push_back(std::string("-") + buf.substr(i, 2));
+                    i++;
+                    continue;
+                }
+
                 args.push_back(std::string("-") + buf[i]);
             }
         } else {
@@ -66,8 +76,15 @@ t_command_data parse_c_style_command(int argc, char* argv[]) {
     for (int i = 1; i < argc; i++) {
         std::string str = argv[i];
 
-        if (str.size() > 1 && str[0] == '-' && str[1] != '-') {
+        if (str.size() > 1 && str[0] == '-' && str[1] != '-' && !std::isdigit(static_cast<unsigned char>(str[1]))) {
             for (size_t j = 1; j < str.size(); j++) {
+                // -O takes its level with it.
+                if (str[j] == 'O' && j + 1 < str.size() && std::isdigit(static_cast<unsigned char>(str[j + 1]))) {
+                    args.push_back(std::string("-") + str.substr(j, 2));
+                    j++;
+                    continue;
+                }
+
                 args.push_back(std::string("-") + str[j]);
             }
 
@@ -90,6 +107,11 @@ bool HELP(const t_command_data& command) {
     std::cout << "  Builds the project at <path> with entry point <entry>.\n";
     std::cout << "  Assume all arguments are relative to cd.\n\n";
 
+    std::cout << "run <entry_path> [function] [arguments] -<flags>\n";
+    std::cout << "  Builds the project with entry point <entry> and runs <function> (main by default) in the VM.\n";
+    std::cout << "  Arguments are read as the types of the parameters.\n";
+    std::cout << "  Builds and runs from this prompt only redo the semantic queries about files that changed since the last one.\n\n";
+
     std::cout << "write\n";
     std::cout << "  Compiles the given code snippet. Flags are implicitly set for debug mode.\n\n";
 
@@ -127,11 +149,47 @@ bool BUILD(const t_command_data& command) {
     config.output_path = command[2];
     config.flag_list = command.size() > 3 ? std::vector<std::string>(command.begin() + 3, command.end()) : std::vector<std::string>();
 
-    licanapi::build_project(config);
+    licanapi::build_project(config, &session);
 
     return true;
 }
 
+bool RUN(const t_command_data& command) {
+    if (command.size() < 2)
+        return false;
+
+    if (!std::filesystem::exists(std::string(command[1]))) {
+        std::cout << "The given entry point file name does not exist within the project directory.\n";
+        return false;
+    }
+
+    licanapi::liconfig_init config;
+    config.project_path = ""; // cd
+    config.entry_point_subpath = command[1];
+
+    std::string function_name = "main";
+    std::vector<std::string> argument_list;
+    bool has_function_name = false;
+
+    // Flags are single letters, so anything else is the function followed by its arguments.
+    for (size_t i = 2; i < command.size(); i++) {
+        const std::string& word = command[i];
+
+        const bool is_level = word.size() == 3 && word[1] == 'O' && std::isdigit(static_cast<unsigned char>(word[2]));
+
+        if (word[0] == '-' && ((word.size() == 2 && std::isalpha(static_cast<unsigned char>(word[1]))) || is_level))
+            config.flag_list.push_back(word);
+        else if (!has_function_name) {
+            function_name = word;
+            has_function_name = true;
+        }
+        else
+            argument_list.push_back(word);
+    }
+
+    return licanapi::run_project(config, function_name, argument_list, &session);
+}
+
 bool WRITE(const t_command_data& command) {
     std::vector<std::string> flag_list = command.size() > 1 ? std::vector<std::string>(command.begin() + 1, command.end()) : std::vector<std::string>();
 
@@ -157,9 +215,21 @@ bool FLAGS(const t_command_data& command) {
     std::cout << "sorry guys, sorthands only:\n";
     std::cout << "dump-tokens           -t     Dumps the list of tokens generated during lexing.\n";
     std::cout << "dump-ast              -a     Dumps the AST generated during parsing.\n";
+    std::cout << "dump-ir               -i     Dumps the SSA IR every function was lowered to.\n";
     std::cout << "dump-logs             -l     Dumps all logs generated during processing.\n";
     std::cout << "dump-chrono           -c     Dumps the amount of time it took each stage of the compiler to process.\n";
     std::cout << "show_cascading_logs   -s     If enabled, the compiler will not attempt to hide logs that could have no use to the programmer.\n";
+    std::cout << "optimize              -O<n>  Optimizes the IR. -O0 leaves it alone (default), -O1 runs the scalar passes and LICM once, -O2 adds value numbering and induction variables and repeats them.\n";
+    std::cout << "single-threaded       -u     Runs every parallel stage of the compiler on the calling thread only.\n";
+    std::cout << "basic-bytecode        -b     Runs the VM without superinstructions or quickening.\n";
+    std::cout << "profile-vm            -p     Counts which instructions the VM runs right after each other.\n";
+    std::cout << "interpret-only        -x     Runs the VM without compiling hot functions to machine code.\n";
+    std::cout << "native-build          -n     Compiles the generated C with the system C compiler into an executable.\n";
+    std::cout << "direct-objects        -e     Writes native objects straight from the IR instead of compiling C. Implies -n.\n";
+    std::cout << "verify-allocation     -v     Checks every register allocation of direct objects and reports the ones that do not hold.\n";
+    std::cout << "whole-program         -w     Inlines small functions across modules, folds the consts they export and drops functions the program never calls. Writes the IR of every module for later builds to read.\n";
+    std::cout << "dump-queries          -q     Dumps how many semantic queries ran or were answered from an earlier build of this prompt, and which ones ran.\n";
+    std::cout << "ignore-interfaces     -r     Reparses every used module instead of loading precompiled interfaces from the output path.\n";
 
     return true;
 }
@@ -178,6 +248,8 @@ bool process_command(const t_command_data& command) {
         return HELP(command);
     if (cmd_name == "build")
         return BUILD(command);
+    if (cmd_name == "run")
+        return RUN(command);
     if (cmd_name == "write")
         return WRITE(command);
     if (cmd_name == "stress")
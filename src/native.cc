@@ -0,0 +1,1518 @@
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+
+#include "native.hh"
+#include "ast.hh"
+#include "symbol.hh"
+#include "constant.hh"
+#include "interface.hh"
+#include "ir.hh"
+#include "regalloc.hh"
+#include "select.hh"
+#include "elf.hh"
+#include "x64.hh"
+
+using namespace core::ast;
+using namespace core::semantic;
+using namespace core::backend;
+using namespace core::backend::x64;
+
+/*
+
+====================================================
+
+Link names
+
+====================================================
+
+*/
+
+std::string core::backend::unit_path(const liprocess& process, const t_file_id file_id) {
+    return std::filesystem::path(frontend::interface_path(process, file_id)).replace_extension().generic_string();
+}
+
+std::string core::backend::unit_include(const liprocess& process, const t_file_id file_id) {
+    return std::filesystem::path(unit_path(process, file_id)).lexically_relative(std::filesystem::path(process.config.output_path)).generic_string() + ".h";
+}
+
+std::string core::backend::unit_prefix(const liprocess& process, const t_file_id file_id) {
+    std::string prefix = std::filesystem::path(unit_include(process, file_id)).replace_extension().generic_string();
+
+    for (char& c : prefix) {
+        if (!std::isalnum(static_cast<unsigned char>(c)))
+            c = '_';
+    }
+
+    if (prefix.empty() || std::isdigit(static_cast<unsigned char>(prefix[0])))
+        prefix.insert(prefix.begin(), '_');
+
+    return prefix;
+}
+
+std::string core::backend::link_name(const liprocess& process, const symbol* declared) {
+    std::string name = process.name_table.get(declared->name);
+
+    // Blocks have no owner. Closures are named after the functions around them.
+    for (const scope* at = declared->parent; at; at = at->parent) {
+        if (at->owner)
+            name = process.name_table.get(at->owner->name) + "__" + name;
+    }
+
+    return unit_prefix(process, declared->file_id) + "__" + name;
+}
+
+const symbol* core::backend::entry_function(liprocess& process) {
+    if (process.file_list.empty() || !process.file_list[0].dump_ir_module.has_value())
+        return nullptr;
+
+    const symbol_table& table = *std::any_cast<const t_symbol_table_ptr&>(process.file_list[0].dump_symbol_table);
+    const type_table& types = *std::any_cast<const t_type_table_ptr&>(process.dump_type_table);
+
+    const symbol* entry = symbol_table::lookup_in(table.root, process.name_table.intern("main"));
+
+    if (!entry || entry->kind != symbol_kind::FUNCTION || entry->template_count != 0 || entry->type == NO_TYPE)
+        return nullptr;
+
+    if (types.get(entry->type).argument_count != 1 || !std::any_cast<const t_ir_module_ptr&>(process.file_list[0].dump_ir_module)->find(entry))
+        return nullptr;
+
+    return entry;
+}
+
+/*
+
+====================================================
+
+Code generation
+Instruction selection (select.hh) decides first which instructions become part of the ones using
+them: lea for sums, immediates, and comparisons fused with their branch. Everything else is emitted
+one instruction at a time.
+
+Values live where the register allocator puts them (regalloc.hh): r10, r11, rbx and r12 to r15 for
+integers and xmm8 to xmm15 for floats, or a stack slot below the callee saved registers the function
+pushes. None of them is used for anything else, so an instruction still loads its operands into rax
+and rcx (xmm0 and xmm1 for floats), computes there and stores the result where it lives. Values hold
+what the VM registers do, integers extended to 64 bits and f32 as a rounded double, so only the edges
+of a function convert: parameters, arguments, results and globals, which are in their C layout.
+
+Blocks are laid out in reverse postorder. Reloads come right before the instruction that needs them,
+and everything an edge moves, phis included, is moved on the edge. The moves of one edge go through
+the stack with push and pop, which makes them parallel for free. Single moves go through the
+peephole window of the assembler, which drops the ones that move a value back where it came from.
+
+Everything a function references outside of itself, callees, globals and its trap messages, is
+recorded as a relocation for the object to resolve.
+
+Functions are compiled on their own, the functions of every object of a build together on the
+worker pool, into code of their own. Objects lay them out in declaration order afterwards, so they
+come out the same whatever the number of threads.
+
+====================================================
+
+*/
+
+constexpr const char* TRAP_NAME = "lican_native_trap";
+constexpr const char* POWER_NAME = "lican_native_pow";
+
+namespace {
+    struct native_reference {
+        uint32_t at; // The rel32, from the start of the function
+        std::string symbol; // Empty for rodata of the function itself
+        uint32_t type;
+        int64_t addend; // Offset into the rodata of the function, for rodata
+    };
+
+    struct native_function {
+        std::vector<uint8_t> byte_list;
+        std::vector<uint8_t> rodata;
+        std::vector<native_reference> reference_list;
+    };
+
+    // Allocated registers from here on are xmm registers, xmm0 being XMM.
+    constexpr uint8_t XMM = 16;
+
+    const register_target& native_target() {
+        static const register_target target = [] {
+            register_target result;
+
+            result.register_list[static_cast<uint8_t>(register_bank::INTEGER)] = { R10, R11, RBX, R12, R13, R14, R15 };
+
+            for (uint8_t xmm = 8; xmm < 16; xmm++) {
+                result.register_list[static_cast<uint8_t>(register_bank::FLOAT)].push_back(XMM + xmm);
+                result.caller_saved_mask |= uint64_t(1) << (XMM + xmm);
+            }
+
+            result.caller_saved_mask |= uint64_t(1) << R10 | uint64_t(1) << R11;
+            return result;
+        }();
+
+        return target;
+    }
+
+    const gpr CALLEE_SAVED_LIST[] = { RBX, R12, R13, R14, R15 };
+
+    // lican_native_pow only touches rax, rdi and rsi, so integer powers do not count.
+    bool is_native_call(const ir_function& function, const t_value_id id) {
+        const instruction& at = function.at(id);
+        return at.op == opcode::CALL || (is_floating(at.type) && (at.op == opcode::MOD || at.op == opcode::POW));
+    }
+
+    inline uint64_t double_bits(const double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(double));
+        return bits;
+    }
+
+    const gpr ARGUMENT_REGISTER_LIST[] = { RDI, RSI, RDX, RCX, R8, R9 };
+    constexpr uint32_t FLOAT_ARGUMENT_COUNT = 8;
+
+    struct native_state {
+        native_state(const core::liprocess& process, const ir_function& function, native_function& result)
+            : process(process), function(function), result(result) {}
+
+        const core::liprocess& process;
+        const ir_function& function;
+        native_function& result;
+
+        assembler code;
+
+        std::vector<uint32_t> block_offset_list;
+        std::vector<std::pair<size_t, t_block_id>> patch_list; // rel32 -> block
+
+        instruction_selection selection;
+        std::optional<ir_numbering> numbering;
+        register_allocation allocation;
+        uint32_t saved_count = 0; // Callee saved registers pushed below rbp
+        uint32_t position = 0; // Of the instruction being emitted
+
+        inline void reference(const size_t at, const std::string& symbol, const uint32_t type) {
+            result.reference_list.push_back({ static_cast<uint32_t>(at), symbol, type, -4 });
+        }
+
+        inline void call(const std::string& symbol) {
+            reference(code.call(), symbol, R_X86_64_PLT32);
+        }
+
+        inline int32_t slot(const t_value_id value) const {
+            return -8 * static_cast<int32_t>(saved_count + allocation.slot_list[value] + 1);
+        }
+
+        // An allocated register as a move operand.
+        static inline move_operand place(const uint8_t reg) {
+            return reg < XMM ? gpr_operand(static_cast<gpr>(reg)) : xmm_operand(static_cast<uint8_t>(reg - XMM));
+        }
+
+        // reg = value, which is in from.
+        inline void read_location(const uint8_t reg, const t_value_id value, const uint8_t from) {
+            code.move(place(reg), from == NO_REGISTER ? slot_operand(slot(value)) : place(from));
+        }
+
+        // to of value = reg.
+        inline void write_location(const t_value_id value, const uint8_t to, const uint8_t reg) {
+            code.move(to == NO_REGISTER ? slot_operand(slot(value)) : place(to), place(reg));
+        }
+
+        // Operands are read where they are at the current instruction.
+        inline void load_into(const uint8_t reg, const t_value_id value) {
+            read_location(reg, value, allocation.location(value, position));
+        }
+
+        // Results go where they are defined, and into their slot too if they ever wait there.
+        void store_from(const t_value_id value, const uint8_t reg) {
+            const uint8_t to = allocation.location(value, numbering->definition(function, value));
+
+            write_location(value, to, reg);
+
+            if (to != NO_REGISTER && allocation.slot_list[value] != NO_SLOT)
+                write_location(value, NO_REGISTER, reg);
+        }
+
+        inline void load(const gpr reg, const t_value_id value) { load_into(reg, value); }
+        inline void store(const t_value_id value, const gpr reg) { store_from(value, reg); }
+        inline void load_double(const uint8_t xmm, const t_value_id value) { load_into(XMM + xmm, value); }
+        inline void store_double(const t_value_id value, const uint8_t xmm) { store_from(value, XMM + xmm); }
+
+        inline void push_register(const gpr reg) {
+            if (reg & 8)
+                code.emit({ 0x41 });
+
+            code.emit({ static_cast<uint8_t>(0x50 + (reg & 7)) });
+        }
+
+        inline void pop_register(const gpr reg) {
+            if (reg & 8)
+                code.emit({ 0x41 });
+
+            code.emit({ static_cast<uint8_t>(0x58 + (reg & 7)) });
+        }
+
+        // Pushes value from where it is in from, 8 bytes.
+        void push_location(const t_value_id value, const uint8_t from) {
+            if (from == NO_REGISTER)
+                code.memory(0, false, { 0xFF }, 6, RBP, slot(value)); // push qword [slot]
+            else if (from < XMM)
+                push_register(static_cast<gpr>(from));
+            else {
+                code.move(gpr_operand(RAX), place(from));
+                push_register(RAX);
+            }
+        }
+
+        // Pops into to of value.
+        void pop_location(const t_value_id value, const uint8_t to) {
+            if (to == NO_REGISTER)
+                code.memory(0, false, { 0x8F }, 0, RBP, slot(value)); // pop qword [slot]
+            else if (to < XMM)
+                pop_register(static_cast<gpr>(to));
+            else {
+                pop_register(RAX);
+                code.move(place(to), gpr_operand(RAX));
+            }
+        }
+
+        inline void to_single(const uint8_t xmm) { code.registers(0xF2, false, { 0x0F, 0x5A }, xmm, xmm); } // cvtsd2ss
+        inline void to_double(const uint8_t xmm) { code.registers(0xF3, false, { 0x0F, 0x5A }, xmm, xmm); } // cvtss2sd
+
+        // xmm = the double in rax.
+        inline void move_to_xmm(const uint8_t xmm, const gpr reg) { code.registers(0x66, true, { 0x0F, 0x6E }, xmm, reg); }
+
+        inline void move_immediate(const gpr reg, const uint64_t value) {
+            code.move(gpr_operand(reg), immediate_operand(value));
+        }
+
+        // Extends rax from the width of type, how slots keep integers.
+        void wrap(const ir_type type) {
+            switch (type) {
+                case ir_type::I8: code.emit({ 0x48, 0x0F, 0xBE, 0xC0 }); break; // movsx rax, al
+                case ir_type::I16: code.emit({ 0x48, 0x0F, 0xBF, 0xC0 }); break; // movsx rax, ax
+                case ir_type::I32: code.emit({ 0x48, 0x63, 0xC0 }); break; // movsxd rax, eax
+                case ir_type::BOOL:
+                case ir_type::U8: code.emit({ 0x0F, 0xB6, 0xC0 }); break; // movzx eax, al
+                case ir_type::U16: code.emit({ 0x0F, 0xB7, 0xC0 }); break; // movzx eax, ax
+                case ir_type::U32: code.emit({ 0x89, 0xC0 }); break; // mov eax, eax
+                default: break;
+            }
+        }
+
+        // Prints message to stderr and exits with 1.
+        void trap(const std::string& message) {
+            const std::string line = message + '\n';
+            const size_t offset = result.rodata.size();
+
+            result.rodata.insert(result.rodata.end(), line.begin(), line.end());
+
+            const size_t at = code.rip_relative(0, true, { 0x8D }, RDI); // lea rdi, [rip + message]
+            result.reference_list.push_back({ static_cast<uint32_t>(at), "", R_X86_64_PC32, static_cast<int64_t>(offset) - 4 });
+
+            code.emit({ 0xBE }); // mov esi, length
+            code.emit_u32(static_cast<uint32_t>(line.size()));
+            call(TRAP_NAME);
+        }
+
+        // Traps unless cc holds.
+        void trap_unless(const condition cc, const std::string& message) {
+            const size_t skip = code.jump_if(cc);
+            trap(message);
+            code.link(skip, code.size());
+        }
+
+        inline void jump_to(const t_block_id block) {
+            patch_list.emplace_back(code.jump(), block);
+        }
+
+        /*
+
+        ====================================================
+
+        Instructions
+
+        ====================================================
+
+        */
+
+        void emit_parameters() {
+            uint32_t integer_count = 0;
+            uint32_t float_count = 0;
+            uint32_t stack_count = 0;
+
+            std::vector<t_value_id> parameter_value(function.parameter_type_list.size(), NO_VALUE);
+
+            for (t_value_id id = 0; id < function.instruction_list.size(); id++) {
+                if (function.at(id).op == opcode::PARAMETER)
+                    parameter_value[function.at(id).immediate] = id;
+            }
+
+            for (size_t i = 0; i < function.parameter_type_list.size(); i++) {
+                const ir_type type = function.parameter_type_list[i];
+                const t_value_id value = parameter_value[i];
+
+                if (is_floating(type) && float_count < FLOAT_ARGUMENT_COUNT) {
+                    const uint8_t xmm = static_cast<uint8_t>(float_count++);
+
+                    if (value == NO_VALUE)
+                        continue;
+
+                    if (type == ir_type::F32)
+                        to_double(xmm);
+
+                    store_double(value, xmm);
+                    continue;
+                }
+
+                if (!is_floating(type) && integer_count < std::size(ARGUMENT_REGISTER_LIST)) {
+                    const gpr reg = ARGUMENT_REGISTER_LIST[integer_count++];
+
+                    if (value == NO_VALUE)
+                        continue;
+
+                    code.registers(0, true, { 0x89 }, reg, RAX); // mov rax, reg
+                    wrap(type);
+                    store(value, RAX);
+                    continue;
+                }
+
+                const int32_t at = 16 + 8 * static_cast<int32_t>(stack_count++);
+
+                if (value == NO_VALUE)
+                    continue;
+
+                if (type == ir_type::F32) {
+                    code.memory(0xF3, false, { 0x0F, 0x10 }, 0, RBP, at); // movss xmm0, [rbp + at]
+                    to_double(0);
+                    store_double(value, 0);
+                }
+                else if (type == ir_type::F64) {
+                    code.memory(0xF2, false, { 0x0F, 0x10 }, 0, RBP, at);
+                    store_double(value, 0);
+                }
+                else {
+                    code.memory(0, true, { 0x8B }, RAX, RBP, at);
+                    wrap(type);
+                    store(value, RAX);
+                }
+            }
+        }
+
+        void emit_convert(const t_value_id id, const instruction& at, const t_value_id operand) {
+            const ir_type from = function.at(operand).type;
+            const ir_type to = at.type;
+
+            if (is_floating(from)) {
+                load_double(0, operand);
+
+                if (is_floating(to)) {
+                    if (to == ir_type::F32)
+                        round_single();
+
+                    store_double(id, 0);
+                    return;
+                }
+
+                if (to == ir_type::BOOL) {
+                    // NaN is not 0 either.
+                    code.emit({ 0x66, 0x0F, 0x57, 0xC9 }); // xorpd xmm1, xmm1
+                    code.emit({ 0x66, 0x0F, 0x2E, 0xC1 }); // ucomisd xmm0, xmm1
+                    code.emit({ 0x0F, 0x95, 0xC0 }); // setne al
+                    code.emit({ 0x0F, 0x9A, 0xC1 }); // setp cl
+                    code.emit({ 0x08, 0xC8 }); // or al, cl
+                    code.emit({ 0x0F, 0xB6, 0xC0 }); // movzx eax, al
+                    store(id, RAX);
+                    return;
+                }
+
+                // Out of range, NaN included, becomes 0 like in the VM.
+                std::vector<size_t> zero_list;
+                std::vector<size_t> done_list;
+
+                auto compare_with = [&](const double bound, const uint8_t jump) {
+                    move_immediate(RAX, double_bits(bound));
+                    move_to_xmm(1, RAX);
+                    code.emit({ 0x66, 0x0F, 0x2E, 0xC1 }); // ucomisd xmm0, xmm1
+                    zero_list.push_back(code.short_jump(jump));
+                };
+
+                if (is_signed(to)) {
+                    compare_with(-9223372036854775808.0, 0x72); // jb
+                    compare_with(9223372036854775808.0, 0x73); // jae
+                    code.emit({ 0xF2, 0x48, 0x0F, 0x2C, 0xC0 }); // cvttsd2si rax, xmm0
+                    done_list.push_back(code.short_jump(0xEB));
+                }
+                else {
+                    compare_with(0.0, 0x72);
+                    compare_with(18446744073709551616.0, 0x73);
+
+                    move_immediate(RAX, double_bits(9223372036854775808.0));
+                    move_to_xmm(1, RAX);
+                    code.emit({ 0x66, 0x0F, 0x2E, 0xC1 }); // ucomisd xmm0, xmm1
+                    const size_t high = code.short_jump(0x73); // jae
+
+                    code.emit({ 0xF2, 0x48, 0x0F, 0x2C, 0xC0 }); // cvttsd2si rax, xmm0
+                    done_list.push_back(code.short_jump(0xEB));
+
+                    code.land(high);
+                    code.emit({ 0xF2, 0x0F, 0x5C, 0xC1 }); // subsd xmm0, xmm1
+                    code.emit({ 0xF2, 0x48, 0x0F, 0x2C, 0xC0 }); // cvttsd2si rax, xmm0
+                    code.emit({ 0x48, 0x0F, 0xBA, 0xF8, 0x3F }); // btc rax, 63
+                    done_list.push_back(code.short_jump(0xEB));
+                }
+
+                for (const size_t zero : zero_list)
+                    code.land(zero);
+
+                code.emit({ 0x31, 0xC0 }); // xor eax, eax
+
+                for (const size_t done : done_list)
+                    code.land(done);
+
+                wrap(to);
+                store(id, RAX);
+                return;
+            }
+
+            load(RAX, operand);
+
+            if (is_floating(to)) {
+                if (from == ir_type::U64) {
+                    // cvtsi2sd is signed. Halve the ones with the top bit set, keeping the low bit for rounding.
+                    code.emit({ 0x48, 0x85, 0xC0 }); // test rax, rax
+                    const size_t big = code.short_jump(0x78); // js
+
+                    code.emit({ 0xF2, 0x48, 0x0F, 0x2A, 0xC0 }); // cvtsi2sd xmm0, rax
+                    const size_t done = code.short_jump(0xEB);
+
+                    code.land(big);
+                    code.emit({ 0x48, 0x89, 0xC1 }); // mov rcx, rax
+                    code.emit({ 0x48, 0xD1, 0xE9 }); // shr rcx, 1
+                    code.emit({ 0x83, 0xE0, 0x01 }); // and eax, 1
+                    code.emit({ 0x48, 0x09, 0xC1 }); // or rcx, rax
+                    code.emit({ 0xF2, 0x48, 0x0F, 0x2A, 0xC1 }); // cvtsi2sd xmm0, rcx
+                    code.emit({ 0xF2, 0x0F, 0x58, 0xC0 }); // addsd xmm0, xmm0
+                    code.land(done);
+                }
+                else
+                    code.emit({ 0xF2, 0x48, 0x0F, 0x2A, 0xC0 }); // cvtsi2sd xmm0, rax
+
+                // Through double first, like the VM.
+                if (to == ir_type::F32)
+                    round_single();
+
+                store_double(id, 0);
+                return;
+            }
+
+            if (to == ir_type::BOOL) {
+                code.emit({ 0x48, 0x85, 0xC0 }); // test rax, rax
+                code.set_bool(C_NE);
+            }
+            else
+                wrap(to);
+
+            store(id, RAX);
+        }
+
+        inline void round_single() {
+            to_single(0);
+            to_double(0);
+        }
+
+        void emit_integer_arithmetic(const t_value_id id, const instruction& at, const uint32_t* operands) {
+            const ir_type type = at.type;
+
+            if (at.op == opcode::POW) {
+                load(RDI, operands[0]);
+                load(RSI, operands[1]);
+
+                if (is_signed(type)) {
+                    code.emit({ 0x48, 0x85, 0xF6 }); // test rsi, rsi
+                    trap_unless(C_GE, "Integer raised to a negative power in '" + function.name + "'.");
+                }
+
+                call(POWER_NAME);
+                wrap(type);
+                store(id, RAX);
+                return;
+            }
+
+            load(RAX, operands[0]);
+
+            switch (at.op) {
+                case opcode::NEG: code.emit({ 0x48, 0xF7, 0xD8 }); break; // neg rax
+                case opcode::ADD: with_operand({ 0x03 }, RAX, operands[1]); break; // add rax, b
+                case opcode::SUB: with_operand({ 0x2B }, RAX, operands[1]); break; // sub rax, b
+                case opcode::MUL: with_operand({ 0x0F, 0xAF }, RAX, operands[1]); break; // imul rax, b
+                default: {
+                    load(RCX, operands[1]);
+
+                    const bool is_modulo = at.op == opcode::MOD;
+
+                    code.emit({ 0x48, 0x85, 0xC9 }); // test rcx, rcx
+                    trap_unless(C_NE, "Division by zero in '" + function.name + "'.");
+
+                    if (is_signed(type)) {
+                        // idiv faults on INT64_MIN / -1, which wraps in lican.
+                        code.emit({ 0x48, 0x83, 0xF9, 0xFF }); // cmp rcx, -1
+                        const size_t divide = code.short_jump(0x75); // jne
+
+                        if (is_modulo)
+                            code.emit({ 0x31, 0xC0 }); // xor eax, eax
+                        else
+                            code.emit({ 0x48, 0xF7, 0xD8 }); // neg rax
+
+                        const size_t done = code.short_jump(0xEB);
+                        code.land(divide);
+                        code.emit({ 0x48, 0x99 }); // cqo
+                        code.emit({ 0x48, 0xF7, 0xF9 }); // idiv rcx
+
+                        if (is_modulo)
+                            code.emit({ 0x48, 0x89, 0xD0 }); // mov rax, rdx
+
+                        code.land(done);
+                    }
+                    else {
+                        code.emit({ 0x31, 0xD2 }); // xor edx, edx
+                        code.emit({ 0x48, 0xF7, 0xF1 }); // div rcx
+
+                        if (is_modulo)
+                            code.emit({ 0x48, 0x89, 0xD0 }); // mov rax, rdx
+                    }
+                    break;
+                }
+            }
+
+            wrap(type);
+            store(id, RAX);
+        }
+
+        void emit_float_arithmetic(const t_value_id id, const instruction& at, const uint32_t* operands) {
+            // NEG flips the sign bit, which keeps an f32 value rounded.
+            if (at.op == opcode::NEG) {
+                load(RAX, operands[0]);
+                code.emit({ 0x48, 0x0F, 0xBA, 0xF8, 0x3F }); // btc rax, 63
+                store(id, RAX);
+                return;
+            }
+
+            load_double(0, operands[0]);
+            load_double(1, operands[1]);
+
+            switch (at.op) {
+                case opcode::ADD: code.emit({ 0xF2, 0x0F, 0x58, 0xC1 }); break; // addsd xmm0, xmm1
+                case opcode::SUB: code.emit({ 0xF2, 0x0F, 0x5C, 0xC1 }); break; // subsd
+                case opcode::MUL: code.emit({ 0xF2, 0x0F, 0x59, 0xC1 }); break; // mulsd
+                case opcode::DIV: code.emit({ 0xF2, 0x0F, 0x5E, 0xC1 }); break; // divsd
+                case opcode::MOD: call("fmod"); break;
+                default: call("pow"); break;
+            }
+
+            if (at.type == ir_type::F32)
+                round_single();
+
+            store_double(id, 0);
+        }
+
+        void emit_comparison(const t_value_id id, const instruction& at, const uint32_t* operands) {
+            const ir_type type = function.at(operands[0]).type;
+
+            if (is_floating(type)) {
+                load_double(0, operands[0]);
+                load_double(1, operands[1]);
+
+                switch (at.op) {
+                    case opcode::EQ:
+                    case opcode::NE: {
+                        // Unordered (NaN) sets the parity flag, and is never equal.
+                        const bool is_equal = at.op == opcode::EQ;
+
+                        code.emit({ 0x66, 0x0F, 0x2E, 0xC1 }); // ucomisd xmm0, xmm1
+                        code.emit({ 0x0F, static_cast<uint8_t>(0x90 | (is_equal ? C_E : C_NE)), 0xC0 });
+                        code.emit({ 0x0F, static_cast<uint8_t>(0x90 | (is_equal ? C_NP : C_P)), 0xC1 });
+                        code.emit({ static_cast<uint8_t>(is_equal ? 0x20 : 0x08), 0xC8 }); // and/or al, cl
+                        code.emit({ 0x0F, 0xB6, 0xC0 });
+                        break;
+                    }
+                    case opcode::LT:
+                    case opcode::LE:
+                        code.emit({ 0x66, 0x0F, 0x2E, 0xC8 }); // ucomisd xmm1, xmm0
+                        code.set_bool(at.op == opcode::LT ? C_A : C_AE);
+                        break;
+                    default:
+                        code.emit({ 0x66, 0x0F, 0x2E, 0xC1 }); // ucomisd xmm0, xmm1
+                        code.set_bool(at.op == opcode::GT ? C_A : C_AE);
+                        break;
+                }
+
+                store(id, RAX);
+                return;
+            }
+
+            static const condition SIGNED_LIST[] = { C_E, C_NE, C_L, C_LE, C_G, C_GE };
+            static const condition UNSIGNED_LIST[] = { C_E, C_NE, C_B, C_BE, C_A, C_AE };
+
+            const size_t index = static_cast<size_t>(at.op) - static_cast<size_t>(opcode::EQ);
+
+            load(RAX, operands[0]);
+            with_operand({ 0x3B }, RAX, operands[1]); // cmp rax, b
+            code.set_bool(is_signed(type) ? SIGNED_LIST[index] : UNSIGNED_LIST[index]);
+            store(id, RAX);
+        }
+
+        /*
+
+        ====================================================
+
+        Selected instructions
+
+        ====================================================
+
+        */
+
+        // reg against the 64 bit integer value wherever it is, a register or its slot. opcode is the
+        // reg, r/m form.
+        void with_operand(std::initializer_list<uint8_t> opcode, const gpr reg, const t_value_id value) {
+            const uint8_t from = allocation.location(value, position);
+
+            if (from == NO_REGISTER)
+                code.memory(0, true, opcode, reg, RBP, slot(value));
+            else
+                code.registers(0, true, opcode, reg, from);
+        }
+
+        // The register the value is in right now, or scratch with the value loaded into it.
+        gpr in_register(const t_value_id value, const gpr scratch) {
+            const uint8_t from = allocation.location(value, position);
+
+            if (from < XMM)
+                return static_cast<gpr>(from);
+
+            load(scratch, value);
+            return scratch;
+        }
+
+        // Where an integer result can be computed: its own register, unless it has to be wrapped first,
+        // which happens in rax.
+        gpr result_register(const t_value_id id, const ir_type type) {
+            const uint8_t to = allocation.location(id, position + 1);
+            return to < XMM && bit_width(type) == 64 ? static_cast<gpr>(to) : RAX;
+        }
+
+        inline void finish_integer(const t_value_id id, const ir_type type, const gpr reg) {
+            if (reg == RAX)
+                wrap(type);
+
+            store(id, reg);
+        }
+
+        struct address_parts {
+            t_value_id base = NO_VALUE;
+            t_value_id index = NO_VALUE;
+            uint8_t scale = 1;
+            int32_t displacement = 0;
+        };
+
+        void collect_address(const t_value_id id, const goal wanted, address_parts& parts) const {
+            const selection_rule& at = rule(selection.rule_of(id, wanted));
+
+            if (at.action == selection_action::CHAIN) {
+                collect_address(id, at.left, parts);
+                return;
+            }
+
+            const uint32_t* operands = function.operands(id);
+            const goal operand_goal_list[] = { at.left, at.right };
+
+            if (at.result == goal::INDEX) {
+                const uint32_t scaled = operand_goal_list[0] == goal::REG ? 0 : 1;
+
+                parts.index = operands[scaled];
+                parts.scale = static_cast<uint8_t>(function.at(operands[1 - scaled]).immediate);
+                return;
+            }
+
+            for (uint32_t i = 0; i < 2; i++) {
+                switch (operand_goal_list[i]) {
+                    case goal::REG:
+                        if (parts.base == NO_VALUE)
+                            parts.base = operands[i];
+                        else
+                            parts.index = operands[i];
+                        break;
+                    case goal::IMM:
+                        parts.displacement += static_cast<int32_t>(function.at(operands[i]).immediate);
+                        break;
+                    default:
+                        collect_address(operands[i], operand_goal_list[i], parts);
+                        break;
+                }
+            }
+        }
+
+        // The whole tree as one lea.
+        void emit_address(const t_value_id id, const instruction& at, const goal wanted) {
+            address_parts parts;
+            collect_address(id, wanted, parts);
+
+            const gpr reg = result_register(id, at.type);
+            const uint8_t base = parts.base == NO_VALUE ? NO_BASE : static_cast<uint8_t>(in_register(parts.base, RAX));
+
+            if (parts.index == NO_VALUE)
+                code.memory(0, true, { 0x8D }, reg, static_cast<gpr>(base), parts.displacement); // lea reg, [base + displacement]
+            else
+                code.indexed(0, true, { 0x8D }, reg, base, in_register(parts.index, RCX), parts.scale, parts.displacement); // lea reg, [base + index * scale + displacement]
+
+            finish_integer(id, at.type, reg);
+        }
+
+        // sub or imul with an immediate.
+        void emit_immediate(const t_value_id id, const instruction& at, const selection_rule& selected) {
+            const uint32_t* operands = function.operands(id);
+            const uint32_t constant = selected.left == goal::IMM ? 0 : 1;
+
+            const t_value_id value = operands[1 - constant];
+            const uint32_t immediate = static_cast<uint32_t>(function.at(operands[constant]).immediate);
+            const gpr reg = result_register(id, at.type);
+
+            if (at.op == opcode::SUB) {
+                load(reg, value);
+                code.registers(0, true, { 0x81 }, 5, reg); // sub reg, imm32
+            }
+            else
+                with_operand({ 0x69 }, reg, value); // imul reg, value, imm32
+
+            code.emit_u32(immediate);
+            finish_integer(id, at.type, reg);
+        }
+
+        // Sets the flags for a comparison and returns the condition that holds when it does.
+        condition emit_condition(const t_value_id id) {
+            static const condition SIGNED_LIST[] = { C_E, C_NE, C_L, C_LE, C_G, C_GE };
+            static const condition UNSIGNED_LIST[] = { C_E, C_NE, C_B, C_BE, C_A, C_AE };
+
+            const instruction& at = function.at(id);
+            const uint32_t* operands = function.operands(id);
+            const selection_rule& selected = rule(selection.rule_of(id, goal::CONDITION));
+            const ir_type type = function.at(operands[0]).type;
+
+            if (is_floating(type)) {
+                load_double(0, operands[0]);
+                load_double(1, operands[1]);
+
+                if (at.op == opcode::LT || at.op == opcode::LE)
+                    code.emit({ 0x66, 0x0F, 0x2E, 0xC8 }); // ucomisd xmm1, xmm0
+                else
+                    code.emit({ 0x66, 0x0F, 0x2E, 0xC1 }); // ucomisd xmm0, xmm1
+
+                return at.op == opcode::LT || at.op == opcode::GT ? C_A : C_AE;
+            }
+
+            const gpr left = in_register(operands[0], RAX);
+
+            if (selected.right == goal::IMM) {
+                code.registers(0, true, { 0x81 }, 7, left); // cmp left, imm32
+                code.emit_u32(static_cast<uint32_t>(function.at(operands[1]).immediate));
+            }
+            else
+                with_operand({ 0x3B }, left, operands[1]); // cmp left, right
+
+            const size_t index = static_cast<size_t>(at.op) - static_cast<size_t>(opcode::EQ);
+            return is_signed(type) ? SIGNED_LIST[index] : UNSIGNED_LIST[index];
+        }
+
+        void emit_selected(const t_value_id id, const instruction& at, const selection_rule& selected) {
+            switch (selected.action) {
+                case selection_action::LEA:
+                    emit_address(id, at, selected.left);
+                    break;
+                case selection_action::SET:
+                    code.set_bool(emit_condition(id));
+                    store(id, RAX);
+                    break;
+                default:
+                    emit_immediate(id, at, selected);
+                    break;
+            }
+        }
+
+        // Globals are in their C layout, so narrow ones are extended on the way in and cut on the way out.
+        void emit_global(const t_value_id id, const instruction& at, const uint32_t* operands) {
+            const std::string name = link_name(process, at.symbol);
+            const bool is_load = at.op == opcode::LOAD_GLOBAL;
+            const ir_type type = is_load ? at.type : function.at(operands[0]).type;
+
+            size_t rel32;
+
+            if (is_floating(type)) {
+                if (is_load) {
+                    rel32 = code.rip_relative(type == ir_type::F32 ? 0xF3 : 0xF2, false, { 0x0F, 0x10 }, 0); // movss/movsd xmm0, [rip + global]
+
+                    if (type == ir_type::F32)
+                        to_double(0);
+
+                    store_double(id, 0);
+                }
+                else {
+                    load_double(0, operands[0]);
+
+                    if (type == ir_type::F32)
+                        to_single(0);
+
+                    rel32 = code.rip_relative(type == ir_type::F32 ? 0xF3 : 0xF2, false, { 0x0F, 0x11 }, 0);
+                }
+
+                reference(rel32, name, R_X86_64_PC32);
+                return;
+            }
+
+            if (is_load) {
+                switch (type) {
+                    case ir_type::I8: rel32 = code.rip_relative(0, true, { 0x0F, 0xBE }, RAX); break; // movsx rax, byte
+                    case ir_type::I16: rel32 = code.rip_relative(0, true, { 0x0F, 0xBF }, RAX); break; // movsx rax, word
+                    case ir_type::I32: rel32 = code.rip_relative(0, true, { 0x63 }, RAX); break; // movsxd rax, dword
+                    case ir_type::BOOL:
+                    case ir_type::U8: rel32 = code.rip_relative(0, false, { 0x0F, 0xB6 }, RAX); break; // movzx eax, byte
+                    case ir_type::U16: rel32 = code.rip_relative(0, false, { 0x0F, 0xB7 }, RAX); break; // movzx eax, word
+                    case ir_type::U32: rel32 = code.rip_relative(0, false, { 0x8B }, RAX); break; // mov eax, dword
+                    default: rel32 = code.rip_relative(0, true, { 0x8B }, RAX); break; // mov rax, qword
+                }
+
+                reference(rel32, name, R_X86_64_PC32);
+                store(id, RAX);
+                return;
+            }
+
+            load(RAX, operands[0]);
+
+            switch (bit_width(type)) {
+                case 1:
+                case 8: rel32 = code.rip_relative(0, false, { 0x88 }, RAX); break; // mov byte, al
+                case 16: rel32 = code.rip_relative(0x66, false, { 0x89 }, RAX); break; // mov word, ax
+                case 32: rel32 = code.rip_relative(0, false, { 0x89 }, RAX); break; // mov dword, eax
+                default: rel32 = code.rip_relative(0, true, { 0x89 }, RAX); break; // mov qword, rax
+            }
+
+            reference(rel32, name, R_X86_64_PC32);
+        }
+
+        void emit_call(const t_value_id id, const instruction& at, const uint32_t* operands) {
+            std::vector<uint32_t> stack_list;
+            std::vector<std::pair<uint32_t, uint8_t>> register_list; // argument -> register or xmm
+
+            uint32_t integer_count = 0;
+            uint32_t float_count = 0;
+
+            for (uint32_t i = 0; i < at.operand_count; i++) {
+                const ir_type type = function.at(operands[i]).type;
+
+                if (is_floating(type) && float_count < FLOAT_ARGUMENT_COUNT)
+                    register_list.emplace_back(i, static_cast<uint8_t>(float_count++));
+                else if (!is_floating(type) && integer_count < std::size(ARGUMENT_REGISTER_LIST))
+                    register_list.emplace_back(i, ARGUMENT_REGISTER_LIST[integer_count++]);
+                else
+                    stack_list.push_back(i);
+            }
+
+            // The stack stays 16 byte aligned at the call.
+            const uint32_t padding = stack_list.size() % 2 == 1 ? 8 : 0;
+
+            if (padding)
+                code.emit({ 0x48, 0x83, 0xEC, 0x08 }); // sub rsp, 8
+
+            for (size_t i = stack_list.size(); i-- > 0;) {
+                const t_value_id value = operands[stack_list[i]];
+
+                if (function.at(value).type == ir_type::F32) {
+                    load_double(0, value);
+                    to_single(0);
+                    code.emit({ 0x66, 0x0F, 0x7E, 0xC0 }); // movd eax, xmm0
+                    code.emit({ 0x50 }); // push rax
+                }
+                else
+                    push_location(value, allocation.location(value, position));
+            }
+
+            for (const auto& [argument, reg] : register_list) {
+                const t_value_id value = operands[argument];
+                const ir_type type = function.at(value).type;
+
+                if (is_floating(type)) {
+                    load_double(reg, value);
+
+                    if (type == ir_type::F32)
+                        to_single(reg);
+                }
+                else
+                    load(static_cast<gpr>(reg), value);
+            }
+
+            call(link_name(process, at.symbol));
+
+            if (!stack_list.empty()) {
+                code.emit({ 0x48, 0x81, 0xC4 }); // add rsp, imm32
+                code.emit_u32(static_cast<uint32_t>(stack_list.size() * 8 + padding));
+            }
+
+            if (at.type == ir_type::VOID)
+                return;
+
+            if (is_floating(at.type)) {
+                if (at.type == ir_type::F32)
+                    to_double(0);
+
+                store_double(id, 0);
+                return;
+            }
+
+            // Callees compiled from C only promise the bits of their return type.
+            wrap(at.type);
+            store(id, RAX);
+        }
+
+        void emit_edge(const t_block_id from, const t_block_id to) {
+            std::vector<edge_move> move_list = edge_moves(function, *numbering, allocation, from, to);
+
+            // A register to itself, or a slot to itself, moves nothing.
+            move_list.erase(std::remove_if(move_list.begin(), move_list.end(), [](const edge_move& move) {
+                return move.from == move.to && (move.from != NO_REGISTER || move.value == move.destination);
+            }), move_list.end());
+
+            if (move_list.size() == 1) {
+                const edge_move& move = move_list[0];
+
+                if (move.to != NO_REGISTER)
+                    read_location(move.to, move.value, move.from);
+                else if (move.from != NO_REGISTER)
+                    write_location(move.destination, NO_REGISTER, move.from);
+                else {
+                    read_location(RAX, move.value, NO_REGISTER);
+                    write_location(move.destination, NO_REGISTER, RAX);
+                }
+            }
+            else {
+                for (const edge_move& move : move_list)
+                    push_location(move.value, move.from);
+
+                for (size_t i = move_list.size(); i-- > 0;)
+                    pop_location(move_list[i].destination, move_list[i].to);
+            }
+
+            jump_to(to);
+        }
+
+        void emit_return(const instruction& at, const uint32_t* operands) {
+            if (at.operand_count > 0) {
+                const ir_type type = function.at(operands[0]).type;
+
+                if (is_floating(type)) {
+                    load_double(0, operands[0]);
+
+                    if (type == ir_type::F32)
+                        to_single(0);
+                }
+                else
+                    load(RAX, operands[0]);
+            }
+
+            if (saved_count == 0) {
+                code.emit({ 0xC9, 0xC3 }); // leave, ret
+                return;
+            }
+
+            code.memory(0, true, { 0x8D }, RSP, RBP, -8 * static_cast<int32_t>(saved_count)); // lea rsp, [rbp - saved]
+
+            for (size_t i = std::size(CALLEE_SAVED_LIST); i-- > 0;) {
+                if ((allocation.used_mask >> CALLEE_SAVED_LIST[i]) & 1)
+                    pop_register(CALLEE_SAVED_LIST[i]);
+            }
+
+            code.emit({ 0x5D, 0xC3 }); // pop rbp, ret
+        }
+
+        void emit_instruction(const t_block_id block, const t_value_id id) {
+            const instruction& at = function.at(id);
+            const uint32_t* operands = function.operands(id);
+
+            // Emitted with the instruction it is folded into.
+            if (selection.folded_list[id])
+                return;
+
+            if (at.op != opcode::BRANCH && selection.rule_of(id, goal::REG) != NO_RULE) {
+                emit_selected(id, at, rule(selection.rule_of(id, goal::REG)));
+                return;
+            }
+
+            switch (at.op) {
+                case opcode::NOP:
+                case opcode::PARAMETER:
+                case opcode::PHI:
+                    break;
+                case opcode::CONSTANT:
+                case opcode::UNDEFINED: {
+                    const uint8_t reg = allocation.location(id, position + 1);
+                    const uint64_t value = at.op == opcode::UNDEFINED ? 0 : at.immediate;
+
+                    if (reg < XMM) {
+                        move_immediate(static_cast<gpr>(reg), value);
+                        store(id, static_cast<gpr>(reg));
+                    }
+                    else if (reg == NO_REGISTER && static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(value))) == value)
+                        code.move(slot_operand(slot(id)), immediate_operand(value));
+                    else {
+                        move_immediate(RAX, value);
+                        store(id, RAX);
+                    }
+                    break;
+                }
+                case opcode::COPY:
+                    load(RAX, operands[0]);
+                    store(id, RAX);
+                    break;
+                case opcode::CONVERT:
+                    emit_convert(id, at, operands[0]);
+                    break;
+                case opcode::NOT:
+                    load(RAX, operands[0]);
+                    code.emit({ 0x48, 0x83, 0xF0, 0x01 }); // xor rax, 1
+                    store(id, RAX);
+                    break;
+                case opcode::NEG:
+                case opcode::ADD:
+                case opcode::SUB:
+                case opcode::MUL:
+                case opcode::DIV:
+                case opcode::MOD:
+                case opcode::POW:
+                    if (is_floating(at.type))
+                        emit_float_arithmetic(id, at, operands);
+                    else
+                        emit_integer_arithmetic(id, at, operands);
+                    break;
+                case opcode::EQ:
+                case opcode::NE:
+                case opcode::LT:
+                case opcode::LE:
+                case opcode::GT:
+                case opcode::GE:
+                    emit_comparison(id, at, operands);
+                    break;
+                case opcode::LOAD_GLOBAL:
+                case opcode::STORE_GLOBAL:
+                    emit_global(id, at, operands);
+                    break;
+                case opcode::CALL:
+                    emit_call(id, at, operands);
+                    break;
+                case opcode::JUMP:
+                    emit_edge(block, at.target[0]);
+                    break;
+                case opcode::BRANCH: {
+                    size_t otherwise;
+
+                    // A comparison folded into the branch jumps on its flags.
+                    if (selection.folded_list[operands[0]])
+                        otherwise = code.jump_if(static_cast<condition>(emit_condition(operands[0]) ^ 1));
+                    else {
+                        load(RAX, operands[0]);
+                        code.emit({ 0x48, 0x85, 0xC0 }); // test rax, rax
+                        otherwise = code.jump_if(C_E);
+                    }
+
+                    emit_edge(block, at.target[0]);
+
+                    code.link(otherwise, code.size());
+                    emit_edge(block, at.target[1]);
+                    break;
+                }
+                case opcode::RETURN:
+                    emit_return(at, operands);
+                    break;
+                case opcode::UNREACHABLE:
+                    trap("'" + function.name + "' ended without returning a value.");
+                    break;
+            }
+        }
+
+        void compile() {
+            selection = select_instructions(function);
+            numbering.emplace(function);
+            allocation = allocate_registers(build_intervals(function, *numbering, is_native_call, selection.folded_list), static_cast<uint32_t>(function.instruction_list.size()), native_target());
+
+            code.emit({ 0x55 }); // push rbp
+            code.emit({ 0x48, 0x89, 0xE5 }); // mov rbp, rsp
+
+            for (const gpr reg : CALLEE_SAVED_LIST) {
+                if ((allocation.used_mask >> reg) & 1) {
+                    push_register(reg);
+                    saved_count++;
+                }
+            }
+
+            // The stack is 16 byte aligned once rbp is pushed, and stays that way.
+            uint32_t frame = allocation.slot_count * 8;
+
+            if ((saved_count * 8 + frame) % 16 != 0)
+                frame += 8;
+
+            if (frame > 0) {
+                code.emit({ 0x48, 0x81, 0xEC }); // sub rsp, frame
+                code.emit_u32(frame);
+            }
+
+            emit_parameters();
+
+            block_offset_list.assign(function.block_list.size(), 0);
+
+            for (const t_block_id block : numbering->block_order) {
+                block_offset_list[block] = static_cast<uint32_t>(code.size());
+
+                for (t_value_id id = function.block_list[block].first; id != NO_VALUE; id = function.at(id).next) {
+                    position = numbering->position_list[id];
+
+                    // Reloads at the start of a block are up to the edges into it.
+                    if (position != numbering->block_start_list[block]) {
+                        const auto [first, last] = std::equal_range(allocation.reload_list.begin(), allocation.reload_list.end(), allocation_piece{ 0, position, 0, 0 },
+                            [](const allocation_piece& a, const allocation_piece& b) { return a.start < b.start; });
+
+                        for (auto reload = first; reload != last; ++reload)
+                            read_location(reload->reg, reload->value, NO_REGISTER);
+                    }
+
+                    emit_instruction(block, id);
+                }
+            }
+
+            for (const auto& [at, block] : patch_list)
+                code.link(at, block_offset_list[block]);
+
+            code.flush();
+            result.byte_list = std::move(code.byte_list);
+        }
+
+        // A function the IR could not express traps as soon as it is called.
+        void compile_trap() {
+            code.emit({ 0x55 }); // push rbp
+            code.emit({ 0x48, 0x89, 0xE5 }); // mov rbp, rsp
+            trap("'" + function.name + "' can not run as native code yet.");
+            result.byte_list = std::move(code.byte_list);
+        }
+    };
+
+    // rdi: message, rsi: its length. write(2, message, length), then exit(1).
+    native_function trap_function() {
+        native_function result;
+        assembler code;
+
+        code.emit({ 0x50 }); // push rax, which aligns the stack for the calls
+        code.emit({ 0x48, 0x89, 0xF2 }); // mov rdx, rsi
+        code.emit({ 0x48, 0x89, 0xFE }); // mov rsi, rdi
+        code.emit({ 0xBF, 0x02, 0x00, 0x00, 0x00 }); // mov edi, 2
+        result.reference_list.push_back({ static_cast<uint32_t>(code.call()), "write", R_X86_64_PLT32, -4 });
+        code.emit({ 0xBF, 0x01, 0x00, 0x00, 0x00 }); // mov edi, 1
+        result.reference_list.push_back({ static_cast<uint32_t>(code.call()), "exit", R_X86_64_PLT32, -4 });
+
+        result.byte_list = std::move(code.byte_list);
+        return result;
+    }
+
+    // rax = rdi to the power of rsi, wrapping.
+    native_function power_function() {
+        native_function result;
+        assembler code;
+
+        code.emit({ 0xB8, 0x01, 0x00, 0x00, 0x00 }); // mov eax, 1
+        const size_t loop = code.size();
+        code.emit({ 0x48, 0x85, 0xF6 }); // test rsi, rsi
+        const size_t done = code.short_jump(0x74); // jz
+        code.emit({ 0x40, 0xF6, 0xC6, 0x01 }); // test sil, 1
+        const size_t skip = code.short_jump(0x74); // jz
+        code.emit({ 0x48, 0x0F, 0xAF, 0xC7 }); // imul rax, rdi
+        code.land(skip);
+        code.emit({ 0x48, 0x0F, 0xAF, 0xFF }); // imul rdi, rdi
+        code.emit({ 0x48, 0xD1, 0xEE }); // shr rsi, 1
+        code.emit({ 0xEB, static_cast<uint8_t>(loop - (code.size() + 2)) }); // jmp loop
+        code.land(done);
+        code.emit({ 0xC3 }); // ret
+
+        result.byte_list = std::move(code.byte_list);
+        return result;
+    }
+
+    // C main, calling the entry and returning what it returns if that is an integer.
+    native_function main_function(const std::string& entry, const bool is_status) {
+        native_function result;
+        assembler code;
+
+        code.emit({ 0x48, 0x83, 0xEC, 0x08 }); // sub rsp, 8
+        result.reference_list.push_back({ static_cast<uint32_t>(code.call()), entry, R_X86_64_PLT32, -4 });
+
+        if (!is_status)
+            code.emit({ 0x31, 0xC0 }); // xor eax, eax
+
+        code.emit({ 0x48, 0x83, 0xC4, 0x08 }); // add rsp, 8
+        code.emit({ 0xC3 }); // ret
+
+        result.byte_list = std::move(code.byte_list);
+        return result;
+    }
+
+    // Appends a function to .text and resolves what it references.
+    void place(elf_object& object, const std::string& name, const bool is_global, const native_function& function) {
+        const uint64_t text = object.align(elf_section::TEXT, 16);
+        std::vector<uint8_t>& bytes = object.data(elf_section::TEXT);
+
+        bytes.insert(bytes.end(), function.byte_list.begin(), function.byte_list.end());
+        object.add_symbol(name, elf_section::TEXT, text, function.byte_list.size(), is_global, true);
+
+        uint64_t rodata = 0;
+
+        if (!function.rodata.empty()) {
+            rodata = object.align(elf_section::RODATA, 8);
+            std::vector<uint8_t>& constants = object.data(elf_section::RODATA);
+            constants.insert(constants.end(), function.rodata.begin(), function.rodata.end());
+        }
+
+        for (const native_reference& at : function.reference_list) {
+            if (at.symbol.empty())
+                object.relocate(elf_section::TEXT, text + at.at, SECTION_SYMBOL + static_cast<uint32_t>(elf_section::RODATA), at.type, static_cast<int64_t>(rodata) + at.addend);
+            else
+                object.relocate(elf_section::TEXT, text + at.at, object.reference(at.symbol), at.type, at.addend);
+        }
+    }
+
+    bool lower_kind(const type_kind kind, ir_type& result) {
+        switch (kind) {
+            case type_kind::U8: result = ir_type::U8; return true;
+            case type_kind::U16: result = ir_type::U16; return true;
+            case type_kind::U32: result = ir_type::U32; return true;
+            case type_kind::U64: result = ir_type::U64; return true;
+            case type_kind::I8: result = ir_type::I8; return true;
+            case type_kind::I16: result = ir_type::I16; return true;
+            case type_kind::I32: result = ir_type::I32; return true;
+            case type_kind::I64: result = ir_type::I64; return true;
+            case type_kind::F32: result = ir_type::F32; return true;
+            case type_kind::F64: result = ir_type::F64; return true;
+            case type_kind::BOOL: result = ir_type::BOOL; return true;
+            default: return false;
+        }
+    }
+
+    struct object_state {
+        object_state(core::liprocess& process, const core::t_file_id file_id, std::vector<core::lilog>& log_list)
+            : process(process), file_id(file_id), ast(std::any_cast<const ast_arena&>(process.file_list[file_id].dump_ast_arena)),
+            table(*std::any_cast<const t_symbol_table_ptr&>(process.file_list[file_id].dump_symbol_table)),
+            types(*std::any_cast<const t_type_table_ptr&>(process.dump_type_table)), log_list(log_list) {}
+
+        core::liprocess& process;
+        const core::t_file_id file_id;
+
+        const ast_arena& ast;
+        const symbol_table& table;
+        type_table& types;
+
+        std::vector<core::lilog>& log_list;
+
+        elf_object object;
+
+        // Per function of the module, compiled apart from the object so the functions of a build can
+        // be spread over the worker pool, with what compiling them had to say.
+        std::vector<native_function> compiled_list;
+        std::vector<std::vector<core::lilog>> function_log_list;
+
+        inline void warning(const t_node_id node, const std::string& message) {
+            log_list.emplace_back(core::lilog::log_level::WARNING, core::lisel(file_id, ast.get_base_ptr(node)->selection.start), message);
+        }
+
+        // Module level variants with a primitive type, initialized like the C units do. Consts go to
+        // .rodata, since importers read them like any other global.
+        void add_global(const t_node_id id, const symbol* declared) {
+            const variant_declaration& declaration = ast.get_as<variant_declaration>(id);
+            const constant* folded = nullptr;
+
+            if (ast.get_base_ptr(declaration.value)->type != node_type::EXPR_NONE)
+                folded = table.constant_map.find(static_cast<uint32_t>(declaration.value));
+
+            ir_type type;
+            bool is_const = false;
+
+            if (declared->type == NO_TYPE) {
+                if (!folded || !lower_kind(folded->kind, type))
+                    return;
+            }
+            else {
+                const type_entry& entry = types.get(declared->type);
+                const type_kind kind = types.get(entry.base).kind;
+
+                is_const = entry.flags & TYPE_CONST;
+
+                if ((entry.flags & ~TYPE_CONST) == 0 && kind == type_kind::POINTER)
+                    type = ir_type::PTR;
+                else if ((entry.flags & ~TYPE_CONST) == 0 && kind == type_kind::ENUM)
+                    type = ir_type::I64;
+                else if ((entry.flags & ~TYPE_CONST) != 0 || !lower_kind(kind, type)) {
+                    warning(id, "Objects are only written for globals of primitive types so far. '" + process.name_table.get(declared->name) + "' is left out.");
+                    return;
+                }
+            }
+
+            const uint64_t size = type == ir_type::BOOL ? 1 : bit_width(type) / 8;
+            uint64_t bits = folded ? constant_bits(*folded) : 0;
+
+            if (type == ir_type::F32) {
+                double value;
+                std::memcpy(&value, &bits, sizeof(double));
+
+                const float single = static_cast<float>(value);
+                uint32_t single_bits;
+                std::memcpy(&single_bits, &single, sizeof(float));
+                bits = single_bits;
+            }
+
+            const std::string name = link_name(process, declared);
+
+            if (bits == 0 && !is_const) {
+                object.add_symbol(name, elf_section::BSS, object.align(elf_section::BSS, size), size, true, false);
+                object.bss_size += size;
+                return;
+            }
+
+            const elf_section section = is_const ? elf_section::RODATA : elf_section::DATA;
+            std::vector<uint8_t>& data = object.data(section);
+            object.add_symbol(name, section, object.align(section, size), size, true, false);
+
+            const size_t at = data.size();
+            data.resize(at + size);
+            std::memcpy(data.data() + at, &bits, size); // Little endian, so the low bytes come first
+        }
+
+        void collect(const t_node_id id) {
+            switch (ast.get_base_ptr(id)->type) {
+                case node_type::ITEM_MODULE:
+                    collect(ast.get_as<item_module>(id).content);
+                    break;
+                case node_type::ITEM_BODY:
+                    for (const t_node_id item : ast.get_as<item_body>(id).item_list)
+                        collect(item);
+                    break;
+                case node_type::VARIANT_DECLARATION:
+                    if (const symbol* declared = table.resolution(id); declared && declared->kind == symbol_kind::VARIANT)
+                        add_global(id, declared);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        inline const ir_module& module() const {
+            return *std::any_cast<const t_ir_module_ptr&>(process.file_list[file_id].dump_ir_module);
+        }
+
+        // Runs on any worker, alongside functions of this module and others.
+        void compile_function(const size_t index) {
+            const ir_function& function = module().function_list[index];
+            std::vector<core::lilog>& function_log = function_log_list[index];
+
+            native_state state(process, function, compiled_list[index]);
+
+            if (function.complete) {
+                state.compile();
+
+                if (process.config._verify_allocation) {
+                    const std::string failure = verify_allocation(function, *state.numbering, state.allocation, native_target(), is_native_call, state.selection.folded_list);
+
+                    if (!failure.empty())
+                        function_log.emplace_back(core::lilog::log_level::COMPILER_ERROR, core::lisel(file_id, ast.get_base_ptr(function.source->node)->selection.start), "The registers allocated for '" + function.name + "' do not hold: " + failure);
+                }
+            }
+            else {
+                function_log.emplace_back(core::lilog::log_level::WARNING, core::lisel(file_id, ast.get_base_ptr(function.source->node)->selection.start), "'" + function.name + "' uses something native code does not support yet. It traps when called.");
+                state.compile_trap();
+            }
+        }
+
+        // Lays out the object once every function is compiled, in declaration order.
+        void build() {
+            const ir_module& functions = module();
+
+            place(object, TRAP_NAME, false, trap_function());
+            place(object, POWER_NAME, false, power_function());
+
+            for (size_t i = 0; i < functions.function_list.size(); i++) {
+                for (core::lilog& log : function_log_list[i])
+                    log_list.push_back(std::move(log));
+
+                place(object, link_name(process, functions.function_list[i].source), true, compiled_list[i]);
+            }
+
+            compiled_list.clear();
+            function_log_list.clear();
+
+            for (const t_node_id item : ast.get_as<ast_root>(0).item_list)
+                collect(item);
+
+            if (file_id == 0) {
+                if (const symbol* entry = entry_function(process)) {
+                    ir_type result;
+                    const type_entry& signature = types.get(entry->type);
+                    const bool is_status = lower_kind(types.get(signature.argument_list[0]).kind, result) && is_integer(result);
+
+                    place(object, "main", true, main_function(link_name(process, entry), is_status));
+                }
+            }
+        }
+    };
+}
+
+// Writes bytes to path unless it already holds them. Returns false if writing failed.
+static bool write_bytes(const std::string& path, const std::vector<uint8_t>& bytes, bool& is_written) {
+    is_written = false;
+
+    {
+        std::ifstream in(path, std::ios::binary);
+
+        if (in.is_open() && std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()) == bytes)
+            return true;
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+
+    if (!out.is_open())
+        return false;
+
+    out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    is_written = true;
+
+    return out.good();
+}
+
+void core::backend::write_objects(liprocess& process, const std::vector<t_file_id>& file_list, const std::vector<std::string>& path_list, std::vector<uint8_t>& failed_list, std::vector<uint8_t>& written_list, std::vector<std::vector<lilog>>& log_list) {
+    std::deque<object_state> state_list;
+
+    // Functions of every file in one go, since the pool runs one job at a time.
+    std::vector<std::pair<size_t, size_t>> function_list;
+
+    for (size_t i = 0; i < file_list.size(); i++) {
+        object_state& state = state_list.emplace_back(process, file_list[i], log_list[i]);
+        const size_t function_count = state.module().function_list.size();
+
+        state.compiled_list.resize(function_count);
+        state.function_log_list.resize(function_count);
+
+        for (size_t j = 0; j < function_count; j++)
+            function_list.emplace_back(i, j);
+    }
+
+    process.pool.parallel_for(function_list.size(), [&](const size_t i) {
+        state_list[function_list[i].first].compile_function(function_list[i].second);
+    });
+
+    process.pool.parallel_for(file_list.size(), [&](const size_t i) {
+        state_list[i].build();
+
+        bool is_written;
+        failed_list[i] = !write_bytes(path_list[i], state_list[i].object.serialize(), is_written);
+        written_list[i] = is_written;
+    });
+}
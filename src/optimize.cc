@@ -0,0 +1,1259 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+#include "core.hh"
+#include "optimize.hh"
+#include "inline.hh"
+
+using namespace core::backend;
+
+/*
+
+====================================================
+
+Helpers
+
+====================================================
+
+*/
+
+// Value operands of an instruction start at first and are step apart. Phis alternate blocks and values.
+static inline uint32_t value_begin(const instruction& at) { return at.op == opcode::PHI ? 1 : 0; }
+static inline uint32_t value_step(const instruction& at) { return at.op == opcode::PHI ? 2 : 1; }
+
+static inline bool has_phis(const ir_function& function, const t_block_id block) {
+    const t_value_id first = function.block_list[block].first;
+    return first != NO_VALUE && function.at(first).op == opcode::PHI;
+}
+
+// First instruction of a block that is not a phi. Blocks always end in a terminator, so there is one.
+static inline t_value_id first_body(const ir_function& function, const t_block_id block) {
+    t_value_id id = function.block_list[block].first;
+
+    while (id != NO_VALUE && function.at(id).op == opcode::PHI)
+        id = function.at(id).next;
+
+    return id;
+}
+
+static t_value_id resolve(std::vector<t_value_id>& forward, t_value_id value) {
+    t_value_id root = value;
+
+    while (forward[root] != NO_VALUE)
+        root = forward[root];
+
+    // Compress the chain, so every value is looked up once.
+    while (forward[value] != NO_VALUE) {
+        const t_value_id next = forward[value];
+        forward[value] = root;
+        value = next;
+    }
+
+    return root;
+}
+
+// Rewrites every value operand through forward, where forward[v] is what v became.
+static void apply_forwards(ir_function& function, std::vector<t_value_id>& forward) {
+    forward.resize(function.instruction_list.size(), NO_VALUE);
+
+    for (const ir_block& block : function.block_list) {
+        for (t_value_id id = block.first; id != NO_VALUE; id = function.at(id).next) {
+            const instruction& user = function.at(id);
+            uint32_t* operand_list = function.operands(id);
+
+            for (uint32_t i = value_begin(user); i < user.operand_count; i += value_step(user))
+                operand_list[i] = resolve(forward, operand_list[i]);
+        }
+    }
+}
+
+// Drops one incoming edge from from out of every phi of block.
+static void drop_phi_edge(ir_function& function, const t_block_id block, const t_block_id from) {
+    for (t_value_id id = function.block_list[block].first; id != NO_VALUE && function.at(id).op == opcode::PHI; id = function.at(id).next) {
+        const uint32_t* operand_list = function.operands(id);
+        std::vector<uint32_t> kept(operand_list, operand_list + function.at(id).operand_count);
+
+        for (size_t i = 0; i < kept.size(); i += 2) {
+            if (kept[i] == from) {
+                kept.erase(kept.begin() + static_cast<std::ptrdiff_t>(i), kept.begin() + static_cast<std::ptrdiff_t>(i) + 2);
+                break;
+            }
+        }
+
+        function.set_operands(id, kept);
+    }
+}
+
+// Turns the branch ending block into a jump to the target taken, dropping the edge not taken.
+static void fold_branch(ir_function& function, const t_block_id block, const bool is_taken) {
+    instruction& branch = function.at(function.block_list[block].last);
+
+    const t_block_id kept = branch.target[is_taken ? 0 : 1];
+    const t_block_id dropped = branch.target[is_taken ? 1 : 0];
+
+    // A branch to the same block either way counts the edge twice in its phis.
+    drop_phi_edge(function, dropped, block);
+
+    branch.op = opcode::JUMP;
+    branch.operand_count = 0;
+    branch.target[0] = kept;
+    branch.target[1] = NO_BLOCK;
+}
+
+bool core::backend::is_pure(const opcode op) {
+    switch (op) {
+        case opcode::CONSTANT:
+        case opcode::UNDEFINED:
+        case opcode::COPY:
+        case opcode::CONVERT:
+        case opcode::NEG:
+        case opcode::NOT:
+        case opcode::ADD:
+        case opcode::SUB:
+        case opcode::MUL:
+        case opcode::DIV:
+        case opcode::MOD:
+        case opcode::POW:
+        case opcode::EQ:
+        case opcode::NE:
+        case opcode::LT:
+        case opcode::LE:
+        case opcode::GT:
+        case opcode::GE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+
+====================================================
+
+Folding
+The same arithmetic the VM does on its registers.
+
+====================================================
+
+*/
+
+static inline double as_double(const uint64_t bits) {
+    double value;
+    std::memcpy(&value, &bits, sizeof(double));
+    return value;
+}
+
+static inline uint64_t double_bits(const double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(double));
+    return bits;
+}
+
+static inline double round_to(const ir_type type, const double value) {
+    return type == ir_type::F32 ? static_cast<double>(static_cast<float>(value)) : value;
+}
+
+// Extends from the width of type like integer registers are. bool arithmetic runs at 8 bits.
+uint64_t core::backend::wrap_to(const uint64_t value, const ir_type type) {
+    switch (type) {
+        case ir_type::I8: return static_cast<uint64_t>(static_cast<int64_t>(static_cast<int8_t>(value)));
+        case ir_type::I16: return static_cast<uint64_t>(static_cast<int64_t>(static_cast<int16_t>(value)));
+        case ir_type::I32: return static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(value)));
+        case ir_type::BOOL:
+        case ir_type::U8: return static_cast<uint8_t>(value);
+        case ir_type::U16: return static_cast<uint16_t>(value);
+        case ir_type::U32: return static_cast<uint32_t>(value);
+        default: return value;
+    }
+}
+
+static uint64_t convert(const uint64_t value, const ir_type from, const ir_type to) {
+    if (is_floating(from)) {
+        const double x = as_double(value);
+
+        if (is_floating(to))
+            return double_bits(round_to(to, x));
+
+        if (to == ir_type::BOOL)
+            return x != 0;
+
+        if (is_signed(to) && x >= -9223372036854775808.0 && x < 9223372036854775808.0)
+            return wrap_to(static_cast<uint64_t>(static_cast<int64_t>(x)), to);
+
+        if (!is_signed(to) && x >= 0 && x < 18446744073709551616.0)
+            return wrap_to(static_cast<uint64_t>(x), to);
+
+        return 0;
+    }
+
+    if (is_floating(to))
+        return double_bits(round_to(to, is_signed(from) ? static_cast<double>(static_cast<int64_t>(value)) : static_cast<double>(value)));
+
+    return to == ir_type::BOOL ? value != 0 : wrap_to(value, to);
+}
+
+static uint64_t integer_power(uint64_t base, uint64_t exponent) {
+    uint64_t result = 1;
+
+    while (exponent) {
+        if (exponent & 1)
+            result *= base;
+
+        base *= base;
+        exponent >>= 1;
+    }
+
+    return result;
+}
+
+// x holds the operands. False if the instruction can not be folded, or would trap.
+static bool fold(const opcode op, const ir_type type, const ir_type operand_type, const uint64_t* x, uint64_t& result) {
+    switch (op) {
+        case opcode::COPY:
+            result = x[0];
+            return true;
+        case opcode::CONVERT:
+            result = convert(x[0], operand_type, type);
+            return true;
+        case opcode::NOT:
+            result = x[0] == 0;
+            return true;
+        case opcode::NEG:
+            result = is_floating(type) ? double_bits(-as_double(x[0])) : wrap_to(0 - x[0], type);
+            return true;
+        case opcode::EQ:
+        case opcode::NE:
+        case opcode::LT:
+        case opcode::LE:
+        case opcode::GT:
+        case opcode::GE: {
+            int order; // -1, 0 or 1, 2 if unordered
+
+            if (is_floating(operand_type)) {
+                const double a = as_double(x[0]);
+                const double b = as_double(x[1]);
+                order = a < b ? -1 : a > b ? 1 : a == b ? 0 : 2;
+            }
+            else if (is_signed(operand_type))
+                order = static_cast<int64_t>(x[0]) < static_cast<int64_t>(x[1]) ? -1 : x[0] == x[1] ? 0 : 1;
+            else
+                order = x[0] < x[1] ? -1 : x[0] == x[1] ? 0 : 1;
+
+            switch (op) {
+                case opcode::EQ: result = order == 0; break;
+                case opcode::NE: result = order != 0; break;
+                case opcode::LT: result = order == -1; break;
+                case opcode::LE: result = order == -1 || order == 0; break;
+                case opcode::GT: result = order == 1; break;
+                default: result = order == 1 || order == 0; break;
+            }
+
+            return true;
+        }
+        case opcode::ADD:
+        case opcode::SUB:
+        case opcode::MUL:
+        case opcode::DIV:
+        case opcode::MOD:
+        case opcode::POW:
+            break;
+        default:
+            return false;
+    }
+
+    if (is_floating(type)) {
+        const double a = as_double(x[0]);
+        const double b = as_double(x[1]);
+        double value;
+
+        switch (op) {
+            case opcode::ADD: value = a + b; break;
+            case opcode::SUB: value = a - b; break;
+            case opcode::MUL: value = a * b; break;
+            case opcode::DIV: value = a / b; break;
+            case opcode::MOD: value = std::fmod(a, b); break;
+            default: value = std::pow(a, b); break;
+        }
+
+        result = double_bits(round_to(type, value));
+        return true;
+    }
+
+    const uint64_t a = x[0];
+    const uint64_t b = x[1];
+
+    switch (op) {
+        case opcode::ADD: result = a + b; break;
+        case opcode::SUB: result = a - b; break;
+        case opcode::MUL: result = a * b; break;
+        case opcode::DIV:
+        case opcode::MOD:
+            if (b == 0)
+                return false;
+
+            // INT64_MIN / -1 wraps, like in the VM.
+            if (is_signed(type) && b == UINT64_MAX)
+                result = op == opcode::DIV ? 0 - a : 0;
+            else if (is_signed(type))
+                result = static_cast<uint64_t>(op == opcode::DIV ? static_cast<int64_t>(a) / static_cast<int64_t>(b) : static_cast<int64_t>(a) % static_cast<int64_t>(b));
+            else
+                result = op == opcode::DIV ? a / b : a % b;
+            break;
+        default:
+            if (is_signed(type) && static_cast<int64_t>(b) < 0)
+                return false;
+
+            result = integer_power(a, b);
+            break;
+    }
+
+    result = wrap_to(result, type);
+    return true;
+}
+
+bool core::backend::has_effect(const ir_function& function, const instruction& at, const uint32_t* operand_list) {
+    switch (at.op) {
+        case opcode::STORE_GLOBAL:
+        case opcode::CALL:
+        case opcode::JUMP:
+        case opcode::BRANCH:
+        case opcode::RETURN:
+        case opcode::UNREACHABLE:
+            return true;
+        case opcode::DIV:
+        case opcode::MOD:
+        case opcode::POW: {
+            if (is_floating(at.type))
+                return false;
+
+            // Traps unless the right side is a constant that can not trap.
+            const instruction& right = function.at(operand_list[1]);
+
+            if (right.op != opcode::CONSTANT)
+                return at.op != opcode::POW || is_signed(at.type);
+
+            return at.op == opcode::POW ? is_signed(at.type) && static_cast<int64_t>(right.immediate) < 0 : right.immediate == 0;
+        }
+        default:
+            return false;
+    }
+}
+
+/*
+
+====================================================
+
+CFG simplification
+Folds branches on constants and to the same block both ways, removes unreachable blocks, merges a
+block into its only predecessor when that predecessor only jumps to it, and sends jumps into
+blocks that do nothing but jump on straight to where those go.
+
+====================================================
+
+*/
+
+// Merges the block after the jump ending into into into, as long as into is its only predecessor.
+static bool merge_block(ir_function& function, const t_block_id into, std::vector<t_value_id>& forward) {
+    const t_value_id jump = function.block_list[into].last;
+
+    if (jump == NO_VALUE || function.at(jump).op != opcode::JUMP)
+        return false;
+
+    const t_block_id merged = function.at(jump).target[0];
+
+    if (merged == into || merged == 0 || function.block_list[merged].predecessor_count != 1)
+        return false;
+
+    for (t_value_id id = function.block_list[merged].first; id != NO_VALUE && function.at(id).op == opcode::PHI; id = function.at(id).next) {
+        if (function.at(id).operand_count != 2)
+            return false;
+    }
+
+    function.remove(jump);
+
+    std::vector<t_value_id> moved_list;
+
+    for (t_value_id id = function.block_list[merged].first; id != NO_VALUE; id = function.at(id).next)
+        moved_list.push_back(id);
+
+    function.block_list[merged].first = NO_VALUE;
+    function.block_list[merged].last = NO_VALUE;
+    function.block_list[merged].is_removed = true;
+
+    ir_block& target = function.block_list[into];
+
+    for (const t_value_id id : moved_list) {
+        instruction& at = function.at(id);
+
+        // Its only predecessor is into, so a phi is its one value.
+        if (at.op == opcode::PHI) {
+            forward.resize(function.instruction_list.size(), NO_VALUE);
+            forward[id] = function.operands(id)[1];
+
+            at.op = opcode::NOP;
+            at.operand_count = 0;
+            at.prev = NO_VALUE;
+            at.next = NO_VALUE;
+            continue;
+        }
+
+        at.block = into;
+        at.prev = target.last;
+        at.next = NO_VALUE;
+
+        if (target.last != NO_VALUE)
+            function.at(target.last).next = id;
+        else
+            target.first = id;
+
+        target.last = id;
+    }
+
+    // Successors now come from into.
+    for (uint32_t i = 0; i < function.successor_count(into); i++) {
+        const t_block_id successor = function.successor(into, i);
+
+        for (t_value_id id = function.block_list[successor].first; id != NO_VALUE && function.at(id).op == opcode::PHI; id = function.at(id).next) {
+            uint32_t* operand_list = function.operands(id);
+
+            for (uint32_t p = 0; p < function.at(id).operand_count; p += 2) {
+                if (operand_list[p] == merged)
+                    operand_list[p] = into;
+            }
+        }
+
+        const ir_block& block = function.block_list[successor];
+
+        for (uint32_t p = 0; p < block.predecessor_count; p++) {
+            t_block_id& predecessor = function.predecessor_pool[block.predecessor_begin + p];
+
+            if (predecessor == merged)
+                predecessor = into;
+        }
+    }
+
+    return true;
+}
+
+// Points predecessors of a block that only jumps straight to the block after it. Returns the edges moved.
+static uint32_t thread_jumps(ir_function& function, const t_block_id empty) {
+    const ir_block& block = function.block_list[empty];
+
+    if (empty == 0 || block.is_removed || block.first != block.last || function.at(block.last).op != opcode::JUMP)
+        return 0;
+
+    const t_block_id target = function.at(block.last).target[0];
+
+    if (target == empty)
+        return 0;
+
+    const bool has_target_phis = has_phis(function, target);
+    uint32_t moved = 0;
+
+    std::vector<t_block_id> predecessor_list(function.predecessors(empty), function.predecessors(empty) + block.predecessor_count);
+    std::sort(predecessor_list.begin(), predecessor_list.end());
+    predecessor_list.erase(std::unique(predecessor_list.begin(), predecessor_list.end()), predecessor_list.end());
+
+    for (const t_block_id predecessor : predecessor_list) {
+        // Two edges from one block into phis would have to agree on the value. Not worth finding out.
+        if (has_target_phis) {
+            const t_block_id* begin = function.predecessors(target);
+
+            if (std::find(begin, begin + function.block_list[target].predecessor_count, predecessor) != begin + function.block_list[target].predecessor_count)
+                continue;
+        }
+
+        instruction& terminator = function.at(function.block_list[predecessor].last);
+
+        for (uint32_t i = 0; i < function.successor_count(predecessor); i++) {
+            if (terminator.target[i] != empty)
+                continue;
+
+            terminator.target[i] = target;
+            moved++;
+
+            for (t_value_id id = function.block_list[target].first; id != NO_VALUE && function.at(id).op == opcode::PHI; id = function.at(id).next) {
+                const uint32_t* operand_list = function.operands(id);
+                std::vector<uint32_t> extended(operand_list, operand_list + function.at(id).operand_count);
+
+                for (size_t p = 0; p < extended.size(); p += 2) {
+                    if (extended[p] == empty) {
+                        const uint32_t value = extended[p + 1];
+                        extended.push_back(predecessor);
+                        extended.push_back(value);
+                        break;
+                    }
+                }
+
+                function.set_operands(id, extended);
+            }
+        }
+    }
+
+    return moved;
+}
+
+uint32_t core::backend::simplify_cfg(ir_function& function) {
+    uint32_t change_count = 0;
+    std::vector<t_value_id> forward;
+
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (t_block_id block = 0; block < function.block_list.size(); block++) {
+            const t_value_id last = function.block_list[block].last;
+
+            if (function.block_list[block].is_removed || last == NO_VALUE || function.at(last).op != opcode::BRANCH)
+                continue;
+
+            const instruction& branch = function.at(last);
+            const instruction& condition = function.at(function.operands(last)[0]);
+
+            if (condition.op == opcode::CONSTANT || branch.target[0] == branch.target[1]) {
+                fold_branch(function, block, condition.op == opcode::CONSTANT ? condition.immediate != 0 : true);
+                changed = true;
+                change_count++;
+            }
+        }
+
+        if (changed)
+            function.compute_predecessors();
+
+        if (function.remove_unreachable_blocks()) {
+            changed = true;
+            change_count++;
+        }
+
+        for (t_block_id block = 0; block < function.block_list.size(); block++) {
+            if (function.block_list[block].is_removed)
+                continue;
+
+            while (merge_block(function, block, forward)) {
+                changed = true;
+                change_count++;
+            }
+        }
+
+        for (t_block_id block = 0; block < function.block_list.size(); block++) {
+            if (const uint32_t moved = thread_jumps(function, block)) {
+                function.compute_predecessors();
+                changed = true;
+                change_count += moved;
+            }
+        }
+
+        if (function.remove_unreachable_blocks())
+            change_count++;
+    }
+
+    if (!forward.empty())
+        apply_forwards(function, forward);
+
+    return change_count;
+}
+
+/*
+
+====================================================
+
+Copy propagation
+Uses of a copy, of a conversion to the type it already has and of a phi that only ever sees one
+value besides itself are pointed at the value itself.
+
+====================================================
+
+*/
+
+uint32_t core::backend::propagate_copies(ir_function& function) {
+    std::vector<t_value_id> forward(function.instruction_list.size(), NO_VALUE);
+    uint32_t change_count = 0;
+
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (t_block_id block = 0; block < function.block_list.size(); block++) {
+            for (t_value_id id = function.block_list[block].first; id != NO_VALUE;) {
+                const t_value_id next = function.at(id).next;
+                const instruction& at = function.at(id);
+                const uint32_t* operand_list = function.operands(id);
+
+                t_value_id same = NO_VALUE;
+
+                if (at.op == opcode::COPY || (at.op == opcode::CONVERT && function.at(operand_list[0]).type == at.type))
+                    same = resolve(forward, operand_list[0]);
+                else if (at.op == opcode::PHI && at.operand_count > 0) {
+                    for (uint32_t i = 1; i < at.operand_count; i += 2) {
+                        const t_value_id value = resolve(forward, operand_list[i]);
+
+                        if (value == same || value == id)
+                            continue;
+
+                        if (same != NO_VALUE) {
+                            same = NO_VALUE;
+                            break;
+                        }
+
+                        same = value;
+                    }
+                }
+
+                if (same != NO_VALUE && same != id) {
+                    forward[id] = same;
+                    function.remove(id);
+                    changed = true;
+                    change_count++;
+                }
+
+                id = next;
+            }
+        }
+    }
+
+    if (change_count > 0)
+        apply_forwards(function, forward);
+
+    return change_count;
+}
+
+/*
+
+====================================================
+
+Sparse conditional constant propagation
+Values start out unknown (top) and only ever move down to a constant and then to varying (bottom).
+Only blocks reached through edges that can run are looked at, so a constant branch keeps the side
+it never takes from spoiling the phis after it. Afterwards constants replace what they were computed
+from, and branches on them become jumps.
+
+====================================================
+
+*/
+
+namespace {
+    enum class lattice : uint8_t {
+        TOP,
+        CONSTANT,
+        BOTTOM,
+    };
+
+    struct sccp_state {
+        explicit sccp_state(ir_function& function) : function(function) {}
+
+        ir_function& function;
+
+        std::vector<lattice> state_list;
+        std::vector<uint64_t> bits_list;
+
+        std::vector<uint8_t> executable_list; // Per block
+        std::vector<uint8_t> edge_list; // Per block and successor, two each
+
+        // Users of every value.
+        std::vector<uint32_t> user_begin_list;
+        std::vector<t_value_id> user_pool;
+
+        std::vector<t_value_id> value_work;
+        std::vector<t_block_id> block_work; // Newly reached, every instruction is looked at
+        std::vector<t_block_id> phi_work; // Reached through another edge, only phis are looked at again
+
+        void collect_users() {
+            const size_t count = function.instruction_list.size();
+            user_begin_list.assign(count + 1, 0);
+
+            for (const ir_block& block : function.block_list) {
+                for (t_value_id id = block.first; id != NO_VALUE; id = function.at(id).next) {
+                    const instruction& at = function.at(id);
+
+                    for (uint32_t i = value_begin(at); i < at.operand_count; i += value_step(at))
+                        user_begin_list[function.operands(id)[i] + 1]++;
+                }
+            }
+
+            for (size_t i = 1; i <= count; i++)
+                user_begin_list[i] += user_begin_list[i - 1];
+
+            user_pool.assign(user_begin_list[count], NO_VALUE);
+            std::vector<uint32_t> fill_list(user_begin_list.begin(), user_begin_list.end() - 1);
+
+            for (const ir_block& block : function.block_list) {
+                for (t_value_id id = block.first; id != NO_VALUE; id = function.at(id).next) {
+                    const instruction& at = function.at(id);
+
+                    for (uint32_t i = value_begin(at); i < at.operand_count; i += value_step(at))
+                        user_pool[fill_list[function.operands(id)[i]]++] = id;
+                }
+            }
+        }
+
+        void lower(const t_value_id id, const lattice state, const uint64_t bits) {
+            lattice& current = state_list[id];
+
+            if (current == lattice::BOTTOM || state == lattice::TOP)
+                return;
+
+            if (current == lattice::CONSTANT && state == lattice::CONSTANT && bits_list[id] == bits)
+                return;
+
+            current = current == lattice::CONSTANT ? lattice::BOTTOM : state;
+            bits_list[id] = bits;
+            value_work.push_back(id);
+        }
+
+        void mark_edge(const t_block_id from, const uint32_t i) {
+            uint8_t& edge = edge_list[from * 2 + i];
+
+            if (edge)
+                return;
+
+            edge = 1;
+
+            const t_block_id to = function.successor(from, i);
+
+            if (!executable_list[to]) {
+                executable_list[to] = 1;
+                block_work.push_back(to);
+            }
+            else
+                phi_work.push_back(to);
+        }
+
+        bool is_edge_executable(const t_block_id from, const t_block_id to) const {
+            for (uint32_t i = 0; i < function.successor_count(from); i++) {
+                if (function.successor(from, i) == to && edge_list[from * 2 + i])
+                    return true;
+            }
+
+            return false;
+        }
+
+        void visit(const t_value_id id) {
+            const instruction& at = function.at(id);
+            const uint32_t* operand_list = function.operands(id);
+
+            switch (at.op) {
+                case opcode::NOP:
+                case opcode::STORE_GLOBAL:
+                case opcode::RETURN:
+                case opcode::UNREACHABLE:
+                    return;
+                case opcode::JUMP:
+                    mark_edge(at.block, 0);
+                    return;
+                case opcode::BRANCH: {
+                    const t_value_id condition = operand_list[0];
+
+                    if (state_list[condition] == lattice::BOTTOM) {
+                        mark_edge(at.block, 0);
+                        mark_edge(at.block, 1);
+                    }
+                    else if (state_list[condition] == lattice::CONSTANT)
+                        mark_edge(at.block, bits_list[condition] != 0 ? 0 : 1);
+                    return;
+                }
+                case opcode::CONSTANT:
+                    lower(id, lattice::CONSTANT, at.immediate);
+                    return;
+                case opcode::UNDEFINED:
+                    // Registers and stack slots of undefined values start out as 0 in every backend.
+                    lower(id, lattice::CONSTANT, 0);
+                    return;
+                case opcode::PHI: {
+                    lattice state = lattice::TOP;
+                    uint64_t bits = 0;
+
+                    for (uint32_t i = 0; i < at.operand_count && state != lattice::BOTTOM; i += 2) {
+                        const t_value_id value = operand_list[i + 1];
+
+                        if (!is_edge_executable(operand_list[i], at.block) || state_list[value] == lattice::TOP)
+                            continue;
+
+                        if (state_list[value] == lattice::BOTTOM || (state == lattice::CONSTANT && bits != bits_list[value]))
+                            state = lattice::BOTTOM;
+                        else {
+                            state = lattice::CONSTANT;
+                            bits = bits_list[value];
+                        }
+                    }
+
+                    lower(id, state, bits);
+                    return;
+                }
+                default:
+                    break;
+            }
+
+            if (!is_pure(at.op) || at.operand_count > 2) {
+                lower(id, lattice::BOTTOM, 0);
+                return;
+            }
+
+            uint64_t x[2] = { 0, 0 };
+
+            for (uint32_t i = 0; i < at.operand_count; i++) {
+                if (state_list[operand_list[i]] != lattice::CONSTANT) {
+                    if (state_list[operand_list[i]] == lattice::BOTTOM)
+                        lower(id, lattice::BOTTOM, 0);
+                    return;
+                }
+
+                x[i] = bits_list[operand_list[i]];
+            }
+
+            uint64_t result;
+
+            if (fold(at.op, at.type, function.at(operand_list[0]).type, x, result))
+                lower(id, lattice::CONSTANT, result);
+            else
+                lower(id, lattice::BOTTOM, 0);
+        }
+
+        void solve() {
+            const size_t count = function.instruction_list.size();
+
+            state_list.assign(count, lattice::TOP);
+            bits_list.assign(count, 0);
+            executable_list.assign(function.block_list.size(), 0);
+            edge_list.assign(function.block_list.size() * 2, 0);
+
+            collect_users();
+
+            executable_list[0] = 1;
+            block_work.push_back(0);
+
+            while (!block_work.empty() || !phi_work.empty() || !value_work.empty()) {
+                if (!block_work.empty()) {
+                    const t_block_id block = block_work.back();
+                    block_work.pop_back();
+
+                    for (t_value_id id = function.block_list[block].first; id != NO_VALUE; id = function.at(id).next)
+                        visit(id);
+                    continue;
+                }
+
+                if (!phi_work.empty()) {
+                    const t_block_id block = phi_work.back();
+                    phi_work.pop_back();
+
+                    for (t_value_id id = function.block_list[block].first; id != NO_VALUE && function.at(id).op == opcode::PHI; id = function.at(id).next)
+                        visit(id);
+                    continue;
+                }
+
+                const t_value_id value = value_work.back();
+                value_work.pop_back();
+
+                for (uint32_t i = user_begin_list[value]; i < user_begin_list[value + 1]; i++) {
+                    const t_value_id user = user_pool[i];
+
+                    if (executable_list[function.at(user).block])
+                        visit(user);
+                }
+            }
+        }
+
+        uint32_t rewrite() {
+            // A branch on a value still unknown means a block was reached without its inputs. Trust nothing then.
+            for (t_block_id block = 0; block < function.block_list.size(); block++) {
+                const t_value_id last = function.block_list[block].last;
+
+                if (executable_list[block] && last != NO_VALUE && function.at(last).op == opcode::BRANCH && state_list[function.operands(last)[0]] == lattice::TOP)
+                    return 0;
+            }
+
+            std::vector<t_value_id> forward(function.instruction_list.size(), NO_VALUE);
+            uint32_t change_count = 0;
+
+            for (t_block_id block = 0; block < function.block_list.size(); block++) {
+                if (!executable_list[block])
+                    continue;
+
+                for (t_value_id id = function.block_list[block].first; id != NO_VALUE;) {
+                    const t_value_id next = function.at(id).next;
+                    instruction& at = function.at(id);
+
+                    if (at.type == ir_type::VOID || at.op == opcode::CONSTANT || state_list[id] != lattice::CONSTANT) {
+                        id = next;
+                        continue;
+                    }
+
+                    if (at.op == opcode::PHI) {
+                        const ir_type type = at.type;
+                        const t_value_id constant = function.insert_before(first_body(function, block), opcode::CONSTANT, type, {}, bits_list[id]);
+
+                        forward.resize(function.instruction_list.size(), NO_VALUE);
+                        forward[id] = constant;
+                        function.remove(id);
+                    }
+                    else {
+                        at.op = opcode::CONSTANT;
+                        at.operand_count = 0;
+                        at.immediate = bits_list[id];
+                        at.symbol = nullptr;
+                    }
+
+                    change_count++;
+                    id = next;
+                }
+
+                const t_value_id last = function.block_list[block].last;
+
+                if (function.at(last).op == opcode::BRANCH && state_list[function.operands(last)[0]] == lattice::CONSTANT) {
+                    fold_branch(function, block, bits_list[function.operands(last)[0]] != 0);
+                    change_count++;
+                }
+            }
+
+            apply_forwards(function, forward);
+
+            function.compute_predecessors();
+
+            if (function.remove_unreachable_blocks())
+                change_count++;
+
+            return change_count;
+        }
+    };
+}
+
+uint32_t core::backend::propagate_constants(ir_function& function) {
+    sccp_state state(function);
+
+    state.solve();
+    return state.rewrite();
+}
+
+/*
+
+====================================================
+
+Global value numbering
+Walks the dominator tree keeping a table of every pure computation seen on the way down. One that
+is already in the table, same operation on the same operands, is replaced by the one that dominates
+it. Integer additions, multiplications and equality compare operands in either order.
+
+====================================================
+
+*/
+
+static inline bool is_commutative(const opcode op, const ir_type type) {
+    switch (op) {
+        case opcode::EQ:
+        case opcode::NE:
+            return true;
+        case opcode::ADD:
+        case opcode::MUL:
+            return is_integer(type);
+        default:
+            return false;
+    }
+}
+
+template <typename T>
+static inline void append_key(std::string& key, const T value) {
+    key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+uint32_t core::backend::number_values(ir_function& function) {
+    const dominator_tree tree(function);
+
+    std::vector<t_value_id> forward(function.instruction_list.size(), NO_VALUE);
+    std::unordered_map<std::string, t_value_id> table;
+    std::vector<std::string> scope_list; // Keys added, popped when the walk leaves the block
+    uint32_t change_count = 0;
+
+    // Each entry remembers the next child to visit and how many keys its block added.
+    struct walk_entry {
+        t_block_id block;
+        uint32_t next;
+        size_t scope_size;
+    };
+
+    std::vector<walk_entry> walk;
+    std::string key;
+
+    auto enter = [&](const t_block_id block) {
+        walk.push_back({ block, 0, scope_list.size() });
+
+        for (t_value_id id = function.block_list[block].first; id != NO_VALUE;) {
+            const t_value_id next = function.at(id).next;
+            const instruction& at = function.at(id);
+            uint32_t* operand_list = function.operands(id);
+
+            for (uint32_t i = value_begin(at); i < at.operand_count; i += value_step(at))
+                operand_list[i] = resolve(forward, operand_list[i]);
+
+            if (!is_pure(at.op) && at.op != opcode::PHI) {
+                id = next;
+                continue;
+            }
+
+            key.clear();
+            append_key(key, at.op);
+            append_key(key, at.type);
+            append_key(key, at.immediate);
+
+            // Phis of different blocks merge different edges.
+            if (at.op == opcode::PHI)
+                append_key(key, block);
+
+            if (is_commutative(at.op, function.at(at.operand_count > 0 ? operand_list[0] : id).type) && at.operand_count == 2) {
+                append_key(key, std::min(operand_list[0], operand_list[1]));
+                append_key(key, std::max(operand_list[0], operand_list[1]));
+            }
+            else {
+                for (uint32_t i = 0; i < at.operand_count; i++)
+                    append_key(key, operand_list[i]);
+            }
+
+            auto [found, is_new] = table.emplace(key, id);
+
+            if (is_new)
+                scope_list.push_back(key);
+            else {
+                forward[id] = found->second;
+                function.remove(id);
+                change_count++;
+            }
+
+            id = next;
+        }
+    };
+
+    enter(0);
+
+    while (!walk.empty()) {
+        walk_entry& top = walk.back();
+
+        if (top.next < tree.child_count(top.block)) {
+            enter(tree.children(top.block)[top.next++]);
+            continue;
+        }
+
+        while (scope_list.size() > top.scope_size) {
+            table.erase(scope_list.back());
+            scope_list.pop_back();
+        }
+
+        walk.pop_back();
+    }
+
+    // Phis read values along back edges, which may have been numbered after them.
+    if (change_count > 0)
+        apply_forwards(function, forward);
+
+    return change_count;
+}
+
+/*
+
+====================================================
+
+Dead code elimination
+Everything with an effect is live, and so is everything a live instruction uses. The rest goes,
+dead phi cycles included.
+
+====================================================
+
+*/
+
+uint32_t core::backend::eliminate_dead_code(ir_function& function) {
+    std::vector<uint8_t> live_list(function.instruction_list.size(), 0);
+    std::vector<t_value_id> work;
+
+    for (const ir_block& block : function.block_list) {
+        for (t_value_id id = block.first; id != NO_VALUE; id = function.at(id).next) {
+            if (has_effect(function, function.at(id), function.operands(id))) {
+                live_list[id] = 1;
+                work.push_back(id);
+            }
+        }
+    }
+
+    while (!work.empty()) {
+        const t_value_id id = work.back();
+        work.pop_back();
+
+        const instruction& at = function.at(id);
+        const uint32_t* operand_list = function.operands(id);
+
+        for (uint32_t i = value_begin(at); i < at.operand_count; i += value_step(at)) {
+            if (!live_list[operand_list[i]]) {
+                live_list[operand_list[i]] = 1;
+                work.push_back(operand_list[i]);
+            }
+        }
+    }
+
+    uint32_t change_count = 0;
+
+    for (const ir_block& block : function.block_list) {
+        for (t_value_id id = block.first; id != NO_VALUE;) {
+            const t_value_id next = function.at(id).next;
+
+            if (!live_list[id]) {
+                function.remove(id);
+                change_count++;
+            }
+
+            id = next;
+        }
+    }
+
+    return change_count;
+}
+
+/*
+
+====================================================
+
+Pass manager
+
+====================================================
+
+*/
+
+constexpr uint32_t PASS_SIMPLIFY_CFG = 0;
+constexpr uint32_t PASS_COPY_PROPAGATION = 1;
+constexpr uint32_t PASS_SCCP = 2;
+constexpr uint32_t PASS_GVN = 3;
+constexpr uint32_t PASS_DCE = 4;
+constexpr uint32_t PASS_LICM = 5;
+constexpr uint32_t PASS_INDUCTION_VARIABLES = 6;
+
+// Statistics of the inliner come after those of the passes, since it works on the call graph rather
+// than one function and is not part of the pipeline.
+constexpr uint32_t PASS_INLINE = 7;
+
+// -O2 stops repeating the pipeline after this many rounds, even if the last one still changed something.
+constexpr uint32_t MAX_ROUND_COUNT = 4;
+
+const std::vector<ir_pass>& pass_manager::pass_list() {
+    static const std::vector<ir_pass> list = {
+        { "simplify-cfg", simplify_cfg },
+        { "copy-propagation", propagate_copies },
+        { "sccp", propagate_constants },
+        { "gvn", number_values },
+        { "dce", eliminate_dead_code },
+        { "licm", hoist_invariants },
+        { "induction-variables", reduce_induction_variables },
+    };
+
+    return list;
+}
+
+pass_manager::pass_manager(const uint8_t level) {
+    if (level == 0)
+        return;
+
+    if (level == 1) {
+        pipeline = { PASS_SIMPLIFY_CFG, PASS_COPY_PROPAGATION, PASS_SCCP, PASS_LICM, PASS_DCE, PASS_SIMPLIFY_CFG, PASS_COPY_PROPAGATION };
+        return;
+    }
+
+    pipeline = { PASS_SIMPLIFY_CFG, PASS_COPY_PROPAGATION, PASS_SCCP, PASS_GVN, PASS_LICM, PASS_INDUCTION_VARIABLES, PASS_DCE, PASS_SIMPLIFY_CFG, PASS_COPY_PROPAGATION };
+    round_limit = MAX_ROUND_COUNT;
+}
+
+void pass_manager::run(ir_function& function, std::vector<pass_statistics>& statistics) const {
+    const std::vector<ir_pass>& list = pass_list();
+    bool is_changed = false;
+
+    for (uint32_t round = 0; round < round_limit; round++) {
+        uint32_t round_change_count = 0;
+
+        for (const uint32_t pass : pipeline) {
+            const auto start = std::chrono::steady_clock::now();
+            const uint32_t change_count = list[pass].run(function);
+            const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+            statistics[pass].nanoseconds += static_cast<uint64_t>(elapsed.count());
+            statistics[pass].change_count += change_count;
+            statistics[pass].run_count++;
+
+            round_change_count += change_count;
+        }
+
+        if (round_change_count == 0)
+            break;
+
+        is_changed = true;
+    }
+
+    if (is_changed)
+        function.compact();
+}
+
+static std::vector<pass_statistics> empty_statistics() {
+    std::vector<pass_statistics> statistics;
+
+    for (const ir_pass& pass : pass_manager::pass_list())
+        statistics.push_back({ pass.name });
+
+    statistics.push_back({ "inline" });
+    return statistics;
+}
+
+// Inlines and runs the pipeline over every lowered function, bottom up over the call graph. The
+// functions of one level are independent, so they are optimized in parallel, each with statistics of
+// its own that are added up afterwards.
+bool core::backend::optimize(liprocess& process, const t_file_id /*entry*/) {
+    const pass_manager manager(process.config.optimization_level);
+
+    std::vector<ir_function*> function_list;
+
+    for (liprocess::lifile& file : process.file_list) {
+        if (!file.dump_ir_module.has_value())
+            continue;
+
+        for (ir_function& function : std::any_cast<const t_ir_module_ptr&>(file.dump_ir_module)->function_list) {
+            if (function.complete)
+                function_list.push_back(&function);
+        }
+    }
+
+    std::vector<std::vector<pass_statistics>> statistics_list(function_list.size());
+
+    if (!manager.pipeline.empty()) {
+        const call_graph graph(function_list);
+
+        // A level only starts once everything it calls is finished.
+        for (const std::vector<uint32_t>& level : graph.level_list) {
+            process.pool.parallel_for(level.size(), [&](const size_t i) {
+                const uint32_t index = level[i];
+                std::vector<pass_statistics>& statistics = statistics_list[index];
+
+                statistics = empty_statistics();
+
+                const auto start = std::chrono::steady_clock::now();
+                const uint32_t inline_count = inline_calls(graph, index, process.config.optimization_level, manager, statistics);
+                const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+                statistics[PASS_INLINE].nanoseconds += static_cast<uint64_t>(elapsed.count());
+                statistics[PASS_INLINE].change_count += inline_count;
+                statistics[PASS_INLINE].run_count++;
+
+                if (inline_count > 0)
+                    function_list[index]->compact();
+
+                manager.run(*function_list[index], statistics);
+            });
+        }
+    }
+
+    t_pass_statistics_ptr total = std::make_shared<std::vector<pass_statistics>>(empty_statistics());
+
+    for (const std::vector<pass_statistics>& statistics : statistics_list) {
+        for (size_t i = 0; i < statistics.size(); i++) {
+            (*total)[i].nanoseconds += statistics[i].nanoseconds;
+            (*total)[i].change_count += statistics[i].change_count;
+            (*total)[i].run_count += statistics[i].run_count;
+        }
+    }
+
+    process.dump_pass_statistics = total;
+
+    return true;
+}
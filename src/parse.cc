@@ -77,6 +77,10 @@ constexpr auto R_FUNC_DELIMITER_TOKEN = core::token_type::RPAREN;
 constexpr auto L_TEMPLATE_DELIMITER_TOKEN = core::token_type::LSQUARE;
 constexpr auto R_TEMPLATE_DELIMITER_TOKEN = core::token_type::RSQUARE;
 
+// Closure parameters. '||' is a closure without any.
+constexpr auto CLOSURE_DELIMITER_TOKEN = core::token_type::PIPE;
+constexpr auto EMPTY_CLOSURE_TOKEN = core::token_type::DOUBLE_PIPE;
+
 // Like C-style braces.
 constexpr auto L_BODY_DELIMITER_TOKEN = core::token_type::LBRACE;
 constexpr auto R_BODY_DELIMITER_TOKEN = core::token_type::RBRACE;
@@ -364,7 +368,7 @@ static t_node_id parse_expr_type(parse_state& state) {
 static t_node_id parse_expr_parameter(parse_state& state) {
     const core::token& start_token = state.now();
    
-    const t_node_id name = state.arena.insert(expr_identifier(state.expect(core::token_type::IDENTIFIER, "Expected an identifier.").selection));
+    const t_node_id name = state.arena.insert(expr_identifier(state.expect(core::token_type::IDENTIFIER, "Expected an identifier.")));
     const t_node_id value_type = parse_optional_type(state);
    
     t_node_id default_value;
@@ -383,7 +387,7 @@ template <bool IS_OPTIONAL>
 static t_node_id parse_expr_identifier(parse_state& state) {
     if constexpr (IS_OPTIONAL)
         if (state.now().type == core::token_type::IDENTIFIER)
-            return state.arena.insert(expr_identifier(state.consume().selection));
+            return state.arena.insert(expr_identifier(state.consume()));
         else
             return state.arena.insert(expr_none(state.now().selection));
     
@@ -392,7 +396,7 @@ static t_node_id parse_expr_identifier(parse_state& state) {
     if (token.type != core::token_type::IDENTIFIER)
         return state.arena.insert(expr_invalid(token.selection));    
     
-    return state.arena.insert(expr_identifier(token.selection));
+    return state.arena.insert(expr_identifier(token));
 }
 
 static t_node_id parse_expr_int_literal(parse_state& state) {
@@ -411,6 +415,26 @@ static t_node_id parse_expr_function(parse_state& state) {
     return state.arena.insert(expr_function(core::lisel(start_token.selection, state.now().selection), std::move(template_parameter_list), std::move(parameter_list), body, return_type));
 }
 
+// |x: i64, y: i64|: i64 { ... }
+static t_node_id parse_expr_closure(parse_state& state) {
+    const core::token& start_token = state.now();
+
+    t_node_list parameter_list;
+
+    if (start_token.type == EMPTY_CLOSURE_TOKEN)
+        state.pos++;
+    else
+        parameter_list = parse_list<false, true>(state, parse_expr_parameter, CLOSURE_DELIMITER_TOKEN, CLOSURE_DELIMITER_TOKEN);
+
+    const t_node_id return_type = parse_optional_type(state);
+    const t_node_id body = parse_statement(state);
+
+    const core::lisel selection(start_token.selection, state.now().selection);
+    const t_node_id function = state.arena.insert(expr_function(selection, {}, std::move(parameter_list), body, return_type));
+
+    return state.arena.insert(expr_closure(selection, function));
+}
+
 #define CASE_LITERAL(type) \
     case core::token_type::type: \
         return state.arena.insert(expr_literal(state.consume().selection, expr_literal::e_literal_type::type));
@@ -418,7 +442,7 @@ static t_node_id parse_expr_function(parse_state& state) {
 static t_node_id parse_primary_expression(parse_state& state) {
     switch (state.now().type) {
         case core::token_type::IDENTIFIER:
-            return state.arena.insert(expr_identifier(state.consume().selection));
+            return state.arena.insert(expr_identifier(state.consume()));
     
         CASE_LITERAL(INT)
         CASE_LITERAL(FLOAT)
@@ -432,6 +456,9 @@ static t_node_id parse_primary_expression(parse_state& state) {
             
         case core::token_type::DEC:
             return parse_variant_declaration(state, true);
+        case CLOSURE_DELIMITER_TOKEN:
+        case EMPTY_CLOSURE_TOKEN:
+            return parse_expr_closure(state);
         case L_EXPR_DELIMITER_TOKEN: {
             state.pos++;
             t_node_id expr = parse_expression(state);
@@ -462,7 +489,7 @@ static t_node_id parse_expr_call(parse_state& state) {
 
     // Allow 'ctor' to be called. This should only be done in the context of constructor delegation.
     if (state.now().type == core::token_type::CTOR)
-        expression = state.arena.insert(expr_identifier(state.consume().selection));
+        expression = state.arena.insert(expr_identifier(state.consume()));
     else {
         expression = parse_member_access(state);
         const node_type expr_type = state.arena.get_base_ptr(expression)->type;
@@ -613,7 +640,7 @@ static t_node_id parse_item_module(parse_state& state) {
     const core::token& start_token = state.consume();
     const core::token& value_token = state.expect(core::token_type::IDENTIFIER, "Expected an identifier.");
 
-    const t_node_id name_node = state.arena.insert(expr_identifier(value_token.selection));
+    const t_node_id name_node = state.arena.insert(expr_identifier(value_token));
     const t_node_id content = parse_item(state);
    
     return state.arena.insert(item_module(core::lisel(start_token.selection, state.arena.get_base_ptr(content)->selection), name_node, content));
@@ -635,7 +662,7 @@ static t_node_id parse_variant_declaration(parse_state& state, const bool local_
                 break;
             }
             value = state.arena.insert(expr_invalid(state.now().selection));
-            state.log_and_pause_errors(core::lilog::log_level::ERROR, state.consume().selection, "Functions can not be declared in function bodies. Declare a closure instead.");
+            state.log_and_pause_errors(core::lilog::log_level::ERROR, state.consume().selection, "Functions can not be declared in function bodies. Declare a closure instead, like 'dec f = |x: i64|: i64 { ... }'.");
             value = state.arena.insert(expr_invalid(state.now().selection));
             break;
         case ASSIGNMENT_TOKEN:
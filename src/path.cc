@@ -0,0 +1,67 @@
+#include "path.hh"
+#include "symbol.hh"
+
+core::semantic::t_path_id core::semantic::path_trie::root(symbol* start) {
+    {
+        std::shared_lock lock(mutex);
+
+        auto it = root_map.find(start);
+        if (it != root_map.end())
+            return it->second;
+    }
+
+    std::unique_lock lock(mutex);
+
+    // Another thread may have beaten us to it between the locks.
+    auto it = root_map.find(start);
+    if (it != root_map.end())
+        return it->second;
+
+    const t_path_id id = static_cast<t_path_id>(node_list.size());
+    node_list.push_back({ start, nullptr, path_node::e_failure::NONE });
+    root_map.emplace(start, id);
+
+    return id;
+}
+
+core::semantic::t_path_id core::semantic::path_trie::child(const t_path_id parent, const t_name_id name) {
+    const uint64_t lookup_key = (static_cast<uint64_t>(parent) << 32) | name;
+
+    {
+        std::shared_lock lock(mutex);
+
+        auto it = child_map.find(lookup_key);
+        if (it != child_map.end())
+            return it->second;
+    }
+
+    std::unique_lock lock(mutex);
+
+    auto it = child_map.find(lookup_key);
+    if (it != child_map.end())
+        return it->second;
+
+    symbol* owner = node_list[parent].target;
+    path_node created = { nullptr, owner, path_node::e_failure::NONE };
+
+    if (!owner->inner)
+        created.failure = path_node::e_failure::NO_MEMBERS;
+    else if (!(created.target = symbol_table::lookup_in(owner->inner, name)))
+        created.failure = path_node::e_failure::NOT_A_MEMBER;
+
+    const t_path_id id = static_cast<t_path_id>(node_list.size());
+    node_list.push_back(created);
+    child_map.emplace(lookup_key, id);
+
+    return id;
+}
+
+const core::semantic::path_node& core::semantic::path_trie::get(const t_path_id id) const {
+    std::shared_lock lock(mutex);
+    return node_list[id];
+}
+
+size_t core::semantic::path_trie::size() const {
+    std::shared_lock lock(mutex);
+    return node_list.size();
+}
@@ -0,0 +1,71 @@
+#include <algorithm>
+
+#include "pool.hh"
+
+liutil::worker_pool::worker_pool(size_t thread_count) {
+    if (thread_count == 0)
+        thread_count = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+    // The caller is the last worker.
+    for (size_t i = 1; i < thread_count; i++)
+        thread_list.emplace_back(&worker_pool::worker_loop, this);
+}
+
+liutil::worker_pool::~worker_pool() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+
+    wake.notify_all();
+
+    for (std::thread& thread : thread_list)
+        thread.join();
+}
+
+void liutil::worker_pool::run(const std::function<void()>& job) {
+    {
+        std::lock_guard lock(mutex);
+
+        current_job = &job;
+        active_count = thread_list.size();
+        generation++;
+    }
+
+    wake.notify_all();
+
+    job();
+
+    std::unique_lock lock(mutex);
+    done.wait(lock, [this]() { return active_count == 0; });
+
+    current_job = nullptr;
+}
+
+void liutil::worker_pool::worker_loop() {
+    size_t seen_generation = 0;
+
+    while (true) {
+        const std::function<void()>* job;
+
+        {
+            std::unique_lock lock(mutex);
+            wake.wait(lock, [&]() { return stopping || generation != seen_generation; });
+
+            if (stopping)
+                return;
+
+            seen_generation = generation;
+            job = current_job;
+        }
+
+        (*job)();
+
+        {
+            std::lock_guard lock(mutex);
+            active_count--;
+        }
+
+        done.notify_one();
+    }
+}
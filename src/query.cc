@@ -0,0 +1,162 @@
+#include "query.hh"
+
+const char* core::semantic::query_kind_name(const query_kind kind) {
+    switch (kind) {
+        case query_kind::FILE_SOURCE: return "FILE_SOURCE";
+        case query_kind::DECLARATION_TYPE: return "DECLARATION_TYPE";
+        case query_kind::CONSTANT_VALUE: return "CONSTANT_VALUE";
+        case query_kind::MEMBER_TYPES: return "MEMBER_TYPES";
+        case query_kind::IDENTIFIER_TARGET: return "IDENTIFIER_TARGET";
+        default: return "UNKNOWN";
+    }
+}
+
+void core::semantic::query_engine::begin_analysis() {
+    analysis++;
+
+    computed.clear();
+    reused = 0;
+}
+
+void core::semantic::query_engine::provide(const query_kind kind, t_provider provider) {
+    provider_list[static_cast<size_t>(kind)] = std::move(provider);
+}
+
+bool core::semantic::query_engine::set_input(const query_key& key, std::any value, const uint64_t fingerprint) {
+    auto [it, inserted] = slot_map.try_emplace(key);
+    slot& at = it->second;
+
+    at.key = key;
+    at.is_input = true;
+
+    if (!inserted && at.fingerprint == fingerprint)
+        return false;
+
+    // A brand new input can not invalidate anything yet, so it does not need a revision of its own.
+    if (!inserted)
+        current_revision++;
+
+    at.value = std::move(value);
+    at.fingerprint = fingerprint;
+    at.changed_at = current_revision;
+    at.verified_at = current_revision;
+
+    return !inserted;
+}
+
+const std::any* core::semantic::query_engine::input(const query_key& key) {
+    auto it = slot_map.find(key);
+    if (it == slot_map.end())
+        return nullptr;
+
+    record(key);
+    return &it->second.value;
+}
+
+const std::any* core::semantic::query_engine::get(const query_key& key) {
+    record(key);
+
+    auto [it, inserted] = slot_map.try_emplace(key);
+    slot& at = it->second;
+
+    if (at.active)
+        return nullptr;
+
+    if (inserted) {
+        at.key = key;
+        execute(at);
+    }
+    else
+        refresh(at);
+
+    if (at.asked_in != analysis && at.computed_in != analysis)
+        reused++;
+
+    at.asked_in = analysis;
+
+    return &at.value;
+}
+
+uint64_t core::semantic::query_engine::subject(const std::string& name) {
+    auto [it, inserted] = subject_map.try_emplace(name, subject_name_list.size());
+
+    if (inserted)
+        subject_name_list.push_back(&it->first);
+
+    return it->second;
+}
+
+const std::string& core::semantic::query_engine::subject_name(const uint64_t subject) const {
+    return *subject_name_list[subject];
+}
+
+bool core::semantic::query_engine::should_replay(const query_key& key) {
+    auto it = slot_map.find(key);
+    if (it == slot_map.end() || it->second.computed_in == analysis || it->second.replayed_in == analysis)
+        return false;
+
+    it->second.replayed_in = analysis;
+    return true;
+}
+
+void core::semantic::query_engine::record(const query_key& key) {
+    if (!frame_list.empty())
+        frame_list.back()->push_back(key);
+}
+
+core::semantic::t_revision core::semantic::query_engine::refresh(slot& at) {
+    if (at.is_input || at.verified_at == current_revision)
+        return at.changed_at;
+
+    // Part of a cycle that is being checked or recomputed. Whoever asked will recompute as well.
+    if (at.active)
+        return current_revision;
+
+    bool stale = false;
+
+    at.active = true;
+
+    for (const query_key& dependency : at.dependency_list) {
+        auto it = slot_map.find(dependency);
+
+        // Dependencies are recorded before they exist, so one may have failed to come into being.
+        if (it == slot_map.end() || refresh(it->second) > at.verified_at) {
+            stale = true;
+            break;
+        }
+    }
+
+    at.active = false;
+
+    if (stale)
+        execute(at);
+    else
+        at.verified_at = current_revision;
+
+    return at.changed_at;
+}
+
+void core::semantic::query_engine::execute(slot& at) {
+    std::vector<query_key> dependency_list;
+    uint64_t fingerprint = 0;
+
+    at.active = true;
+    frame_list.push_back(&dependency_list);
+
+    std::any value = provider_list[static_cast<size_t>(at.key.kind)](*this, at.key.subject, fingerprint);
+
+    frame_list.pop_back();
+    at.active = false;
+
+    computed.push_back(at.key);
+    at.computed_in = analysis;
+
+    // Same fingerprint as before: dependents stay valid.
+    if (!at.value.has_value() || at.fingerprint != fingerprint)
+        at.changed_at = current_revision;
+
+    at.value = std::move(value);
+    at.fingerprint = fingerprint;
+    at.verified_at = current_revision;
+    at.dependency_list = std::move(dependency_list);
+}
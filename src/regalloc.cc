@@ -0,0 +1,727 @@
+#include <algorithm>
+#include <cmath>
+
+#include "regalloc.hh"
+#include "loop.hh"
+
+using namespace core::backend;
+
+constexpr uint32_t NO_POSITION = UINT32_MAX;
+
+/*
+
+====================================================
+
+Linear scan
+
+====================================================
+
+*/
+
+const allocation_piece* register_allocation::piece_at(const uint32_t value, const uint32_t position) const {
+    const allocation_piece* begin = piece_list.data() + piece_begin_list[value];
+    const allocation_piece* end = piece_list.data() + piece_begin_list[value + 1];
+
+    // The last piece that starts at or before position.
+    const allocation_piece* after = std::upper_bound(begin, end, position, [](const uint32_t at, const allocation_piece& piece) { return at < piece.start; });
+
+    if (after == begin || (after - 1)->end < position)
+        return nullptr;
+
+    return after - 1;
+}
+
+namespace {
+    struct scan_interval {
+        live_interval interval;
+        uint8_t reg;
+        bool is_reload; // Starts at a use, after waiting in the slot
+    };
+
+    struct linear_scan {
+        linear_scan(const interval_set& intervals, const register_target& target)
+            : call_list(intervals.call_list), target(target) {}
+
+        const std::vector<uint32_t>& call_list;
+        const register_target& target;
+
+        std::vector<scan_interval> work; // Grows as intervals are split
+        std::vector<uint32_t> unhandled; // Heap, earliest start on top
+        std::vector<uint32_t> active; // Holding a register right now
+
+        // Earliest start first, and the order they came in between equal starts, so allocation is
+        // the same on every run.
+        inline bool is_later(const uint32_t a, const uint32_t b) const {
+            const uint32_t left = work[a].interval.start;
+            const uint32_t right = work[b].interval.start;
+
+            return left != right ? left > right : a > b;
+        }
+
+        void enqueue(const uint32_t index) {
+            unhandled.push_back(index);
+            std::push_heap(unhandled.begin(), unhandled.end(), [this](const uint32_t a, const uint32_t b) { return is_later(a, b); });
+        }
+
+        uint32_t dequeue() {
+            std::pop_heap(unhandled.begin(), unhandled.end(), [this](const uint32_t a, const uint32_t b) { return is_later(a, b); });
+
+            const uint32_t index = unhandled.back();
+            unhandled.pop_back();
+
+            return index;
+        }
+
+        float weight(const uint32_t index) const {
+            const live_interval& at = work[index].interval;
+            float sum = 0;
+
+            for (const live_use& use : at.use_list)
+                sum += use.weight;
+
+            return sum / static_cast<float>(at.end - at.start + 1);
+        }
+
+        // How long reg can be held from position on: caller saved ones up to and including the next call.
+        uint32_t limit(const uint8_t reg, const uint32_t position) const {
+            if (!target.is_caller_saved(reg))
+                return NO_POSITION;
+
+            const auto call = std::lower_bound(call_list.begin(), call_list.end(), position);
+            return call == call_list.end() ? NO_POSITION : *call;
+        }
+
+        // From position on the interval waits in its slot, until a use after position, where the rest
+        // becomes an interval of its own to allocate. A use at position itself reads the slot.
+        void evict(const uint32_t index, const uint32_t position) {
+            live_interval& at = work[index].interval;
+
+            const uint32_t value = at.value;
+            const register_bank bank = at.bank;
+            const uint32_t end = at.end;
+
+            std::vector<live_use> use_list = std::move(at.use_list);
+
+            const auto next = std::upper_bound(use_list.begin(), use_list.end(), position, [](const uint32_t p, const live_use& use) { return p < use.position; });
+            const auto first = std::lower_bound(use_list.begin(), use_list.end(), position, [](const live_use& use, const uint32_t p) { return use.position < p; });
+
+            const uint32_t waiting_end = next == use_list.end() ? end : next->position - 1;
+
+            std::vector<live_use> waiting_list(first, next);
+            std::vector<live_use> reload_list(next, use_list.end());
+
+            if (position <= at.start) {
+                at.end = waiting_end;
+                at.use_list = std::move(waiting_list);
+                work[index].reg = NO_REGISTER;
+            }
+            else {
+                at.end = position - 1;
+                at.use_list.assign(use_list.begin(), first);
+                work.push_back({ { value, bank, position, waiting_end, std::move(waiting_list) }, NO_REGISTER, false });
+            }
+
+            if (next != use_list.end()) {
+                const uint32_t start = next->position;
+                work.push_back({ { value, bank, start, end, std::move(reload_list) }, NO_REGISTER, true });
+                enqueue(static_cast<uint32_t>(work.size() - 1));
+            }
+        }
+
+        // Gives the interval reg for as long as it can have it.
+        void assign(const uint32_t index, const uint8_t reg) {
+            const uint32_t until = limit(reg, work[index].interval.start);
+
+            work[index].reg = reg;
+            active.push_back(index);
+
+            if (work[index].interval.end > until)
+                evict(index, until + 1);
+        }
+
+        // The free register that stays free the longest.
+        bool allocate_free(const uint32_t index) {
+            const live_interval& at = work[index].interval;
+
+            uint64_t busy_mask = 0;
+
+            for (const uint32_t held : active)
+                busy_mask |= uint64_t(1) << work[held].reg;
+
+            uint8_t best = NO_REGISTER;
+            uint32_t best_until = 0;
+
+            for (const uint8_t reg : target.register_list[static_cast<uint8_t>(at.bank)]) {
+                if ((busy_mask >> reg) & 1)
+                    continue;
+
+                const uint32_t until = limit(reg, at.start);
+
+                if (until > at.start && (best == NO_REGISTER || until > best_until)) {
+                    best = reg;
+                    best_until = until;
+                }
+            }
+
+            if (best == NO_REGISTER)
+                return false;
+
+            assign(index, best);
+            return true;
+        }
+
+        // Takes the register of the active interval that weighs least, if that weighs less than this one.
+        // Otherwise this one waits in its slot.
+        void allocate_blocked(const uint32_t index) {
+            const live_interval& at = work[index].interval;
+            const float current = weight(index);
+
+            uint32_t victim = NO_POSITION;
+            float victim_weight = current;
+
+            for (const uint32_t held : active) {
+                if (work[held].interval.bank != at.bank || limit(work[held].reg, at.start) <= at.start)
+                    continue;
+
+                const float held_weight = weight(held);
+
+                if (held_weight < victim_weight) {
+                    victim = held;
+                    victim_weight = held_weight;
+                }
+            }
+
+            const uint32_t position = at.start;
+
+            if (victim == NO_POSITION) {
+                evict(index, position);
+                return;
+            }
+
+            const uint8_t reg = work[victim].reg;
+
+            active.erase(std::find(active.begin(), active.end(), victim));
+            evict(victim, position);
+
+            assign(index, reg);
+        }
+
+        void run() {
+            while (!unhandled.empty()) {
+                const uint32_t index = dequeue();
+                const uint32_t position = work[index].interval.start;
+
+                active.erase(std::remove_if(active.begin(), active.end(), [&](const uint32_t held) { return work[held].interval.end < position; }), active.end());
+
+                if (!allocate_free(index))
+                    allocate_blocked(index);
+            }
+        }
+    };
+}
+
+register_allocation core::backend::allocate_registers(const interval_set& intervals, const uint32_t value_count, const register_target& target) {
+    linear_scan scan(intervals, target);
+
+    for (const live_interval& interval : intervals.interval_list) {
+        scan.work.push_back({ interval, NO_REGISTER, false });
+        scan.enqueue(static_cast<uint32_t>(scan.work.size() - 1));
+    }
+
+    scan.run();
+
+    register_allocation result;
+
+    for (const scan_interval& at : scan.work) {
+        const allocation_piece piece = { at.interval.value, at.interval.start, at.interval.end, at.reg };
+        result.piece_list.push_back(piece);
+
+        if (at.reg != NO_REGISTER) {
+            result.used_mask |= uint64_t(1) << at.reg;
+
+            if (at.is_reload)
+                result.reload_list.push_back(piece);
+        }
+    }
+
+    std::sort(result.piece_list.begin(), result.piece_list.end(), [](const allocation_piece& a, const allocation_piece& b) {
+        return a.value != b.value ? a.value < b.value : a.start < b.start;
+    });
+
+    std::sort(result.reload_list.begin(), result.reload_list.end(), [](const allocation_piece& a, const allocation_piece& b) {
+        return a.start != b.start ? a.start < b.start : a.value < b.value;
+    });
+
+    result.piece_begin_list.assign(value_count + 1, 0);
+    result.slot_list.assign(value_count, NO_SLOT);
+
+    for (const allocation_piece& piece : result.piece_list) {
+        result.piece_begin_list[piece.value + 1]++;
+
+        if (piece.reg == NO_REGISTER && result.slot_list[piece.value] == NO_SLOT)
+            result.slot_list[piece.value] = 0;
+    }
+
+    for (uint32_t value = 0; value < value_count; value++) {
+        result.piece_begin_list[value + 1] += result.piece_begin_list[value];
+
+        if (result.slot_list[value] != NO_SLOT)
+            result.slot_list[value] = result.slot_count++;
+
+        if (result.piece_begin_list[value + 1] - result.piece_begin_list[value] > 1)
+            result.split_list.push_back(value);
+    }
+
+    return result;
+}
+
+/*
+
+====================================================
+
+Intervals of the IR
+
+====================================================
+
+*/
+
+ir_numbering::ir_numbering(const ir_function& function) {
+    const dominator_tree tree(function);
+
+    block_order = tree.reverse_postorder;
+    position_list.assign(function.instruction_list.size(), NO_POSITION);
+    block_start_list.assign(function.block_list.size(), NO_POSITION);
+    block_end_list.assign(function.block_list.size(), NO_POSITION);
+
+    // The entry block starts with the parameters. Nothing jumps back to it, so a reload at its
+    // start is never left to an edge.
+    const t_block_id entry = block_order[0];
+    block_start_list[entry] = 0;
+
+    uint32_t position = 0;
+
+    for (t_value_id id = function.block_list[entry].first; id != NO_VALUE; id = function.at(id).next) {
+        if (function.at(id).op == opcode::PARAMETER) {
+            position_list[id] = position;
+            position += 2;
+        }
+    }
+
+    for (const t_block_id block : block_order) {
+        if (block != entry)
+            block_start_list[block] = position;
+
+        for (t_value_id id = function.block_list[block].first; id != NO_VALUE; id = function.at(id).next) {
+            if (function.at(id).op == opcode::PARAMETER)
+                continue;
+
+            position_list[id] = position;
+            position += 2;
+        }
+
+        block_end_list[block] = position_list[function.block_list[block].last];
+    }
+}
+
+static inline bool has_result(const instruction& at) {
+    return at.type != ir_type::VOID && at.op != opcode::NOP;
+}
+
+static inline bool is_folded(const t_folded_list& folded_list, const t_value_id id) {
+    return !folded_list.empty() && folded_list[id];
+}
+
+// Calls read with every value the instruction reads, which takes the operands of what is folded into it.
+template <typename F>
+static void for_each_read(const ir_function& function, const t_folded_list& folded_list, const t_value_id id, F&& read) {
+    const uint32_t* operand_list = function.operands(id);
+
+    for (uint32_t i = 0; i < function.at(id).operand_count; i++) {
+        if (is_folded(folded_list, operand_list[i]))
+            for_each_read(function, folded_list, operand_list[i], read);
+        else
+            read(operand_list[i]);
+    }
+}
+
+interval_set core::backend::build_intervals(const ir_function& function, const ir_numbering& numbering, const t_call_predicate is_call, const t_folded_list& folded_list) {
+    const dominator_tree tree(function);
+    const loop_forest forest(function, tree);
+
+    interval_set result;
+    std::vector<uint32_t> interval_of(function.instruction_list.size(), NO_POSITION);
+
+    for (const t_block_id block : numbering.block_order) {
+        for (t_value_id id = function.block_list[block].first; id != NO_VALUE; id = function.at(id).next) {
+            if (!has_result(function.at(id)) || is_folded(folded_list, id))
+                continue;
+
+            const uint32_t definition = numbering.definition(function, id);
+
+            interval_of[id] = static_cast<uint32_t>(result.interval_list.size());
+            result.interval_list.push_back({ id, bank_of(function.at(id).type), definition, definition, {} });
+        }
+    }
+
+    // What a use is worth grows tenfold with every loop around it.
+    const auto frequency = [&](const t_block_id block) {
+        return std::pow(10.0f, static_cast<float>(std::min<uint32_t>(forest.depth(block), 6)));
+    };
+
+    const auto use = [&](const t_value_id value, const uint32_t position, const float weight) {
+        live_interval& interval = result.interval_list[interval_of[value]];
+
+        interval.end = std::max(interval.end, position);
+        interval.use_list.push_back({ position, weight });
+    };
+
+    // Edges going back in the order, each with the range it spans.
+    std::vector<std::pair<uint32_t, uint32_t>> loop_list;
+
+    for (const t_block_id block : numbering.block_order) {
+        const float weight = frequency(block);
+
+        for (t_value_id id = function.block_list[block].first; id != NO_VALUE; id = function.at(id).next) {
+            const instruction& at = function.at(id);
+            const uint32_t* operand_list = function.operands(id);
+            const uint32_t position = numbering.position_list[id];
+
+            if (at.op == opcode::PHI) {
+                for (uint32_t i = 0; i < at.operand_count; i += 2) {
+                    if (numbering.block_end_list[operand_list[i]] != NO_POSITION)
+                        use(operand_list[i + 1], numbering.block_end_list[operand_list[i]], frequency(operand_list[i]));
+                }
+
+                continue;
+            }
+
+            if (is_folded(folded_list, id))
+                continue;
+
+            for_each_read(function, folded_list, id, [&](const t_value_id value) { use(value, position, weight); });
+
+            if (is_call(function, id))
+                result.call_list.push_back(position);
+        }
+
+        for (uint32_t i = 0; i < function.successor_count(block); i++) {
+            const t_block_id to = function.successor(block, i);
+
+            if (numbering.block_start_list[to] <= numbering.block_start_list[block])
+                loop_list.emplace_back(numbering.block_start_list[to], numbering.block_end_list[block]);
+        }
+    }
+
+    std::sort(loop_list.begin(), loop_list.end());
+
+    for (live_interval& interval : result.interval_list) {
+        std::sort(interval.use_list.begin(), interval.use_list.end(), [](const live_use& a, const live_use& b) { return a.position < b.position; });
+
+        // Defined before a loop and alive anywhere in it: the back edge can take it around again, so
+        // it lives to the end of the loop. Loops it reaches that way reach further still.
+        auto loop = std::upper_bound(loop_list.begin(), loop_list.end(), std::make_pair(interval.start, NO_POSITION));
+
+        for (; loop != loop_list.end() && loop->first <= interval.end; ++loop)
+            interval.end = std::max(interval.end, loop->second);
+    }
+
+    return result;
+}
+
+/*
+
+====================================================
+
+Moves
+
+====================================================
+
+*/
+
+std::vector<edge_move> core::backend::edge_moves(const ir_function& function, const ir_numbering& numbering, const register_allocation& allocation, const t_block_id from, const t_block_id to) {
+    const uint32_t out = numbering.block_end_list[from];
+    const uint32_t in = numbering.block_start_list[to];
+
+    std::vector<edge_move> move_list;
+
+    for (t_value_id phi = function.block_list[to].first; phi != NO_VALUE && function.at(phi).op == opcode::PHI; phi = function.at(phi).next) {
+        const uint32_t* operand_list = function.operands(phi);
+
+        for (uint32_t i = 0; i < function.at(phi).operand_count; i += 2) {
+            if (operand_list[i] != from)
+                continue;
+
+            const t_value_id source = operand_list[i + 1];
+            const uint8_t from_reg = allocation.location(source, out);
+            const uint8_t to_reg = allocation.location(phi, in);
+
+            // A phi that comes around unchanged only moves if it changed places, and its slot
+            // already holds it.
+            if (source == phi) {
+                if (from_reg != to_reg && to_reg != NO_REGISTER)
+                    move_list.push_back({ source, from_reg, phi, to_reg });
+
+                break;
+            }
+
+            move_list.push_back({ source, from_reg, phi, to_reg });
+
+            // Phis are defined here, so they are stored here too.
+            if (to_reg != NO_REGISTER && allocation.slot_list[phi] != NO_SLOT)
+                move_list.push_back({ source, from_reg, phi, NO_REGISTER });
+
+            break;
+        }
+    }
+
+    // Whatever is live across the edge and changes places. A value is stored when it is defined if
+    // it ever waits in its slot, so only the ones going into a register have to move.
+    for (const uint32_t value : allocation.split_list) {
+        if (function.at(value).op == opcode::PHI && function.at(value).block == to)
+            continue;
+
+        const allocation_piece* before = allocation.piece_at(value, out);
+        const allocation_piece* after = allocation.piece_at(value, in);
+
+        if (before && after && after->reg != NO_REGISTER && before->reg != after->reg)
+            move_list.push_back({ value, before->reg, value, after->reg });
+    }
+
+    return move_list;
+}
+
+/*
+
+====================================================
+
+Verification
+
+====================================================
+
+*/
+
+namespace {
+    struct machine_state {
+        bool is_set = false;
+        std::vector<uint32_t> register_list; // The value each register holds, NO_VALUE if none is known
+        std::vector<uint8_t> slot_list; // Per value, whether its slot has been written on every path here
+    };
+
+    struct allocation_verifier {
+        allocation_verifier(const ir_function& function, const ir_numbering& numbering, const register_allocation& allocation, const register_target& target, const t_call_predicate is_call, const t_folded_list& folded_list)
+            : function(function), numbering(numbering), allocation(allocation), target(target), is_call(is_call), folded_list(folded_list) {}
+
+        const ir_function& function;
+        const ir_numbering& numbering;
+        const register_allocation& allocation;
+        const register_target& target;
+        const t_call_predicate is_call;
+        const t_folded_list& folded_list;
+
+        std::string failure;
+
+        inline void fail(const std::string& message) {
+            if (failure.empty())
+                failure = message;
+        }
+
+        static std::string name(const uint32_t value) { return "v" + std::to_string(value); }
+        static std::string place(const uint8_t reg) { return reg == NO_REGISTER ? "its slot" : "register " + std::to_string(reg); }
+
+        void read(machine_state& state, const uint32_t value, const uint8_t reg, const uint32_t position, const bool is_checked) {
+            if (!is_checked)
+                return;
+
+            const bool is_there = reg == NO_REGISTER ? allocation.slot_list[value] != NO_SLOT && state.slot_list[value] : state.register_list[reg] == value;
+
+            if (!is_there)
+                fail(name(value) + " is read from " + place(reg) + " at " + std::to_string(position) + ", which does not hold it on every path there.");
+        }
+
+        void run_block(const t_block_id block, machine_state& state, const bool is_checked) {
+            const uint32_t block_start = numbering.block_start_list[block];
+
+            for (t_value_id id = function.block_list[block].first; id != NO_VALUE; id = function.at(id).next) {
+                const instruction& at = function.at(id);
+
+                if (at.op == opcode::PHI || is_folded(folded_list, id))
+                    continue;
+
+                const uint32_t position = numbering.position_list[id];
+
+                if (position != block_start) {
+                    const auto [first, last] = std::equal_range(allocation.reload_list.begin(), allocation.reload_list.end(), allocation_piece{ 0, position, 0, 0 },
+                        [](const allocation_piece& a, const allocation_piece& b) { return a.start < b.start; });
+
+                    for (auto reload = first; reload != last; ++reload) {
+                        read(state, reload->value, NO_REGISTER, position, is_checked);
+                        state.register_list[reload->reg] = reload->value;
+                    }
+                }
+
+                for_each_read(function, folded_list, id, [&](const t_value_id value) {
+                    const allocation_piece* piece = allocation.piece_at(value, position);
+
+                    if (!piece) {
+                        if (is_checked)
+                            fail(name(value) + " is read at " + std::to_string(position) + ", where it has no location.");
+                        return;
+                    }
+
+                    read(state, value, piece->reg, position, is_checked);
+                });
+
+                if (is_call(function, id)) {
+                    for (uint8_t reg = 0; reg < 64; reg++) {
+                        if (target.is_caller_saved(reg))
+                            state.register_list[reg] = NO_VALUE;
+                    }
+                }
+
+                if (!has_result(at))
+                    continue;
+
+                const allocation_piece* piece = allocation.piece_at(id, position + 1);
+
+                if (!piece) {
+                    if (is_checked)
+                        fail(name(id) + " has no location where it is defined.");
+                    continue;
+                }
+
+                if (piece->reg != NO_REGISTER)
+                    state.register_list[piece->reg] = id;
+
+                if (allocation.slot_list[id] != NO_SLOT)
+                    state.slot_list[id] = 1;
+            }
+        }
+
+        void run_edge(const t_block_id from, const t_block_id to, machine_state& state, const bool is_checked) {
+            const std::vector<edge_move> move_list = edge_moves(function, numbering, allocation, from, to);
+
+            for (const edge_move& move : move_list)
+                read(state, move.value, move.from, numbering.block_end_list[from], is_checked);
+
+            for (const edge_move& move : move_list) {
+                if (move.to == NO_REGISTER)
+                    state.slot_list[move.destination] = 1;
+                else
+                    state.register_list[move.to] = move.destination;
+            }
+        }
+
+        // Keeps what both agree on. True if into changed.
+        static bool merge(machine_state& into, const machine_state& from) {
+            if (!into.is_set) {
+                into = from;
+                return true;
+            }
+
+            bool is_changed = false;
+
+            for (size_t i = 0; i < into.register_list.size(); i++) {
+                if (into.register_list[i] != NO_VALUE && into.register_list[i] != from.register_list[i]) {
+                    into.register_list[i] = NO_VALUE;
+                    is_changed = true;
+                }
+            }
+
+            for (size_t i = 0; i < into.slot_list.size(); i++) {
+                if (into.slot_list[i] && !from.slot_list[i]) {
+                    into.slot_list[i] = 0;
+                    is_changed = true;
+                }
+            }
+
+            return is_changed;
+        }
+
+        void check_pieces() {
+            std::vector<allocation_piece> held_list;
+
+            for (const allocation_piece& piece : allocation.piece_list) {
+                if (piece.reg != NO_REGISTER)
+                    held_list.push_back(piece);
+            }
+
+            std::sort(held_list.begin(), held_list.end(), [](const allocation_piece& a, const allocation_piece& b) {
+                return a.reg != b.reg ? a.reg < b.reg : a.start < b.start;
+            });
+
+            for (size_t i = 1; i < held_list.size(); i++) {
+                if (held_list[i].reg == held_list[i - 1].reg && held_list[i].start <= held_list[i - 1].end)
+                    fail(name(held_list[i - 1].value) + " and " + name(held_list[i].value) + " share register " + std::to_string(held_list[i].reg) + " at " + std::to_string(held_list[i].start) + ".");
+            }
+
+            std::vector<uint32_t> call_list;
+
+            for (const t_block_id block : numbering.block_order) {
+                for (t_value_id id = function.block_list[block].first; id != NO_VALUE; id = function.at(id).next) {
+                    if (is_call(function, id))
+                        call_list.push_back(numbering.position_list[id]);
+                }
+            }
+
+            for (const allocation_piece& piece : held_list) {
+                if (!target.is_caller_saved(piece.reg))
+                    continue;
+
+                const auto call = std::lower_bound(call_list.begin(), call_list.end(), piece.start);
+
+                if (call != call_list.end() && *call < piece.end)
+                    fail(name(piece.value) + " is kept in caller saved register " + std::to_string(piece.reg) + " across the call at " + std::to_string(*call) + ".");
+            }
+        }
+
+        void run() {
+            check_pieces();
+
+            const size_t value_count = function.instruction_list.size();
+            std::vector<machine_state> in_list(function.block_list.size());
+
+            const t_block_id entry = numbering.block_order[0];
+
+            in_list[entry].is_set = true;
+            in_list[entry].register_list.assign(64, NO_VALUE);
+            in_list[entry].slot_list.assign(value_count, 0);
+
+            for (bool is_changed = true; is_changed;) {
+                is_changed = false;
+
+                for (const t_block_id block : numbering.block_order) {
+                    if (!in_list[block].is_set)
+                        continue;
+
+                    machine_state state = in_list[block];
+                    run_block(block, state, false);
+
+                    for (uint32_t i = 0; i < function.successor_count(block); i++) {
+                        const t_block_id to = function.successor(block, i);
+                        machine_state edge = state;
+
+                        run_edge(block, to, edge, false);
+                        is_changed = merge(in_list[to], edge) || is_changed;
+                    }
+                }
+            }
+
+            for (const t_block_id block : numbering.block_order) {
+                machine_state state = in_list[block];
+                run_block(block, state, true);
+
+                for (uint32_t i = 0; i < function.successor_count(block); i++) {
+                    machine_state edge = state;
+                    run_edge(block, function.successor(block, i), edge, true);
+                }
+            }
+        }
+    };
+}
+
+std::string core::backend::verify_allocation(const ir_function& function, const ir_numbering& numbering, const register_allocation& allocation, const register_target& target, const t_call_predicate is_call, const t_folded_list& folded_list) {
+    allocation_verifier verifier(function, numbering, allocation, target, is_call, folded_list);
+    verifier.run();
+
+    return verifier.failure;
+}
@@ -0,0 +1,148 @@
+/*
+
+====================================================
+
+Module loading for 'use' items.
+
+use "constants" looks next to the file that wrote it first, then in the project root.
+Loaded modules are either lexed and parsed like any other file or, if a fresh precompiled interface
+exists in the output path, mapped in without ever touching the frontend. With -w the module also
+needs fresh IR next to its interface (link.hh).
+
+====================================================
+
+*/
+
+#include <filesystem>
+
+#include "core.hh"
+#include "ast.hh"
+#include "interface.hh"
+#include "link.hh"
+
+using namespace core::ast;
+
+constexpr const char* SOURCE_EXTENSION = ".lican";
+
+// path, selection of the use item
+using t_use_list = std::vector<std::pair<std::string, core::lisel>>;
+
+static void collect_ast_uses(const core::liprocess& process, const ast_arena& ast, const t_node_id id, t_use_list& use_list) {
+    const node* base = ast.get_base_ptr(id);
+
+    switch (base->type) {
+        case node_type::ITEM_USE: {
+            const std::string path = process.sub_source_code(ast.get_base_ptr(ast.get_as<item_use>(id).path)->selection);
+
+            if (path.size() >= 2)
+                use_list.emplace_back(path.substr(1, path.size() - 2), base->selection);
+
+            break;
+        }
+        case node_type::ITEM_MODULE:
+            collect_ast_uses(process, ast, ast.get_as<item_module>(id).content, use_list);
+            break;
+        case node_type::ITEM_BODY:
+            for (const t_node_id item : ast.get_as<item_body>(id).item_list)
+                collect_ast_uses(process, ast, item, use_list);
+            break;
+        default:
+            break;
+    }
+}
+
+static t_use_list collect_uses(const core::liprocess& process, const core::t_file_id file_id) {
+    const core::liprocess::lifile& file = process.file_list[file_id];
+    t_use_list use_list;
+
+    if (file.dump_ast_arena.has_value()) {
+        const ast_arena& ast = std::any_cast<const ast_arena&>(file.dump_ast_arena);
+
+        for (const t_node_id item : ast.get_as<ast_root>(0).item_list)
+            collect_ast_uses(process, ast, item, use_list);
+    }
+    else if (file.dump_interface.has_value()) {
+        const auto& iface = std::any_cast<const std::shared_ptr<core::frontend::module_interface>&>(file.dump_interface);
+
+        for (uint32_t i = 0; i < iface->header().decl_count; i++) {
+            const core::frontend::lii::decl_entry& decl = iface->decl(i);
+
+            if (decl.kind == core::frontend::lii::decl_kind::USE)
+                use_list.emplace_back(std::string(iface->text(decl.text_offset, decl.text_length)), core::lisel(file_id, 0));
+        }
+    }
+
+    return use_list;
+}
+
+// Returns an empty string if the module could not be found.
+static std::string find_module_path(const core::liprocess& process, const core::t_file_id file_id, const std::string& use_path) {
+    const std::filesystem::path relative = use_path + SOURCE_EXTENSION;
+
+    const std::filesystem::path beside = std::filesystem::path(process.file_list[file_id].path).parent_path() / relative;
+    if (std::filesystem::is_regular_file(beside))
+        return beside.lexically_normal().generic_string();
+
+    const std::filesystem::path from_root = std::filesystem::path(process.file_list[0].path).parent_path() / relative;
+    if (std::filesystem::is_regular_file(from_root))
+        return from_root.lexically_normal().generic_string();
+
+    return "";
+}
+
+// Plain builds can not link against an object a whole program build dropped functions from, and whole
+// program builds need the IR of every module they do not parse.
+static bool is_usable(const core::liprocess& process, const core::t_file_id file_id, const core::frontend::module_interface& iface) {
+    if (!process.config._whole_program)
+        return !(iface.header().flags & core::frontend::INTERFACE_WHOLE_PROGRAM_ONLY);
+
+    return core::backend::has_link_ir(process, file_id);
+}
+
+// Lex and parse, unless a precompiled interface can stand in for the file.
+static bool load_module(core::liprocess& process, const core::t_file_id file_id) {
+    core::liprocess::lifile& file = process.file_list[file_id];
+
+    if (!process.config._ignore_interfaces) {
+        auto iface = core::frontend::module_interface::open(process, core::frontend::interface_path(process, file_id));
+
+        if (iface && iface->matches_source(file.source_code) && is_usable(process, file_id, *iface)) {
+            file.dump_interface = std::move(iface);
+            return true;
+        }
+    }
+
+    return core::frontend::lex(process, file_id) && core::frontend::parse(process, file_id);
+}
+
+bool core::frontend::resolve_uses(liprocess& process, const t_file_id file_id) {
+    bool success = true;
+
+    for (const auto& [use_path, selection] : collect_uses(process, file_id)) {
+        const std::string path = find_module_path(process, file_id, use_path);
+
+        if (path.empty()) {
+            process.add_log(lilog::log_level::ERROR, selection, "Could not find a module named \"" + use_path + "\".");
+            success = false;
+            continue;
+        }
+
+        const t_file_id existing_id = process.find_file(path);
+
+        if (existing_id >= 0) {
+            process.file_list[file_id].use_list.push_back(existing_id);
+            continue;
+        }
+
+        if (!process.add_file(path))
+            return false;
+
+        const t_file_id used_id = static_cast<t_file_id>(process.file_list.size() - 1);
+        process.file_list[file_id].use_list.push_back(used_id);
+
+        if (!load_module(process, used_id) || !resolve_uses(process, used_id))
+            success = false;
+    }
+
+    return success;
+}
@@ -0,0 +1,361 @@
+#include <algorithm>
+#include <iterator>
+
+#include "select.hh"
+
+using namespace core::backend;
+using namespace core::backend::x64;
+
+/*
+
+====================================================
+
+Rules
+
+====================================================
+
+*/
+
+namespace {
+    constexpr goal REG = goal::REG;
+    constexpr goal IMM = goal::IMM;
+    constexpr goal SCALE = goal::SCALE;
+    constexpr goal INDEX = goal::INDEX;
+    constexpr goal BASE_INDEX = goal::BASE_INDEX;
+    constexpr goal ADDRESS = goal::ADDRESS;
+    constexpr goal CONDITION = goal::CONDITION;
+    constexpr goal NONE = goal::COUNT;
+
+    constexpr operand_class ANY = operand_class::ANY;
+    constexpr operand_class INTEGER = operand_class::INTEGER;
+    constexpr operand_class FLOAT = operand_class::FLOAT;
+
+    // What emitting an instruction the plain way costs: load the operands, compute, store.
+    constexpr uint16_t PLAIN_COST = 3;
+
+    constexpr selection_rule RULE_LIST[] = {
+        { IMM, opcode::CONSTANT, NONE, NONE, INTEGER, constant_test::SIMM32, 0, selection_action::LEAF },
+        { SCALE, opcode::CONSTANT, NONE, NONE, INTEGER, constant_test::SCALE, 0, selection_action::LEAF },
+
+        { INDEX, opcode::MUL, REG, SCALE, INTEGER, constant_test::NONE, 0, selection_action::FOLD },
+        { INDEX, opcode::MUL, SCALE, REG, INTEGER, constant_test::NONE, 0, selection_action::FOLD },
+
+        { BASE_INDEX, opcode::ADD, REG, REG, INTEGER, constant_test::NONE, 0, selection_action::FOLD },
+        { BASE_INDEX, opcode::ADD, REG, INDEX, INTEGER, constant_test::NONE, 0, selection_action::FOLD },
+        { BASE_INDEX, opcode::ADD, INDEX, REG, INTEGER, constant_test::NONE, 0, selection_action::FOLD },
+
+        { ADDRESS, opcode::NOP, BASE_INDEX, NONE, ANY, constant_test::NONE, 0, selection_action::CHAIN },
+        { ADDRESS, opcode::ADD, REG, IMM, INTEGER, constant_test::NONE, 0, selection_action::FOLD },
+        { ADDRESS, opcode::ADD, IMM, REG, INTEGER, constant_test::NONE, 0, selection_action::FOLD },
+        { ADDRESS, opcode::ADD, BASE_INDEX, IMM, INTEGER, constant_test::NONE, 0, selection_action::FOLD },
+        { ADDRESS, opcode::ADD, IMM, BASE_INDEX, INTEGER, constant_test::NONE, 0, selection_action::FOLD },
+        { ADDRESS, opcode::ADD, INDEX, IMM, INTEGER, constant_test::NONE, 0, selection_action::FOLD },
+        { ADDRESS, opcode::ADD, IMM, INDEX, INTEGER, constant_test::NONE, 0, selection_action::FOLD },
+
+        { REG, opcode::NOP, ADDRESS, NONE, ANY, constant_test::NONE, 1, selection_action::LEA },
+        { REG, opcode::SUB, REG, IMM, INTEGER, constant_test::NONE, 1, selection_action::IMMEDIATE },
+        { REG, opcode::MUL, REG, IMM, INTEGER, constant_test::NONE, 1, selection_action::IMMEDIATE },
+        { REG, opcode::MUL, IMM, REG, INTEGER, constant_test::NONE, 1, selection_action::IMMEDIATE },
+        { CONDITION, opcode::EQ, REG, REG, INTEGER, constant_test::NONE, 1, selection_action::FOLD },
+        { CONDITION, opcode::NE, REG, REG, INTEGER, constant_test::NONE, 1, selection_action::FOLD },
+        { CONDITION, opcode::LT, REG, REG, INTEGER, constant_test::NONE, 1, selection_action::FOLD },
+        { CONDITION, opcode::LE, REG, REG, INTEGER, constant_test::NONE, 1, selection_action::FOLD },
+        { CONDITION, opcode::GT, REG, REG, INTEGER, constant_test::NONE, 1, selection_action::FOLD },
+        { CONDITION, opcode::GE, REG, REG, INTEGER, constant_test::NONE, 1, selection_action::FOLD },
+        { CONDITION, opcode::EQ, REG, IMM, INTEGER, constant_test::NONE, 1, selection_action::FOLD },
+        { CONDITION, opcode::NE, REG, IMM, INTEGER, constant_test::NONE, 1, selection_action::FOLD },
+        { CONDITION, opcode::LT, REG, IMM, INTEGER, constant_test::NONE, 1, selection_action::FOLD },
+        { CONDITION, opcode::LE, REG, IMM, INTEGER, constant_test::NONE, 1, selection_action::FOLD },
+        { CONDITION, opcode::GT, REG, IMM, INTEGER, constant_test::NONE, 1, selection_action::FOLD },
+        { CONDITION, opcode::GE, REG, IMM, INTEGER, constant_test::NONE, 1, selection_action::FOLD },
+
+        // Equality of floats needs the parity flag as well, so only orderings are a single jump.
+        { CONDITION, opcode::LT, REG, REG, FLOAT, constant_test::NONE, 1, selection_action::FOLD },
+        { CONDITION, opcode::LE, REG, REG, FLOAT, constant_test::NONE, 1, selection_action::FOLD },
+        { CONDITION, opcode::GT, REG, REG, FLOAT, constant_test::NONE, 1, selection_action::FOLD },
+        { CONDITION, opcode::GE, REG, REG, FLOAT, constant_test::NONE, 1, selection_action::FOLD },
+
+        { REG, opcode::NOP, CONDITION, NONE, ANY, constant_test::NONE, 1, selection_action::SET },
+    };
+
+    constexpr size_t RULE_COUNT = std::size(RULE_LIST);
+
+    inline constexpr bool is_chain(const selection_rule& at) {
+        return at.action == selection_action::CHAIN || at.action == selection_action::LEA || at.action == selection_action::SET;
+    }
+
+    // Chain rules come after every rule reaching the goal they start from, so one pass in table order
+    // closes a node.
+    constexpr bool is_well_formed() {
+        if (RULE_COUNT >= NO_RULE)
+            return false;
+
+        for (size_t i = 0; i < RULE_COUNT; i++) {
+            const selection_rule& at = RULE_LIST[i];
+
+            if (at.action == selection_action::LEAF) {
+                if (at.op != opcode::CONSTANT || at.test == constant_test::NONE || at.left != NONE || at.right != NONE)
+                    return false;
+            }
+            else if (is_chain(at)) {
+                if (at.op != opcode::NOP || at.left == NONE || at.left == at.result || at.right != NONE)
+                    return false;
+
+                for (size_t j = i + 1; j < RULE_COUNT; j++) {
+                    if (RULE_LIST[j].result == at.left)
+                        return false;
+                }
+            }
+            else {
+                if (at.left == NONE || at.right == NONE || at.test != constant_test::NONE)
+                    return false;
+
+                if (at.action == selection_action::IMMEDIATE && (at.result != REG || (at.left == IMM) == (at.right == IMM)))
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    static_assert(is_well_formed(), "Selection rules have to be leaves, chains from goals closed before them, or binary.");
+
+    constexpr uint16_t NO_COST = UINT16_MAX;
+
+    inline bool passes(const constant_test test, const uint64_t immediate) {
+        const int64_t value = static_cast<int64_t>(immediate);
+
+        switch (test) {
+            case constant_test::SIMM32: return value == static_cast<int64_t>(static_cast<int32_t>(value));
+            case constant_test::SCALE: return value == 1 || value == 2 || value == 4 || value == 8;
+            default: return true;
+        }
+    }
+
+    inline bool is_of(const operand_class operands, const ir_type type) {
+        switch (operands) {
+            case operand_class::INTEGER: return is_integer(type);
+            case operand_class::FLOAT: return is_floating(type);
+            default: return true;
+        }
+    }
+
+    struct selector {
+        explicit selector(const ir_function& function) : function(function) {}
+
+        const ir_function& function;
+
+        std::vector<std::array<uint16_t, GOAL_COUNT>> cost_table;
+        std::vector<uint32_t> use_count_list;
+        std::vector<uint32_t> immediate_count_list; // Uses of a constant as an immediate
+
+        instruction_selection result;
+
+        // Used once, in the same block, and something the rules can take apart.
+        bool is_foldable(const t_value_id value, const t_value_id user) const {
+            const instruction& at = function.at(value);
+
+            if (at.op == opcode::CONSTANT || at.op == opcode::PHI || use_count_list[value] != 1 || at.block != function.at(user).block)
+                return false;
+
+            for (size_t i = 1; i < GOAL_COUNT; i++) {
+                if (result.rule_table[value][i] != NO_RULE)
+                    return true;
+            }
+
+            return false;
+        }
+
+        // A register costs nothing when the value is computed anyway, and its whole tree when only
+        // this user is there to compute it.
+        uint16_t operand_cost(const t_value_id value, const goal wanted, const t_value_id user) const {
+            if (function.at(value).op == opcode::CONSTANT)
+                return wanted == REG ? 0 : cost_table[value][static_cast<size_t>(wanted)];
+
+            if (is_foldable(value, user))
+                return cost_table[value][static_cast<size_t>(wanted)];
+
+            return wanted == REG ? 0 : NO_COST;
+        }
+
+        inline void offer(const t_value_id id, const goal reached, const uint32_t cost, const size_t index) {
+            uint16_t& best = cost_table[id][static_cast<size_t>(reached)];
+
+            if (cost < best) {
+                best = static_cast<uint16_t>(cost);
+                result.rule_table[id][static_cast<size_t>(reached)] = static_cast<uint8_t>(index);
+            }
+        }
+
+        void label(const t_value_id id) {
+            const instruction& at = function.at(id);
+            const uint32_t* operand_list = function.operands(id);
+
+            if (at.op == opcode::CONSTANT) {
+                for (size_t i = 0; i < RULE_COUNT; i++) {
+                    const selection_rule& rule = RULE_LIST[i];
+
+                    if (rule.action == selection_action::LEAF && is_of(rule.operands, at.type) && passes(rule.test, at.immediate))
+                        offer(id, rule.result, rule.cost, i);
+                }
+
+                return;
+            }
+
+            if (at.operand_count != 2 || at.op == opcode::PHI)
+                return;
+
+            const ir_type type = function.at(operand_list[0]).type;
+            bool is_matched = false;
+
+            for (size_t i = 0; i < RULE_COUNT; i++) {
+                const selection_rule& rule = RULE_LIST[i];
+
+                if (is_chain(rule)) {
+                    if (is_matched && cost_table[id][static_cast<size_t>(rule.left)] != NO_COST)
+                        offer(id, rule.result, cost_table[id][static_cast<size_t>(rule.left)] + uint32_t(rule.cost), i);
+                    continue;
+                }
+
+                if (rule.op != at.op || !is_of(rule.operands, type))
+                    continue;
+
+                const uint32_t left = operand_cost(operand_list[0], rule.left, id);
+                const uint32_t right = operand_cost(operand_list[1], rule.right, id);
+
+                if (left == NO_COST || right == NO_COST)
+                    continue;
+
+                if (!is_matched) {
+                    is_matched = true;
+
+                    // Emitting it the plain way is always there to fall back on.
+                    cost_table[id][static_cast<size_t>(REG)] = static_cast<uint16_t>(std::min<uint32_t>(PLAIN_COST + operand_cost(operand_list[0], REG, id) + operand_cost(operand_list[1], REG, id), NO_COST - 1));
+                }
+
+                offer(id, rule.result, rule.cost + left + right, i);
+            }
+        }
+
+        void reduce(const t_value_id id, const goal wanted) {
+            const uint8_t index = result.rule_of(id, wanted);
+
+            if (index == NO_RULE)
+                return;
+
+            const selection_rule& rule = RULE_LIST[index];
+
+            if (is_chain(rule)) {
+                reduce(id, rule.left);
+                return;
+            }
+
+            if (rule.action == selection_action::LEAF)
+                return;
+
+            const uint32_t* operand_list = function.operands(id);
+            const goal operand_goal_list[] = { rule.left, rule.right };
+
+            for (uint32_t i = 0; i < 2; i++) {
+                const t_value_id operand = operand_list[i];
+
+                if (operand_goal_list[i] == REG)
+                    continue;
+
+                if (function.at(operand).op == opcode::CONSTANT) {
+                    immediate_count_list[operand]++;
+                    continue;
+                }
+
+                result.folded_list[operand] = true;
+                result.goal_list[operand] = operand_goal_list[i];
+                reduce(operand, operand_goal_list[i]);
+            }
+        }
+
+        void run() {
+            const size_t count = function.instruction_list.size();
+
+            cost_table.assign(count, {});
+            result.rule_table.assign(count, {});
+            result.goal_list.assign(count, REG);
+            result.folded_list.assign(count, false);
+            use_count_list.assign(count, 0);
+            immediate_count_list.assign(count, 0);
+
+            for (auto& costs : cost_table)
+                costs.fill(NO_COST);
+
+            for (auto& rules : result.rule_table)
+                rules.fill(NO_RULE);
+
+            for (t_value_id id = 0; id < count; id++) {
+                const instruction& at = function.at(id);
+                const uint32_t* operand_list = function.operands(id);
+
+                if (at.op == opcode::NOP || function.block_list[at.block].is_removed)
+                    continue;
+
+                for (uint32_t i = at.op == opcode::PHI ? 1 : 0; i < at.operand_count; i += at.op == opcode::PHI ? 2 : 1)
+                    use_count_list[operand_list[i]]++;
+
+                // Constants may be anywhere, hoisted out of loops most of all, so leaves come first.
+                if (at.op == opcode::CONSTANT)
+                    label(id);
+            }
+
+            for (const ir_block& block : function.block_list) {
+                if (block.is_removed)
+                    continue;
+
+                for (t_value_id id = block.first; id != NO_VALUE; id = function.at(id).next) {
+                    if (function.at(id).op != opcode::CONSTANT)
+                        label(id);
+                }
+            }
+
+            // Users come after what they fold, so going backwards reaches every root before its tree.
+            for (const ir_block& block : function.block_list) {
+                if (block.is_removed)
+                    continue;
+
+                for (t_value_id id = block.last; id != NO_VALUE; id = function.at(id).prev) {
+                    const instruction& at = function.at(id);
+
+                    if (result.folded_list[id] || at.op == opcode::CONSTANT)
+                        continue;
+
+                    if (at.op == opcode::BRANCH) {
+                        const t_value_id condition = function.operands(id)[0];
+
+                        if (is_foldable(condition, id) && result.rule_of(condition, CONDITION) != NO_RULE) {
+                            result.folded_list[condition] = true;
+                            result.goal_list[condition] = CONDITION;
+                            reduce(condition, CONDITION);
+                        }
+
+                        continue;
+                    }
+
+                    reduce(id, REG);
+                }
+            }
+
+            for (t_value_id id = 0; id < count; id++) {
+                if (function.at(id).op == opcode::CONSTANT && use_count_list[id] > 0 && immediate_count_list[id] == use_count_list[id])
+                    result.folded_list[id] = true;
+            }
+        }
+    };
+}
+
+const selection_rule& core::backend::x64::rule(const uint8_t index) {
+    return RULE_LIST[index];
+}
+
+instruction_selection core::backend::x64::select_instructions(const ir_function& function) {
+    selector state(function);
+    state.run();
+
+    return std::move(state.result);
+}
@@ -1,7 +1,2722 @@
 // A tree walker that generates a symbol table and checks it as it does so.
 
+#include <filesystem>
+#include <iterator>
+#include <set>
+#include <unordered_map>
+
 #include "core.hh"
+#include "ast.hh"
+#include "symbol.hh"
+#include "interface.hh"
+#include "instance.hh"
+#include "query.hh"
+#include "path.hh"
+
+using namespace core::ast;
+using namespace core::semantic;
+
+// Stands in for the AST of interface-only files.
+static const ast_arena NO_AST;
+
+// Same order as the primitive type kinds.
+static const char* const PRIMITIVE_NAME_LIST[] = {
+    "u8", "u16", "u32", "u64",
+    "i8", "i16", "i32", "i64",
+    "f32", "f64",
+    "bool", "char", "string", "void",
+};
+
+// Module name, intrinsic names. An empty module name puts the intrinsics in the global scope.
+static const std::vector<std::pair<const char*, std::vector<const char*>>> INTRINSIC_LIST = {
+    { "", { "alloc", "free", "bit_cast" } },
+    { "io", { "write" } },
+};
+
+/*
+
+====================================================
+
+Symbol table
+
+====================================================
+
+*/
+
+core::semantic::symbol_table::symbol_table(const t_file_id file_id, const size_t node_count, scope* builtin_scope)
+    : file_id(file_id), node_count(node_count) {
+    root = scope_stack(arena, file_id, nullptr).make_scope(builtin_scope ? scope_kind::MODULE : scope_kind::BUILTIN, builtin_scope, nullptr);
+    resolution_list = arena.make_array<symbol*>(node_count);
+
+    type_list = arena.make_array<t_type_id>(node_count);
+    std::fill(type_list, type_list + node_count, NO_TYPE);
+
+    constant_map.init(arena);
+}
+
+symbol* core::semantic::symbol_table::declare(scope* target, symbol* declared) {
+    if (!target->table.insert(declared->name, declared))
+        return *target->table.find(declared->name);
+
+    if (!declared->parent)
+        declared->parent = target;
+
+    return nullptr;
+}
+
+symbol* core::semantic::symbol_table::lookup_in(const scope* target, const t_name_id name) {
+    symbol* const* found = target->table.find(name);
+    return found ? *found : nullptr;
+}
+
+symbol* core::semantic::scope_stack::make_symbol(const symbol_kind kind, const t_name_id name, const ast::t_node_id node) {
+    symbol* created = arena.make<symbol>();
+
+    created->kind = kind;
+    created->name = name;
+    created->file_id = file_id;
+    created->node = node;
+    created->interface_index = NO_INTERFACE_INDEX;
+    created->parent = nullptr;
+    created->inner = nullptr;
+    created->type = NO_TYPE;
+    created->template_list = nullptr;
+    created->template_count = 0;
+    created->operators = nullptr;
+    created->capture_list = nullptr;
+    created->capture_count = 0;
+
+    return created;
+}
+
+scope* core::semantic::scope_stack::make_scope(const scope_kind kind, scope* parent, symbol* owner) {
+    scope* created = arena.make<scope>();
+
+    created->kind = kind;
+    created->parent = parent;
+    created->owner = owner;
+    created->table.init(arena);
+
+    return created;
+}
+
+symbol* core::semantic::scope_stack::lookup(const t_name_id name) const {
+    for (const scope* at = current(); at; at = at->parent) {
+        if (symbol* const* found = at->table.find(name))
+            return *found;
+    }
+
+    return nullptr;
+}
+
+static inline type_table& process_types(core::liprocess& process) {
+    return *std::any_cast<const t_type_table_ptr&>(process.dump_type_table);
+}
+
+static inline symbol_table& file_table(core::liprocess& process, const core::t_file_id file_id) {
+    return *std::any_cast<const t_symbol_table_ptr&>(process.file_list[file_id].dump_symbol_table);
+}
+
+/*
+
+====================================================
+
+Builtins
+
+====================================================
+
+*/
+
+static t_symbol_table_ptr make_builtin_table(core::liprocess& process) {
+    auto table = std::make_shared<symbol_table>(-1, 0, nullptr);
+    scope_stack scopes(table->arena, -1, table->root);
+
+    for (uint8_t i = 0; i < std::size(PRIMITIVE_NAME_LIST); i++) {
+        symbol* primitive = scopes.make_symbol(symbol_kind::PRIMITIVE, process.name_table.intern(PRIMITIVE_NAME_LIST[i]), NO_NODE);
+        primitive->type = primitive_type(static_cast<type_kind>(static_cast<uint8_t>(type_kind::U8) + i));
+
+        scopes.declare(primitive);
+    }
+
+    for (const auto& [module_name, intrinsic_list] : INTRINSIC_LIST) {
+        scope* target = table->root;
+
+        if (module_name[0] != '\0') {
+            symbol* module = scopes.make_symbol(symbol_kind::MODULE, process.name_table.intern(module_name), NO_NODE);
+            module->inner = scopes.make_scope(scope_kind::MODULE, table->root, module);
+            scopes.declare(module);
+
+            target = module->inner;
+        }
+
+        for (const char* name : intrinsic_list)
+            symbol_table::declare(target, scopes.make_symbol(symbol_kind::INTRINSIC, process.name_table.intern(name), NO_NODE));
+    }
+
+    return table;
+}
+
+/*
+
+====================================================
+
+Walker
+
+====================================================
+
+*/
+
+// A function body waiting to be checked. Its function scope (template parameters and parameters) is built
+// during declaration collection and is read-only from then on.
+struct body_task {
+    core::t_file_id file_id;
+    t_node_id body;
+    scope* function_scope;
+};
+
+namespace core::semantic {
+    constexpr uint64_t NO_SUBJECT = UINT64_MAX;
+
+    // A type that outlives the type table of one analysis, in prefix order: every entry is followed by the
+    // entries of its arguments. Declarations are named by subject.
+    struct stable_type_entry {
+        type_kind kind;
+        uint8_t flags;
+        uint16_t argument_count;
+        uint64_t source; // NO_SUBJECT for primitives, NIL, functions and pointers
+    };
+
+    using t_stable_type = std::vector<stable_type_entry>;
+
+    inline uint64_t query_fingerprint(const t_stable_type& type) {
+        uint64_t hash = 0xcbf29ce484222325ull;
+
+        for (const stable_type_entry& entry : type) {
+            hash = (hash ^ (static_cast<uint64_t>(entry.kind) | static_cast<uint64_t>(entry.flags) << 8 | static_cast<uint64_t>(entry.argument_count) << 16)) * 0x100000001B3ull;
+            hash = (hash ^ entry.source) * 0x100000001B3ull;
+        }
+
+        return hash;
+    }
+
+    inline uint64_t query_fingerprint(const std::vector<t_stable_type>& type_list) {
+        uint64_t hash = type_list.size();
+
+        for (const t_stable_type& type : type_list)
+            hash = (hash ^ query_fingerprint(type)) * 0x100000001B3ull;
+
+        return hash;
+    }
+
+    // What working out a query reported, with its file named by subject.
+    struct stable_log {
+        uint64_t file;
+        core::lilog log;
+    };
+
+    // A memoized fact and whether working it out reported errors. Everyone asking for it fails along with it.
+    // An analysis that reuses it from an earlier one reports the same again.
+    template <typename V>
+    struct checked_fact {
+        V value;
+        bool success;
+        std::vector<stable_log> log_list;
+    };
+
+    template <typename V>
+    inline uint64_t query_fingerprint(const checked_fact<V>& fact) {
+        return query_fingerprint(fact.value) ^ static_cast<uint64_t>(fact.success);
+    }
+}
+
+// One of these exists per file during declaration collection and per function body while bodies are checked.
+// Nothing in here is shared between threads except for the read-only parts of the symbol table.
+struct semantic_state {
+    semantic_state(core::liprocess& process, const core::t_file_id file_id, symbol_table& table, liutil::bump_arena& arena, scope* base, std::vector<core::lilog>& log_sink)
+        : process(process), file_id(file_id),
+          ast(process.file_list[file_id].dump_ast_arena.has_value() ? std::any_cast<const ast_arena&>(process.file_list[file_id].dump_ast_arena) : NO_AST),
+          table(table), types(*std::any_cast<const t_type_table_ptr&>(process.dump_type_table)),
+          instances(*std::any_cast<const t_instance_cache_ptr&>(process.dump_instance_cache)),
+          queries(*std::any_cast<const t_query_engine_ptr&>(process.dump_query_engine)),
+          paths(*std::any_cast<const t_path_trie_ptr&>(process.dump_path_trie)),
+          scopes(arena, file_id, base), log_sink(log_sink), constant_sink(&table.constant_map), ctor_name(process.name_table.intern("ctor")) {}
+
+    core::liprocess& process;
+
+    const core::t_file_id file_id;
+    const ast_arena& ast;
+
+    symbol_table& table;
+    type_table& types;
+    instance_cache& instances;
+    query_engine& queries;
+    path_trie& paths;
+    scope_stack scopes;
+
+    // Body workers each get their own sink. They are merged in a fixed order once every worker is done.
+    std::vector<core::lilog>& log_sink;
+
+    // Bodies found during declaration collection. Null while checking a body.
+    std::vector<body_task>* body_task_list = nullptr;
 
-bool core::frontend::semantic_analyze(liprocess& process, const t_file_id file_id) {
+    // Where folded constants go. The table itself, except for bodies.
+    liutil::flat_map<constant>* constant_sink;
+
+    // Set while module level declarations are folded. Only then, on one thread, may a const be folded on first use.
+    bool on_demand = false;
+
+    // Declaration a query is computed for. The names it reads are recorded as its dependencies.
+    const symbol* query_owner = nullptr;
+
+    const core::t_name_id ctor_name;
+
+    // Locals of the body being checked and where they were last read. A read inside a loop the local
+    // was declared outside of can run again, so it never counts as the last one.
+    struct local_use {
+        t_node_id last = NO_NODE;
+        uint32_t loop_depth = 0; // Of the declaration
+        bool is_repeated = false;
+    };
+
+    // A local bound to a '&&' parameter, which has to be its last read.
+    struct move_candidate {
+        t_node_id read;
+        const symbol* local;
+    };
+
+    std::unordered_map<const symbol*, local_use> local_use_map;
+    std::vector<move_candidate> move_candidate_list;
+
+    // Locals declared without a type have the type of their initializer.
+    std::unordered_map<const symbol*, t_type_id> inferred_type_map;
+    uint32_t loop_depth = 0;
+
+    // Closures whose body is being checked, innermost last. Each captures the locals from outside of
+    // it that it reads.
+    struct closure_frame {
+        symbol* closure;
+        const scope* function_scope;
+        t_node_id declaration;
+        uint32_t loop_depth; // Where it is declared
+        std::vector<const symbol*> capture_list;
+    };
+
+    std::vector<closure_frame> closure_stack;
+
+    // Closures are named after the function they are declared in. (function, name) of every one so far.
+    std::set<std::pair<const symbol*, core::t_name_id>> closure_name_set;
+
+    bool success = true;
+
+    inline void error(const core::lisel& selection, const std::string& message) {
+        log_sink.emplace_back(core::lilog::log_level::ERROR, selection, message);
+        success = false;
+    }
+
+    inline const std::string& name_of(const core::t_name_id name) const {
+        return process.name_table.get(name);
+    }
+
+    inline const node* base(const t_node_id id) const {
+        return ast.get_base_ptr(id);
+    }
+
+    inline bool is_identifier(const t_node_id id) const {
+        return base(id)->type == node_type::EXPR_IDENTIFIER;
+    }
+
+    // Declares into the current scope and reports clashes.
+    symbol* declare(const symbol_kind kind, const t_node_id name_id, const t_node_id declaration_id) {
+        // The parser already reported whatever is sitting here instead.
+        if (!is_identifier(name_id))
+            return nullptr;
+
+        const expr_identifier& name = ast.get_as<expr_identifier>(name_id);
+
+        symbol* declared = scopes.make_symbol(kind, name.name, declaration_id);
+
+        if (scopes.declare(declared)) {
+            error(name.selection, "'" + name_of(name.name) + "' is already declared in this scope.");
+            return nullptr;
+        }
+
+        table.resolve(name_id, declared);
+        table.resolve(declaration_id, declared);
+
+        return declared;
+    }
+
+    // Parameters and variants declared in a body.
+    static bool is_local(const symbol* found) {
+        return found && (found->kind == symbol_kind::PARAMETER || (found->kind == symbol_kind::VARIANT && found->parent && found->parent->kind != scope_kind::MODULE));
+    }
+
+    static bool is_inside(const symbol* found, const scope* target) {
+        for (const scope* at = found->parent; at; at = at->parent) {
+            if (at == target)
+                return true;
+        }
+
+        return false;
+    }
+
+    // Every closure being checked that found is from outside of captures it. Returns the outermost
+    // one, which is declared next to found. nullptr if nothing captures it.
+    closure_frame* capture(const symbol* found) {
+        closure_frame* outermost = nullptr;
+
+        for (auto it = closure_stack.rbegin(); it != closure_stack.rend() && !is_inside(found, it->function_scope); ++it) {
+            if (std::find(it->capture_list.begin(), it->capture_list.end(), found) == it->capture_list.end())
+                it->capture_list.push_back(found);
+
+            outermost = &*it;
+        }
+
+        return outermost;
+    }
+
+    inline bool is_captured(const symbol* found) const {
+        return !closure_stack.empty() && !is_inside(found, closure_stack.back().function_scope);
+    }
+
+    void note_read(const symbol* found, const t_node_id id) {
+        if (body_task_list || !is_local(found))
+            return;
+
+        t_node_id at = id;
+        uint32_t depth = loop_depth;
+
+        // Closures copy what they capture where they are declared, and that is where it is read.
+        if (const closure_frame* frame = capture(found)) {
+            at = frame->declaration;
+            depth = frame->loop_depth;
+        }
+
+        local_use& use = local_use_map[found];
+        use.last = at;
+        use.is_repeated = depth > use.loop_depth;
+    }
+
+    // A closure that captures something has to be handed it on every call, so calling it from another
+    // closure captures it in turn.
+    void note_call(const symbol* found, const t_node_id id) {
+        if (!is_closure(found)) {
+            note_read(found, id);
+            return;
+        }
+
+        if (found->capture_count > 0)
+            capture(found);
+    }
+
+    // The copy a closure holds is the same on every call, so it never changes.
+    void note_write(const symbol* found, const t_node_id id) {
+        if (is_local(found) && is_captured(found))
+            error(base(id)->selection, "'" + name_of(found->name) + "' is captured by copy, so the closure can not assign it.");
+    }
+
+    // The expression at id is bound to a '&&' parameter. Temporaries always can be, locals only at their
+    // last read. Other places can not be moved from. This is only a check: no copy is dropped for it.
+    void check_move(const t_node_id id) {
+        const node_type type = base(id)->type;
+        const symbol* found = type == node_type::EXPR_IDENTIFIER ? table.resolution(id) : nullptr;
+
+        if (is_local(found) && is_captured(found)) {
+            error(base(id)->selection, "'" + name_of(found->name) + "' is captured by the closure, which may be called again, so it can not be moved into a '&&' parameter.");
+            return;
+        }
+
+        if (is_local(found)) {
+            move_candidate_list.push_back({ id, found });
+            return;
+        }
+
+        const bool is_place = (found && (found->kind == symbol_kind::VARIANT || found->kind == symbol_kind::PROPERTY))
+            || (type == node_type::EXPR_BINARY && ast.get_as<expr_binary>(id).opr.type == core::token_type::DOT);
+
+        if (is_place)
+            error(base(id)->selection, "Only temporaries and locals at their last use can bind to a '&&' parameter.");
+    }
+
+    // Once the whole body is read, the last reads are known.
+    void finish_moves() {
+        for (const move_candidate& candidate : move_candidate_list) {
+            const local_use& use = local_use_map[candidate.local];
+
+            if (use.last != candidate.read || use.is_repeated)
+                error(base(candidate.read)->selection, "'" + name_of(candidate.local->name) + "' can be read again after this, so it can not be moved into a '&&' parameter.");
+        }
+    }
+
+    // Declares template parameters into the current scope. The owner keeps them, in order, as types.
+    void declare_templates(symbol* owner, const t_node_list& parameter_list) {
+        t_type_id* template_list = parameter_list.empty() ? nullptr : scopes.arena.make_array<t_type_id>(parameter_list.size());
+
+        for (size_t i = 0; i < parameter_list.size(); i++) {
+            symbol* declared = declare(symbol_kind::TEMPLATE_PARAMETER, parameter_list[i], parameter_list[i]);
+            template_list[i] = declared ? types.intern(type_kind::TEMPLATE_PARAMETER, declared) : NO_TYPE;
+        }
+
+        if (owner) {
+            owner->template_list = template_list;
+            owner->template_count = static_cast<uint16_t>(parameter_list.size());
+        }
+    }
+};
+
+/*
+
+====================================================
+
+Declaration collection
+Runs over the top level of every file before any body is looked at, so the order of declarations
+in a module does not matter.
+
+====================================================
+
+*/
+
+// Returns false if the struct already overloads opr with the same arity.
+static bool add_operator(liutil::bump_arena& arena, symbol* owner, const core::token_type opr, const bool is_binary, symbol* overload) {
+    if (!owner->operators)
+        owner->operators = arena.make<operator_table>();
+
+    symbol*& slot = (is_binary ? owner->operators->binary_list : owner->operators->unary_list)[static_cast<size_t>(opr)];
+    if (slot)
+        return false;
+
+    slot = overload;
     return true;
-}
\ No newline at end of file
+}
+
+static void collect_struct(semantic_state& state, const t_node_id id) {
+    const item_struct_declaration& declaration = state.ast.get_as<item_struct_declaration>(id);
+
+    symbol* declared = state.declare(symbol_kind::STRUCT, declaration.name, id);
+    if (!declared)
+        return;
+
+    declared->type = state.types.intern(type_kind::STRUCT, declared);
+    declared->inner = state.scopes.make_scope(scope_kind::STRUCT, state.scopes.current(), declared);
+    state.scopes.enter(declared->inner);
+
+    state.declare_templates(declared, declaration.template_parameter_list);
+
+    for (const t_node_id member : declaration.member_list) {
+        switch (state.base(member)->type) {
+            case node_type::EXPR_PROPERTY:
+                state.declare(symbol_kind::PROPERTY, state.ast.get_as<expr_property>(member).name, member);
+                break;
+            case node_type::EXPR_METHOD:
+                state.declare(symbol_kind::METHOD, state.ast.get_as<expr_method>(member).name, member);
+                break;
+            case node_type::EXPR_OPERATOR: {
+                const expr_operator& opr = state.ast.get_as<expr_operator>(member);
+                const size_t parameter_count = state.ast.get_as<expr_function>(opr.function).parameter_list.size();
+
+                if (parameter_count > 1) {
+                    state.error(state.base(member)->selection, "Operators take at most one parameter.");
+                    break;
+                }
+
+                symbol* overload = state.scopes.make_symbol(symbol_kind::OPERATOR, core::NONE_NAME, member);
+                overload->parent = declared->inner;
+
+                if (!add_operator(state.scopes.arena, declared, opr.opr, parameter_count == 1, overload)) {
+                    state.error(state.base(member)->selection, "This operator is already overloaded in '" + state.name_of(declared->name) + "'.");
+                    break;
+                }
+
+                state.table.resolve(member, overload);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    state.scopes.pop_scope();
+}
+
+static void collect_item(semantic_state& state, const t_node_id id) {
+    switch (state.base(id)->type) {
+        case node_type::ITEM_MODULE: {
+            const item_module& module = state.ast.get_as<item_module>(id);
+            const expr_identifier& name = state.ast.get_as<expr_identifier>(module.name);
+
+            // Modules can be reopened. Keep adding to the same member scope.
+            symbol* declared = symbol_table::lookup_in(state.scopes.current(), name.name);
+
+            if (!declared || declared->kind != symbol_kind::MODULE) {
+                declared = state.declare(symbol_kind::MODULE, module.name, id);
+                if (!declared)
+                    return;
+
+                declared->inner = state.scopes.make_scope(scope_kind::MODULE, state.scopes.current(), declared);
+            }
+
+            state.table.resolve(module.name, declared);
+            state.table.resolve(id, declared);
+
+            state.scopes.enter(declared->inner);
+            collect_item(state, module.content);
+            state.scopes.pop_scope();
+            break;
+        }
+        case node_type::ITEM_BODY:
+            for (const t_node_id item : state.ast.get_as<item_body>(id).item_list)
+                collect_item(state, item);
+            break;
+        case node_type::VARIANT_DECLARATION: {
+            const variant_declaration& declaration = state.ast.get_as<variant_declaration>(id);
+
+            if (!state.is_identifier(declaration.name)) {
+                state.error(state.base(declaration.name)->selection, "Qualified declarations are not supported.");
+                return;
+            }
+
+            const bool is_function = state.base(declaration.value)->type == node_type::EXPR_FUNCTION;
+            state.declare(is_function ? symbol_kind::FUNCTION : symbol_kind::VARIANT, declaration.name, id);
+            break;
+        }
+        case node_type::ITEM_TYPE_DECLARATION: {
+            const item_type_declaration& declaration = state.ast.get_as<item_type_declaration>(id);
+
+            if (!state.is_identifier(declaration.name))
+                break;
+
+            symbol* declared = state.declare(symbol_kind::TYPEDEC, declaration.name, id);
+            if (!declared || declaration.parameter_list.empty())
+                break;
+
+            // Generic typedecs keep their parameters in a member scope, like structs.
+            declared->inner = state.scopes.push_scope(scope_kind::BLOCK, declared);
+            state.declare_templates(declared, declaration.parameter_list);
+            state.scopes.pop_scope();
+            break;
+        }
+        case node_type::ITEM_STRUCT_DECLARATION:
+            if (state.is_identifier(state.ast.get_as<item_struct_declaration>(id).name))
+                collect_struct(state, id);
+            break;
+        case node_type::ITEM_ENUM: {
+            const item_enum& declaration = state.ast.get_as<item_enum>(id);
+
+            if (!state.is_identifier(declaration.name))
+                break;
+
+            symbol* declared = state.declare(symbol_kind::ENUM, declaration.name, id);
+            if (!declared)
+                break;
+
+            declared->type = state.types.intern(type_kind::ENUM, declared);
+
+            declared->inner = state.scopes.make_scope(scope_kind::MODULE, state.scopes.current(), declared);
+            state.scopes.enter(declared->inner);
+
+            for (const t_node_id set : declaration.set_list) {
+                if (state.base(set)->type == node_type::EXPR_ENUM_SET)
+                    state.declare(symbol_kind::ENUM_SET, state.ast.get_as<expr_enum_set>(set).name, set);
+            }
+
+            state.scopes.pop_scope();
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void declare_interface_templates(core::liprocess& process, scope_stack& scopes, const core::frontend::module_interface& iface, const core::frontend::lii::decl_entry& decl, scope* target, symbol* owner) {
+    t_type_id* template_list = decl.template_count == 0 ? nullptr : scopes.arena.make_array<t_type_id>(decl.template_count);
+
+    for (uint32_t t = 0; t < decl.template_count; t++) {
+        symbol* declared = scopes.make_symbol(symbol_kind::TEMPLATE_PARAMETER, iface.name(iface.index(decl.template_begin + t)), NO_NODE);
+        template_list[t] = symbol_table::declare(target, declared) ? NO_TYPE : process_types(process).intern(type_kind::TEMPLATE_PARAMETER, declared);
+    }
+
+    owner->template_list = template_list;
+    owner->template_count = static_cast<uint16_t>(decl.template_count);
+}
+
+// Interface-only files never had an AST. Their declarations come straight from the mapped interface.
+static void collect_interface(core::liprocess& process, symbol_table& table, const core::frontend::module_interface& iface) {
+    namespace lii = core::frontend::lii;
+
+    std::vector<symbol*>& decl_symbol_list = table.interface_symbol_list;
+    decl_symbol_list.assign(iface.header().decl_count, nullptr);
+
+    scope_stack scopes(table.arena, table.file_id, table.root);
+
+    for (uint32_t i = 0; i < iface.header().decl_count; i++) {
+        const lii::decl_entry& decl = iface.decl(i);
+
+        scope* target = table.root;
+        if (decl.parent != core::frontend::INTERFACE_NONE) {
+            if (!decl_symbol_list[decl.parent] || !decl_symbol_list[decl.parent]->inner)
+                continue;
+
+            target = decl_symbol_list[decl.parent]->inner;
+        }
+
+        symbol_kind kind;
+        switch (decl.kind) {
+            case lii::decl_kind::MODULE: kind = symbol_kind::MODULE; break;
+            case lii::decl_kind::VARIANT: kind = symbol_kind::VARIANT; break;
+            case lii::decl_kind::FUNCTION: kind = symbol_kind::FUNCTION; break;
+            case lii::decl_kind::STRUCT: kind = symbol_kind::STRUCT; break;
+            case lii::decl_kind::ENUM: kind = symbol_kind::ENUM; break;
+            case lii::decl_kind::TYPEDEC: kind = symbol_kind::TYPEDEC; break;
+            default: continue;
+        }
+
+        symbol* declared = scopes.make_symbol(kind, iface.name(decl.name), NO_NODE);
+        declared->interface_index = i;
+
+        if (symbol* existing = symbol_table::declare(target, declared)) {
+            // Reopened module
+            decl_symbol_list[i] = existing->kind == symbol_kind::MODULE && kind == symbol_kind::MODULE ? existing : nullptr;
+            continue;
+        }
+
+        decl_symbol_list[i] = declared;
+
+        if (kind == symbol_kind::STRUCT)
+            declared->type = process_types(process).intern(type_kind::STRUCT, declared);
+        else if (kind == symbol_kind::ENUM)
+            declared->type = process_types(process).intern(type_kind::ENUM, declared);
+
+        if (kind == symbol_kind::TYPEDEC && decl.template_count != 0) {
+            declared->inner = scopes.make_scope(scope_kind::BLOCK, target, declared);
+            declare_interface_templates(process, scopes, iface, decl, declared->inner, declared);
+            continue;
+        }
+
+        if (kind != symbol_kind::MODULE && kind != symbol_kind::STRUCT && kind != symbol_kind::ENUM)
+            continue;
+
+        declared->inner = scopes.make_scope(kind == symbol_kind::STRUCT ? scope_kind::STRUCT : scope_kind::MODULE, target, declared);
+        declare_interface_templates(process, scopes, iface, decl, declared->inner, declared);
+
+        for (uint32_t m = 0; m < decl.member_count; m++) {
+            const lii::member_entry& member = iface.member(decl.member_begin + m);
+
+            if (member.kind == lii::member_kind::OPERATOR) {
+                symbol* overload = scopes.make_symbol(symbol_kind::OPERATOR, core::NONE_NAME, NO_NODE);
+                overload->interface_index = decl.member_begin + m;
+                overload->parent = declared->inner;
+
+                add_operator(table.arena, declared, static_cast<core::token_type>(member.opr), member.parameter_count == 1, overload);
+                continue;
+            }
+
+            symbol_kind member_kind;
+            switch (member.kind) {
+                case lii::member_kind::PROPERTY: member_kind = symbol_kind::PROPERTY; break;
+                case lii::member_kind::METHOD: member_kind = symbol_kind::METHOD; break;
+                case lii::member_kind::ENUM_SET: member_kind = symbol_kind::ENUM_SET; break;
+                default: continue;
+            }
+
+            symbol* member_symbol = scopes.make_symbol(member_kind, iface.name(member.name), NO_NODE);
+            member_symbol->interface_index = decl.member_begin + m;
+            symbol_table::declare(declared->inner, member_symbol);
+        }
+    }
+}
+
+// Everything a used module declares at its top level becomes visible in the user. Local declarations win.
+static void import_uses(core::liprocess& process, const core::t_file_id file_id) {
+    symbol_table& table = file_table(process, file_id);
+
+    for (const core::t_file_id used_id : process.file_list[file_id].use_list) {
+        const symbol_table& used = file_table(process, used_id);
+
+        used.root->table.for_each([&](const uint32_t, symbol* imported) {
+            symbol_table::declare(table.root, imported);
+        });
+    }
+}
+
+/*
+
+====================================================
+
+Resolution
+
+====================================================
+
+*/
+
+static void resolve_expression(semantic_state& state, const t_node_id id);
+static void resolve_statement(semantic_state& state, const t_node_id id);
+
+static symbol* resolve_identifier(semantic_state& state, const t_node_id id) {
+    const expr_identifier& identifier = state.ast.get_as<expr_identifier>(id);
+
+    // ctor(...) delegates to another constructor of the enclosing struct.
+    if (identifier.name == state.ctor_name) {
+        for (const scope* at = state.scopes.current(); at; at = at->parent) {
+            if (at->kind == scope_kind::STRUCT) {
+                state.table.resolve(id, at->owner);
+                return at->owner;
+            }
+        }
+    }
+
+    symbol* found = state.scopes.lookup(identifier.name);
+
+    if (!found) {
+        state.error(identifier.selection, "Unknown identifier '" + state.name_of(identifier.name) + "'.");
+        return nullptr;
+    }
+
+    state.table.resolve(id, found);
+    return found;
+}
+
+// a..b..c - 'a' is looked up by scope, every step after that is a single probe into the path trie.
+// Returns the trie node of the whole path, or NO_PATH if it does not resolve.
+static t_path_id resolve_path(semantic_state& state, const t_node_id id) {
+    const node* base = state.base(id);
+
+    if (base->type == node_type::EXPR_IDENTIFIER) {
+        symbol* found = resolve_identifier(state, id);
+        return found ? state.paths.root(found) : NO_PATH;
+    }
+
+    if (base->type != node_type::EXPR_BINARY || state.ast.get_as<expr_binary>(id).opr.type != core::token_type::DOUBLE_DOT) {
+        resolve_expression(state, id);
+        return NO_PATH;
+    }
+
+    const expr_binary& binary = state.ast.get_as<expr_binary>(id);
+
+    const t_path_id owner = resolve_path(state, binary.first);
+    if (owner == NO_PATH)
+        return NO_PATH;
+
+    if (!state.is_identifier(binary.second)) {
+        state.error(state.base(binary.second)->selection, "Expected a member name.");
+        return NO_PATH;
+    }
+
+    const expr_identifier& member_name = state.ast.get_as<expr_identifier>(binary.second);
+
+    const t_path_id member = state.paths.child(owner, member_name.name);
+    const path_node& found = state.paths.get(member);
+
+    switch (found.failure) {
+        case path_node::e_failure::NO_MEMBERS:
+            state.error(binary.opr.selection, "'" + state.name_of(found.parent->name) + "' has no members.");
+            return NO_PATH;
+        case path_node::e_failure::NOT_A_MEMBER:
+            state.error(member_name.selection, "'" + state.name_of(member_name.name) + "' is not a member of '" + state.name_of(found.parent->name) + "'.");
+            return NO_PATH;
+        default:
+            break;
+    }
+
+    state.table.resolve(binary.second, found.target);
+    state.table.resolve(id, found.target);
+
+    return member;
+}
+
+static symbol* resolve_scope_resolution(semantic_state& state, const t_node_id id) {
+    const t_path_id path = resolve_path(state, id);
+    return path == NO_PATH ? nullptr : state.paths.get(path).target;
+}
+
+static t_type_id typedec_type(semantic_state& state, symbol* typedec, const core::lisel& selection);
+static void note_target(semantic_state& state, const t_node_id id);
+
+// declaration[argument_list]. Each distinct argument list is only ever worked out once per process.
+static t_type_id instantiate(semantic_state& state, symbol* declaration, const std::vector<t_type_id>& argument_list, const core::lisel& selection) {
+    // Signatures further down the file are not resolved yet. Do not cache anything for them.
+    if ((declaration->kind == symbol_kind::FUNCTION || declaration->kind == symbol_kind::METHOD) && declaration->type == NO_TYPE)
+        return INVALID_TYPE;
+
+    if (argument_list.size() != declaration->template_count) {
+        state.error(selection, "'" + state.name_of(declaration->name) + "' expects " + std::to_string(declaration->template_count) +
+            " template argument(s), got " + std::to_string(argument_list.size()) + ".");
+        return INVALID_TYPE;
+    }
+
+    instance& found = state.instances.get(declaration, argument_list.data(), static_cast<uint16_t>(argument_list.size()));
+
+    std::call_once(found.checked, [&]() {
+        switch (declaration->kind) {
+            case symbol_kind::STRUCT:
+                found.type = state.types.intern(type_kind::STRUCT, declaration, found.argument_list, found.argument_count);
+                break;
+            case symbol_kind::TYPEDEC:
+                found.type = state.types.substitute(typedec_type(state, declaration, selection), declaration->template_list, found.argument_list, found.argument_count);
+                break;
+            default:
+                found.type = state.types.substitute(declaration->type, declaration->template_list, found.argument_list, found.argument_count);
+        }
+    });
+
+    return found.type;
+}
+
+// The type a name refers to, given its already canonical arguments.
+static t_type_id named_type(semantic_state& state, symbol* source, const std::vector<t_type_id>& argument_list, const core::lisel& selection) {
+    switch (source->kind) {
+        case symbol_kind::PRIMITIVE:
+            return source->type;
+        case symbol_kind::STRUCT:
+            // A generic struct may name itself without arguments inside its own declaration.
+            if (argument_list.empty())
+                return source->type;
+
+            return instantiate(state, source, argument_list, selection);
+        case symbol_kind::ENUM:
+            return state.types.intern(type_kind::ENUM, source);
+        case symbol_kind::TEMPLATE_PARAMETER:
+            return state.types.intern(type_kind::TEMPLATE_PARAMETER, source);
+        case symbol_kind::TYPEDEC:
+            if (source->inner)
+                return instantiate(state, source, argument_list, selection);
+
+            return typedec_type(state, source, selection);
+        default:
+            return INVALID_TYPE;
+    }
+}
+
+// Returns NO_TYPE if no type was written and INVALID_TYPE if it failed to resolve.
+static t_type_id resolve_type(semantic_state& state, const t_node_id id) {
+    const node* base = state.base(id);
+
+    if (base->type != node_type::EXPR_TYPE)
+        return base->type == node_type::EXPR_NONE ? NO_TYPE : INVALID_TYPE;
+
+    const expr_type& type = state.ast.get_as<expr_type>(id);
+
+    symbol* source = resolve_scope_resolution(state, type.source);
+    state.table.resolve(id, source);
+    note_target(state, type.source);
+
+    std::vector<t_type_id> argument_list;
+    argument_list.reserve(type.argument_list.size());
+
+    for (const t_node_id argument : type.argument_list) {
+        const t_type_id argument_type = resolve_type(state, argument);
+        argument_list.push_back(argument_type == NO_TYPE ? INVALID_TYPE : argument_type);
+    }
+
+    t_type_id result = INVALID_TYPE;
+
+    if (source) {
+        result = named_type(state, source, argument_list, state.base(type.source)->selection);
+
+        if (result == INVALID_TYPE && source->kind != symbol_kind::TYPEDEC)
+            state.error(state.base(type.source)->selection, "'" + state.name_of(source->name) + "' is not a type.");
+    }
+
+    if (type.is_pointer)
+        result = state.types.pointer(result);
+
+    uint8_t flags = 0;
+    if (type.is_const)
+        flags |= TYPE_CONST;
+    if (type.reference_type == expr_type::e_reference_type::LVALUE)
+        flags |= TYPE_LVALUE;
+    else if (type.reference_type == expr_type::e_reference_type::RVALUE)
+        flags |= TYPE_RVALUE;
+
+    result = state.types.qualify(result, flags);
+    state.table.set_type(id, result);
+
+    return result;
+}
+
+// Types inside an interface are name paths. The first name is looked up from base outwards.
+// The interface was checked when it was written, so anything that does not resolve is just invalid.
+static t_type_id interface_type(semantic_state& state, const core::frontend::module_interface& iface, const scope* base, const uint32_t index) {
+    namespace lii = core::frontend::lii;
+
+    if (index == core::frontend::INTERFACE_NONE)
+        return NO_TYPE;
+
+    const lii::type_entry& entry = iface.type(index);
+    if (entry.path_count == 0)
+        return INVALID_TYPE;
+
+    symbol* source = nullptr;
+    for (const scope* at = base; at && !source; at = at->parent)
+        source = symbol_table::lookup_in(at, iface.name(iface.index(entry.path_begin)));
+
+    if (source && entry.path_count > 1) {
+        t_path_id path = state.paths.root(source);
+
+        for (uint32_t i = 1; source && i < entry.path_count; i++) {
+            path = state.paths.child(path, iface.name(iface.index(entry.path_begin + i)));
+            source = state.paths.get(path).target;
+        }
+    }
+
+    if (!source)
+        return INVALID_TYPE;
+
+    std::vector<t_type_id> argument_list;
+    argument_list.reserve(entry.argument_count);
+
+    for (uint32_t i = 0; i < entry.argument_count; i++) {
+        const t_type_id argument_type = interface_type(state, iface, base, iface.index(entry.argument_begin + i));
+        argument_list.push_back(argument_type == NO_TYPE ? INVALID_TYPE : argument_type);
+    }
+
+    t_type_id result = named_type(state, source, argument_list, core::lisel(state.file_id, 0));
+
+    if (entry.flags & lii::TYPE_POINTER)
+        result = state.types.pointer(result);
+
+    uint8_t flags = 0;
+    if (entry.flags & lii::TYPE_CONST)
+        flags |= TYPE_CONST;
+    if (entry.flags & lii::TYPE_LVALUE)
+        flags |= TYPE_LVALUE;
+    if (entry.flags & lii::TYPE_RVALUE)
+        flags |= TYPE_RVALUE;
+
+    return state.types.qualify(result, flags);
+}
+
+/*
+
+====================================================
+
+Queries
+
+The query engine outlives the symbols and types of one analysis. Declarations are named by their file,
+relative to the entry point, and the names of the scopes they are declared in. Memoized types name the
+declarations they refer to the same way and are interned again by every analysis that reuses them.
+
+====================================================
+
+*/
+
+static std::string relative_path(const core::liprocess& process, const core::t_file_id file_id) {
+    if (file_id < 0)
+        return "";
+
+    const std::filesystem::path root = std::filesystem::path(process.file_list[0].path).parent_path();
+    const std::filesystem::path path = process.file_list[file_id].path;
+
+    return (root.empty() ? path : path.lexically_relative(root)).generic_string();
+}
+
+static core::t_file_id file_of_path(const core::liprocess& process, const std::string& path) {
+    for (size_t i = 0; i < process.file_list.size(); i++) {
+        if (relative_path(process, static_cast<core::t_file_id>(i)) == path)
+            return static_cast<core::t_file_id>(i);
+    }
+
+    return -1;
+}
+
+// The scope a stable name starts in: a file's root or, for an empty path, the builtin scope.
+static scope* root_of_path(core::liprocess& process, const std::string& path) {
+    if (path.empty())
+        return std::any_cast<const t_symbol_table_ptr&>(process.dump_builtin_table)->root;
+
+    const core::t_file_id file_id = file_of_path(process, path);
+    return file_id < 0 ? nullptr : file_table(process, file_id).root;
+}
+
+// "file\0outer\0...\0name". Empty for anything that can not be found again by name, like locals and parameters.
+static std::string stable_name(const core::liprocess& process, const symbol* declared) {
+    std::vector<const symbol*> chain;
+
+    for (const symbol* at = declared; ; ) {
+        chain.push_back(at);
+
+        const scope* parent = at->parent;
+        if (!parent)
+            return "";
+
+        if (!parent->owner) {
+            const bool is_root = parent->kind == scope_kind::BUILTIN || (parent->parent && parent->parent->kind == scope_kind::BUILTIN);
+
+            if (!is_root)
+                return "";
+            break;
+        }
+
+        if (parent->owner->inner != parent)
+            return "";
+
+        at = parent->owner;
+    }
+
+    std::string name = relative_path(process, chain.back()->file_id);
+
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+        name += '\0' + process.name_table.get((*it)->name);
+
+    return name;
+}
+
+static symbol* stable_declaration(core::liprocess& process, const std::string& name) {
+    size_t end = name.find('\0');
+    if (end == std::string::npos)
+        return nullptr;
+
+    const scope* at = root_of_path(process, name.substr(0, end));
+
+    while (at) {
+        const size_t begin = end + 1;
+        end = name.find('\0', begin);
+
+        symbol* found = symbol_table::lookup_in(at, process.name_table.intern(name.substr(begin, end == std::string::npos ? std::string::npos : end - begin)));
+
+        if (!found || end == std::string::npos)
+            return found;
+
+        at = found->inner;
+    }
+
+    return nullptr;
+}
+
+static uint64_t declaration_subject(semantic_state& state, const symbol* declared) {
+    const std::string name = declared ? stable_name(state.process, declared) : "";
+    return name.empty() ? NO_SUBJECT : state.queries.subject(name);
+}
+
+static symbol* subject_declaration(core::liprocess& process, query_engine& queries, const uint64_t subject) {
+    return subject == NO_SUBJECT ? nullptr : stable_declaration(process, queries.subject_name(subject));
+}
+
+static uint64_t file_subject(core::liprocess& process, query_engine& queries, const core::t_file_id file_id) {
+    return queries.subject(relative_path(process, file_id));
+}
+
+static void stabilize(semantic_state& state, const t_type_id id, t_stable_type& out) {
+    const type_entry& qualified = state.types.get(id);
+    const type_entry& entry = state.types.get(qualified.base);
+
+    out.push_back({ entry.kind, qualified.flags, entry.argument_count, entry.source ? declaration_subject(state, entry.source) : NO_SUBJECT });
+
+    for (uint16_t i = 0; i < entry.argument_count; i++)
+        stabilize(state, entry.argument_list[i], out);
+}
+
+static t_stable_type stabilize(semantic_state& state, const t_type_id id) {
+    t_stable_type out;
+    stabilize(state, id == NO_TYPE ? INVALID_TYPE : id, out);
+
+    return out;
+}
+
+// Interns a memoized type into the type table of this analysis. A declaration that is gone makes the type invalid.
+static t_type_id restore(semantic_state& state, const t_stable_type& type, size_t& at) {
+    const stable_type_entry& entry = type[at++];
+
+    std::vector<t_type_id> argument_list(entry.argument_count);
+    bool is_valid = true;
+
+    for (uint16_t i = 0; i < entry.argument_count; i++) {
+        argument_list[i] = restore(state, type, at);
+        is_valid &= argument_list[i] != INVALID_TYPE || entry.kind == type_kind::FUNCTION;
+    }
+
+    t_type_id base;
+
+    if (entry.kind <= type_kind::NIL)
+        base = primitive_type(entry.kind);
+    else {
+        const symbol* source = entry.source == NO_SUBJECT ? nullptr : subject_declaration(state.process, state.queries, entry.source);
+
+        if (!is_valid || (entry.source != NO_SUBJECT && !source))
+            return INVALID_TYPE;
+
+        base = state.types.intern(entry.kind, source, argument_list.data(), entry.argument_count);
+    }
+
+    return entry.flags ? state.types.qualify(base, entry.flags) : base;
+}
+
+static t_type_id restore(semantic_state& state, const t_stable_type& type) {
+    size_t at = 0;
+    return type.empty() ? INVALID_TYPE : restore(state, type, at);
+}
+
+// Everything a query reports goes to its own sink, so it can be reported again by later analyses.
+static std::vector<stable_log> stable_logs(core::liprocess& process, query_engine& queries, const std::vector<core::lilog>& log_list) {
+    std::vector<stable_log> stable_list;
+    stable_list.reserve(log_list.size());
+
+    for (const core::lilog& log : log_list) {
+        process.log_list.push_back(log);
+        stable_list.push_back({ file_subject(process, queries, log.selection.file_id), log });
+    }
+
+    return stable_list;
+}
+
+template <typename V>
+static void replay(semantic_state& state, const query_key& key, const checked_fact<V>& fact) {
+    if (!fact.success)
+        state.success = false;
+
+    if (fact.log_list.empty() || !state.queries.should_replay(key))
+        return;
+
+    for (const stable_log& entry : fact.log_list) {
+        const core::t_file_id file_id = file_of_path(state.process, state.queries.subject_name(entry.file));
+
+        if (file_id >= 0)
+            state.process.log_list.emplace_back(entry.log.level, core::lisel(file_id, entry.log.selection.start, entry.log.selection.end), entry.log.message);
+    }
+}
+
+// a..b..c as written, which is what an identifier target query is about along with where it is looked up from.
+static std::string written_path(semantic_state& state, const t_node_id id) {
+    if (state.is_identifier(id))
+        return state.name_of(state.ast.get_as<expr_identifier>(id).name);
+
+    if (state.base(id)->type != node_type::EXPR_BINARY || state.ast.get_as<expr_binary>(id).opr.type != core::token_type::DOUBLE_DOT)
+        return "";
+
+    const expr_binary& binary = state.ast.get_as<expr_binary>(id);
+    const std::string owner = written_path(state, binary.first);
+
+    return owner.empty() || !state.is_identifier(binary.second) ? "" : owner + ".." + state.name_of(state.ast.get_as<expr_identifier>(binary.second).name);
+}
+
+// A query only stays valid while every name it read still names the same declaration. What a name resolves
+// to is a query of its own, which reads the files the name could come from.
+static void note_target(semantic_state& state, const t_node_id id) {
+    if (!state.queries.computing() || !state.query_owner)
+        return;
+
+    const std::string owner = stable_name(state.process, state.query_owner);
+    const std::string path = written_path(state, id);
+
+    if (!owner.empty() && !path.empty())
+        state.queries.get<uint64_t>({ query_kind::IDENTIFIER_TARGET, state.queries.subject(owner + '\1' + path) });
+}
+
+// Every name path an expression or type reads, for queries that work from what was resolved before.
+static void note_targets(semantic_state& state, const t_node_id id) {
+    switch (state.base(id)->type) {
+        case node_type::EXPR_IDENTIFIER:
+            note_target(state, id);
+            break;
+        case node_type::EXPR_TYPE: {
+            note_target(state, state.ast.get_as<expr_type>(id).source);
+
+            // What the value folds to depends on what a typedec it is declared as expands to.
+            symbol* source = state.table.resolution(id);
+            if (source && source->kind == symbol_kind::TYPEDEC && !source->inner)
+                typedec_type(state, source, state.base(id)->selection);
+
+            for (const t_node_id argument : state.ast.get_as<expr_type>(id).argument_list)
+                note_targets(state, argument);
+            break;
+        }
+        case node_type::EXPR_UNARY:
+            note_targets(state, state.ast.get_as<expr_unary>(id).operand);
+            break;
+        case node_type::EXPR_BINARY: {
+            const expr_binary& binary = state.ast.get_as<expr_binary>(id);
+
+            if (binary.opr.type == core::token_type::DOUBLE_DOT) {
+                note_target(state, id);
+                break;
+            }
+
+            note_targets(state, binary.first);
+            note_targets(state, binary.second);
+            break;
+        }
+        case node_type::EXPR_TERNARY: {
+            const expr_ternary& ternary = state.ast.get_as<expr_ternary>(id);
+
+            note_targets(state, ternary.first);
+            note_targets(state, ternary.second);
+            note_targets(state, ternary.third);
+            break;
+        }
+        case node_type::EXPR_CALL: {
+            const expr_call& call = state.ast.get_as<expr_call>(id);
+
+            note_targets(state, call.callee);
+
+            for (const t_node_id argument : call.template_argument_list)
+                note_targets(state, argument);
+            for (const t_node_id argument : call.argument_list)
+                note_targets(state, argument);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Looks the path up from the scope of the declaration that reads it, recording every file it could come from.
+static uint64_t identifier_target(core::liprocess& process, query_engine& queries, const uint64_t subject) {
+    const std::string& name = queries.subject_name(subject);
+    const size_t split = name.find('\1');
+
+    const symbol* owner = stable_declaration(process, name.substr(0, split));
+    if (!owner || owner->file_id < 0)
+        return NO_SUBJECT;
+
+    queries.input({ query_kind::FILE_SOURCE, file_subject(process, queries, owner->file_id) });
+
+    for (const core::t_file_id used_id : process.file_list[owner->file_id].use_list)
+        queries.input({ query_kind::FILE_SOURCE, file_subject(process, queries, used_id) });
+
+    const std::string path = name.substr(split + 1);
+    symbol* found = nullptr;
+
+    for (size_t begin = 0; begin != std::string::npos; ) {
+        const size_t end = path.find("..", begin);
+        const core::t_name_id step = process.name_table.intern(path.substr(begin, end == std::string::npos ? std::string::npos : end - begin));
+
+        if (!found) {
+            for (const scope* at = owner->inner ? owner->inner : owner->parent; at && !found; at = at->parent)
+                found = symbol_table::lookup_in(at, step);
+        }
+        else
+            found = found->inner ? symbol_table::lookup_in(found->inner, step) : nullptr;
+
+        if (!found)
+            return NO_SUBJECT;
+
+        if (found->file_id >= 0)
+            queries.input({ query_kind::FILE_SOURCE, file_subject(process, queries, found->file_id) });
+
+        begin = end == std::string::npos ? end : end + 2;
+    }
+
+    const std::string target = stable_name(process, found);
+    return target.empty() ? NO_SUBJECT : queries.subject(target);
+}
+
+// Typedecs expand to the type they alias, which for generic ones is still written in terms of their
+// template parameters.
+static checked_fact<t_stable_type> expand_typedec(core::liprocess& process, query_engine& queries, symbol* declared) {
+    queries.input({ query_kind::FILE_SOURCE, file_subject(process, queries, declared->file_id) });
+
+    scope* base = declared->inner ? declared->inner : declared->parent;
+    symbol_table& table = file_table(process, declared->file_id);
+
+    std::vector<core::lilog> log_list;
+    semantic_state declaring(process, declared->file_id, table, table.arena, base, log_list);
+    declaring.query_owner = declared;
+
+    t_type_id result;
+
+    if (declared->interface_index != NO_INTERFACE_INDEX) {
+        const auto& iface = std::any_cast<const std::shared_ptr<core::frontend::module_interface>&>(process.file_list[declared->file_id].dump_interface);
+        result = interface_type(declaring, *iface, base, iface->decl(declared->interface_index).type);
+    }
+    else
+        result = resolve_type(declaring, declaring.ast.get_as<item_type_declaration>(declared->node).type_value);
+
+    return { stabilize(declaring, result), declaring.success, stable_logs(process, queries, log_list) };
+}
+
+// They are expanded on first use, so the order of declarations does not matter.
+static t_type_id typedec_type(semantic_state& state, symbol* typedec, const core::lisel& selection) {
+    // Every typedec is expanded before bodies are checked. Inside a query the dependency still has to be recorded.
+    if (typedec->type != NO_TYPE && !state.queries.computing())
+        return typedec->type;
+
+    const query_key key = { query_kind::DECLARATION_TYPE, declaration_subject(state, typedec) };
+
+    // Local typedecs are expanded where they are declared.
+    if (key.subject == NO_SUBJECT)
+        return typedec->type == NO_TYPE ? INVALID_TYPE : typedec->type;
+
+    const checked_fact<t_stable_type>* fact = state.queries.get<checked_fact<t_stable_type>>(key);
+
+    if (!fact) {
+        state.error(selection, "'" + state.name_of(typedec->name) + "' is defined in terms of itself.");
+        return INVALID_TYPE;
+    }
+
+    replay(state, key, *fact);
+
+    // Memoized or not, this symbol has not seen the value yet.
+    typedec->type = restore(state, fact->value);
+
+    return typedec->type;
+}
+
+// The types of the properties of a struct. Methods are resolved with their bodies.
+static checked_fact<std::vector<t_stable_type>> resolve_property_types(core::liprocess& process, query_engine& queries, symbol* declared) {
+    queries.input({ query_kind::FILE_SOURCE, file_subject(process, queries, declared->file_id) });
+
+    symbol_table& table = file_table(process, declared->file_id);
+
+    std::vector<core::lilog> log_list;
+    semantic_state declaring(process, declared->file_id, table, table.arena, declared->inner, log_list);
+    declaring.query_owner = declared;
+
+    std::vector<t_stable_type> type_list;
+
+    for (const t_node_id member : declaring.ast.get_as<item_struct_declaration>(declared->node).member_list) {
+        if (declaring.base(member)->type == node_type::EXPR_PROPERTY)
+            type_list.push_back(stabilize(declaring, resolve_type(declaring, declaring.ast.get_as<expr_property>(member).value_type)));
+    }
+
+    return { std::move(type_list), declaring.success, stable_logs(process, queries, log_list) };
+}
+
+// nullptr for structs that can not be named again, which resolve their properties themselves.
+static const checked_fact<std::vector<t_stable_type>>* property_types(semantic_state& state, const symbol* declared) {
+    const query_key key = { query_kind::MEMBER_TYPES, declaration_subject(state, declared) };
+
+    if (key.subject == NO_SUBJECT)
+        return nullptr;
+
+    const checked_fact<std::vector<t_stable_type>>* fact = state.queries.get<checked_fact<std::vector<t_stable_type>>>(key);
+
+    if (fact)
+        replay(state, key, *fact);
+
+    return fact;
+}
+
+// Parameter types followed by the return type. A missing return type means void.
+static t_type_id signature_type(semantic_state& state, std::vector<t_type_id>& parameter_type_list, const t_type_id return_type) {
+    for (t_type_id& parameter_type : parameter_type_list) {
+        if (parameter_type == NO_TYPE)
+            parameter_type = INVALID_TYPE;
+    }
+
+    parameter_type_list.push_back(return_type == NO_TYPE ? primitive_type(type_kind::VOID) : return_type);
+
+    return state.types.intern(type_kind::FUNCTION, nullptr, parameter_type_list.data(), static_cast<uint16_t>(parameter_type_list.size()));
+}
+
+static t_type_id interface_signature(semantic_state& state, const core::frontend::module_interface& iface, const scope* base, const uint32_t parameter_begin, const uint32_t parameter_count, const uint32_t return_type) {
+    std::vector<t_type_id> parameter_type_list;
+    parameter_type_list.reserve(parameter_count + 1);
+
+    for (uint32_t i = 0; i < parameter_count; i++)
+        parameter_type_list.push_back(interface_type(state, iface, base, iface.index(parameter_begin + i)));
+
+    return signature_type(state, parameter_type_list, interface_type(state, iface, base, return_type));
+}
+
+// Gives interface declarations their types. Runs once every use is imported, since types may name anything visible.
+static void type_interface(semantic_state& state, const core::frontend::module_interface& iface) {
+    namespace lii = core::frontend::lii;
+
+    for (uint32_t i = 0; i < iface.header().decl_count; i++) {
+        symbol* declared = state.table.interface_symbol_list[i];
+
+        // Reopened modules
+        if (!declared || declared->interface_index != i)
+            continue;
+
+        const lii::decl_entry& decl = iface.decl(i);
+
+        switch (declared->kind) {
+            case symbol_kind::VARIANT:
+                declared->type = interface_type(state, iface, declared->parent, decl.type);
+                break;
+            case symbol_kind::FUNCTION: {
+                const scope* base = declared->parent;
+
+                // Template parameters of functions are only needed to spell the signature.
+                if (decl.template_count != 0) {
+                    scope* template_scope = state.scopes.make_scope(scope_kind::FUNCTION, declared->parent, declared);
+                    declare_interface_templates(state.process, state.scopes, iface, decl, template_scope, declared);
+
+                    base = template_scope;
+                }
+
+                declared->type = interface_signature(state, iface, base, decl.parameter_begin, decl.parameter_count, decl.type);
+                break;
+            }
+            case symbol_kind::TYPEDEC:
+                typedec_type(state, declared, core::lisel(state.file_id, 0));
+                break;
+            case symbol_kind::STRUCT:
+                for (uint32_t m = 0; m < decl.member_count; m++) {
+                    const lii::member_entry& member = iface.member(decl.member_begin + m);
+                    symbol* member_symbol = symbol_table::lookup_in(declared->inner, iface.name(member.name));
+
+                    if (!member_symbol || member_symbol->interface_index != decl.member_begin + m)
+                        continue;
+
+                    if (member.kind == lii::member_kind::PROPERTY)
+                        member_symbol->type = interface_type(state, iface, declared->inner, member.type);
+                    else if (member.kind == lii::member_kind::METHOD)
+                        member_symbol->type = interface_signature(state, iface, declared->inner, member.parameter_begin, member.parameter_count, member.type);
+                }
+
+                if (declared->operators) {
+                    for (symbol* const* list : { declared->operators->unary_list, declared->operators->binary_list }) {
+                        for (size_t opr = 0; opr < core::TOKEN_TYPE_COUNT; opr++) {
+                            if (symbol* overload = list[opr]) {
+                                const lii::member_entry& member = iface.member(overload->interface_index);
+                                overload->type = interface_signature(state, iface, declared->inner, member.parameter_begin, member.parameter_count, member.type);
+                            }
+                        }
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/*
+
+====================================================
+
+Constants
+
+====================================================
+
+*/
+
+static const constant* constant_of(semantic_state& state, const symbol* found);
+
+// Folds id as the given type, or as its natural type if none was written. The value is recorded for the backend.
+static const constant* fold_constant(semantic_state& state, const t_node_id id, const t_type_id type) {
+    constant_context context(state.process, state.ast, state.table, state.log_sink);
+    context.lookup = [&state](const symbol* found) { return constant_of(state, found); };
+
+    type_kind kind;
+
+    if (type == NO_TYPE)
+        kind = natural_kind(context, id);
+    else {
+        const type_entry& entry = state.types.get(type);
+
+        // const is fine. Anything pointing somewhere else is not a value.
+        if (entry.kind == type_kind::POINTER || (entry.flags & (TYPE_LVALUE | TYPE_RVALUE)))
+            return nullptr;
+
+        kind = entry.kind;
+    }
+
+    constant value;
+    const bool folded = fold(context, id, kind, value);
+
+    if (!context.success)
+        state.success = false;
+
+    if (!folded)
+        return nullptr;
+
+    state.constant_sink->insert(static_cast<uint32_t>(id), value);
+    return state.constant_sink->find(static_cast<uint32_t>(id));
+}
+
+static inline bool is_constant_declaration(semantic_state& state, const symbol* found) {
+    return found->kind == symbol_kind::VARIANT && found->node != NO_NODE && found->type != NO_TYPE && (state.types.get(found->type).flags & TYPE_CONST);
+}
+
+// Folds a module level const declaration. The value was resolved before, so the names it reads are
+// recorded on their own, and so is the expansion of a typedec it is declared as.
+static checked_fact<constant> fold_declaration(core::liprocess& process, query_engine& queries, const symbol* declared) {
+    queries.input({ query_kind::FILE_SOURCE, file_subject(process, queries, declared->file_id) });
+
+    symbol_table& table = file_table(process, declared->file_id);
+
+    // Folds into a sink of its own. The caller records the value, whether it was just folded or memoized.
+    liutil::bump_arena arena(256);
+    liutil::flat_map<constant> constant_sink;
+    constant_sink.init(arena);
+
+    std::vector<core::lilog> log_list;
+    semantic_state declaring(process, declared->file_id, table, table.arena, declared->parent, log_list);
+    declaring.constant_sink = &constant_sink;
+    declaring.on_demand = true;
+    declaring.query_owner = declared;
+
+    const variant_declaration& declaration = declaring.ast.get_as<variant_declaration>(declared->node);
+
+    note_targets(declaring, declaration.value_type);
+    note_targets(declaring, declaration.value);
+
+    const constant* folded = fold_constant(declaring, declaration.value, declared->type);
+
+    constant value;
+    value.kind = type_kind::INVALID;
+    value.u = 0;
+
+    return { folded ? *folded : value, declaring.success, stable_logs(process, queries, log_list) };
+}
+
+// Value of a const declaration. Locals always come before their users. Module level ones may be
+// used before their own turn while declarations are folded, so they are folded on first use.
+static const constant* constant_of(semantic_state& state, const symbol* found) {
+    if (!is_constant_declaration(state, found))
+        return nullptr;
+
+    core::liprocess* process = &state.process;
+
+    if (!state.on_demand) {
+        const ast_arena& ast = std::any_cast<const ast_arena&>(process->file_list[found->file_id].dump_ast_arena);
+        const t_node_id value = ast.get_as<variant_declaration>(found->node).value;
+
+        if (const constant* folded = file_table(*process, found->file_id).constant_map.find(static_cast<uint32_t>(value)))
+            return folded;
+
+        return found->file_id == state.file_id ? state.constant_sink->find(static_cast<uint32_t>(value)) : nullptr;
+    }
+
+    const query_key key = { query_kind::CONSTANT_VALUE, declaration_subject(state, found) };
+    if (key.subject == NO_SUBJECT)
+        return nullptr;
+
+    const checked_fact<constant>* fact = state.queries.get<checked_fact<constant>>(key);
+    // Declarations that refer to each other in a circle simply never fold.
+    if (!fact)
+        return nullptr;
+
+    replay(state, key, *fact);
+
+    if (fact->value.kind != type_kind::INVALID) {
+        const ast_arena& ast = std::any_cast<const ast_arena&>(process->file_list[found->file_id].dump_ast_arena);
+        file_table(*process, found->file_id).constant_map.insert(static_cast<uint32_t>(ast.get_as<variant_declaration>(found->node).value), fact->value);
+    }
+
+    return fact->value.kind != type_kind::INVALID ? &fact->value : nullptr;
+}
+
+/*
+
+====================================================
+
+Expression types
+
+Every expression of a body gets its type recorded next to its resolution, as far as it is known. What
+is not known, like the result of an intrinsic or a module level value declared without a type, is
+NO_TYPE and never reported. Scalars convert into each other the way the backends convert them, so only
+values that can not be converted at all are errors.
+
+====================================================
+
+*/
+
+static inline bool is_known(const t_type_id id) {
+    return id != NO_TYPE && id != INVALID_TYPE;
+}
+
+// Integers, floats, bool and char. Enums are integers to every backend.
+static inline bool is_scalar(const type_kind kind) {
+    return (kind >= type_kind::U8 && kind <= type_kind::CHAR) || kind == type_kind::ENUM;
+}
+
+// Types spelled with template parameters are only checked once they are instantiated, which bodies never are.
+static bool is_generic(const type_table& types, const t_type_id id) {
+    const type_entry& entry = types.get(id);
+
+    if (entry.kind == type_kind::TEMPLATE_PARAMETER)
+        return true;
+
+    for (uint16_t i = 0; i < entry.argument_count; i++) {
+        if (is_known(entry.argument_list[i]) && is_generic(types, entry.argument_list[i]))
+            return true;
+    }
+
+    return false;
+}
+
+// Whether a value of type from can be passed, assigned or returned where a to is expected.
+static bool is_convertible(const type_table& types, const t_type_id from, const t_type_id to) {
+    if (!is_known(from) || !is_known(to) || is_generic(types, from) || is_generic(types, to))
+        return true;
+
+    const type_entry& source = types.get(types.get(from).base);
+    const type_entry& target = types.get(types.get(to).base);
+
+    if (types.get(from).base == types.get(to).base || (is_scalar(source.kind) && is_scalar(target.kind)))
+        return true;
+
+    switch (source.kind) {
+        // The empty value of everything a scalar is not.
+        case type_kind::NIL:
+            return !is_scalar(target.kind);
+        case type_kind::POINTER: {
+            if (target.kind != type_kind::POINTER)
+                return false;
+
+            const type_entry& from_pointee = types.get(types.get(source.argument_list[0]).base);
+            const type_entry& to_pointee = types.get(types.get(target.argument_list[0]).base);
+
+            return from_pointee.kind == type_kind::VOID || to_pointee.kind == type_kind::VOID || source.argument_list[0] == target.argument_list[0] ||
+                types.get(source.argument_list[0]).base == types.get(target.argument_list[0]).base;
+        }
+        // A generic struct names itself without arguments inside its own declaration.
+        case type_kind::STRUCT:
+            return target.kind == type_kind::STRUCT && source.source == target.source && (source.argument_count == 0 || target.argument_count == 0);
+        default:
+            return false;
+    }
+}
+
+// Reports value unless its type converts to expected. what names the place it goes, like "'x' holds a".
+static void expect_type(semantic_state& state, const t_node_id value, const t_type_id expected, const std::string& what) {
+    const t_type_id actual = state.table.type_of(value);
+
+    if (!is_convertible(state.types, actual, expected)) {
+        state.error(state.base(value)->selection, what + " '" + state.types.pretty_debug(state.process, expected) + "', not a '" +
+            state.types.pretty_debug(state.process, actual) + "'.");
+    }
+}
+
+// The type of the value a name refers to.
+static t_type_id value_type_of(const semantic_state& state, const symbol* found) {
+    if (!found)
+        return NO_TYPE;
+
+    switch (found->kind) {
+        case symbol_kind::VARIANT:
+        case symbol_kind::PARAMETER:
+        case symbol_kind::PROPERTY: {
+            if (found->type != NO_TYPE)
+                return found->type;
+
+            const auto inferred = state.inferred_type_map.find(found);
+            return inferred != state.inferred_type_map.end() ? inferred->second : NO_TYPE;
+        }
+        case symbol_kind::FUNCTION:
+        case symbol_kind::METHOD:
+            return found->type;
+        case symbol_kind::ENUM_SET:
+            return found->parent && found->parent->owner ? found->parent->owner->type : NO_TYPE;
+        default:
+            return NO_TYPE;
+    }
+}
+
+// object.name. Properties and methods of a struct or of the struct a pointer points to, with the arguments
+// of an instance filled in.
+static t_type_id member_type(semantic_state& state, const expr_binary& binary) {
+    t_type_id object = state.table.type_of(binary.first);
+    if (!is_known(object) || !state.is_identifier(binary.second))
+        return NO_TYPE;
+
+    if (state.types.get(object).kind == type_kind::POINTER)
+        object = state.types.get(object).argument_list[0];
+
+    if (!is_known(object))
+        return NO_TYPE;
+
+    const type_entry& entry = state.types.get(state.types.get(object).base);
+    if (entry.kind != type_kind::STRUCT || !entry.source->inner)
+        return NO_TYPE;
+
+    const expr_identifier& name = state.ast.get_as<expr_identifier>(binary.second);
+    const symbol* member = symbol_table::lookup_in(entry.source->inner, name.name);
+
+    if (!member || (member->kind != symbol_kind::PROPERTY && member->kind != symbol_kind::METHOD)) {
+        state.error(name.selection, "'" + state.name_of(name.name) + "' is not a member of '" + state.name_of(entry.source->name) + "'.");
+        return INVALID_TYPE;
+    }
+
+    if (!is_known(member->type))
+        return NO_TYPE;
+
+    const bool is_instance = entry.argument_count != 0 && entry.argument_count == entry.source->template_count;
+    return is_instance ? state.types.substitute(member->type, entry.source->template_list, entry.argument_list, entry.argument_count) : member->type;
+}
+
+// The function a callable symbol was declared with, if its file was parsed. Interfaces do not keep defaults.
+static const expr_function* declared_function(const semantic_state& state, const symbol* callee) {
+    if (!callee || callee->node == NO_NODE || !state.process.file_list[callee->file_id].dump_ast_arena.has_value())
+        return nullptr;
+
+    const ast_arena& ast = std::any_cast<const ast_arena&>(state.process.file_list[callee->file_id].dump_ast_arena);
+    t_node_id function = NO_NODE;
+
+    switch (ast.get_base_ptr(callee->node)->type) {
+        case node_type::VARIANT_DECLARATION: {
+            const t_node_id value = ast.get_as<variant_declaration>(callee->node).value;
+
+            if (ast.get_base_ptr(value)->type == node_type::EXPR_FUNCTION)
+                function = value;
+            else if (ast.get_base_ptr(value)->type == node_type::EXPR_CLOSURE)
+                function = ast.get_as<expr_closure>(value).function;
+            break;
+        }
+        case node_type::EXPR_METHOD:
+            function = ast.get_as<expr_method>(callee->node).function;
+            break;
+        default:
+            break;
+    }
+
+    return function == NO_NODE ? nullptr : &ast.get_as<expr_function>(function);
+}
+
+// Checks the arguments of a call against the signature it calls and returns its result. Calling a struct
+// constructs one. Intrinsics take anything and return NO_TYPE.
+static t_type_id check_call(semantic_state& state, const t_node_id id, const expr_call& call, const symbol* callee, const t_type_id signature_id) {
+    if (callee && callee->kind == symbol_kind::STRUCT)
+        return callee->type;
+
+    if (!is_known(signature_id) || state.types.get(signature_id).kind != type_kind::FUNCTION)
+        return NO_TYPE;
+
+    const type_entry& signature = state.types.get(signature_id);
+    const size_t parameter_count = signature.argument_count - 1u;
+
+    std::string name = "This function";
+    if (callee)
+        name = "'" + state.name_of(callee->name) + "'";
+    else if (state.base(call.callee)->type == node_type::EXPR_BINARY && state.is_identifier(state.ast.get_as<expr_binary>(call.callee).second))
+        name = "'" + state.name_of(state.ast.get_as<expr_identifier>(state.ast.get_as<expr_binary>(call.callee).second).name) + "'";
+
+    size_t required_count = parameter_count;
+
+    if (const expr_function* function = declared_function(state, callee)) {
+        required_count = 0;
+
+        for (const t_node_id parameter : function->parameter_list) {
+            if (state.base(state.ast.get_as<expr_parameter>(parameter).default_value)->type == node_type::EXPR_NONE)
+                required_count++;
+        }
+    }
+
+    if (call.argument_list.size() < required_count || call.argument_list.size() > parameter_count) {
+        const std::string expected = required_count == parameter_count ? std::to_string(parameter_count) : std::to_string(required_count) + " to " + std::to_string(parameter_count);
+
+        state.error(state.base(id)->selection, name + " takes " + expected + " argument(s), got " + std::to_string(call.argument_list.size()) + ".");
+    }
+
+    for (size_t i = 0; i < call.argument_list.size() && i < parameter_count; i++)
+        expect_type(state, call.argument_list[i], signature.argument_list[i], "Argument " + std::to_string(i + 1) + " of " + name + " is a");
+
+    return signature.argument_list[parameter_count];
+}
+
+// The type of a unary or binary expression that is not an overload, which already has its result.
+static t_type_id operator_type(semantic_state& state, const core::token_type opr, const t_node_id first, const t_node_id second = NO_NODE) {
+    const t_type_id first_type = state.table.type_of(first);
+
+    switch (opr) {
+        case core::token_type::BANG:
+        case core::token_type::DOUBLE_EQUAL:
+        case core::token_type::BANG_EQUAL:
+        case core::token_type::LARROW:
+        case core::token_type::RARROW:
+        case core::token_type::LESS_EQUAL:
+        case core::token_type::GREATER_EQUAL:
+        case core::token_type::DOUBLE_AMPERSAND:
+        case core::token_type::DOUBLE_PIPE:
+            return primitive_type(type_kind::BOOL);
+        case core::token_type::AT:
+            return is_known(first_type) ? state.types.pointer(first_type) : NO_TYPE;
+        case core::token_type::ASTERISK:
+            if (second != NO_NODE)
+                break;
+
+            return is_known(first_type) && state.types.get(first_type).kind == type_kind::POINTER ? state.types.get(first_type).argument_list[0] : NO_TYPE;
+        default:
+            break;
+    }
+
+    if (is_known(first_type) || second == NO_NODE)
+        return first_type;
+
+    return state.table.type_of(second);
+}
+
+/*
+
+====================================================
+
+Operators
+
+====================================================
+
+*/
+
+// Points id at the overload its left (or only) operand provides. The backend calls it directly. A struct
+// operand has no builtin meaning, so a struct without a fitting overload is an error. The operands are
+// typed already, whatever kind of expression they are. right is NO_NODE for unary operators.
+static void dispatch_operator(semantic_state& state, const t_node_id id, const core::token& opr, const t_node_id operand, const t_node_id right = NO_NODE) {
+    const bool is_binary = right != NO_NODE;
+
+    const t_type_id type = state.table.type_of(operand);
+    if (!is_known(type))
+        return;
+
+    const type_entry& entry = state.types.get(type);
+    if (entry.kind != type_kind::STRUCT)
+        return;
+
+    // Assigning a struct and taking its address mean what they always do.
+    if ((is_binary && opr.type == core::token_type::EQUAL) || (!is_binary && opr.type == core::token_type::AT))
+        return;
+
+    const std::string struct_name = state.name_of(entry.source->name);
+    const std::string opr_name = state.process.sub_source_code(opr.selection);
+
+    symbol* overload = entry.source->operators ? (is_binary ? entry.source->operators->binary_list : entry.source->operators->unary_list)[static_cast<size_t>(opr.type)] : nullptr;
+
+    if (!overload) {
+        state.error(opr.selection, "'" + struct_name + "' has no operator overload for " + (is_binary ? "binary" : "unary") + " '" + opr_name + "'.");
+        return;
+    }
+
+    if (overload->type == NO_TYPE)
+        return;
+
+    state.table.resolve(id, overload);
+
+    // The signature is written in terms of the struct's template parameters.
+    const bool is_instance = entry.argument_count == entry.source->template_count;
+
+    auto substitute = [&](const t_type_id written) {
+        return is_instance ? state.types.substitute(written, entry.source->template_list, entry.argument_list, entry.argument_count) : written;
+    };
+
+    const type_entry& signature = state.types.get(overload->type);
+
+    if (is_binary) {
+        const t_type_id parameter = substitute(signature.argument_list[0]);
+        const t_type_id argument = state.table.type_of(right);
+
+        // The right hand side converts like any other argument.
+        if (!is_convertible(state.types, argument, parameter)) {
+            state.error(state.base(right)->selection, "'" + opr_name + "' of '" + struct_name + "' takes a right hand side of type '" + state.types.pretty_debug(state.process, parameter) +
+                "', not '" + state.types.pretty_debug(state.process, argument) + "'.");
+        }
+    }
+
+    state.table.set_type(id, substitute(signature.argument_list[signature.argument_count - 1]));
+}
+
+// Arguments of '&&' parameters have to be temporaries or locals at their last read, which are moved in.
+static void bind_arguments(semantic_state& state, const expr_call& call, const type_entry& signature) {
+    if (signature.kind != type_kind::FUNCTION)
+        return;
+
+    const size_t parameter_count = signature.argument_count - 1;
+
+    for (size_t i = 0; i < call.argument_list.size() && i < parameter_count; i++) {
+        const t_type_id parameter = signature.argument_list[i];
+
+        if (parameter == NO_TYPE || parameter == INVALID_TYPE)
+            continue;
+
+        if (state.types.get(parameter).flags & TYPE_RVALUE)
+            state.check_move(call.argument_list[i]);
+    }
+}
+
+static bool is_assignment(const core::token_type opr) {
+    switch (opr) {
+        case core::token_type::EQUAL:
+        case core::token_type::PLUS_EQUAL:
+        case core::token_type::MINUS_EQUAL:
+        case core::token_type::ASTERISK_EQUAL:
+        case core::token_type::SLASH_EQUAL:
+        case core::token_type::PERCENT_EQUAL:
+        case core::token_type::CARET_EQUAL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+
+====================================================
+
+Resolution, continued
+
+====================================================
+
+*/
+
+static void resolve_closure(semantic_state& state, const t_node_id id);
+
+static void resolve_expression(semantic_state& state, const t_node_id id) {
+    switch (state.base(id)->type) {
+        case node_type::EXPR_IDENTIFIER: {
+            const symbol* found = resolve_identifier(state, id);
+
+            // Closures live in the frame of the function that declares them, so they can not go anywhere else.
+            if (is_closure(found))
+                state.error(state.base(id)->selection, "'" + state.name_of(found->name) + "' is a closure, which can only be called. It can not be passed on, stored or returned.");
+
+            state.note_read(found, id);
+            state.table.set_type(id, value_type_of(state, found));
+            break;
+        }
+        case node_type::EXPR_LITERAL:
+            switch (state.ast.get_as<expr_literal>(id).literal_type) {
+                case expr_literal::e_literal_type::FLOAT: state.table.set_type(id, primitive_type(type_kind::F64)); break;
+                case expr_literal::e_literal_type::INT: state.table.set_type(id, primitive_type(type_kind::I32)); break;
+                case expr_literal::e_literal_type::STRING: state.table.set_type(id, primitive_type(type_kind::STRING)); break;
+                case expr_literal::e_literal_type::CHAR: state.table.set_type(id, primitive_type(type_kind::CHAR)); break;
+                case expr_literal::e_literal_type::BOOL: state.table.set_type(id, primitive_type(type_kind::BOOL)); break;
+                case expr_literal::e_literal_type::NIL: state.table.set_type(id, NIL_TYPE); break;
+            }
+            break;
+        case node_type::EXPR_TYPE:
+            resolve_type(state, id);
+            break;
+        case node_type::EXPR_UNARY: {
+            const expr_unary& unary = state.ast.get_as<expr_unary>(id);
+
+            resolve_expression(state, unary.operand);
+            dispatch_operator(state, id, unary.opr, unary.operand);
+
+            if (state.table.type_of(id) == NO_TYPE)
+                state.table.set_type(id, operator_type(state, unary.opr.type, unary.operand));
+
+            if ((unary.opr.type == core::token_type::DOUBLE_PLUS || unary.opr.type == core::token_type::DOUBLE_MINUS) && state.is_identifier(unary.operand))
+                state.note_write(state.table.resolution(unary.operand), unary.operand);
+            break;
+        }
+        case node_type::EXPR_BINARY: {
+            const expr_binary& binary = state.ast.get_as<expr_binary>(id);
+
+            if (binary.opr.type == core::token_type::DOUBLE_DOT) {
+                state.table.set_type(id, value_type_of(state, resolve_scope_resolution(state, id)));
+                break;
+            }
+
+            // Assigning a local is not a read of it.
+            if (binary.opr.type == core::token_type::EQUAL && state.is_identifier(binary.first))
+                state.table.set_type(binary.first, value_type_of(state, resolve_identifier(state, binary.first)));
+            else
+                resolve_expression(state, binary.first);
+
+            if (is_assignment(binary.opr.type) && state.is_identifier(binary.first))
+                state.note_write(state.table.resolution(binary.first), binary.first);
+
+            // Member names depend on the type of the object and are checked with types.
+            if (binary.opr.type == core::token_type::DOT) {
+                state.table.set_type(id, member_type(state, binary));
+                break;
+            }
+
+            resolve_expression(state, binary.second);
+            dispatch_operator(state, id, binary.opr, binary.first, binary.second);
+
+            if (state.table.type_of(id) != NO_TYPE)
+                break;
+
+            if (is_assignment(binary.opr.type)) {
+                std::string target = "The target";
+                if (state.is_identifier(binary.first))
+                    target = "'" + state.name_of(state.ast.get_as<expr_identifier>(binary.first).name) + "'";
+                else if (state.base(binary.first)->type == node_type::EXPR_BINARY && state.is_identifier(state.ast.get_as<expr_binary>(binary.first).second))
+                    target = "'" + state.name_of(state.ast.get_as<expr_identifier>(state.ast.get_as<expr_binary>(binary.first).second).name) + "'";
+
+                expect_type(state, binary.second, state.table.type_of(binary.first), target + " holds a");
+                state.table.set_type(id, state.table.type_of(binary.first));
+            } else {
+                state.table.set_type(id, operator_type(state, binary.opr.type, binary.first, binary.second));
+            }
+
+            break;
+        }
+        case node_type::EXPR_TERNARY: {
+            const expr_ternary& ternary = state.ast.get_as<expr_ternary>(id);
+
+            resolve_expression(state, ternary.first);
+            resolve_expression(state, ternary.second);
+            resolve_expression(state, ternary.third);
+
+            state.table.set_type(id, is_known(state.table.type_of(ternary.second)) ? state.table.type_of(ternary.second) : state.table.type_of(ternary.third));
+            break;
+        }
+        case node_type::EXPR_CALL: {
+            const expr_call& call = state.ast.get_as<expr_call>(id);
+
+            if (state.is_identifier(call.callee))
+                state.note_call(resolve_identifier(state, call.callee), call.callee);
+            else
+                resolve_expression(state, call.callee);
+
+            std::vector<t_type_id> template_argument_list;
+            template_argument_list.reserve(call.template_argument_list.size());
+
+            for (const t_node_id argument : call.template_argument_list) {
+                const t_type_id argument_type = resolve_type(state, argument);
+                template_argument_list.push_back(argument_type == NO_TYPE ? INVALID_TYPE : argument_type);
+            }
+
+            // Intrinsics like bit_cast take anything. Generic functions and methods are instantiated.
+            symbol* callee = state.table.resolution(call.callee);
+
+            if (!template_argument_list.empty() && callee && (callee->kind == symbol_kind::FUNCTION || callee->kind == symbol_kind::METHOD))
+                state.table.set_type(call.callee, instantiate(state, callee, template_argument_list, state.base(call.callee)->selection));
+
+            for (const t_node_id argument : call.argument_list)
+                resolve_expression(state, argument);
+
+            const t_type_id signature_id = state.table.type_of(call.callee) != NO_TYPE ? state.table.type_of(call.callee) : callee ? callee->type : NO_TYPE;
+
+            if (callee && callee->kind == symbol_kind::FUNCTION && signature_id != NO_TYPE && signature_id != INVALID_TYPE)
+                bind_arguments(state, call, state.types.get(signature_id));
+
+            state.table.set_type(id, check_call(state, id, call, callee, signature_id));
+            break;
+        }
+        case node_type::VARIANT_DECLARATION: {
+            const variant_declaration& declaration = state.ast.get_as<variant_declaration>(id);
+
+            if (state.base(declaration.value)->type == node_type::EXPR_CLOSURE) {
+                resolve_closure(state, id);
+                break;
+            }
+
+            const t_type_id value_type = resolve_type(state, declaration.value_type);
+
+            // Resolve first so 'dec x = x' refers to an outer x.
+            resolve_expression(state, declaration.value);
+
+            if (!state.is_identifier(declaration.name)) {
+                state.error(state.base(declaration.name)->selection, "Local declarations can not be qualified.");
+                break;
+            }
+
+            const std::string name = state.name_of(state.ast.get_as<expr_identifier>(declaration.name).name);
+
+            if (value_type != NO_TYPE)
+                expect_type(state, declaration.value, value_type, "'" + name + "' holds a");
+
+            if (symbol* declared = state.declare(symbol_kind::VARIANT, declaration.name, id)) {
+                declared->type = value_type;
+
+                if (value_type == NO_TYPE && is_known(state.table.type_of(declaration.value)))
+                    state.inferred_type_map[declared] = state.types.get(state.table.type_of(declaration.value)).base;
+
+                if (!state.body_task_list)
+                    state.local_use_map[declared].loop_depth = state.loop_depth;
+            }
+
+            fold_constant(state, declaration.value, value_type);
+            break;
+        }
+        case node_type::EXPR_CLOSURE:
+            if (state.body_task_list)
+                state.error(state.base(id)->selection, "Closures can only be declared in function bodies. Declare a function instead.");
+            else
+                state.error(state.base(id)->selection, "Closures have to be declared with 'dec' and called by their name.");
+            break;
+        default:
+            break;
+    }
+}
+
+// A return has to give what the function it is in returns. Constructors and destructors return nothing.
+static void check_return(semantic_state& state, const t_node_id id, const t_node_id expression) {
+    const symbol* function = nullptr;
+    for (const scope* at = state.scopes.current(); at && !function; at = at->parent) {
+        if (at->kind == scope_kind::FUNCTION)
+            function = at->owner;
+    }
+
+    if (!function || (function->kind != symbol_kind::FUNCTION && function->kind != symbol_kind::METHOD && function->kind != symbol_kind::OPERATOR) || !is_known(function->type))
+        return;
+
+    const type_entry& signature = state.types.get(function->type);
+    if (signature.kind != type_kind::FUNCTION)
+        return;
+
+    const t_type_id expected = signature.argument_list[signature.argument_count - 1];
+    if (!is_known(expected))
+        return;
+
+    const bool is_void = state.types.get(state.types.get(expected).base).kind == type_kind::VOID;
+    const bool has_value = state.base(expression)->type != node_type::EXPR_NONE;
+
+    const std::string name = function->kind == symbol_kind::OPERATOR ? "This operator" : "'" + state.name_of(function->name) + "'";
+
+    if (is_void && has_value)
+        state.error(state.base(expression)->selection, name + " returns nothing, so its 'return' can not give a value.");
+    else if (!is_void && !has_value)
+        state.error(state.base(id)->selection, name + " returns a '" + state.types.pretty_debug(state.process, expected) + "', so its 'return' needs a value.");
+    else if (has_value)
+        expect_type(state, expression, expected, name + " returns a");
+}
+
+static void resolve_statement(semantic_state& state, const t_node_id id) {
+    switch (state.base(id)->type) {
+        case node_type::ITEM_BODY:
+            state.scopes.push_scope(scope_kind::BLOCK);
+
+            for (const t_node_id statement : state.ast.get_as<item_body>(id).item_list)
+                resolve_statement(state, statement);
+
+            state.scopes.pop_scope();
+            break;
+        case node_type::STMT_IF: {
+            const stmt_if& statement = state.ast.get_as<stmt_if>(id);
+
+            resolve_expression(state, statement.condition);
+            fold_constant(state, statement.condition, primitive_type(type_kind::BOOL));
+            resolve_statement(state, statement.consequent);
+            resolve_statement(state, statement.alternate);
+            break;
+        }
+        case node_type::STMT_WHILE: {
+            const stmt_while& statement = state.ast.get_as<stmt_while>(id);
+
+            state.loop_depth++;
+            resolve_expression(state, statement.condition);
+            fold_constant(state, statement.condition, primitive_type(type_kind::BOOL));
+            resolve_statement(state, statement.consequent);
+            state.loop_depth--;
+
+            resolve_statement(state, statement.alternate);
+            break;
+        }
+        case node_type::STMT_RETURN: {
+            const t_node_id expression = state.ast.get_as<stmt_return>(id).expression;
+
+            resolve_expression(state, expression);
+            check_return(state, id, expression);
+            break;
+        }
+        case node_type::ITEM_TYPE_DECLARATION: {
+            const item_type_declaration& declaration = state.ast.get_as<item_type_declaration>(id);
+
+            if (declaration.parameter_list.empty()) {
+                const t_type_id type_value = resolve_type(state, declaration.type_value);
+
+                if (symbol* declared = state.is_identifier(declaration.name) ? state.declare(symbol_kind::TYPEDEC, declaration.name, id) : nullptr)
+                    declared->type = type_value;
+                break;
+            }
+
+            symbol* declared = state.is_identifier(declaration.name) ? state.declare(symbol_kind::TYPEDEC, declaration.name, id) : nullptr;
+            scope* parameter_scope = state.scopes.push_scope(scope_kind::BLOCK, declared);
+
+            if (declared)
+                declared->inner = parameter_scope;
+
+            state.declare_templates(declared, declaration.parameter_list);
+
+            const t_type_id type_value = resolve_type(state, declaration.type_value);
+            if (declared)
+                declared->type = type_value == NO_TYPE ? INVALID_TYPE : type_value;
+
+            state.scopes.pop_scope();
+            break;
+        }
+        case node_type::STMT_NONE:
+        case node_type::STMT_INVALID:
+        case node_type::STMT_BREAK:
+        case node_type::STMT_CONTINUE:
+            break;
+        default:
+            resolve_expression(state, id);
+    }
+}
+
+// Signatures are resolved right away. The body is queued and checked later, in parallel with every other body.
+// initializer_list is only set for constructors. The initializers see the parameters.
+static void resolve_function(semantic_state& state, const t_node_id id, symbol* owner, const t_node_list* initializer_list = nullptr) {
+    const expr_function& function = state.ast.get_as<expr_function>(id);
+
+    scope* function_scope = state.scopes.push_scope(scope_kind::FUNCTION, owner);
+
+    // Constructors are owned by their struct, which already has a type.
+    const bool owns_signature = owner && (owner->kind == symbol_kind::FUNCTION || owner->kind == symbol_kind::METHOD || owner->kind == symbol_kind::OPERATOR);
+
+    state.declare_templates(owns_signature ? owner : nullptr, function.template_parameter_list);
+
+    std::vector<t_type_id> parameter_type_list;
+    parameter_type_list.reserve(function.parameter_list.size() + 1);
+
+    for (const t_node_id parameter_id : function.parameter_list) {
+        const expr_parameter& parameter = state.ast.get_as<expr_parameter>(parameter_id);
+
+        parameter_type_list.push_back(resolve_type(state, parameter.value_type));
+        resolve_expression(state, parameter.default_value);
+        expect_type(state, parameter.default_value, parameter_type_list.back(), "This parameter holds a");
+
+        if (symbol* declared = state.declare(symbol_kind::PARAMETER, parameter.name, parameter_id))
+            declared->type = parameter_type_list.back();
+    }
+
+    const t_type_id function_type = signature_type(state, parameter_type_list, resolve_type(state, function.return_type));
+    state.table.set_type(id, function_type);
+
+    if (owns_signature)
+        owner->type = function_type;
+
+    if (initializer_list) {
+        const scope* struct_scope = function_scope->parent;
+
+        for (const t_node_id set_id : *initializer_list) {
+            const expr_initializer_set& set = state.ast.get_as<expr_initializer_set>(set_id);
+
+            resolve_expression(state, set.value);
+
+            if (!state.is_identifier(set.property_name))
+                continue;
+
+            const expr_identifier& property_name = state.ast.get_as<expr_identifier>(set.property_name);
+
+            symbol* property = struct_scope ? symbol_table::lookup_in(struct_scope, property_name.name) : nullptr;
+
+            if (!property || property->kind != symbol_kind::PROPERTY)
+                state.error(property_name.selection, "'" + state.name_of(property_name.name) + "' is not a property of this struct.");
+            else
+                state.table.resolve(set.property_name, property);
+        }
+    }
+
+    state.body_task_list->push_back({ state.file_id, function.body, function_scope });
+
+    state.scopes.pop_scope();
+}
+
+// dec f = |x: i64|: i64 { ... }. A closure is checked where it is declared, as part of the body around
+// it, and only declared once its own body is done, so it can not call itself.
+static void resolve_closure(semantic_state& state, const t_node_id id) {
+    const variant_declaration& declaration = state.ast.get_as<variant_declaration>(id);
+    const expr_function& function = state.ast.get_as<expr_function>(state.ast.get_as<expr_closure>(declaration.value).function);
+
+    if (!state.is_identifier(declaration.name)) {
+        state.error(state.base(declaration.name)->selection, "Local declarations can not be qualified.");
+        return;
+    }
+
+    if (state.base(declaration.value_type)->type != node_type::EXPR_NONE)
+        state.error(state.base(declaration.value_type)->selection, "Closures have the type of their signature, so none can be written.");
+
+    const expr_identifier& name = state.ast.get_as<expr_identifier>(declaration.name);
+
+    const symbol* enclosing = nullptr;
+    for (const scope* at = state.scopes.current(); at && !enclosing; at = at->parent) {
+        if (at->kind == scope_kind::FUNCTION)
+            enclosing = at->owner;
+    }
+
+    if (!state.closure_name_set.insert({ enclosing, name.name }).second)
+        state.error(name.selection, "'" + state.name_of(name.name) + "' already names a closure in this function. Closures need names of their own within a function.");
+
+    symbol* declared = state.scopes.make_symbol(symbol_kind::FUNCTION, name.name, id);
+    scope* function_scope = state.scopes.push_scope(scope_kind::FUNCTION, declared);
+
+    std::vector<t_type_id> parameter_type_list;
+    parameter_type_list.reserve(function.parameter_list.size() + 1);
+
+    for (const t_node_id parameter_id : function.parameter_list) {
+        const expr_parameter& parameter = state.ast.get_as<expr_parameter>(parameter_id);
+
+        parameter_type_list.push_back(resolve_type(state, parameter.value_type));
+        resolve_expression(state, parameter.default_value);
+        expect_type(state, parameter.default_value, parameter_type_list.back(), "This parameter holds a");
+
+        if (symbol* parameter_symbol = state.declare(symbol_kind::PARAMETER, parameter.name, parameter_id))
+            parameter_symbol->type = parameter_type_list.back();
+    }
+
+    declared->type = signature_type(state, parameter_type_list, resolve_type(state, function.return_type));
+    state.table.set_type(state.ast.get_as<expr_closure>(declaration.value).function, declared->type);
+
+    // Loops around the declaration do not repeat anything within one call.
+    const uint32_t loop_depth = state.loop_depth;
+
+    state.closure_stack.push_back({ declared, function_scope, id, loop_depth, {} });
+    state.loop_depth = 0;
+
+    resolve_statement(state, function.body);
+
+    state.loop_depth = loop_depth;
+
+    const std::vector<const symbol*>& capture_list = state.closure_stack.back().capture_list;
+
+    if (!capture_list.empty()) {
+        const symbol** list = state.scopes.arena.make_array<const symbol*>(capture_list.size());
+        std::copy(capture_list.begin(), capture_list.end(), list);
+
+        declared->capture_list = list;
+        declared->capture_count = static_cast<uint16_t>(capture_list.size());
+    }
+
+    state.closure_stack.pop_back();
+    state.scopes.pop_scope();
+
+    if (state.scopes.declare(declared)) {
+        state.error(name.selection, "'" + state.name_of(name.name) + "' is already declared in this scope.");
+        return;
+    }
+
+    state.table.resolve(declaration.name, declared);
+    state.table.resolve(id, declared);
+}
+
+static void resolve_struct(semantic_state& state, const t_node_id id) {
+    const item_struct_declaration& declaration = state.ast.get_as<item_struct_declaration>(id);
+
+    symbol* declared = state.table.resolution(id);
+    if (!declared)
+        return;
+
+    state.scopes.enter(declared->inner);
+
+    const checked_fact<std::vector<t_stable_type>>* properties = property_types(state, declared);
+    size_t property_index = 0;
+
+    for (const t_node_id member : declaration.member_list) {
+        switch (state.base(member)->type) {
+            case node_type::EXPR_PROPERTY: {
+                const expr_property& property = state.ast.get_as<expr_property>(member);
+
+                t_type_id value_type;
+
+                if (properties && property_index < properties->value.size()) {
+                    value_type = restore(state, properties->value[property_index++]);
+                    state.table.set_type(property.value_type, value_type);
+                }
+                else
+                    value_type = resolve_type(state, property.value_type);
+
+                resolve_expression(state, property.default_value);
+                expect_type(state, property.default_value, value_type, "This property holds a");
+
+                if (symbol* declared_property = state.table.resolution(member))
+                    declared_property->type = value_type;
+                break;
+            }
+            case node_type::EXPR_METHOD:
+                resolve_function(state, state.ast.get_as<expr_method>(member).function, state.table.resolution(member));
+                break;
+            case node_type::EXPR_OPERATOR: {
+                symbol* overload = state.table.resolution(member);
+                resolve_function(state, state.ast.get_as<expr_operator>(member).function, overload ? overload : declared);
+                break;
+            }
+            case node_type::EXPR_CONSTRUCTOR: {
+                const expr_constructor& constructor = state.ast.get_as<expr_constructor>(member);
+                resolve_function(state, constructor.function, declared, &constructor.initializer_list);
+                break;
+            }
+            case node_type::EXPR_DESTRUCTOR: {
+                scope* function_scope = state.scopes.make_scope(scope_kind::FUNCTION, declared->inner, declared);
+                state.body_task_list->push_back({ state.file_id, state.ast.get_as<expr_destructor>(member).body, function_scope });
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    state.scopes.pop_scope();
+}
+
+static void resolve_item(semantic_state& state, const t_node_id id) {
+    switch (state.base(id)->type) {
+        case node_type::ITEM_MODULE: {
+            symbol* module = state.table.resolution(id);
+            if (!module)
+                return;
+
+            state.scopes.enter(module->inner);
+            resolve_item(state, state.ast.get_as<item_module>(id).content);
+            state.scopes.pop_scope();
+            break;
+        }
+        case node_type::ITEM_BODY:
+            for (const t_node_id item : state.ast.get_as<item_body>(id).item_list)
+                resolve_item(state, item);
+            break;
+        case node_type::VARIANT_DECLARATION: {
+            const variant_declaration& declaration = state.ast.get_as<variant_declaration>(id);
+
+            const t_type_id value_type = resolve_type(state, declaration.value_type);
+
+            if (symbol* declared = state.table.resolution(id))
+                declared->type = value_type;
+
+            if (state.base(declaration.value)->type == node_type::EXPR_FUNCTION) {
+                resolve_function(state, declaration.value, state.table.resolution(id));
+                break;
+            }
+
+            resolve_expression(state, declaration.value);
+
+            if (value_type != NO_TYPE && state.is_identifier(declaration.name))
+                expect_type(state, declaration.value, value_type, "'" + state.name_of(state.ast.get_as<expr_identifier>(declaration.name).name) + "' holds a");
+            break;
+        }
+        case node_type::ITEM_TYPE_DECLARATION: {
+            const item_type_declaration& declaration = state.ast.get_as<item_type_declaration>(id);
+
+            if (symbol* declared = state.table.resolution(id))
+                typedec_type(state, declared, state.base(declaration.name)->selection);
+            break;
+        }
+        case node_type::ITEM_STRUCT_DECLARATION:
+            resolve_struct(state, id);
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+
+====================================================
+
+Entry
+
+Phase 1 (serial): collect the declarations of every file, import uses and resolve every signature.
+    After this the module, struct and function scopes never change again.
+Phase 2 (parallel): check every function body on the worker pool. Names are resolved and every
+    expression is typed: calls against their signatures, initializers and assignments against what
+    they set, returns against the function. A body only ever writes to its own block scopes, its own
+    arena, its own slots in the resolution and type lists and its own log sink.
+
+====================================================
+
+*/
+
+// Module level values are folded in declaration order. A const declaration that was used before its
+// own turn was already folded then, and is not folded (or reported) a second time.
+static void fold_item(semantic_state& state, const t_node_id id) {
+    switch (state.base(id)->type) {
+        case node_type::ITEM_MODULE: {
+            const item_module& module = state.ast.get_as<item_module>(id);
+
+            if (state.base(module.content)->type == node_type::ITEM_BODY)
+                fold_item(state, module.content);
+            break;
+        }
+        case node_type::ITEM_BODY:
+            for (const t_node_id item : state.ast.get_as<item_body>(id).item_list)
+                fold_item(state, item);
+            break;
+        case node_type::VARIANT_DECLARATION: {
+            const variant_declaration& declaration = state.ast.get_as<variant_declaration>(id);
+            const symbol* declared = state.table.resolution(id);
+
+            if (!declared || state.base(declaration.value)->type == node_type::EXPR_FUNCTION)
+                break;
+
+            if (is_constant_declaration(state, declared))
+                constant_of(state, declared);
+            else
+                fold_constant(state, declaration.value, declared->type);
+            break;
+        }
+        case node_type::ITEM_ENUM:
+            for (const t_node_id set : state.ast.get_as<item_enum>(id).set_list) {
+                if (state.base(set)->type == node_type::EXPR_ENUM_SET)
+                    fold_constant(state, state.ast.get_as<expr_enum_set>(set).value, NO_TYPE);
+            }
+            break;
+        case node_type::ITEM_STRUCT_DECLARATION:
+            // Primitive property defaults, so generated constructors can assign them as they are.
+            for (const t_node_id member : state.ast.get_as<item_struct_declaration>(id).member_list) {
+                if (state.base(member)->type != node_type::EXPR_PROPERTY)
+                    continue;
+
+                const expr_property& property = state.ast.get_as<expr_property>(member);
+                const symbol* declared = state.table.resolution(member);
+
+                if (declared && declared->type != NO_TYPE && is_foldable(state.types.get(declared->type).kind) && state.base(property.default_value)->type != node_type::EXPR_NONE)
+                    fold_constant(state, property.default_value, declared->type);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static bool collect_declarations(core::liprocess& process, scope* builtin_scope, std::vector<body_task>& body_task_list) {
+    bool success = true;
+
+    for (size_t i = 0; i < process.file_list.size(); i++) {
+        core::liprocess::lifile& file = process.file_list[i];
+
+        if (file.is_interface_only()) {
+            auto table = std::make_shared<symbol_table>(static_cast<core::t_file_id>(i), 0, builtin_scope);
+            collect_interface(process, *table, *std::any_cast<const std::shared_ptr<core::frontend::module_interface>&>(file.dump_interface));
+            file.dump_symbol_table = table;
+            continue;
+        }
+
+        const ast_arena& ast = std::any_cast<const ast_arena&>(file.dump_ast_arena);
+        auto table = std::make_shared<symbol_table>(static_cast<core::t_file_id>(i), ast.node_list.size(), builtin_scope);
+        file.dump_symbol_table = table;
+
+        semantic_state state(process, static_cast<core::t_file_id>(i), *table, table->arena, table->root, process.log_list);
+
+        for (const t_node_id item : ast.get_as<ast_root>(0).item_list)
+            collect_item(state, item);
+
+        success &= state.success;
+    }
+
+    for (size_t i = 0; i < process.file_list.size(); i++)
+        import_uses(process, static_cast<core::t_file_id>(i));
+
+    for (size_t i = 0; i < process.file_list.size(); i++) {
+        core::liprocess::lifile& file = process.file_list[i];
+
+        if (!file.is_interface_only())
+            continue;
+
+        symbol_table& table = file_table(process, static_cast<core::t_file_id>(i));
+
+        semantic_state state(process, static_cast<core::t_file_id>(i), table, table.arena, table.root, process.log_list);
+        type_interface(state, *std::any_cast<const std::shared_ptr<core::frontend::module_interface>&>(file.dump_interface));
+
+        success &= state.success;
+    }
+
+    for (size_t i = 0; i < process.file_list.size(); i++) {
+        core::liprocess::lifile& file = process.file_list[i];
+
+        if (file.is_interface_only())
+            continue;
+
+        symbol_table& table = file_table(process, static_cast<core::t_file_id>(i));
+
+        semantic_state state(process, static_cast<core::t_file_id>(i), table, table.arena, table.root, process.log_list);
+        state.body_task_list = &body_task_list;
+
+        for (const t_node_id item : state.ast.get_as<ast_root>(0).item_list)
+            resolve_item(state, item);
+
+        success &= state.success;
+    }
+
+    // Every signature is known now, so consts may refer to each other across files in any order.
+    for (size_t i = 0; i < process.file_list.size(); i++) {
+        core::liprocess::lifile& file = process.file_list[i];
+
+        if (file.is_interface_only())
+            continue;
+
+        symbol_table& table = file_table(process, static_cast<core::t_file_id>(i));
+
+        semantic_state state(process, static_cast<core::t_file_id>(i), table, table.arena, table.root, process.log_list);
+        state.on_demand = true;
+
+        for (const t_node_id item : state.ast.get_as<ast_root>(0).item_list)
+            fold_item(state, item);
+
+        success &= state.success;
+    }
+
+    return success;
+}
+
+static bool check_bodies(core::liprocess& process, const std::vector<body_task>& body_task_list) {
+    std::vector<std::unique_ptr<liutil::bump_arena>> arena_list(body_task_list.size());
+    std::vector<std::vector<core::lilog>> log_sink_list(body_task_list.size());
+    std::vector<liutil::flat_map<constant>> constant_sink_list(body_task_list.size());
+    std::vector<uint8_t> success_list(body_task_list.size(), 1);
+
+    process.pool.parallel_for(body_task_list.size(), [&](const size_t i) {
+        const body_task& task = body_task_list[i];
+        symbol_table& table = file_table(process, task.file_id);
+
+        arena_list[i] = std::make_unique<liutil::bump_arena>(4 * 1024);
+        constant_sink_list[i].init(*arena_list[i]);
+
+        semantic_state state(process, task.file_id, table, *arena_list[i], task.function_scope, log_sink_list[i]);
+        state.constant_sink = &constant_sink_list[i];
+
+        resolve_statement(state, task.body);
+        state.finish_moves();
+
+        success_list[i] = state.success;
+    });
+
+    bool success = true;
+
+    // Task order is declaration order, so the logs come out the same no matter how the work was split.
+    for (size_t i = 0; i < body_task_list.size(); i++) {
+        const body_task& task = body_task_list[i];
+        symbol_table& table = file_table(process, task.file_id);
+
+        constant_sink_list[i].for_each([&table](const uint32_t node, const constant& value) {
+            table.constant_map.insert(node, value);
+        });
+
+        table.body_arena_list.push_back(std::move(arena_list[i]));
+        for (const core::lilog& log : log_sink_list[i])
+            process.log_list.push_back(log);
+
+        success &= success_list[i] != 0;
+    }
+
+    return success;
+}
+
+// Analyzes every loaded file at once. The entry point is just one of them, everything else was pulled in through its uses.
+bool core::frontend::semantic_analyze(liprocess& process, const t_file_id /*entry*/) {
+    if (!process.dump_type_table.has_value())
+        process.dump_type_table = std::make_shared<type_table>();
+
+    if (!process.dump_instance_cache.has_value())
+        process.dump_instance_cache = std::make_shared<instance_cache>();
+
+    if (!process.dump_path_trie.has_value())
+        process.dump_path_trie = std::make_shared<path_trie>();
+
+    if (!process.dump_query_engine.has_value())
+        process.dump_query_engine = std::make_shared<query_engine>();
+
+    if (!process.dump_builtin_table.has_value())
+        process.dump_builtin_table = make_builtin_table(process);
+
+    query_engine& queries = *std::any_cast<const t_query_engine_ptr&>(process.dump_query_engine);
+    queries.begin_analysis();
+
+    // Providers read the symbols of this analysis. What they memoize does not.
+    core::liprocess* analyzed = &process;
+
+    queries.provide<checked_fact<t_stable_type>>(query_kind::DECLARATION_TYPE, [analyzed](query_engine& engine, const uint64_t subject) {
+        symbol* declared = subject_declaration(*analyzed, engine, subject);
+        return declared && declared->kind == symbol_kind::TYPEDEC ? expand_typedec(*analyzed, engine, declared) : checked_fact<t_stable_type>{ {}, false, {} };
+    });
+
+    queries.provide<checked_fact<constant>>(query_kind::CONSTANT_VALUE, [analyzed](query_engine& engine, const uint64_t subject) {
+        const symbol* declared = subject_declaration(*analyzed, engine, subject);
+        if (declared && declared->kind == symbol_kind::VARIANT && declared->node != NO_NODE)
+            return fold_declaration(*analyzed, engine, declared);
+
+        checked_fact<constant> missing = { {}, false, {} };
+        missing.value.kind = type_kind::INVALID;
+        return missing;
+    });
+
+    queries.provide<checked_fact<std::vector<t_stable_type>>>(query_kind::MEMBER_TYPES, [analyzed](query_engine& engine, const uint64_t subject) {
+        symbol* declared = subject_declaration(*analyzed, engine, subject);
+        return declared && declared->kind == symbol_kind::STRUCT && declared->node != NO_NODE ?
+            resolve_property_types(*analyzed, engine, declared) : checked_fact<std::vector<t_stable_type>>{ {}, false, {} };
+    });
+
+    queries.provide<uint64_t>(query_kind::IDENTIFIER_TARGET, [analyzed](query_engine& engine, const uint64_t subject) {
+        return identifier_target(*analyzed, engine, subject);
+    });
+
+    for (size_t i = 0; i < process.file_list.size(); i++) {
+        const uint64_t source_hash = liutil::hash_bytes(process.file_list[i].source_code);
+        queries.set_input({ query_kind::FILE_SOURCE, file_subject(process, queries, static_cast<core::t_file_id>(i)) }, source_hash, source_hash);
+    }
+
+    scope* builtin_scope = std::any_cast<const t_symbol_table_ptr&>(process.dump_builtin_table)->root;
+
+    std::vector<body_task> body_task_list;
+
+    const bool declarations_success = collect_declarations(process, builtin_scope, body_task_list);
+    const bool body_success = check_bodies(process, body_task_list);
+
+    core::frontend::emit_interfaces(process);
+
+    return declarations_success && body_success;
+}
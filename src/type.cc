@@ -0,0 +1,186 @@
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "type.hh"
+#include "symbol.hh"
+
+static const char* const PRIMITIVE_TYPE_NAME_LIST[] = {
+    "u8", "u16", "u32", "u64",
+    "i8", "i16", "i32", "i64",
+    "f32", "f64",
+    "bool", "char", "string", "void",
+};
+
+const char* core::semantic::primitive_name(const type_kind kind) {
+    return is_primitive(kind) ? PRIMITIVE_TYPE_NAME_LIST[static_cast<uint8_t>(kind) - static_cast<uint8_t>(type_kind::U8)] : "";
+}
+
+bool core::semantic::type_table::key::operator==(const key& other) const {
+    return kind == other.kind && flags == other.flags && source == other.source && argument_count == other.argument_count &&
+        (argument_count == 0 || std::memcmp(argument_list, other.argument_list, sizeof(t_type_id) * argument_count) == 0);
+}
+
+size_t core::semantic::type_table::key_hash::operator()(const key& value) const {
+    uint64_t hash = static_cast<uint64_t>(value.kind) | (static_cast<uint64_t>(value.flags) << 8) | (static_cast<uint64_t>(value.argument_count) << 16);
+
+    hash = (hash ^ reinterpret_cast<uintptr_t>(value.source)) * 0x9E3779B97F4A7C15ull;
+
+    for (uint16_t i = 0; i < value.argument_count; i++)
+        hash = (hash ^ value.argument_list[i]) * 0x9E3779B97F4A7C15ull;
+
+    return static_cast<size_t>(hash ^ (hash >> 32));
+}
+
+core::semantic::type_table::type_table() {
+    // INVALID, every primitive and NIL, in type_kind order.
+    for (uint8_t kind = 0; kind <= static_cast<uint8_t>(type_kind::NIL); kind++)
+        intern(static_cast<type_kind>(kind), nullptr);
+}
+
+core::semantic::t_type_id core::semantic::type_table::intern(const type_kind kind, const symbol* source, const t_type_id* argument_list, const uint16_t argument_count, const uint8_t flags) {
+    // Qualified types always know their unqualified self.
+    const t_type_id base = flags != 0 ? intern(kind, source, argument_list, argument_count, 0) : 0;
+
+    const key lookup_key = { kind, flags, argument_count, source, argument_list };
+
+    {
+        std::shared_lock lock(mutex);
+
+        auto it = id_map.find(lookup_key);
+        if (it != id_map.end())
+            return it->second;
+    }
+
+    std::unique_lock lock(mutex);
+
+    // Another thread may have beaten us to it between the locks.
+    auto it = id_map.find(lookup_key);
+    if (it != id_map.end())
+        return it->second;
+
+    t_type_id* stored_argument_list = nullptr;
+    if (argument_count != 0) {
+        stored_argument_list = arena.make_array<t_type_id>(argument_count);
+        std::memcpy(stored_argument_list, argument_list, sizeof(t_type_id) * argument_count);
+    }
+
+    const t_type_id id = static_cast<t_type_id>(entry_list.size());
+    entry_list.push_back({ kind, flags, argument_count, flags != 0 ? base : id, source, stored_argument_list });
+    id_map.emplace(key{ kind, flags, argument_count, source, stored_argument_list }, id);
+
+    return id;
+}
+
+core::semantic::t_type_id core::semantic::type_table::qualify(const t_type_id id, const uint8_t flags) {
+    const type_entry& entry = get(id);
+
+    if (id == INVALID_TYPE || (entry.flags | flags) == entry.flags)
+        return id;
+
+    return intern(entry.kind, entry.source, entry.argument_list, entry.argument_count, entry.flags | flags);
+}
+
+core::semantic::t_type_id core::semantic::type_table::pointer(const t_type_id pointee) {
+    if (pointee == INVALID_TYPE)
+        return INVALID_TYPE;
+
+    return intern(type_kind::POINTER, nullptr, &pointee, 1);
+}
+
+core::semantic::t_type_id core::semantic::type_table::substitute(const t_type_id id, const t_type_id* from, const t_type_id* to, const uint16_t count) {
+    if (id == NO_TYPE || count == 0)
+        return id;
+
+    const type_entry& entry = get(id);
+
+    for (uint16_t i = 0; i < count; i++) {
+        if (entry.base == from[i])
+            return qualify(to[i], entry.flags);
+    }
+
+    if (entry.argument_count == 0)
+        return id;
+
+    std::vector<t_type_id> argument_list(entry.argument_list, entry.argument_list + entry.argument_count);
+    bool changed = false;
+
+    for (t_type_id& argument : argument_list) {
+        const t_type_id substituted = substitute(argument, from, to, count);
+
+        changed |= substituted != argument;
+        argument = substituted;
+    }
+
+    return changed ? intern(entry.kind, entry.source, argument_list.data(), entry.argument_count, entry.flags) : id;
+}
+
+const core::semantic::type_entry& core::semantic::type_table::get(const t_type_id id) const {
+    std::shared_lock lock(mutex);
+    return entry_list[id];
+}
+
+size_t core::semantic::type_table::size() const {
+    std::shared_lock lock(mutex);
+    return entry_list.size();
+}
+
+std::string core::semantic::type_table::pretty_debug(const liprocess& process, const t_type_id id) const {
+    if (id == NO_TYPE)
+        return "<none>";
+
+    const type_entry& entry = get(id);
+    std::string buffer;
+
+    if (entry.flags & TYPE_CONST)
+        buffer += "const ";
+
+    switch (entry.kind) {
+        case type_kind::INVALID:
+            buffer += "<invalid>";
+            break;
+        case type_kind::NIL:
+            buffer += "nil";
+            break;
+        case type_kind::POINTER:
+            buffer += '@' + pretty_debug(process, entry.argument_list[0]);
+            break;
+        case type_kind::FUNCTION:
+            buffer += '(';
+
+            for (uint16_t i = 0; i + 1 < entry.argument_count; i++) {
+                if (i != 0)
+                    buffer += ", ";
+                buffer += pretty_debug(process, entry.argument_list[i]);
+            }
+
+            buffer += "): " + pretty_debug(process, entry.argument_list[entry.argument_count - 1]);
+            break;
+        default:
+            if (is_primitive(entry.kind)) {
+                buffer += primitive_name(entry.kind);
+                break;
+            }
+
+            buffer += process.name_table.get(entry.source->name);
+
+            if (entry.argument_count != 0) {
+                buffer += '[';
+
+                for (uint16_t i = 0; i < entry.argument_count; i++) {
+                    if (i != 0)
+                        buffer += ", ";
+                    buffer += pretty_debug(process, entry.argument_list[i]);
+                }
+
+                buffer += ']';
+            }
+    }
+
+    if (entry.flags & TYPE_LVALUE)
+        buffer += '&';
+    if (entry.flags & TYPE_RVALUE)
+        buffer += "&&";
+
+    return buffer;
+}
@@ -0,0 +1,768 @@
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+#include "vm.hh"
+#include "jit.hh"
+#include "symbol.hh"
+
+using namespace core::backend;
+
+// Computed gotos are a GCC and Clang extension.
+#if defined(__GNUC__)
+    #define LICAN_VM_THREADED 1
+#else
+    #define LICAN_VM_THREADED 0
+#endif
+
+// Registers shared by every frame of a run, and how deep calls may nest.
+constexpr size_t VM_STACK_SIZE = 1 << 20;
+constexpr size_t VM_MAX_DEPTH = 1 << 16;
+
+// Machine code calls nest on the native stack, so past this depth calls stay in the interpreter.
+constexpr size_t VM_MAX_NATIVE_DEPTH = 1 << 10;
+
+static const char* const VM_OP_NAME_LIST[] = {
+#define LICAN_VM_NAME(name) #name,
+    LICAN_VM_OPCODES(LICAN_VM_NAME)
+#undef LICAN_VM_NAME
+};
+
+const char* core::backend::vm_op_name(const vm_op op) {
+    return VM_OP_NAME_LIST[static_cast<uint16_t>(op)];
+}
+
+vm_op core::backend::integer_op(const vm_op family, const ir_type type) {
+    vm_width width;
+
+    switch (type) {
+        case ir_type::I8: width = vm_width::S8; break;
+        case ir_type::I16: width = vm_width::S16; break;
+        case ir_type::I32: width = vm_width::S32; break;
+        case ir_type::I64: width = vm_width::S64; break;
+        case ir_type::U8: case ir_type::BOOL: width = vm_width::U8; break;
+        case ir_type::U16: width = vm_width::U16; break;
+        case ir_type::U32: width = vm_width::U32; break;
+        default: width = vm_width::U64; break;
+    }
+
+    return static_cast<vm_op>(static_cast<uint16_t>(family) + static_cast<uint16_t>(width));
+}
+
+uint32_t core::backend::vm_program::find(const t_file_id file_id, const std::string& name) const {
+    for (uint32_t i = 0; i < function_list.size(); i++) {
+        const vm_function& function = function_list[i];
+        const semantic::scope* parent = function.source->parent;
+
+        // The root scope of a file is the only module scope without an owner.
+        if (function.file_id == file_id && function.name == name && parent && parent->kind == semantic::scope_kind::MODULE && !parent->owner)
+            return i;
+    }
+
+    return UINT32_MAX;
+}
+
+// Registers hold integers extended from their width. T is the width.
+template <typename T>
+static inline uint64_t wrap(const uint64_t value) {
+    return static_cast<uint64_t>(static_cast<int64_t>(static_cast<T>(value)));
+}
+
+static inline uint64_t signed_divide(const uint64_t x, const uint64_t y) {
+    // INT64_MIN / -1 wraps instead of trapping, like every other overflow.
+    return y == UINT64_MAX ? 0 - x : static_cast<uint64_t>(static_cast<int64_t>(x) / static_cast<int64_t>(y));
+}
+
+static inline uint64_t signed_modulo(const uint64_t x, const uint64_t y) {
+    return y == UINT64_MAX ? 0 : static_cast<uint64_t>(static_cast<int64_t>(x) % static_cast<int64_t>(y));
+}
+
+static inline uint64_t integer_power(uint64_t base, uint64_t exponent) {
+    uint64_t result = 1;
+
+    while (exponent) {
+        if (exponent & 1)
+            result *= base;
+
+        base *= base;
+        exponent >>= 1;
+    }
+
+    return result;
+}
+
+static inline double round_f32(const double value) {
+    return static_cast<double>(static_cast<float>(value));
+}
+
+static uint64_t normalize(const uint64_t value, const ir_type type) {
+    switch (type) {
+        case ir_type::I8: return wrap<int8_t>(value);
+        case ir_type::I16: return wrap<int16_t>(value);
+        case ir_type::I32: return wrap<int32_t>(value);
+        case ir_type::U8: return wrap<uint8_t>(value);
+        case ir_type::U16: return wrap<uint16_t>(value);
+        case ir_type::U32: return wrap<uint32_t>(value);
+        case ir_type::BOOL: return value != 0;
+        default: return value;
+    }
+}
+
+// Floats that do not fit the integer they are converted to become 0.
+static vm_value convert(const vm_value value, const ir_type from, const ir_type to) {
+    vm_value result;
+
+    if (is_floating(from)) {
+        if (is_floating(to))
+            result.f = to == ir_type::F32 ? round_f32(value.f) : value.f;
+        else if (to == ir_type::BOOL)
+            result.u = value.f != 0;
+        else if (is_signed(to) && value.f >= -9223372036854775808.0 && value.f < 9223372036854775808.0)
+            result.u = normalize(static_cast<uint64_t>(static_cast<int64_t>(value.f)), to);
+        else if (!is_signed(to) && value.f >= 0 && value.f < 18446744073709551616.0)
+            result.u = normalize(static_cast<uint64_t>(value.f), to);
+        else
+            result.u = 0;
+
+        return result;
+    }
+
+    if (is_floating(to)) {
+        result.f = is_signed(from) ? static_cast<double>(value.i) : static_cast<double>(value.u);
+
+        if (to == ir_type::F32)
+            result.f = round_f32(result.f);
+
+        return result;
+    }
+
+    result.u = normalize(value.u, to);
+    return result;
+}
+
+// The i-th argument register of a call, stored four to a word after it.
+static inline uint16_t argument_register(const vm_instruction* word_list, const uint16_t i) {
+    const vm_instruction& word = word_list[i / 4];
+
+    switch (i % 4) {
+        case 0: return static_cast<uint16_t>(word.op);
+        case 1: return word.a;
+        case 2: return word.b;
+        default: return word.c;
+    }
+}
+
+static inline uint32_t target_of(const vm_instruction* at) {
+    return static_cast<uint32_t>(at->b) | static_cast<uint32_t>(at->c) << 16;
+}
+
+vm_op core::backend::quickened_convert(const ir_type from, const ir_type to) {
+    if (is_floating(from))
+        return from == ir_type::F64 && to == ir_type::F32 ? vm_op::F64_TO_F32 : vm_op::CONVERT;
+
+    if (to == ir_type::BOOL)
+        return vm_op::I_TO_BOOL;
+
+    if (to == ir_type::F32)
+        return is_signed(from) ? vm_op::S_TO_F32 : vm_op::U_TO_F32;
+
+    if (to == ir_type::F64)
+        return is_signed(from) ? vm_op::S_TO_F64 : vm_op::U_TO_F64;
+
+    return is_integer(to) || to == ir_type::PTR ? integer_op(vm_op::EXTEND_S8, to) : vm_op::CONVERT;
+}
+
+struct core::backend::vm_machine {
+    explicit vm_machine(vm_program& program) : program(program), stack(VM_STACK_SIZE) {}
+
+    vm_program& program;
+    std::vector<vm_value> stack;
+
+    size_t depth = 0; // Frames of the run, interpreted or not
+    size_t native_depth = 0; // Machine code frames on the native stack
+
+    bool jit = false;
+    std::string trap;
+};
+
+// Whether function has machine code. It gets some once count reaches threshold.
+static bool tier_up(vm_machine& machine, vm_function* function, uint32_t& count, const uint32_t threshold) {
+    if (machine.native_depth >= VM_MAX_NATIVE_DEPTH)
+        return false;
+
+    if (function->native)
+        return true;
+
+    if (function->is_jit_failed || ++count < threshold)
+        return false;
+
+    function->native = jit_compile(machine.program, *function);
+    function->is_jit_failed = !function->native;
+
+    return !function->is_jit_failed;
+}
+
+static inline uint32_t run_native(vm_machine& machine, vm_function* function, vm_value* registers, const uint32_t at) {
+    machine.native_depth++;
+    const uint32_t status = function->native->run(registers, &machine, at);
+    machine.native_depth--;
+
+    return status;
+}
+
+namespace {
+    struct vm_frame {
+        vm_function* function;
+        vm_value* registers;
+        vm_instruction* return_pc; // Where the caller continues, once this frame calls something
+        uint16_t result; // Register of the caller the result goes to
+    };
+}
+
+// PROFILE counts every pair of instructions that run one after the other. It is a separate
+// instantiation, so a normal run does not pay for it.
+template <bool PROFILE>
+static bool interpret(vm_machine& machine, vm_function* current, vm_value* r, vm_instruction* pc, vm_value& result) {
+    std::vector<vm_frame> frame_list;
+    frame_list.reserve(64);
+
+    vm_program& program = machine.program;
+    const vm_value* const stack_end = machine.stack.data() + machine.stack.size();
+    vm_function* const function_list = program.function_list.data();
+    vm_value* const global_list = program.global_list.data();
+    const bool quicken = program.quicken;
+    const bool jit = machine.jit;
+
+    uint64_t* const pair_count_list = program.pair_count_list.data();
+    uint16_t previous = 0;
+    (void)pair_count_list;
+    (void)previous;
+
+    frame_list.push_back({ current, r, nullptr, 0 });
+
+    vm_value returned;
+    returned.u = 0;
+
+    #define VM_PROFILE() \
+        if constexpr (PROFILE) { \
+            const uint16_t next_op = static_cast<uint16_t>(pc->op); \
+            pair_count_list[previous * static_cast<size_t>(vm_op::COUNT) + next_op]++; \
+            previous = next_op; \
+        }
+
+#if LICAN_VM_THREADED
+    static const void* const dispatch_table[] = {
+#define LICAN_VM_LABEL(name) &&op_##name,
+        LICAN_VM_OPCODES(LICAN_VM_LABEL)
+#undef LICAN_VM_LABEL
+    };
+
+    #define VM_CASE(name) op_##name:
+    #define VM_DISPATCH() { VM_PROFILE() goto *dispatch_table[static_cast<uint16_t>(pc->op)]; }
+    #define VM_NEXT() { pc++; VM_DISPATCH(); }
+
+    VM_DISPATCH();
+#else
+    #define VM_CASE(name) case vm_op::name:
+    #define VM_DISPATCH() { VM_PROFILE() continue; }
+    #define VM_NEXT() { pc++; VM_DISPATCH(); }
+
+    for (;;) switch (pc->op) {
+#endif
+
+    #define VM_INTEGER_HANDLER(NAME, T, EXPRESSION) \
+        VM_CASE(NAME) { \
+            const uint64_t x = r[pc->b].u; \
+            const uint64_t y = r[pc->c].u; \
+            (void)y; \
+            r[pc->a].u = wrap<T>(EXPRESSION); \
+            VM_NEXT(); \
+        }
+
+    #define VM_INTEGER_HANDLERS(FAMILY, EXPRESSION) \
+        VM_INTEGER_HANDLER(FAMILY##_S8, int8_t, EXPRESSION) \
+        VM_INTEGER_HANDLER(FAMILY##_S16, int16_t, EXPRESSION) \
+        VM_INTEGER_HANDLER(FAMILY##_S32, int32_t, EXPRESSION) \
+        VM_INTEGER_HANDLER(FAMILY##_S64, int64_t, EXPRESSION) \
+        VM_INTEGER_HANDLER(FAMILY##_U8, uint8_t, EXPRESSION) \
+        VM_INTEGER_HANDLER(FAMILY##_U16, uint16_t, EXPRESSION) \
+        VM_INTEGER_HANDLER(FAMILY##_U32, uint32_t, EXPRESSION) \
+        VM_INTEGER_HANDLER(FAMILY##_U64, uint64_t, EXPRESSION)
+
+    // Signedness of the width decides how division rounds and whether the exponent can be negative.
+    #define VM_CHECKED_HANDLER(NAME, T, CHECK, EXPRESSION) \
+        VM_CASE(NAME) { \
+            using width = T; \
+            const uint64_t x = r[pc->b].u; \
+            const uint64_t y = r[pc->c].u; \
+            CHECK \
+            r[pc->a].u = wrap<width>(EXPRESSION(x, y, std::is_signed_v<width>)); \
+            VM_NEXT(); \
+        }
+
+    #define VM_CHECKED_HANDLERS(FAMILY, CHECK, EXPRESSION) \
+        VM_CHECKED_HANDLER(FAMILY##_S8, int8_t, CHECK, EXPRESSION) \
+        VM_CHECKED_HANDLER(FAMILY##_S16, int16_t, CHECK, EXPRESSION) \
+        VM_CHECKED_HANDLER(FAMILY##_S32, int32_t, CHECK, EXPRESSION) \
+        VM_CHECKED_HANDLER(FAMILY##_S64, int64_t, CHECK, EXPRESSION) \
+        VM_CHECKED_HANDLER(FAMILY##_U8, uint8_t, CHECK, EXPRESSION) \
+        VM_CHECKED_HANDLER(FAMILY##_U16, uint16_t, CHECK, EXPRESSION) \
+        VM_CHECKED_HANDLER(FAMILY##_U32, uint32_t, CHECK, EXPRESSION) \
+        VM_CHECKED_HANDLER(FAMILY##_U64, uint64_t, CHECK, EXPRESSION)
+
+    #define VM_DIVIDE(x, y, is_signed) (is_signed ? signed_divide(x, y) : x / y)
+    #define VM_MODULO(x, y, is_signed) (is_signed ? signed_modulo(x, y) : x % y)
+    #define VM_POWER(x, y, is_signed) integer_power(x, y)
+
+    #define VM_FLOAT_HANDLER(NAME, ROUND, EXPRESSION) \
+        VM_CASE(NAME) { \
+            const double x = r[pc->b].f; \
+            const double y = r[pc->c].f; \
+            (void)y; \
+            r[pc->a].f = ROUND(EXPRESSION); \
+            VM_NEXT(); \
+        }
+
+    #define VM_COMPARISON_HANDLER(NAME, FIELD, OPERATOR) \
+        VM_CASE(NAME) { \
+            r[pc->a].u = r[pc->b].FIELD OPERATOR r[pc->c].FIELD; \
+            VM_NEXT(); \
+        }
+
+    #define VM_KEEP(value) (value)
+    #define VM_IMMEDIATE static_cast<uint64_t>(static_cast<int64_t>(static_cast<int16_t>(pc->c)))
+
+    // Back edges count towards compiling the function, and enter its machine code once it has some.
+    #define VM_JUMP(TARGET) { \
+        const uint32_t target = TARGET; \
+        if (jit && target <= static_cast<uint32_t>(pc - current->code.data()) && tier_up(machine, current, current->loop_count, JIT_LOOP_THRESHOLD)) { \
+            const uint32_t status = run_native(machine, current, r, target); \
+            if (status == JIT_TRAPPED) \
+                return false; \
+            if (status == JIT_RETURNED) { \
+                returned = r[0]; \
+                goto frame_returned; \
+            } \
+            pc = current->code.data() + status; \
+        } \
+        else \
+            pc = current->code.data() + target; \
+        VM_DISPATCH(); \
+    }
+
+    #define VM_JUMP_HANDLER(NAME, FIELD, OPERATOR) \
+        VM_CASE(NAME) { \
+            if (r[pc->a].FIELD OPERATOR r[pc->b].FIELD) \
+                VM_JUMP(target_of(pc + 1)) \
+            pc += 2; \
+            VM_DISPATCH(); \
+        }
+
+    // Rewraps b to the width of T, after applying OPERATION to it. Shared by extensions and ADDI.
+    #define VM_EXTEND_HANDLER(NAME, T, OPERATION) \
+        VM_CASE(NAME) { \
+            r[pc->a].u = wrap<T>(r[pc->b].u OPERATION); \
+            VM_NEXT(); \
+        }
+
+        VM_CASE(MOVE) {
+            r[pc->a] = r[pc->b];
+            VM_NEXT();
+        }
+        VM_CASE(CONVERT) {
+            const ir_type from = static_cast<ir_type>(pc->c >> 8);
+            const ir_type to = static_cast<ir_type>(pc->c & 0xFF);
+
+            if (quicken) {
+                const vm_op specialized = quickened_convert(from, to);
+
+                if (specialized != vm_op::CONVERT) {
+                    pc->op = specialized;
+                    VM_DISPATCH();
+                }
+            }
+
+            r[pc->a] = convert(r[pc->b], from, to);
+            VM_NEXT();
+        }
+        VM_CASE(LOAD_GLOBAL) {
+            r[pc->a] = global_list[target_of(pc)];
+            VM_NEXT();
+        }
+        VM_CASE(STORE_GLOBAL) {
+            global_list[target_of(pc)] = r[pc->a];
+            VM_NEXT();
+        }
+
+        VM_INTEGER_HANDLERS(ADD, x + y)
+        VM_INTEGER_HANDLERS(SUB, x - y)
+        VM_INTEGER_HANDLERS(MUL, x * y)
+        VM_CHECKED_HANDLERS(DIV, if (y == 0) goto division_by_zero;, VM_DIVIDE)
+        VM_CHECKED_HANDLERS(MOD, if (y == 0) goto division_by_zero;, VM_MODULO)
+        VM_CHECKED_HANDLERS(POW, if (std::is_signed_v<width> && static_cast<int64_t>(y) < 0) goto negative_power;, VM_POWER)
+        VM_INTEGER_HANDLERS(NEG, 0 - x)
+
+        VM_FLOAT_HANDLER(ADD_F32, round_f32, x + y)
+        VM_FLOAT_HANDLER(SUB_F32, round_f32, x - y)
+        VM_FLOAT_HANDLER(MUL_F32, round_f32, x * y)
+        VM_FLOAT_HANDLER(DIV_F32, round_f32, x / y)
+        VM_FLOAT_HANDLER(MOD_F32, round_f32, std::fmod(x, y))
+        VM_FLOAT_HANDLER(POW_F32, round_f32, std::pow(x, y))
+        VM_FLOAT_HANDLER(NEG_F32, VM_KEEP, -x)
+        VM_FLOAT_HANDLER(ADD_F64, VM_KEEP, x + y)
+        VM_FLOAT_HANDLER(SUB_F64, VM_KEEP, x - y)
+        VM_FLOAT_HANDLER(MUL_F64, VM_KEEP, x * y)
+        VM_FLOAT_HANDLER(DIV_F64, VM_KEEP, x / y)
+        VM_FLOAT_HANDLER(MOD_F64, VM_KEEP, std::fmod(x, y))
+        VM_FLOAT_HANDLER(POW_F64, VM_KEEP, std::pow(x, y))
+        VM_FLOAT_HANDLER(NEG_F64, VM_KEEP, -x)
+
+        VM_CASE(NOT) {
+            r[pc->a].u = !r[pc->b].u;
+            VM_NEXT();
+        }
+
+        VM_COMPARISON_HANDLER(EQ_I, u, ==)
+        VM_COMPARISON_HANDLER(NE_I, u, !=)
+        VM_COMPARISON_HANDLER(LT_S, i, <)
+        VM_COMPARISON_HANDLER(LE_S, i, <=)
+        VM_COMPARISON_HANDLER(GT_S, i, >)
+        VM_COMPARISON_HANDLER(GE_S, i, >=)
+        VM_COMPARISON_HANDLER(LT_U, u, <)
+        VM_COMPARISON_HANDLER(LE_U, u, <=)
+        VM_COMPARISON_HANDLER(GT_U, u, >)
+        VM_COMPARISON_HANDLER(GE_U, u, >=)
+        VM_COMPARISON_HANDLER(EQ_F, f, ==)
+        VM_COMPARISON_HANDLER(NE_F, f, !=)
+        VM_COMPARISON_HANDLER(LT_F, f, <)
+        VM_COMPARISON_HANDLER(LE_F, f, <=)
+        VM_COMPARISON_HANDLER(GT_F, f, >)
+        VM_COMPARISON_HANDLER(GE_F, f, >=)
+
+        VM_EXTEND_HANDLER(ADDI_S8, int8_t, + VM_IMMEDIATE)
+        VM_EXTEND_HANDLER(ADDI_S16, int16_t, + VM_IMMEDIATE)
+        VM_EXTEND_HANDLER(ADDI_S32, int32_t, + VM_IMMEDIATE)
+        VM_EXTEND_HANDLER(ADDI_S64, int64_t, + VM_IMMEDIATE)
+        VM_EXTEND_HANDLER(ADDI_U8, uint8_t, + VM_IMMEDIATE)
+        VM_EXTEND_HANDLER(ADDI_U16, uint16_t, + VM_IMMEDIATE)
+        VM_EXTEND_HANDLER(ADDI_U32, uint32_t, + VM_IMMEDIATE)
+        VM_EXTEND_HANDLER(ADDI_U64, uint64_t, + VM_IMMEDIATE)
+
+        VM_JUMP_HANDLER(JUMP_EQ_I, u, ==)
+        VM_JUMP_HANDLER(JUMP_NE_I, u, !=)
+        VM_JUMP_HANDLER(JUMP_LT_S, i, <)
+        VM_JUMP_HANDLER(JUMP_LE_S, i, <=)
+        VM_JUMP_HANDLER(JUMP_GT_S, i, >)
+        VM_JUMP_HANDLER(JUMP_GE_S, i, >=)
+        VM_JUMP_HANDLER(JUMP_LT_U, u, <)
+        VM_JUMP_HANDLER(JUMP_LE_U, u, <=)
+        VM_JUMP_HANDLER(JUMP_GT_U, u, >)
+        VM_JUMP_HANDLER(JUMP_GE_U, u, >=)
+
+        VM_CASE(MOVE_JUMP) {
+            r[pc->a] = r[pc->b];
+            VM_JUMP(target_of(pc + 1))
+        }
+
+        VM_EXTEND_HANDLER(EXTEND_S8, int8_t, )
+        VM_EXTEND_HANDLER(EXTEND_S16, int16_t, )
+        VM_EXTEND_HANDLER(EXTEND_S32, int32_t, )
+        VM_EXTEND_HANDLER(EXTEND_S64, int64_t, )
+        VM_EXTEND_HANDLER(EXTEND_U8, uint8_t, )
+        VM_EXTEND_HANDLER(EXTEND_U16, uint16_t, )
+        VM_EXTEND_HANDLER(EXTEND_U32, uint32_t, )
+        VM_EXTEND_HANDLER(EXTEND_U64, uint64_t, )
+
+        VM_CASE(S_TO_F32) {
+            r[pc->a].f = round_f32(static_cast<double>(r[pc->b].i));
+            VM_NEXT();
+        }
+        VM_CASE(S_TO_F64) {
+            r[pc->a].f = static_cast<double>(r[pc->b].i);
+            VM_NEXT();
+        }
+        VM_CASE(U_TO_F32) {
+            r[pc->a].f = round_f32(static_cast<double>(r[pc->b].u));
+            VM_NEXT();
+        }
+        VM_CASE(U_TO_F64) {
+            r[pc->a].f = static_cast<double>(r[pc->b].u);
+            VM_NEXT();
+        }
+        VM_CASE(F64_TO_F32) {
+            r[pc->a].f = round_f32(r[pc->b].f);
+            VM_NEXT();
+        }
+        VM_CASE(I_TO_BOOL) {
+            r[pc->a].u = r[pc->b].u != 0;
+            VM_NEXT();
+        }
+
+        VM_CASE(JUMP) {
+            VM_JUMP(target_of(pc))
+        }
+        VM_CASE(JUMP_IF) {
+            if (r[pc->a].u)
+                VM_JUMP(target_of(pc))
+            VM_NEXT();
+        }
+        VM_CASE(JUMP_IF_NOT) {
+            if (!r[pc->a].u)
+                VM_JUMP(target_of(pc))
+            VM_NEXT();
+        }
+        VM_CASE(CALL) {
+            vm_function* callee = function_list + pc->b;
+            vm_value* callee_registers = r + current->frame_template.size();
+
+            if (callee_registers + callee->frame_template.size() > stack_end || machine.depth >= VM_MAX_DEPTH)
+                goto stack_overflow;
+
+            std::memcpy(callee_registers, callee->frame_template.data(), callee->frame_template.size() * sizeof(vm_value));
+
+            for (uint16_t i = 0; i < pc->c; i++)
+                callee_registers[i] = r[argument_register(pc + 1, i)];
+
+            vm_instruction* const return_pc = pc + 1 + (pc->c + 3) / 4;
+            uint32_t entry = 0;
+
+            machine.depth++;
+
+            if (jit && tier_up(machine, callee, callee->call_count, JIT_CALL_THRESHOLD)) {
+                entry = run_native(machine, callee, callee_registers, 0);
+
+                if (entry == JIT_TRAPPED)
+                    return false;
+
+                if (entry == JIT_RETURNED) {
+                    machine.depth--;
+
+                    if (callee->return_type != ir_type::VOID)
+                        r[pc->a] = callee_registers[0];
+
+                    pc = return_pc;
+                    VM_DISPATCH();
+                }
+
+                // Deoptimized. The interpreter takes the frame over where the machine code stopped.
+            }
+
+            frame_list.back().return_pc = return_pc;
+            frame_list.push_back({ callee, callee_registers, nullptr, pc->a });
+
+            current = callee;
+            r = callee_registers;
+            pc = callee->code.data() + entry;
+            VM_DISPATCH();
+        }
+        VM_CASE(RETURN) {
+            returned = r[pc->a];
+            goto frame_returned;
+        }
+        VM_CASE(RETURN_VOID) {
+        frame_returned:
+            const uint16_t target = frame_list.back().result;
+            const bool has_result = current->return_type != ir_type::VOID;
+
+            machine.depth--;
+            frame_list.pop_back();
+            if (frame_list.empty())
+                goto finished;
+
+            current = frame_list.back().function;
+            r = frame_list.back().registers;
+            pc = frame_list.back().return_pc;
+
+            if (has_result)
+                r[target] = returned;
+            VM_DISPATCH();
+        }
+        VM_CASE(UNREACHABLE) {
+            machine.trap = "'" + current->name + "' ended without returning a value.";
+            return false;
+        }
+
+#if !LICAN_VM_THREADED
+        default:
+            machine.trap = "Invalid bytecode in '" + current->name + "'.";
+            return false;
+    }
+#endif
+
+    #undef VM_CASE
+    #undef VM_DISPATCH
+    #undef VM_NEXT
+    #undef VM_INTEGER_HANDLER
+    #undef VM_INTEGER_HANDLERS
+    #undef VM_CHECKED_HANDLER
+    #undef VM_CHECKED_HANDLERS
+    #undef VM_DIVIDE
+    #undef VM_MODULO
+    #undef VM_POWER
+    #undef VM_FLOAT_HANDLER
+    #undef VM_COMPARISON_HANDLER
+    #undef VM_KEEP
+    #undef VM_JUMP
+    #undef VM_JUMP_HANDLER
+    #undef VM_EXTEND_HANDLER
+    #undef VM_IMMEDIATE
+    #undef VM_PROFILE
+
+finished:
+    result = returned;
+    return true;
+
+division_by_zero:
+    machine.trap = "Division by zero in '" + current->name + "'.";
+    return false;
+
+negative_power:
+    machine.trap = "Integer raised to a negative power in '" + current->name + "'.";
+    return false;
+
+stack_overflow:
+    machine.trap = "Stack overflow in '" + current->name + "'.";
+    return false;
+}
+
+bool core::backend::jit_call(vm_machine* machine, vm_value* registers, const vm_function* caller, const uint32_t at) {
+    const vm_instruction* pc = caller->code.data() + at;
+    vm_function* callee = machine->program.function_list.data() + pc->b;
+    vm_value* callee_registers = registers + caller->frame_template.size();
+
+    if (callee_registers + callee->frame_template.size() > machine->stack.data() + machine->stack.size() || machine->depth >= VM_MAX_DEPTH) {
+        machine->trap = "Stack overflow in '" + caller->name + "'.";
+        return false;
+    }
+
+    std::memcpy(callee_registers, callee->frame_template.data(), callee->frame_template.size() * sizeof(vm_value));
+
+    for (uint16_t i = 0; i < pc->c; i++)
+        callee_registers[i] = registers[argument_register(pc + 1, i)];
+
+    machine->depth++;
+
+    uint32_t entry = 0;
+    vm_value result;
+
+    if (tier_up(*machine, callee, callee->call_count, JIT_CALL_THRESHOLD)) {
+        entry = run_native(*machine, callee, callee_registers, 0);
+
+        if (entry == JIT_TRAPPED)
+            return false;
+
+        if (entry == JIT_RETURNED) {
+            machine->depth--;
+            result = callee_registers[0];
+        }
+    }
+
+    if (entry != JIT_RETURNED && !interpret<false>(*machine, callee, callee_registers, callee->code.data() + entry, result))
+        return false;
+
+    if (callee->return_type != ir_type::VOID)
+        registers[pc->a] = result;
+
+    return true;
+}
+
+uint64_t core::backend::jit_convert(const uint64_t value, const uint32_t types) {
+    vm_value from;
+    from.u = value;
+
+    return convert(from, static_cast<ir_type>(types >> 8), static_cast<ir_type>(types & 0xFF)).u;
+}
+
+uint64_t core::backend::jit_power(const uint64_t base, const uint64_t exponent) {
+    return integer_power(base, exponent);
+}
+
+bool core::backend::execute(vm_program& program, const uint32_t function, const std::vector<vm_value>& argument_list, vm_value& result, std::string& trap) {
+    vm_function* entry = &program.function_list[function];
+
+    if (!entry->is_runnable()) {
+        trap = "'" + entry->name + "' can not run: " + entry->failure + '.';
+        return false;
+    }
+
+    vm_machine machine(program);
+
+    // Profiles are of the interpreter alone.
+    machine.jit = LICAN_JIT_AVAILABLE && program.jit && program.pair_count_list.empty();
+
+    if (entry->frame_template.size() > machine.stack.size()) {
+        trap = "'" + entry->name + "' needs more registers than the VM has.";
+        return false;
+    }
+
+    vm_value* r = machine.stack.data();
+    std::copy(entry->frame_template.begin(), entry->frame_template.end(), r);
+    std::copy(argument_list.begin(), argument_list.end(), r);
+
+    machine.depth = 1;
+
+    const bool success = program.pair_count_list.empty()
+        ? interpret<false>(machine, entry, r, entry->code.data(), result)
+        : interpret<true>(machine, entry, r, entry->code.data(), result);
+
+    if (!success)
+        trap = machine.trap;
+
+    return success;
+}
+
+bool core::backend::parse_value(const std::string& text, const ir_type type, vm_value& result) {
+    try {
+        size_t used = 0;
+
+        if (type == ir_type::BOOL) {
+            if (text != "true" && text != "false")
+                return false;
+
+            result.u = text == "true";
+            return true;
+        }
+
+        if (is_floating(type)) {
+            result.f = std::stod(text, &used);
+
+            if (type == ir_type::F32)
+                result.f = round_f32(result.f);
+        }
+        else if (is_signed(type)) {
+            result.i = std::stoll(text, &used, 0);
+
+            if (normalize(result.u, type) != result.u)
+                return false;
+        }
+        else if (is_unsigned(type)) {
+            if (!text.empty() && text[0] == '-')
+                return false;
+
+            result.u = std::stoull(text, &used, 0);
+
+            if (normalize(result.u, type) != result.u)
+                return false;
+        }
+        else
+            return false;
+
+        return used == text.size();
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+}
+
+std::string core::backend::pretty_debug(const vm_value value, const ir_type type) {
+    if (type == ir_type::BOOL)
+        return value.u ? "true" : "false";
+
+    if (is_floating(type))
+        return std::to_string(value.f);
+
+    if (is_signed(type))
+        return std::to_string(value.i);
+
+    return std::to_string(value.u);
+}
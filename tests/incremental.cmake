@@ -0,0 +1,36 @@
+# Builds the same project twice from one prompt, with one file edited in between, then once more
+# unchanged. Only the queries that read the edited file, or read one that changed, may run again.
+set(input_path ${WORK_DIR}/incremental_input.txt)
+file(WRITE ${input_path} "run before/main.lican main -q\nrun after/main.lican main -q\nrun after/main.lican main -q\nexit\n")
+
+execute_process(COMMAND ${LICANC} INPUT_FILE ${input_path} OUTPUT_VARIABLE output WORKING_DIRECTORY ${CMAKE_CURRENT_LIST_DIR}/incremental)
+
+string(FIND "${output}" "'main' returned 19." first_run)
+string(FIND "${output}" "'main' returned 28." second_run)
+string(FIND "${output}" "Queries: 0 ran" third_run)
+
+if(first_run EQUAL -1 OR second_run EQUAL -1 OR third_run EQUAL -1)
+    message(FATAL_ERROR "Unexpected results:\n${output}")
+endif()
+
+# The report of the second build is everything between the first two results.
+string(SUBSTRING "${output}" ${first_run} -1 rest)
+string(FIND "${rest}" "Queries:" report_begin)
+string(FIND "${rest}" "'main' returned 28." report_end)
+math(EXPR report_length "${report_end} - ${report_begin}")
+string(SUBSTRING "${rest}" ${report_begin} ${report_length} report)
+
+foreach(expected "CONSTANT_VALUE shapes.lican..SIDE" "CONSTANT_VALUE main.lican..BASE" "MEMBER_TYPES shapes.lican..square")
+    string(FIND "${report}" "${expected}" at)
+    if(at EQUAL -1)
+        message(FATAL_ERROR "'${expected}' did not run again:\n${report}")
+    endif()
+endforeach()
+
+# main's typedec only names one from the edited file, which expands the same as before.
+foreach(unexpected "DECLARATION_TYPE main.lican..total" "other.lican")
+    string(FIND "${report}" "${unexpected}" at)
+    if(NOT at EQUAL -1)
+        message(FATAL_ERROR "'${unexpected}' ran again:\n${report}")
+    endif()
+endforeach()
@@ -0,0 +1,19 @@
+# Builds against an interface whose source hash matches but whose typedec names a type past the end
+# of its type table. It has to be ignored, and the module parsed from its source instead.
+set(output_path ${WORK_DIR}/interface_out)
+file(REMOVE_RECURSE ${output_path})
+file(MAKE_DIRECTORY ${output_path})
+file(COPY ${CMAKE_CURRENT_LIST_DIR}/interface/shapes.lii DESTINATION ${output_path})
+
+execute_process(COMMAND ${LICANC} build main.lican ${output_path} -l -a OUTPUT_VARIABLE output RESULT_VARIABLE result WORKING_DIRECTORY ${CMAKE_CURRENT_LIST_DIR}/interface)
+
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "licanc failed with ${result}:\n${output}")
+endif()
+
+foreach(expected "Ignoring malformed module interface" "FILE - 'shapes.lican':\nAST:")
+    string(FIND "${output}" "${expected}" at)
+    if(at EQUAL -1)
+        message(FATAL_ERROR "Expected '${expected}':\n${output}")
+    endif()
+endforeach()